@@ -0,0 +1,67 @@
+// Wind and growth animation shared by every shader that draws tree geometry.
+// Spliced in by ShaderLoader where a shader says #include "animation.glsl"
+
+// Hierarchical wind, evaluated per vertex from the time alone so the CPU uploads nothing per frame
+struct Wind {
+    vec3 direction;  // Horizontal direction the wind blows towards
+    float strength;  // Trunk bend per squared unit of height, 0 turns the wind off
+    float frequency; // Trunk sways per second, deeper branches sway faster
+    float flutter;   // Branch sway per unit of branch length, relative to strength
+};
+uniform Wind wind;
+uniform float time;
+
+// Two detuned waves so the sway doesn't look periodic
+float windWave(float frequency, float phase) {
+    float t = time * frequency + phase;
+    return sin(6.2831853 * t) + 0.3 * sin(14.451326 * t + 1.7);
+}
+
+// One branch level pivoting around its origin, reach away from it
+vec3 branchSway(float depth, float phase, float reach, float gust) {
+    vec3 across = vec3(-wind.direction.z, 0.0, wind.direction.x);
+    float amplitude = wind.strength * wind.flutter * reach * pow(0.7, depth - 1.0);
+    return amplitude * windWave(wind.frequency * (1.0 + 0.5 * depth), phase + gust) * (across + 0.5 * wind.direction);
+}
+
+// position and origin.xyz share a space, world is only used to roll gusts across the forest.
+// origin.w is depth + phase of the branch, negative for shapes that stay still; parent holds the
+// parent branch's phase and its distance to origin, so a branch follows its parent's sway
+vec3 windOffset(vec3 position, vec3 world, vec4 origin, vec2 parent) {
+    if (wind.strength <= 0.0 || origin.w < 0.0) {
+        return vec3(0.0);
+    }
+    float depth = floor(origin.w);
+    float phase = fract(origin.w);
+    float gust = -0.05 * dot(world.xz, wind.direction.xz);
+
+    // The trunk bends with the square of the height above the ground, which carries every branch along
+    float height = max(position.y + 0.5, 0.0);
+    vec3 offset = wind.strength * height * height * (1.0 + 0.5 * windWave(wind.frequency, gust)) * wind.direction;
+
+    if (depth >= 1.0) {
+        offset += branchSway(depth, phase, length(position - origin.xyz), gust);
+    }
+    if (depth >= 2.0) {
+        offset += branchSway(depth - 1.0, parent.x, parent.y, gust);
+    }
+    return offset;
+}
+
+// Growth animation: a segment grows out of its anchor between its birth and grown times as growthTime
+// runs from 0 to 1
+uniform bool growing;
+uniform float growthTime;
+
+// How much of the segment exists, 1 when not animating and for shapes with no birth time
+float growthFraction(float birth, float grown) {
+    if (!growing || grown <= birth) {
+        return 1.0;
+    }
+    return clamp((growthTime - birth) / (grown - birth), 0.0, 1.0);
+}
+
+// growthStart.xyz is the anchor in position's space, growthStart.w the birth time
+vec3 grow(vec3 position, vec4 growthStart, float growthEnd) {
+    return mix(growthStart.xyz, position, growthFraction(growthStart.w, growthEnd));
+}
@@ -0,0 +1,20 @@
+#version 410 core
+
+// One end of a branch segment, two per GL_PATCHES patch. Wind and growth are per segment, so
+// branchpatch.tesc applies them once it knows the segment from gl_PrimitiveID
+layout(location = 0) in vec4 segmentPoint;   // xyz: tree-space position, w: radius at this end
+layout(location = 1) in vec3 segmentTangent; // Tube frame at this end, shared with the neighbouring segment
+layout(location = 2) in vec3 segmentNormal;
+layout(location = 3) in vec4 instanceOffset; // Per-tree world offset, one instance per forest tree
+
+out vec4 patchPoint;
+out vec3 patchTangent;
+out vec3 patchNormal;
+out vec3 patchOffset;
+
+void main() {
+    patchPoint = segmentPoint;
+    patchTangent = segmentTangent;
+    patchNormal = segmentNormal;
+    patchOffset = instanceOffset.xyz;
+}
@@ -0,0 +1,83 @@
+#version 330 core
+
+in vec3 quadPosition;
+flat in vec3 segmentStart;
+flat in vec3 segmentEnd;
+flat in float segmentRadius;
+
+out vec4 fragColor;
+
+struct Material {
+    vec4 ambient;
+    vec4 diffuse;
+    vec4 specular;
+    float shininess;
+};
+
+uniform mat4 viewMatrix;
+uniform mat4 projMatrix;
+uniform mat4 lightSpaceMatrix;
+uniform vec3 cameraPosition;
+
+uniform Material material;
+uniform bool textureUsed;
+uniform sampler2D Texture;
+uniform float blend;
+
+uniform float ka;
+uniform float kd;
+uniform float ks;
+uniform vec4 lightColor;
+uniform vec3 lightDirection;
+uniform bool toonShadingEnable;
+uniform int toonColorLevel;
+uniform bool shadowMapEnable;
+uniform sampler2D shadowMap;
+
+#include "capsule.glsl"
+
+// Same test as calculateShadow in phong.frag
+float calculateShadow(vec4 fragPosLightSpace) {
+    vec3 projCoords = fragPosLightSpace.xyz / fragPosLightSpace.w * 0.5 + 0.5;
+    float closestDepth = texture(shadowMap, projCoords.xy).r;
+    float shadow = projCoords.z - 0.002 > closestDepth ? 0.8 : 0.0;
+    return projCoords.z > 1.0 ? 0.0 : shadow;
+}
+
+void main() {
+    vec3 rayDirection = normalize(quadPosition - cameraPosition);
+    float t = intersectCapsule(cameraPosition, rayDirection, segmentStart, segmentEnd, segmentRadius);
+    if (t < 0.0) {
+        discard;
+    }
+
+    vec3 worldSpacePosition = cameraPosition + t * rayDirection;
+    vec4 clipPosition = projMatrix * viewMatrix * vec4(worldSpacePosition, 1.0);
+    gl_FragDepth = clipPosition.z / clipPosition.w * 0.5 + 0.5;
+
+    vec3 normal;
+    vec2 uv;
+    capsuleSurface(worldSpacePosition, segmentStart, segmentEnd, normal, uv);
+
+    vec4 diffuse = material.diffuse;
+    if (textureUsed) {
+        diffuse = (1.0 - blend) * diffuse + blend * texture(Texture, uv);
+    }
+
+    // First light only, with the same toon banding as phong.frag
+    vec3 lightDir = normalize(-lightDirection);
+    float diffuseFactor = max(dot(normal, lightDir), 0.0);
+    if (toonShadingEnable && diffuseFactor > 0.0) {
+        diffuseFactor = ceil(diffuseFactor * (11 - toonColorLevel)) / float(11 - toonColorLevel);
+    }
+
+    vec4 specularColor = vec4(0.0);
+    if (!toonShadingEnable) {
+        float specularFactor = max(dot(reflect(-lightDir, normal), -rayDirection), 0.0);
+        specularColor = ks * material.specular * pow(specularFactor, material.shininess);
+    }
+
+    float shadow = shadowMapEnable ? calculateShadow(lightSpaceMatrix * vec4(worldSpacePosition, 1.0)) : 0.0;
+    fragColor = ka * material.ambient + lightColor * (kd * diffuse * diffuseFactor + specularColor) * (1.0 - shadow);
+    fragColor.a = 1.0;
+}
@@ -0,0 +1,51 @@
+// Ray-cast capsule twigs, shared by capsule.frag, capsuledepth.frag and capsulebake.frag
+
+// Distance along the ray to the capsule around start-end, negative on a miss
+float intersectCapsule(vec3 origin, vec3 direction, vec3 start, vec3 end, float radius) {
+    vec3 axis = end - start;
+    vec3 fromStart = origin - start;
+    float axisAxis = dot(axis, axis);
+    float axisDirection = dot(axis, direction);
+    float axisOrigin = dot(axis, fromStart);
+    float directionOrigin = dot(direction, fromStart);
+    float originOrigin = dot(fromStart, fromStart);
+
+    // Infinite cylinder first, then the end sphere on whichever side the hit fell outside
+    float a = axisAxis - axisDirection * axisDirection;
+    float b = axisAxis * directionOrigin - axisOrigin * axisDirection;
+    float c = axisAxis * originOrigin - axisOrigin * axisOrigin - radius * radius * axisAxis;
+    float h = b * b - a * c;
+    if (h >= 0.0) {
+        float t = (-b - sqrt(h)) / a;
+        float y = axisOrigin + t * axisDirection;
+        if (y > 0.0 && y < axisAxis) {
+            return t;
+        }
+        vec3 fromCap = y <= 0.0 ? fromStart : origin - end;
+        b = dot(direction, fromCap);
+        c = dot(fromCap, fromCap) - radius * radius;
+        h = b * b - c;
+        if (h > 0.0) {
+            return -b - sqrt(h);
+        }
+    }
+    return -1.0;
+}
+
+// Origin of a ray along direction through quadPosition, far enough back that the whole capsule lies ahead of it.
+// The shadow pass and the impostor bake cast such parallel rays
+vec3 parallelRayOrigin(vec3 quadPosition, vec3 direction, vec3 start, vec3 end, float radius) {
+    float reach = length(end - start) + 2.0 * radius;
+    return quadPosition - direction * reach;
+}
+
+// Normal at a surface point from the closest point on the axis, and texture coordinates that wrap around
+// and along the axis like Cylinder
+void capsuleSurface(vec3 position, vec3 start, vec3 end, out vec3 normal, out vec2 uv) {
+    vec3 axis = end - start;
+    float along = clamp(dot(position - start, axis) / dot(axis, axis), 0.0, 1.0);
+    normal = normalize(position - (start + along * axis));
+    vec3 reference = normalize(cross(abs(axis.y) < 0.9 * length(axis) ? vec3(0.0, 1.0, 0.0) : vec3(1.0, 0.0, 0.0), axis));
+    float around = atan(dot(normal, cross(normalize(axis), reference)), dot(normal, reference)) / 6.2831853 + 0.5;
+    uv = vec2(around, along);
+}
@@ -0,0 +1,65 @@
+#version 330 core
+
+layout(location = 0) in vec2 corner;          // Quad corner in [-1, 1]^2
+layout(location = 3) in vec4 instanceOffset;  // Tree offset, advances once every capsuleCount instances
+
+// Four texels per capsule of the template tree: start and radius, end, the wind origin of its branch,
+// then its wind parent with the birth and grown times
+uniform samplerBuffer capsuleData;
+uniform int firstCapsule;  // First capsule of the drawn range
+uniform int capsuleCount;  // Capsules in the range, drawn once per tree
+
+out vec3 quadPosition;          // World-space point on the bounding quad
+flat out vec3 segmentStart;
+flat out vec3 segmentEnd;
+flat out float segmentRadius;
+
+uniform mat4 viewMatrix;
+uniform mat4 projMatrix;
+uniform vec3 cameraPosition;
+uniform bool orthographic;      // Parallel rays along rayDirection, for the shadow pass
+uniform vec3 rayDirection;
+
+#include "animation.glsl"
+
+void main() {
+    int capsule = firstCapsule + gl_InstanceID % capsuleCount;
+    vec4 capsuleStart = texelFetch(capsuleData, 4 * capsule);
+    vec4 capsuleEnd = texelFetch(capsuleData, 4 * capsule + 1);
+    vec4 windOrigin = texelFetch(capsuleData, 4 * capsule + 2);
+    vec4 windParent = texelFetch(capsuleData, 4 * capsule + 3);
+
+    // A growing capsule lengthens and thickens from its start, so it is no sphere before its birth
+    float grown = growthFraction(windParent.z, windParent.w);
+    vec3 end = mix(capsuleStart.xyz, capsuleEnd.xyz, grown);
+
+    // Both ends sway like the meshed branches; the quad and the ray-cast follow the moved segment
+    vec3 worldStart = capsuleStart.xyz + instanceOffset.xyz;
+    vec3 worldEnd = end + instanceOffset.xyz;
+    segmentStart = worldStart + windOffset(capsuleStart.xyz, worldStart, windOrigin, windParent.xy);
+    segmentEnd = worldEnd + windOffset(end, worldEnd, windOrigin, windParent.xy);
+    segmentRadius = capsuleStart.w * grown;
+
+    vec3 center = 0.5 * (segmentStart + segmentEnd);
+    vec3 toViewer = orthographic ? -rayDirection : normalize(cameraPosition - center);
+
+    // Quad facing the viewer, stretched along the segment's projection onto it
+    vec3 halfAxis = 0.5 * (segmentEnd - segmentStart);
+    vec3 along = halfAxis - dot(halfAxis, toViewer) * toViewer;
+    float alongLength = length(along);
+    along = alongLength > 1e-6 ? along / alongLength
+                               : normalize(cross(abs(toViewer.y) < 0.9 ? vec3(0.0, 1.0, 0.0) : vec3(1.0, 0.0, 0.0), toViewer));
+    vec3 across = cross(toViewer, along);
+
+    // Parts of the capsule nearer than the quad project outside it under perspective, grow the quad to match
+    float scale = 1.0;
+    if (!orthographic) {
+        float distance = length(cameraPosition - center);
+        float nearest = abs(dot(halfAxis, toViewer)) + segmentRadius;
+        scale = distance / max(distance - nearest, 1e-3);
+    }
+
+    vec3 offset = (corner.x * (alongLength + segmentRadius) * along + corner.y * segmentRadius * across) * scale;
+    quadPosition = center + offset;
+    gl_Position = projMatrix * viewMatrix * vec4(quadPosition, 1.0);
+}
@@ -0,0 +1,47 @@
+#version 330 core
+
+// Bakes capsule twigs into the impostor atlas like impostorbake.frag: parallel rays along the view direction,
+// unlit color and the normal at the hit
+in vec3 quadPosition;
+flat in vec3 segmentStart;
+flat in vec3 segmentEnd;
+flat in float segmentRadius;
+
+layout(location = 0) out vec4 albedo;       // Diffuse color, alpha marks coverage
+layout(location = 1) out vec4 normalDepth;  // World-space normal packed to [0, 1], depth within the frame
+
+uniform mat4 viewMatrix;
+uniform mat4 projMatrix;
+uniform vec3 rayDirection;
+
+uniform vec4 diffuse;
+uniform bool textureUsed;
+uniform sampler2D Texture;
+uniform float blend;
+
+#include "capsule.glsl"
+
+void main() {
+    vec3 origin = parallelRayOrigin(quadPosition, rayDirection, segmentStart, segmentEnd, segmentRadius);
+    float t = intersectCapsule(origin, rayDirection, segmentStart, segmentEnd, segmentRadius);
+    if (t < 0.0) {
+        discard;
+    }
+
+    vec3 position = origin + t * rayDirection;
+    vec4 clipPosition = projMatrix * viewMatrix * vec4(position, 1.0);
+    float depth = clipPosition.z / clipPosition.w * 0.5 + 0.5;
+    gl_FragDepth = depth;
+
+    vec3 normal;
+    vec2 uv;
+    capsuleSurface(position, segmentStart, segmentEnd, normal, uv);
+
+    vec4 color = diffuse;
+    if (textureUsed) {
+        color = (1.0 - blend) * color + blend * texture(Texture, uv);
+    }
+
+    albedo = vec4(color.rgb, 1.0);
+    normalDepth = vec4(normal * 0.5 + 0.5, depth);
+}
@@ -0,0 +1,24 @@
+#version 330 core
+
+// Shadow pass for capsule twigs: parallel rays along the light, only the depth of the hit is kept
+in vec3 quadPosition;
+flat in vec3 segmentStart;
+flat in vec3 segmentEnd;
+flat in float segmentRadius;
+
+uniform mat4 viewMatrix;
+uniform mat4 projMatrix;
+uniform vec3 rayDirection;
+
+#include "capsule.glsl"
+
+void main() {
+    vec3 origin = parallelRayOrigin(quadPosition, rayDirection, segmentStart, segmentEnd, segmentRadius);
+    float t = intersectCapsule(origin, rayDirection, segmentStart, segmentEnd, segmentRadius);
+    if (t < 0.0) {
+        discard;
+    }
+
+    vec4 clipPosition = projMatrix * viewMatrix * vec4(origin + t * rayDirection, 1.0);
+    gl_FragDepth = clipPosition.z / clipPosition.w * 0.5 + 0.5;
+}
@@ -0,0 +1,28 @@
+#version 330 core
+
+// One point per forest tree: xyz is the tree's world offset, w is passed through untouched
+layout(location = 0) in vec4 instanceOffset;
+
+out vec4 vertexInstance;
+flat out int vertexVisible;
+
+// Frustum planes (ax + by + cz + d >= 0 is inside), not normalized
+uniform vec4 frustumPlanes[6];
+
+// Bounding sphere of the template tree in its local space
+uniform vec3 boundsCenter;
+uniform float boundsRadius;
+
+void main() {
+    vec3 center = boundsCenter + instanceOffset.xyz;
+
+    vertexVisible = 1;
+    for (int i = 0; i < 6; i++) {
+        vec4 plane = frustumPlanes[i];
+        if (dot(plane.xyz, center) + plane.w < -boundsRadius * length(plane.xyz)) {
+            vertexVisible = 0;
+        }
+    }
+
+    vertexInstance = instanceOffset;
+}
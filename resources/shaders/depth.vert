@@ -1,10 +1,20 @@
 #version 330 core
 
 layout(location = 0) in vec3 position;
+layout(location = 3) in vec4 instanceOffset; // Per-tree world offset when the forest is instanced
+layout(location = 6) in vec4 windOrigin;     // Branch origin and depth + phase, see windOffset
+layout(location = 7) in vec2 windParent;     // Parent branch's phase and distance to windOrigin
+layout(location = 8) in vec4 growthStart;    // Growth anchor and birth time, see grow
+layout(location = 9) in float growthEnd;     // Time the segment is fully grown
 
 uniform mat4 modelMatrix;
 uniform mat4 lightSpaceMatrix;
 
+#include "animation.glsl"
+
 void main() {
-    gl_Position = lightSpaceMatrix * modelMatrix * vec4(position, 1.0);
+    vec3 treeSpacePosition = grow(vec3(modelMatrix * vec4(position, 1.0)), growthStart, growthEnd);
+    vec3 worldSpacePosition = treeSpacePosition + instanceOffset.xyz;
+    worldSpacePosition += windOffset(treeSpacePosition, worldSpacePosition, windOrigin, windParent);
+    gl_Position = lightSpaceMatrix * vec4(worldSpacePosition, 1.0);
 }
@@ -0,0 +1,76 @@
+#version 330 core
+
+flat in ivec2 frameIndex[4];
+flat in vec4 frameWeights;
+in vec2 frameUV[4];
+in vec3 quadPosition;
+flat in vec3 viewDirection;
+
+out vec4 fragColor;
+
+uniform sampler2D albedoAtlas;
+uniform sampler2D normalDepthAtlas;
+uniform int framesPerSide;
+uniform float treeRadius;
+
+uniform mat4 viewMatrix;
+uniform mat4 projMatrix;
+uniform mat4 lightSpaceMatrix;
+
+uniform float ka;
+uniform float kd;
+uniform vec4 lightColor;
+uniform vec3 lightDirection;
+uniform bool toonShadingEnable;
+uniform int toonColorLevel;
+uniform bool shadowMapEnable;
+uniform sampler2D shadowMap;
+
+// Same test as calculateShadow in phong.frag
+float calculateShadow(vec4 fragPosLightSpace) {
+    vec3 projCoords = fragPosLightSpace.xyz / fragPosLightSpace.w * 0.5 + 0.5;
+    float closestDepth = texture(shadowMap, projCoords.xy).r;
+    float shadow = projCoords.z - 0.002 > closestDepth ? 0.8 : 0.0;
+    return projCoords.z > 1.0 ? 0.0 : shadow;
+}
+
+void main() {
+    // Blend the nearest baked views
+    vec4 albedo = vec4(0.0);
+    vec3 normal = vec3(0.0);
+    float depth = 0.0;
+    float depthWeight = 0.0;
+    for (int i = 0; i < 4; i++) {
+        vec2 atlasUV = (vec2(frameIndex[i]) + clamp(frameUV[i], 0.0, 1.0)) / float(framesPerSide);
+        vec4 frameAlbedo = texture(albedoAtlas, atlasUV);
+        vec4 frameNormalDepth = texture(normalDepthAtlas, atlasUV);
+
+        float weight = frameWeights[i] * frameAlbedo.a;
+        albedo += frameWeights[i] * frameAlbedo;
+        normal += weight * (frameNormalDepth.xyz * 2.0 - 1.0);
+        depth += weight * frameNormalDepth.w;
+        depthWeight += weight;
+    }
+
+    if (albedo.a < 0.5) {
+        discard;
+    }
+    albedo.rgb /= albedo.a;
+    normal = normalize(normal);
+    depth /= depthWeight;
+
+    // Push the fragment from the quad to the baked surface so impostors intersect the ground and each other
+    vec3 worldSpacePosition = quadPosition + viewDirection * (0.5 - depth) * 2.0 * treeRadius;
+    vec4 clipPosition = projMatrix * viewMatrix * vec4(worldSpacePosition, 1.0);
+    gl_FragDepth = clipPosition.z / clipPosition.w * 0.5 + 0.5;
+
+    // Directional diffuse with the same toon banding as phong.frag
+    float diffuseFactor = max(dot(normal, normalize(-lightDirection)), 0.0);
+    if (toonShadingEnable && diffuseFactor > 0.0) {
+        diffuseFactor = ceil(diffuseFactor * (11 - toonColorLevel)) / float(11 - toonColorLevel);
+    }
+
+    float shadow = shadowMapEnable ? calculateShadow(lightSpaceMatrix * vec4(worldSpacePosition, 1.0)) : 0.0;
+    fragColor = ka * albedo + kd * albedo * diffuseFactor * lightColor * (1.0 - shadow);
+    fragColor.a = 1.0;
+}
@@ -0,0 +1,71 @@
+#version 330 core
+
+layout(location = 0) in vec2 corner;         // Quad corner in [-1, 1]^2
+layout(location = 3) in vec4 instanceOffset; // World offset of the tree
+
+// Where the atlas frames nearest to this view are, and this vertex's position inside each of them
+flat out ivec2 frameIndex[4];
+flat out vec4 frameWeights;
+out vec2 frameUV[4];
+
+out vec3 quadPosition;          // World-space point on the quad
+flat out vec3 viewDirection;    // Tree center towards the camera
+
+uniform mat4 viewMatrix;
+uniform mat4 projMatrix;
+uniform vec3 cameraPosition;
+
+// Bounding sphere of the baked tree in its local space
+uniform vec3 treeCenter;
+uniform float treeRadius;
+uniform int framesPerSide;
+
+// Must match hemiOctDecode and frameBasis in realtimeimpostor.cpp
+vec3 hemiOctDecode(vec2 e) {
+    vec2 t = 0.5 * vec2(e.x + e.y, e.x - e.y);
+    return normalize(vec3(t.x, 1.0 - abs(t.x) - abs(t.y), t.y));
+}
+
+vec2 hemiOctEncode(vec3 d) {
+    d /= abs(d.x) + abs(d.y) + abs(d.z);
+    return vec2(d.x + d.z, d.x - d.z);
+}
+
+void frameBasis(vec3 d, out vec3 right, out vec3 up) {
+    right = abs(d.y) > 0.999 ? vec3(1.0, 0.0, 0.0) : normalize(cross(vec3(0.0, 1.0, 0.0), d));
+    up = cross(d, right);
+}
+
+void main() {
+    vec3 center = treeCenter + instanceOffset.xyz;
+    viewDirection = normalize(cameraPosition - center);
+
+    // Billboard facing the camera, large enough to hold the bounding sphere from any side
+    vec3 right, up;
+    frameBasis(viewDirection, right, up);
+    vec3 offset = (corner.x * right + corner.y * up) * treeRadius;
+    quadPosition = center + offset;
+    gl_Position = projMatrix * viewMatrix * vec4(quadPosition, 1.0);
+
+    // Views below the horizon were never baked, use the horizon instead
+    vec3 bakedDirection = normalize(vec3(viewDirection.x, max(viewDirection.y, 0.0), viewDirection.z));
+    vec2 grid = (hemiOctEncode(bakedDirection) * 0.5 + 0.5) * float(framesPerSide) - 0.5;
+    grid = clamp(grid, vec2(0.0), vec2(float(framesPerSide - 1)));
+    ivec2 base = ivec2(floor(grid));
+    ivec2 next = min(base + 1, ivec2(framesPerSide - 1));
+    vec2 f = grid - vec2(base);
+
+    frameIndex[0] = base;
+    frameIndex[1] = ivec2(next.x, base.y);
+    frameIndex[2] = ivec2(base.x, next.y);
+    frameIndex[3] = next;
+    frameWeights = vec4((1.0 - f.x) * (1.0 - f.y), f.x * (1.0 - f.y), (1.0 - f.x) * f.y, f.x * f.y);
+
+    // Project the quad point onto each frame's image plane; the projection is affine so it interpolates exactly
+    for (int i = 0; i < 4; i++) {
+        vec2 e = (vec2(frameIndex[i]) + 0.5) / float(framesPerSide) * 2.0 - 1.0;
+        vec3 frameRight, frameUp;
+        frameBasis(hemiOctDecode(e), frameRight, frameUp);
+        frameUV[i] = 0.5 + vec2(dot(offset, frameRight), dot(offset, frameUp)) / (2.0 * treeRadius);
+    }
+}
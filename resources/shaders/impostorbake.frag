@@ -0,0 +1,38 @@
+#version 330 core
+
+// Bakes one view of the tree into the impostor atlas, driven by phong.vert
+in vec3 worldSpacePosition;
+in vec3 worldSpaceNormal;
+in vec2 TexCoords;
+in vec4 fragPosLightSpace;
+
+layout(location = 0) out vec4 albedo;       // Diffuse color, alpha marks coverage
+layout(location = 1) out vec4 normalDepth;  // World-space normal packed to [0, 1], depth within the frame
+
+uniform vec4 diffuse;
+uniform bool textureUsed;
+uniform sampler2D Texture;
+uniform float blend;
+uniform float repeatU;
+uniform float repeatV;
+uniform bool leafCard; // Alpha-tested, two-sided leaf card drawn by leaf.vert
+
+void main() {
+    // Same diffuse blend as phong.frag, lighting happens when the impostor is drawn
+    vec4 color = diffuse;
+    if (textureUsed) {
+        vec4 textureColor = texture(Texture, vec2(TexCoords.x * repeatU, TexCoords.y * repeatV));
+        if (leafCard && textureColor.a < 0.5) {
+            discard;
+        }
+        color = (1.0 - blend) * color + blend * textureColor;
+    }
+
+    vec3 normal = normalize(worldSpaceNormal);
+    if (leafCard && !gl_FrontFacing) {
+        normal = -normal;
+    }
+
+    albedo = vec4(color.rgb, 1.0);
+    normalDepth = vec4(normal * 0.5 + 0.5, gl_FragCoord.z);
+}
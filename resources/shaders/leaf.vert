@@ -0,0 +1,55 @@
+#version 330 core
+
+// Crossed-quad leaf card, placed per instance from the leaf buffer; outputs match phong.vert
+layout(location = 0) in vec3 cardPosition;   // x across the leaf, y along it, z across for the crossed quad
+layout(location = 1) in vec3 cardNormal;
+layout(location = 2) in vec2 uv;
+layout(location = 3) in vec4 instanceOffset; // Tree offset, advances once every leafCount instances
+
+out vec3 worldSpacePosition;
+out vec3 worldSpaceNormal;
+out vec2 TexCoords;
+out vec4 fragPosLightSpace;
+out vec3 tint;
+
+// Five texels per leaf: base and length, growth direction and spin, turtle right and tint,
+// then the wind origin of the branch holding the leaf, and its wind parent with the leaf's birth and grown times
+uniform samplerBuffer leafData;
+uniform int leafCount;
+
+uniform mat4 viewMatrix;
+uniform mat4 projMatrix;
+uniform mat4 lightSpaceMatrix;
+
+#include "animation.glsl"
+
+void main() {
+    int leaf = gl_InstanceID % leafCount;
+    vec4 base = texelFetch(leafData, 5 * leaf);
+    vec4 grow = texelFetch(leafData, 5 * leaf + 1);
+    vec4 side = texelFetch(leafData, 5 * leaf + 2);
+    vec4 windOrigin = texelFetch(leafData, 5 * leaf + 3);
+    vec4 windParent = texelFetch(leafData, 5 * leaf + 4);
+
+    // Turtle frame spun about the growth direction by the leaf's random angle
+    vec3 up = grow.xyz;
+    vec3 front = cross(side.xyz, up);
+    vec3 right = cos(grow.w) * side.xyz + sin(grow.w) * front;
+    front = cross(right, up);
+
+    float height = base.w * growthFraction(windParent.z, windParent.w);
+    float width = 0.6 * height;
+    vec3 local = cardPosition.x * width * right + cardPosition.y * height * up + cardPosition.z * width * front;
+
+    // The card moves rigidly with the point of the branch it hangs from
+    vec3 stem = base.xyz + instanceOffset.xyz;
+    stem += windOffset(base.xyz, stem, windOrigin, windParent.xy);
+
+    worldSpacePosition = stem + local;
+    worldSpaceNormal = normalize(cardNormal.x * right + cardNormal.y * up + cardNormal.z * front);
+    TexCoords = uv;
+    tint = mix(vec3(0.85, 1.0, 0.7), vec3(1.1, 1.05, 1.0), side.w);
+
+    fragPosLightSpace = lightSpaceMatrix * vec4(worldSpacePosition, 1.0);
+    gl_Position = projMatrix * viewMatrix * vec4(worldSpacePosition, 1.0);
+}
@@ -0,0 +1,12 @@
+#version 330 core
+
+// Shadow pass for leaf cards: only the texels the leaf covers cast a shadow
+in vec2 TexCoords;
+
+uniform sampler2D Texture;
+
+void main() {
+    if (texture(Texture, TexCoords).a < 0.5) {
+        discard;
+    }
+}
@@ -0,0 +1,5 @@
+#version 330 core
+
+void main() {
+    // Nothing to write, color and depth writes are masked off; only the sample count of the query matters
+}
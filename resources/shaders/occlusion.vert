@@ -0,0 +1,16 @@
+#version 330 core
+
+// Unit cube from the cube primitive, corners at -0.5 and 0.5
+layout(location = 0) in vec3 objectSpacePosition;
+
+// World-space bounding box being tested
+uniform vec3 boxMin;
+uniform vec3 boxMax;
+
+uniform mat4 viewMatrix;
+uniform mat4 projMatrix;
+
+void main() {
+    vec3 worldSpacePosition = mix(boxMin, boxMax, objectSpacePosition + 0.5);
+    gl_Position = projMatrix * viewMatrix * vec4(worldSpacePosition, 1.0);
+}
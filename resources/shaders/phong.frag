@@ -22,6 +22,7 @@ in vec3 worldSpacePosition;
 in vec3 worldSpaceNormal;
 in vec2 TexCoords; // Interpolated UV coordinates from vertex shader
 in vec4 fragPosLightSpace; // Light space position from vertex shader
+in vec3 tint; // Color variation multiplied into the material
 
 // Task 10: declare an out vec4 for your output color
 out vec4 fragColor;
@@ -55,6 +56,18 @@ int rimLightPower = 4;
 uniform Light lights[8];   // Array of lights, up to eight lights
 uniform int numLights;     // Actual number of active lights
 
+uniform float lodFade;     // Share of pixels handed to the coarser LOD level while fading, 0 when not fading
+uniform bool lodFadeIn;    // Whether this draw is the coarser level fading in
+uniform bool leafCard;     // Alpha-tested, two-sided leaf card
+
+// 4x4 ordered dither thresholds in (0, 1)
+const float bayer4x4[16] = float[16](0.0, 8.0, 2.0, 10.0, 12.0, 4.0, 14.0, 6.0, 3.0, 11.0, 1.0, 9.0, 15.0, 7.0, 13.0, 5.0);
+
+float ditherThreshold(vec2 fragCoord) {
+    ivec2 cell = ivec2(mod(fragCoord, 4.0));
+    return (bayer4x4[cell.y * 4 + cell.x] + 0.5) / 16.0;
+}
+
 // Function to calculate shadow
 float calculateShadow(vec4 fragPosLightSpace) {
     // Perform perspective divide
@@ -81,12 +94,25 @@ float calculateShadow(vec4 fragPosLightSpace) {
 }
 
 void main() {
+    // Two LOD levels cover complementary pixels while fading
+    if (lodFade > 0.0 && (ditherThreshold(gl_FragCoord.xy) < lodFade) != lodFadeIn) {
+        discard;
+    }
+
+    // Leaf cards cut their outline out of the texture
+    if (leafCard && texture(Texture, vec2(TexCoords.x * repeatU, TexCoords.y * repeatV)).a < 0.5) {
+        discard;
+    }
+
     // Ambient color
-    vec4 ambientColor = ka * material.ambient;
+    vec4 ambientColor = ka * material.ambient * vec4(tint, 1.0);
     fragColor = ambientColor;
 
-    // Normalize world-space normal
+    // Normalize world-space normal, cards are lit from whichever side faces the viewer
     vec3 normal = normalize(worldSpaceNormal);
+    if (leafCard && !gl_FrontFacing) {
+        normal = -normal;
+    }
 
     // Compute the view direction (from fragment to camera)
     vec3 viewDir = normalize(vec3(cameraPosition) - worldSpacePosition);
@@ -154,6 +180,7 @@ void main() {
              vec4 textureColor = texture(Texture, repeatedTexCoords);
              blendedDiffuse = (1.0f - blend) * blendedDiffuse + blend * textureColor;
          }
+         blendedDiffuse.rgb *= tint;
 
          vec4 diffuseColor = blendedDiffuse * diffuseFactor;
 
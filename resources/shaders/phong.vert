@@ -5,6 +5,11 @@
 layout(location = 0) in vec3 objectSpacePosition;
 layout(location = 1) in vec3 objectSpaceNormal;
 layout(location = 2) in vec2 uv;        // UV coordinates
+layout(location = 3) in vec4 instanceOffset; // Per-tree world offset when the forest is instanced, (0, 0, 0, 1) otherwise
+layout(location = 6) in vec4 windOrigin;     // Branch origin and depth + phase, see windOffset
+layout(location = 7) in vec2 windParent;     // Parent branch's phase and distance to windOrigin
+layout(location = 8) in vec4 growthStart;    // Growth anchor and birth time, see grow
+layout(location = 9) in float growthEnd;     // Time the segment is fully grown
 
 // Task 5: declare `out` variables for the world-space position and normal,
 //         to be passed to the fragment shader
@@ -12,6 +17,7 @@ out vec3 worldSpacePosition;
 out vec3 worldSpaceNormal;
 out vec2 TexCoords; // Pass UV coordinates to fragment shader
 out vec4 fragPosLightSpace; // Add an output for the light space position
+out vec3 tint;              // Per-instance color variation, only leaf cards vary it
 
 // Task 6: declare a uniform mat4 to store model matrix
 uniform mat4 modelMatrix;
@@ -24,11 +30,16 @@ uniform mat4 projMatrix;
 // Add a uniform for the light space transformation matrix
 uniform mat4 lightSpaceMatrix;
 
+#include "animation.glsl"
+
 void main() {
     TexCoords = uv; // Pass UV to fragment shader
+    tint = vec3(1.0);
     // Task 8: compute the world-space position and normal, then pass them to
     //         the fragment shader using the variables created in task 5
-    worldSpacePosition = vec3(modelMatrix * vec4(objectSpacePosition, 1.f)) ;
+    vec3 treeSpacePosition = grow(vec3(modelMatrix * vec4(objectSpacePosition, 1.f)), growthStart, growthEnd);
+    worldSpacePosition = treeSpacePosition + instanceOffset.xyz;
+    worldSpacePosition += windOffset(treeSpacePosition, worldSpacePosition, windOrigin, windParent);
 
     worldSpaceNormal = normalMatrix * objectSpaceNormal;
 
@@ -36,8 +47,8 @@ void main() {
     // In projects 5 and 6, consider the performance implications of performing this here.
 
     // Task 9: set gl_Position to the object space position transformed to clip space
-    gl_Position = projMatrix * viewMatrix * modelMatrix * vec4(objectSpacePosition, 1.0);
+    gl_Position = projMatrix * viewMatrix * vec4(worldSpacePosition, 1.0);
 
     // Transform to light space
-    fragPosLightSpace = lightSpaceMatrix * modelMatrix * vec4(objectSpacePosition, 1.0);
+    fragPosLightSpace = lightSpaceMatrix * vec4(worldSpacePosition, 1.0);
 }
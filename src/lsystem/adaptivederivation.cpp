@@ -0,0 +1,252 @@
+#include "adaptivederivation.h"
+#include "ruleprogram.h"
+#include "turtlecommand.h"
+#include <algorithm>
+#include <limits>
+
+namespace {
+
+// An expanded subtree collapses back into a proxy only once it covers less than this fraction of the
+// expansion threshold
+constexpr float kCollapseFraction = 0.75f;
+
+// Subtrees kept at most, collapsed ones included; past it the cut stops getting finer. Refining goes
+// breadth first, so the budget goes to the largest subtrees
+constexpr size_t kMaxNodes = size_t(1) << 16;
+
+bool balancedBrackets(const std::string& symbols) {
+    int depth = 0;
+    for (char c : symbols) {
+        depth += c == '[' ? 1 : c == ']' ? -1 : 0;
+        if (depth < 0) {
+            return false;
+        }
+    }
+    return depth == 0;
+}
+
+// Grow the sphere (center, radius) to also hold the sphere (otherCenter, otherRadius)
+void enclose(glm::vec3& center, float& radius, const glm::vec3& otherCenter, float otherRadius) {
+    float distance = glm::length(otherCenter - center);
+    if (distance + otherRadius <= radius) {
+        return;
+    }
+    if (distance + radius <= otherRadius) {
+        center = otherCenter;
+        radius = otherRadius;
+        return;
+    }
+    float grown = 0.5f * (distance + radius + otherRadius);
+    center += (otherCenter - center) * ((grown - radius) / distance);
+    radius = grown;
+}
+
+}
+
+void SubtreeProxy::write(float* out) const {
+    const float values[kParameters] = {center.x, center.y, center.z, radius, leaves,
+                                       position.x, position.y, position.z, grow.x, grow.y, grow.z,
+                                       forward.x, forward.y, forward.z, right.x, right.y, right.z};
+    std::copy(values, values + kParameters, out);
+}
+
+SubtreeProxy SubtreeProxy::read(const float* in) {
+    return {glm::vec3(in[0], in[1], in[2]), in[3], in[4], glm::vec3(in[5], in[6], in[7]), glm::vec3(in[8], in[9], in[10]),
+            glm::vec3(in[11], in[12], in[13]), glm::vec3(in[14], in[15], in[16])};
+}
+
+bool AdaptiveDerivation::compile(const std::string& axiom, const ProductionRules& rules, int iterations, float angle, float length,
+                                 const glm::vec3& root) {
+    *this = AdaptiveDerivation();
+    if (isStochastic(rules) || isContextSensitive(rules) || !balancedBrackets(axiom)) {
+        return false;
+    }
+    for (const auto& [symbol, productions] : rules) {
+        if (!productions.empty()) {
+            if (!balancedBrackets(productions[0].successor)) {
+                *this = AdaptiveDerivation();
+                return false;
+            }
+            m_rules[symbol] = productions[0].successor;
+        }
+    }
+    m_axiom = axiom;
+    m_iterations = std::clamp(iterations, 0, RuleProgram::kMaxIterations);
+    m_angle = angle;
+    m_length = length;
+
+    // The axiom is the successor of a pseudo-node rewritten once more than the iterations, always expanded.
+    // The frame is the one the turtle starts with
+    Node start = {0, 0, m_iterations + 1, true};
+    start.entry = {root, glm::vec3(0.0f, 1.0f, 0.0f), glm::vec3(0.0f, 0.0f, -1.0f), glm::vec3(1.0f, 0.0f, 0.0f)};
+    m_nodes.push_back(start);
+    expand(0);
+    return true;
+}
+
+// Walk successor from frame like the turtle would. Modules still rewritten remaining more times are not walked
+// into: their summaries move the frame and grow the sphere (center, radius) in one step, and each is passed to
+// child(symbol, entry, exit, center, radius, leaves)
+template <typename Child>
+void AdaptiveDerivation::walk(const std::string& successor, int remaining, Frame& frame, glm::vec3& center, float& radius,
+                              bool& leaves, Child&& child) {
+    std::vector<Frame> stack;
+    for (char symbol : successor) {
+        if (rewritable(symbol, remaining)) {
+            // Summaries are relative to a canonical frame of the same handedness; the rotation taking that frame
+            // to this one carries them over
+            bool handedness = glm::dot(frame.right, glm::cross(frame.grow, frame.forward)) > 0.0f;
+            const Summary& part = summary(symbol, remaining, handedness);
+            glm::mat3 canonical(glm::vec3(handedness ? -1.0f : 1.0f, 0.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f),
+                                glm::vec3(0.0f, 0.0f, -1.0f));
+            glm::mat3 rotation = glm::mat3(frame.right, frame.grow, frame.forward) * glm::transpose(canonical);
+            Frame exit = {frame.position + rotation * part.exit.position, rotation * part.exit.grow,
+                          rotation * part.exit.forward, rotation * part.exit.right};
+            glm::vec3 partCenter = frame.position + rotation * part.center;
+            child(symbol, frame, exit, partCenter, part.radius, part.leaves);
+            enclose(center, radius, partCenter, part.radius);
+            leaves = leaves || part.leaves;
+            frame = exit;
+            continue;
+        }
+
+        TurtleCommand command = kTurtleCommands[static_cast<uint8_t>(symbol)];
+        switch (command) {
+        case TurtleCommand::Trunk:
+        case TurtleCommand::Branch:
+        case TurtleCommand::Leaf:
+            frame.position += frame.grow * (m_length * turtleStep(command));
+            enclose(center, radius, frame.position, 0.0f);
+            leaves = leaves || command == TurtleCommand::Leaf;
+            break;
+        case TurtleCommand::Push:
+            stack.push_back(frame);
+            break;
+        case TurtleCommand::Pop:
+            if (!stack.empty()) {
+                frame = stack.back();
+                stack.pop_back();
+            }
+            break;
+        default:
+            turnTurtle(command, glm::radians(m_angle), frame.grow, frame.forward, frame.right);
+            break;
+        }
+    }
+}
+
+// Memoized, so every symbol's subtree is summarized once per rewrite count from its successor's summaries
+const AdaptiveDerivation::Summary& AdaptiveDerivation::summary(char symbol, int remaining, bool handedness) {
+    uint32_t key = static_cast<uint8_t>(symbol) | static_cast<uint32_t>(remaining) << 8 | (handedness ? 1u << 16 : 0u);
+    auto found = m_summaries.find(key);
+    if (found != m_summaries.end()) {
+        return found->second;
+    }
+
+    Summary result;
+    result.exit = {glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f), glm::vec3(0.0f, 0.0f, -1.0f),
+                   glm::vec3(handedness ? -1.0f : 1.0f, 0.0f, 0.0f)};
+    result.center = glm::vec3(0.0f);
+    result.radius = 0.0f;
+    result.leaves = false;
+    walk(m_rules.at(symbol), remaining - 1, result.exit, result.center, result.radius, result.leaves,
+         [](char, const Frame&, const Frame&, const glm::vec3&, float, bool) {});
+    return m_summaries.emplace(key, result).first->second;
+}
+
+// Create the children of a node, one per module of its successor that is rewritten further
+void AdaptiveDerivation::expand(uint32_t index) {
+    const Node parent = m_nodes[index];
+    int remaining = parent.remaining - 1;
+    uint8_t birth = childBirth(parent);
+
+    Frame frame = parent.entry;
+    glm::vec3 center = frame.position;
+    float radius = 0.0f;
+    bool leaves = false;
+    uint32_t first = static_cast<uint32_t>(m_nodes.size());
+    walk(successorOf(index), remaining, frame, center, radius, leaves,
+         [&](char symbol, const Frame& entry, const Frame& exit, const glm::vec3& partCenter, float partRadius, bool partLeaves) {
+        Node child = {symbol, birth, remaining};
+        child.entry = entry;
+        child.exit = exit;
+        child.center = partCenter;
+        child.radius = partRadius;
+        child.leaves = partLeaves;
+        m_nodes.push_back(child);
+    });
+    m_nodes[index].firstChild = first;
+    m_nodes[index].childCount = static_cast<uint32_t>(m_nodes.size()) - first;
+}
+
+bool AdaptiveDerivation::refine(const glm::mat4& view, const glm::mat4& proj, float viewportHeight, float thresholdPixels) {
+    // A sphere of radius r at depth d covers about r * proj[1][1] * height / d pixels across
+    float pixelsPerRadius = proj[1][1] * viewportHeight;
+    bool changed = false;
+    m_proxies = 0;
+
+    std::vector<uint32_t> queue = {0};
+    for (size_t next = 0; next < queue.size(); ++next) {
+        uint32_t index = queue[next];
+        if (index != 0) {
+            Node& node = m_nodes[index];
+
+            // Behind the camera nothing is resolved; around it everything is
+            float depth = -(view * glm::vec4(node.center, 1.0f)).z;
+            float pixels = depth < -node.radius ? 0.0f
+                           : depth <= node.radius ? std::numeric_limits<float>::infinity()
+                                                  : node.radius * pixelsPerRadius / depth;
+            bool resolved = pixels >= thresholdPixels * (node.expanded ? kCollapseFraction : 1.0f);
+            if (resolved && node.firstChild == 0 && m_nodes.size() >= kMaxNodes) {
+                resolved = false;
+            }
+            if (resolved != node.expanded) {
+                changed = true;
+                if (resolved && node.firstChild == 0) {
+                    expand(index);
+                }
+                m_nodes[index].expanded = resolved;
+            }
+            if (!resolved) {
+                ++m_proxies;
+                continue;
+            }
+        }
+        const Node& node = m_nodes[index];
+        for (uint32_t child = node.firstChild; child < node.firstChild + node.childCount; ++child) {
+            queue.push_back(child);
+        }
+    }
+    return changed;
+}
+
+void AdaptiveDerivation::emit(ModuleBuffer& modules) const {
+    modules.clear();
+    if (!m_nodes.empty()) {
+        emit(0, modules);
+    }
+}
+
+// An expanded node is its successor, with the modules rewritten further taken from its children in order
+void AdaptiveDerivation::emit(uint32_t index, ModuleBuffer& modules) const {
+    const Node& node = m_nodes[index];
+    if (index != 0 && !node.expanded) {
+        SubtreeProxy proxy = {node.center, node.radius, node.leaves ? 1.0f : 0.0f, node.exit.position,
+                              node.exit.grow, node.exit.forward, node.exit.right};
+        float values[SubtreeProxy::kParameters];
+        proxy.write(values);
+        modules.push_back(kProxySymbol, node.birth, values, SubtreeProxy::kParameters);
+        return;
+    }
+
+    int remaining = node.remaining - 1;
+    uint8_t birth = childBirth(node);
+    uint32_t child = node.firstChild;
+    for (char symbol : successorOf(index)) {
+        if (rewritable(symbol, remaining)) {
+            emit(child++, modules);
+        } else {
+            modules.push_back(symbol, birth, nullptr, 0);
+        }
+    }
+}
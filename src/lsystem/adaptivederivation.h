@@ -0,0 +1,114 @@
+#ifndef ADAPTIVEDERIVATION_H
+#define ADAPTIVEDERIVATION_H
+
+#include "modulebuffer.h"
+#include "production.h"
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <glm/glm.hpp>
+
+// Module standing in for a subtree the camera cannot resolve, see AdaptiveDerivation
+inline constexpr char kProxySymbol = '%';
+
+// Parameters of a proxy module: the subtree's bounding sphere, whether it holds leaves, and the turtle
+// state it would leave behind, so whatever follows it is drawn where it would be. All in world space
+struct SubtreeProxy {
+    static constexpr int kParameters = 17;
+
+    glm::vec3 center;
+    float radius;
+    float leaves; // 1 when the subtree draws leaves
+    glm::vec3 position;
+    glm::vec3 grow;
+    glm::vec3 forward;
+    glm::vec3 right;
+
+    void write(float* out) const;
+    static SubtreeProxy read(const float* in);
+};
+
+// Derivation of a deterministic L-system that only expands the subtrees the camera can resolve. Every symbol
+// that would still be rewritten is a subtree whose bounding sphere and net turtle move only depend on the
+// symbol, the rewrites left and the turtle's frame, so they are computed once per symbol and rewrite count
+// from its successor's, without deriving it. Subtrees whose sphere projects smaller than a threshold stay
+// unexpanded and are emitted as proxy modules. Expanded subtrees are kept when the camera moves away and
+// reused when it comes back, so refining only touches the part of the tree whose size crossed the threshold
+class AdaptiveDerivation
+{
+public:
+    // Prepare to derive axiom iterations times with the turtle starting at root. Returns false, leaving the
+    // derivation empty, for grammars it cannot expand lazily: stochastic or context-sensitive ones, and
+    // successors whose brackets do not balance
+    bool compile(const std::string& axiom, const ProductionRules& rules, int iterations, float angle, float length,
+                 const glm::vec3& root);
+
+    bool empty() const { return m_nodes.empty(); }
+
+    // Expand subtrees whose bounding sphere covers at least thresholdPixels on a viewport viewportHeight
+    // pixels high, and collapse expanded ones that shrank below a fraction of it, so a subtree near the
+    // threshold does not flip every frame. Returns whether anything changed
+    bool refine(const glm::mat4& view, const glm::mat4& proj, float viewportHeight, float thresholdPixels);
+
+    // The current cut as modules: expanded symbols as the full derivation would have them and every
+    // unexpanded subtree as one proxy module
+    void emit(ModuleBuffer& modules) const;
+
+    // Unexpanded subtrees in the current cut
+    int proxies() const { return m_proxies; }
+
+private:
+    struct Frame {
+        glm::vec3 position;
+        glm::vec3 grow;
+        glm::vec3 forward;
+        glm::vec3 right;
+    };
+
+    // What a subtree draws, relative to a canonical frame at the origin
+    struct Summary {
+        Frame exit;
+        glm::vec3 center;
+        float radius;
+        bool leaves;
+    };
+
+    struct Node {
+        char symbol;
+        uint8_t birth;
+        int remaining;          // Rewrites left for the symbol, at least 1
+        bool expanded = false;
+        uint32_t firstChild = 0; // Children are the successor's modules rewritten further, consecutive in m_nodes once created
+        uint32_t childCount = 0;
+        Frame entry{};
+        Frame exit{};
+        glm::vec3 center = glm::vec3(0.0f);
+        float radius = 0.0f;
+        bool leaves = false;
+    };
+
+    bool rewritable(char symbol, int remaining) const { return remaining > 0 && m_rules.count(symbol) > 0; }
+    const std::string& successorOf(uint32_t node) const { return node == 0 ? m_axiom : m_rules.at(m_nodes[node].symbol); }
+    uint8_t childBirth(const Node& node) const {
+        return static_cast<uint8_t>(std::min(m_iterations - node.remaining + 1, 15));
+    }
+    const Summary& summary(char symbol, int remaining, bool handedness);
+    template <typename Child>
+    void walk(const std::string& successor, int remaining, Frame& frame, glm::vec3& center, float& radius, bool& leaves,
+              Child&& child);
+    void expand(uint32_t node);
+    void emit(uint32_t node, ModuleBuffer& modules) const;
+
+    std::unordered_map<char, std::string> m_rules;
+    std::string m_axiom;
+    int m_iterations = 0;
+    float m_angle = 0.0f;
+    float m_length = 0.0f;
+    std::unordered_map<uint32_t, Summary> m_summaries; // By symbol, rewrites left and frame handedness
+    std::vector<Node> m_nodes;                          // The axiom's pseudo-node first
+    int m_proxies = 0;
+};
+
+#endif // ADAPTIVEDERIVATION_H
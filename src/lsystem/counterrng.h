@@ -0,0 +1,50 @@
+#ifndef COUNTERRNG_H
+#define COUNTERRNG_H
+
+#include <cstdint>
+
+// Counter-based random numbers (Widynski's Squares): every value is a pure function of a key and a
+// counter, with no state to share between threads. A derivation keys it on its seed and counts on
+// (iteration, symbol position), so the result is the same however the work is split
+class CounterRng
+{
+public:
+    // Squares wants keys with well mixed digits, so seeds are spread with SplitMix64 first
+    explicit CounterRng(uint32_t seed) : m_key(mix(seed) | 1u) {}
+
+    uint32_t bits(uint64_t counter) const {
+        uint64_t x = counter * m_key;
+        uint64_t y = x;
+        uint64_t z = y + m_key;
+        x = x * x + y;
+        x = (x >> 32) | (x << 32);
+        x = x * x + z;
+        x = (x >> 32) | (x << 32);
+        x = x * x + y;
+        x = (x >> 32) | (x << 32);
+        return static_cast<uint32_t>((x * x + z) >> 32);
+    }
+
+    // Uniform in [0, 1) for one symbol of one iteration; positions up to 2^40 get distinct counters
+    float uniform(int iteration, uint64_t position) const {
+        uint64_t counter = (static_cast<uint64_t>(iteration) << 40) ^ position;
+        return static_cast<float>(bits(counter) >> 8) * (1.0f / 16777216.0f);
+    }
+
+    // Seed of tree number index of a forest grown from seed
+    static uint32_t treeSeed(uint32_t seed, uint32_t index) {
+        return index == 0 ? seed : CounterRng(seed).bits(~static_cast<uint64_t>(index));
+    }
+
+private:
+    static uint64_t mix(uint64_t value) {
+        value += 0x9E3779B97F4A7C15ull;
+        value = (value ^ (value >> 30)) * 0xBF58476D1CE4E5B9ull;
+        value = (value ^ (value >> 27)) * 0x94D049BB133111EBull;
+        return value ^ (value >> 31);
+    }
+
+    uint64_t m_key;
+};
+
+#endif // COUNTERRNG_H
@@ -0,0 +1,22 @@
+#ifndef DEPTHLOD_H
+#define DEPTHLOD_H
+
+#include <algorithm>
+#include <cmath>
+
+// A tree keeps its depth until its distance asks for one this far past halfway to the next, so a tree near a
+// switching distance does not pop back and forth as the camera moves
+inline constexpr float kDepthHysteresis = 0.25f;
+
+// Iterations a forest tree at distance is drawn with, given the depth it was drawn with last: all levels
+// within nearDistance, then one iteration fewer every time the distance doubles, down to a single iteration
+inline int treeDepthAt(float distance, float nearDistance, int levels, int current) {
+    nearDistance = std::max(nearDistance, 1e-3f);
+    float ideal = levels - std::log2(std::max(distance, nearDistance) / nearDistance);
+    if (std::abs(ideal - current) > 0.5f + kDepthHysteresis) {
+        current = std::clamp(static_cast<int>(std::lround(ideal)), 1, levels);
+    }
+    return current;
+}
+
+#endif // DEPTHLOD_H
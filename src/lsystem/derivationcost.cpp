@@ -0,0 +1,90 @@
+#include "derivationcost.h"
+#include <algorithm>
+#include <array>
+#include "lsystem/treesegment.h"
+
+namespace {
+
+// Triangles TessellationPolicy gives a segment before any budget: about 6 slices for wood, 6x3 for a leaf
+constexpr double kTrianglesPerSegment = 36.0;
+constexpr double kTrianglesPerLeaf = 36.0;
+
+// The least it can strip a segment to, 3 slices in one stack; 2x3 for a leaf
+constexpr double kMinTrianglesPerSegment = 18.0;
+constexpr double kMinTrianglesPerLeaf = 12.0;
+
+// Bytes per derived symbol while rewriting: the packed input and output strings with their birth iterations,
+// half a byte each, and the unpacked string handed to the turtle
+constexpr double kBytesPerSymbol = 4.0 * 0.5 + sizeof(char);
+
+// Position, normal and uv
+constexpr double kBytesPerVertex = 8.0 * sizeof(float);
+
+// Weight of a new measurement in the running rates
+constexpr double kCalibrationWeight = 0.5;
+
+}
+
+std::vector<DerivationCost> DerivationCostModel::estimate(const LSystem& lSystem, int triangleBudget) const {
+    std::vector<DerivationCost> costs;
+    for (const auto& counts : lSystem.symbolCounts()) {
+        DerivationCost cost;
+        for (const auto& [symbol, count] : counts) {
+            cost.symbols += count;
+            if (symbol == 'F' || symbol == 'X') {
+                cost.segments += count;
+            } else if (symbol == 'L') {
+                cost.leaves += count;
+            }
+        }
+
+        // The tessellation policy shrinks the tree into the budget, but not below its minimum slices
+        double natural = cost.segments * kTrianglesPerSegment + cost.leaves * kTrianglesPerLeaf;
+        double minimum = cost.segments * kMinTrianglesPerSegment + cost.leaves * kMinTrianglesPerLeaf;
+        cost.triangles = triangleBudget > 0 ? std::max(std::min(natural, static_cast<double>(triangleBudget)), minimum)
+                                            : natural;
+
+        double vertexBytes = 3.0 * cost.triangles * kBytesPerVertex;
+        cost.cpuBytes = cost.symbols * kBytesPerSymbol + (cost.segments + cost.leaves) * sizeof(TreeSegment) + vertexBytes;
+        cost.gpuBytes = vertexBytes;
+        cost.milliseconds = cost.symbols * m_msPerSymbol + (cost.segments + cost.leaves) * m_msPerSegment;
+        costs.push_back(cost);
+    }
+    return costs;
+}
+
+int DerivationCostModel::affordableIterations(const std::vector<DerivationCost>& costs, double budgetMilliseconds) {
+    int iterations = static_cast<int>(costs.size()) - 1;
+    if (budgetMilliseconds <= 0.0) {
+        return std::max(iterations, 0);
+    }
+
+    // Cost only grows with the iteration count, so the first one over budget ends the search
+    int affordable = 0;
+    for (int i = 1; i <= iterations && costs[i].milliseconds <= budgetMilliseconds; ++i) {
+        affordable = i;
+    }
+    return affordable;
+}
+
+DerivationCost DerivationCostModel::counted(const PackedSymbols& derived) {
+    std::array<size_t, 16> counts = derived.histogram();
+    DerivationCost cost;
+    cost.symbols = static_cast<double>(derived.size());
+    cost.segments = static_cast<double>(counts[PackedSymbols::code('F')] + counts[PackedSymbols::code('X')]);
+    cost.leaves = static_cast<double>(counts[PackedSymbols::code('L')]);
+    return cost;
+}
+
+void DerivationCostModel::calibrate(const DerivationCost& predicted, double deriveMilliseconds, double interpretMilliseconds) {
+    // Tiny trees are dominated by fixed costs and timer resolution, they would skew the rates
+    if (predicted.symbols >= 1000.0 && deriveMilliseconds > 0.0) {
+        double measured = deriveMilliseconds / predicted.symbols;
+        m_msPerSymbol += kCalibrationWeight * (measured - m_msPerSymbol);
+    }
+    double drawn = predicted.segments + predicted.leaves;
+    if (drawn >= 100.0 && interpretMilliseconds > 0.0) {
+        double measured = interpretMilliseconds / drawn;
+        m_msPerSegment += kCalibrationWeight * (measured - m_msPerSegment);
+    }
+}
@@ -0,0 +1,40 @@
+#ifndef DERIVATIONCOST_H
+#define DERIVATIONCOST_H
+
+#include <vector>
+#include "lsystem/lsystem.h"
+
+// What deriving and building one tree will cost, predicted from symbol counts alone
+struct DerivationCost {
+    double symbols = 0.0;      // Length of the derived string
+    double segments = 0.0;     // Trunk and branch moves ('F', 'X')
+    double leaves = 0.0;       // Leaf moves ('L')
+    double triangles = 0.0;    // Triangles of one tree after TessellationPolicy fits it into the triangle budget
+    double cpuBytes = 0.0;     // Peak of the derivation strings plus the segment list and meshed vertices
+    double gpuBytes = 0.0;     // Vertex buffers uploaded for the tree
+    double milliseconds = 0.0; // Derivation plus interpretation, at the rates measured so far
+};
+
+// Predicts DerivationCost for every iteration count of a grammar, and learns this machine's speed from
+// the generations that actually run
+class DerivationCostModel
+{
+public:
+    // Entry i is the cost of deriving lSystem's grammar i times, up to its iteration count
+    std::vector<DerivationCost> estimate(const LSystem& lSystem, int triangleBudget) const;
+
+    // Largest iteration count whose estimated time fits budgetMilliseconds, never below 0; a budget of 0 allows all
+    static int affordableIterations(const std::vector<DerivationCost>& costs, double budgetMilliseconds);
+
+    // The symbol, segment and leaf counts of a derived string, read off its histogram; the rest stays 0
+    static DerivationCost counted(const PackedSymbols& derived);
+
+    // Fold the measured times of a generation into the per-symbol and per-segment rates
+    void calibrate(const DerivationCost& predicted, double deriveMilliseconds, double interpretMilliseconds);
+
+private:
+    double m_msPerSymbol = 2e-5;  // Rewriting, about 20 ns per derived symbol
+    double m_msPerSegment = 4e-3; // Turtle walk, meshing and upload per drawn segment
+};
+
+#endif // DERIVATIONCOST_H
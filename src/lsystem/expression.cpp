@@ -0,0 +1,310 @@
+#include "expression.h"
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdlib>
+#include <utility>
+
+namespace {
+
+// Recursive descent over the expression text, lowest precedence first: || && comparisons + - * / unary ^
+class ExpressionParser {
+public:
+    ExpressionParser(std::string_view text, const std::vector<std::string>& formals, std::vector<Instruction>& code)
+        : m_text(text), m_formals(formals), m_code(code) {}
+
+    bool parse(std::string& error) {
+        parseOr();
+        skipSpace();
+        if (m_error.empty() && m_position < m_text.size()) {
+            fail("unexpected \"" + std::string(1, m_text[m_position]) + "\"");
+        }
+        error = m_error;
+        return m_error.empty();
+    }
+
+private:
+    void fail(const std::string& message) {
+        if (m_error.empty()) {
+            m_error = message + " in \"" + std::string(m_text) + "\"";
+        }
+    }
+
+    void skipSpace() {
+        while (m_position < m_text.size() && std::isspace(static_cast<unsigned char>(m_text[m_position]))) {
+            ++m_position;
+        }
+    }
+
+    bool accept(std::string_view token) {
+        skipSpace();
+        if (m_text.substr(m_position, token.size()) == token) {
+            m_position += token.size();
+            return true;
+        }
+        return false;
+    }
+
+    void emit(Opcode op) { m_code.push_back({op}); }
+
+    void parseOr() {
+        parseAnd();
+        while (m_error.empty() && accept("||")) {
+            parseAnd();
+            emit(Opcode::Or);
+        }
+    }
+
+    void parseAnd() {
+        parseComparison();
+        while (m_error.empty() && accept("&&")) {
+            parseComparison();
+            emit(Opcode::And);
+        }
+    }
+
+    void parseComparison() {
+        parseSum();
+        // Two-character operators first, so "<=" is not read as "<" followed by "="
+        static constexpr std::pair<std::string_view, Opcode> kComparisons[] = {
+            {"<=", Opcode::LessEqual}, {">=", Opcode::GreaterEqual}, {"==", Opcode::Equal},
+            {"!=", Opcode::NotEqual}, {"<", Opcode::Less}, {">", Opcode::Greater},
+        };
+        for (const auto& [token, op] : kComparisons) {
+            if (m_error.empty() && accept(token)) {
+                parseSum();
+                emit(op);
+                return;
+            }
+        }
+    }
+
+    void parseSum() {
+        parseProduct();
+        while (m_error.empty()) {
+            if (accept("+")) {
+                parseProduct();
+                emit(Opcode::Add);
+            } else if (accept("-")) {
+                parseProduct();
+                emit(Opcode::Subtract);
+            } else {
+                return;
+            }
+        }
+    }
+
+    void parseProduct() {
+        parseUnary();
+        while (m_error.empty()) {
+            if (accept("*")) {
+                parseUnary();
+                emit(Opcode::Multiply);
+            } else if (accept("/")) {
+                parseUnary();
+                emit(Opcode::Divide);
+            } else {
+                return;
+            }
+        }
+    }
+
+    void parseUnary() {
+        skipSpace();
+        if (accept("-")) {
+            parseUnary();
+            emit(Opcode::Negate);
+        } else if (m_text.substr(m_position, 2) != "!=" && accept("!")) {
+            parseUnary();
+            emit(Opcode::Not);
+        } else {
+            parsePower();
+        }
+    }
+
+    // Right associative, and binds tighter than a leading minus: -2^2 is -4
+    void parsePower() {
+        parsePrimary();
+        if (m_error.empty() && accept("^")) {
+            parseUnary();
+            emit(Opcode::Power);
+        }
+    }
+
+    void parsePrimary() {
+        skipSpace();
+        if (m_position >= m_text.size()) {
+            fail("expression ends early");
+            return;
+        }
+
+        char c = m_text[m_position];
+        if (std::isdigit(static_cast<unsigned char>(c)) || c == '.') {
+            size_t start = m_position;
+            while (m_position < m_text.size() && (std::isdigit(static_cast<unsigned char>(m_text[m_position])) ||
+                                                   m_text[m_position] == '.')) {
+                ++m_position;
+            }
+            if (m_position < m_text.size() && (m_text[m_position] == 'e' || m_text[m_position] == 'E')) {
+                ++m_position;
+                if (m_position < m_text.size() && (m_text[m_position] == '+' || m_text[m_position] == '-')) {
+                    ++m_position;
+                }
+                while (m_position < m_text.size() && std::isdigit(static_cast<unsigned char>(m_text[m_position]))) {
+                    ++m_position;
+                }
+            }
+            std::string number(m_text.substr(start, m_position - start));
+            char* end = nullptr;
+            float value = std::strtof(number.c_str(), &end);
+            if (end != number.c_str() + number.size()) {
+                fail("malformed number \"" + number + "\"");
+                return;
+            }
+            m_code.push_back({Opcode::Constant, 0, value});
+            return;
+        }
+
+        if (std::isalpha(static_cast<unsigned char>(c)) || c == '_') {
+            size_t start = m_position;
+            while (m_position < m_text.size() && (std::isalnum(static_cast<unsigned char>(m_text[m_position])) ||
+                                                   m_text[m_position] == '_')) {
+                ++m_position;
+            }
+            std::string name(m_text.substr(start, m_position - start));
+            if (accept("(")) {
+                parseCall(name);
+                return;
+            }
+            auto formal = std::find(m_formals.begin(), m_formals.end(), name);
+            if (formal == m_formals.end()) {
+                fail("unknown parameter \"" + name + "\"");
+                return;
+            }
+            m_code.push_back({Opcode::Parameter, static_cast<uint8_t>(formal - m_formals.begin())});
+            return;
+        }
+
+        if (accept("(")) {
+            parseOr();
+            if (m_error.empty() && !accept(")")) {
+                fail("missing \")\"");
+            }
+            return;
+        }
+        fail("unexpected \"" + std::string(1, c) + "\"");
+    }
+
+    // The opening parenthesis is already consumed
+    void parseCall(const std::string& name) {
+        static constexpr std::pair<std::string_view, Opcode> kUnary[] = {
+            {"sqrt", Opcode::Sqrt}, {"sin", Opcode::Sin}, {"cos", Opcode::Cos},
+        };
+        static constexpr std::pair<std::string_view, Opcode> kBinary[] = {
+            {"min", Opcode::Min}, {"max", Opcode::Max},
+        };
+        for (const auto& [function, op] : kUnary) {
+            if (name == function) {
+                parseOr();
+                if (m_error.empty() && !accept(")")) {
+                    fail(name + " takes one argument");
+                }
+                emit(op);
+                return;
+            }
+        }
+        for (const auto& [function, op] : kBinary) {
+            if (name == function) {
+                parseOr();
+                if (m_error.empty() && !accept(",")) {
+                    fail(name + " takes two arguments");
+                }
+                parseOr();
+                if (m_error.empty() && !accept(")")) {
+                    fail(name + " takes two arguments");
+                }
+                emit(op);
+                return;
+            }
+        }
+        fail("unknown function \"" + name + "\"");
+    }
+
+    std::string_view m_text;
+    const std::vector<std::string>& m_formals;
+    std::vector<Instruction>& m_code;
+    size_t m_position = 0;
+    std::string m_error;
+};
+
+}
+
+bool compileExpression(std::string_view text, const std::vector<std::string>& formals,
+                       std::vector<Instruction>& code, std::string& error) {
+    size_t begin = code.size();
+    ExpressionParser parser(text, formals, code);
+    if (!parser.parse(error)) {
+        code.resize(begin);
+        return false;
+    }
+
+    // Values and parameters push one, binary operations pop one, the rest leave the depth alone
+    int depth = 0;
+    int deepest = 0;
+    for (size_t i = begin; i < code.size(); ++i) {
+        switch (code[i].op) {
+        case Opcode::Constant:
+        case Opcode::Parameter:
+            ++depth;
+            break;
+        case Opcode::Negate:
+        case Opcode::Not:
+        case Opcode::Sqrt:
+        case Opcode::Sin:
+        case Opcode::Cos:
+            break;
+        default:
+            --depth;
+            break;
+        }
+        deepest = std::max(deepest, depth);
+    }
+    if (deepest > kMaxExpressionStack) {
+        error = "expression \"" + std::string(text) + "\" is nested too deeply";
+        code.resize(begin);
+        return false;
+    }
+    return true;
+}
+
+float evaluateExpression(const Instruction* begin, const Instruction* end, const float* parameters) {
+    float stack[kMaxExpressionStack];
+    int top = -1;
+    for (const Instruction* instruction = begin; instruction != end; ++instruction) {
+        switch (instruction->op) {
+        case Opcode::Constant: stack[++top] = instruction->value; break;
+        case Opcode::Parameter: stack[++top] = parameters[instruction->index]; break;
+        case Opcode::Add: --top; stack[top] += stack[top + 1]; break;
+        case Opcode::Subtract: --top; stack[top] -= stack[top + 1]; break;
+        case Opcode::Multiply: --top; stack[top] *= stack[top + 1]; break;
+        case Opcode::Divide: --top; stack[top] /= stack[top + 1]; break;
+        case Opcode::Power: --top; stack[top] = std::pow(stack[top], stack[top + 1]); break;
+        case Opcode::Negate: stack[top] = -stack[top]; break;
+        case Opcode::Less: --top; stack[top] = stack[top] < stack[top + 1]; break;
+        case Opcode::Greater: --top; stack[top] = stack[top] > stack[top + 1]; break;
+        case Opcode::LessEqual: --top; stack[top] = stack[top] <= stack[top + 1]; break;
+        case Opcode::GreaterEqual: --top; stack[top] = stack[top] >= stack[top + 1]; break;
+        case Opcode::Equal: --top; stack[top] = stack[top] == stack[top + 1]; break;
+        case Opcode::NotEqual: --top; stack[top] = stack[top] != stack[top + 1]; break;
+        case Opcode::And: --top; stack[top] = stack[top] != 0.0f && stack[top + 1] != 0.0f; break;
+        case Opcode::Or: --top; stack[top] = stack[top] != 0.0f || stack[top + 1] != 0.0f; break;
+        case Opcode::Not: stack[top] = stack[top] == 0.0f; break;
+        case Opcode::Min: --top; stack[top] = std::min(stack[top], stack[top + 1]); break;
+        case Opcode::Max: --top; stack[top] = std::max(stack[top], stack[top + 1]); break;
+        case Opcode::Sqrt: stack[top] = std::sqrt(stack[top]); break;
+        case Opcode::Sin: stack[top] = std::sin(stack[top] * 0.017453292f); break;
+        case Opcode::Cos: stack[top] = std::cos(stack[top] * 0.017453292f); break;
+        }
+    }
+    return top >= 0 ? stack[top] : 0.0f;
+}
@@ -0,0 +1,40 @@
+#ifndef EXPRESSION_H
+#define EXPRESSION_H
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Operations of the stack machine that evaluates module parameters and rule conditions. Comparisons and
+// logic yield 1 or 0, and anything non-zero counts as true
+enum class Opcode : uint8_t {
+    Constant,  // Push value
+    Parameter, // Push the formal parameter at index
+    Add, Subtract, Multiply, Divide, Power, Negate,
+    Less, Greater, LessEqual, GreaterEqual, Equal, NotEqual,
+    And, Or, Not,
+    Min, Max, Sqrt, Sin, Cos
+};
+
+struct Instruction {
+    Opcode op;
+    uint8_t index = 0;  // Parameter index
+    float value = 0.0f; // Constant value
+};
+
+// Deepest stack any compiled expression may need; deeper ones are rejected when compiled
+inline constexpr int kMaxExpressionStack = 32;
+
+// Compile an infix expression over the named formal parameters, such as "l * 0.8" or "l > 0.1 && w < 1",
+// appending its instructions to code. Numbers, formals, + - * / ^, comparisons, && || !, parentheses and
+// min(a, b), max(a, b), sqrt(x), sin(x), cos(x) with angles in degrees. Returns false and sets error on
+// anything else
+bool compileExpression(std::string_view text, const std::vector<std::string>& formals,
+                       std::vector<Instruction>& code, std::string& error);
+
+// Run the instructions [begin, end) of a compiled expression on a module's parameters. No allocation,
+// the stack lives on the caller's stack
+float evaluateExpression(const Instruction* begin, const Instruction* end, const float* parameters);
+
+#endif // EXPRESSION_H
@@ -0,0 +1,122 @@
+#include "lightfield.h"
+#include "utils/parallelfor.h"
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+// Columns per thread below which re-summing is not worth splitting
+constexpr size_t kMinColumnsPerThread = 256;
+
+}
+
+LightField::LightField(const glm::mat4& lightView, float extent, float nearPlane, float farPlane, float voxelSize, float extinction)
+    : m_lightView(lightView), m_extent(extent), m_near(nearPlane), m_voxelSize(voxelSize), m_extinction(extinction) {
+    int across = std::max(static_cast<int>(std::ceil(2.0f * extent / voxelSize)), 1);
+    int along = std::max(static_cast<int>(std::ceil((farPlane - nearPlane) / voxelSize)), 1);
+    m_dimensions = glm::ivec3(across, across, along);
+    size_t voxels = static_cast<size_t>(across) * across * along;
+    m_area.assign(voxels, 0.0f);
+    m_exposure.assign(voxels, 1.0f);
+}
+
+int LightField::voxelOf(const glm::vec3& position) const {
+    glm::vec3 light = glm::vec3(m_lightView * glm::vec4(position, 1.0f));
+    glm::ivec3 cell = glm::ivec3(glm::floor(glm::vec3(light.x + m_extent, light.y + m_extent, -light.z - m_near) / m_voxelSize));
+    if (glm::any(glm::lessThan(cell, glm::ivec3(0))) || glm::any(glm::greaterThanEqual(cell, m_dimensions))) {
+        return -1;
+    }
+    return (cell.y * m_dimensions.x + cell.x) * m_dimensions.z + cell.z;
+}
+
+// Spread every segment's area over the voxels it passes through, sampled every half voxel. Wood shades its
+// length times its diameter; leaf cards are about as wide as they are long
+std::vector<LightField::Cover> LightField::voxelize(const std::vector<TreeSegment>& segments) const {
+    std::vector<Cover> covers;
+    for (const TreeSegment& segment : segments) {
+        float length = glm::length(segment.end - segment.start);
+        float area = length * (segment.kind == SegmentKind::Leaf ? length : segment.thickness);
+        int samples = std::max(static_cast<int>(std::ceil(2.0f * length / m_voxelSize)), 1);
+        for (int s = 0; s < samples; ++s) {
+            int voxel = voxelOf(glm::mix(segment.start, segment.end, (s + 0.5f) / samples));
+            if (voxel >= 0) {
+                covers.push_back({static_cast<uint32_t>(voxel), area / samples});
+            }
+        }
+    }
+
+    std::sort(covers.begin(), covers.end(), [](const Cover& a, const Cover& b) { return a.voxel < b.voxel; });
+    size_t merged = 0;
+    for (size_t i = 0; i < covers.size(); ++i) {
+        if (merged > 0 && covers[merged - 1].voxel == covers[i].voxel) {
+            covers[merged - 1].area += covers[i].area;
+        } else {
+            covers[merged++] = covers[i];
+        }
+    }
+    covers.resize(merged);
+    return covers;
+}
+
+void LightField::update(const std::vector<std::vector<TreeSegment>>& sources) {
+    m_sources.resize(std::max(m_sources.size(), sources.size()));
+
+    // Each source's change is the difference of two sorted cover lists. Sources grow mostly at their tips,
+    // so most voxels they cover are unchanged and drop out here
+    std::vector<std::vector<Cover>> changes(sources.size());
+    parallelFor(sources.size(), parallelChunks(sources.size(), 1), [&](size_t, size_t begin, size_t end) {
+        for (size_t source = begin; source < end; ++source) {
+            std::vector<Cover> covers = voxelize(sources[source]);
+            const std::vector<Cover>& previous = m_sources[source];
+            std::vector<Cover>& change = changes[source];
+            size_t i = 0;
+            size_t j = 0;
+            while (i < covers.size() || j < previous.size()) {
+                if (j == previous.size() || (i < covers.size() && covers[i].voxel < previous[j].voxel)) {
+                    change.push_back(covers[i++]);
+                } else if (i == covers.size() || previous[j].voxel < covers[i].voxel) {
+                    change.push_back({previous[j].voxel, -previous[j].area});
+                    ++j;
+                } else {
+                    if (covers[i].area != previous[j].area) {
+                        change.push_back({covers[i].voxel, covers[i].area - previous[j].area});
+                    }
+                    ++i;
+                    ++j;
+                }
+            }
+            m_sources[source] = std::move(covers);
+        }
+    });
+
+    // Sources overlap, so their changes are applied on one thread, in source order so the sums do not depend
+    // on the thread count
+    std::vector<uint32_t> columns;
+    for (const std::vector<Cover>& change : changes) {
+        for (const Cover& cover : change) {
+            m_area[cover.voxel] += cover.area;
+            columns.push_back(cover.voxel / m_dimensions.z);
+        }
+    }
+    std::sort(columns.begin(), columns.end());
+    columns.erase(std::unique(columns.begin(), columns.end()), columns.end());
+
+    // Light enters each column at the near plane and is attenuated by the area it has passed
+    float perArea = m_extinction / (m_voxelSize * m_voxelSize);
+    parallelFor(columns.size(), parallelChunks(columns.size(), kMinColumnsPerThread), [&](size_t, size_t begin, size_t end) {
+        for (size_t c = begin; c < end; ++c) {
+            size_t first = static_cast<size_t>(columns[c]) * m_dimensions.z;
+            float shade = 0.0f;
+            for (int z = 0; z < m_dimensions.z; ++z) {
+                m_exposure[first + z] = std::exp(-perArea * shade);
+                shade += std::max(m_area[first + z], 0.0f);
+            }
+        }
+    });
+    m_updatedColumns = columns.size();
+}
+
+float LightField::exposure(const glm::vec3& position) const {
+    int voxel = voxelOf(position);
+    return voxel < 0 ? 1.0f : m_exposure[voxel];
+}
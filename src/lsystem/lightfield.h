@@ -0,0 +1,61 @@
+#ifndef LIGHTFIELD_H
+#define LIGHTFIELD_H
+
+#include "treesegment.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Module of an open L-system that asks the environment for light: the turtle notes where it reaches each
+// one, and the exposure there is written into its first parameter before the next rewrite
+inline constexpr char kLightQuerySymbol = '?';
+
+// Where the turtle reached a query module, in world space
+struct EnvironmentQuery {
+    size_t module;
+    glm::vec3 position;
+};
+
+// How much of one directional light reaches each cell of a coarse voxel grid. The grid fills the light's
+// orthographic volume, the one the shadow map renders, with columns running along the light, so a voxel's
+// shadow is the area of everything in front of it in its column. Occupancy is kept per source, one per tree:
+// replacing a source's segments changes only the voxels it covers differently and re-sums only their columns
+class LightField
+{
+public:
+    // lightView and the ortho bounds are the shadow map's: x and y in [-extent, extent], depth in [nearPlane,
+    // farPlane]. Light through a voxel entirely covered by branches and leaves falls to exp(-extinction)
+    LightField(const glm::mat4& lightView, float extent, float nearPlane, float farPlane, float voxelSize, float extinction);
+
+    // Make sources[i] the occupancy of source i. Sources are voxelized and compared with their last
+    // occupancy in parallel, and the changed columns re-summed in parallel
+    void update(const std::vector<std::vector<TreeSegment>>& sources);
+
+    // Fraction of the light reaching position, 1 outside the volume
+    float exposure(const glm::vec3& position) const;
+
+    // Columns the last update re-summed
+    size_t updatedColumns() const { return m_updatedColumns; }
+
+private:
+    struct Cover {
+        uint32_t voxel;
+        float area;
+    };
+
+    int voxelOf(const glm::vec3& position) const;
+    std::vector<Cover> voxelize(const std::vector<TreeSegment>& segments) const;
+
+    glm::mat4 m_lightView;
+    float m_extent;
+    float m_near;
+    float m_voxelSize;
+    float m_extinction;
+    glm::ivec3 m_dimensions;                 // x and y across the light, z along it from the near plane
+    std::vector<float> m_area;               // Area shading the light in each voxel, z fastest
+    std::vector<float> m_exposure;           // Light reaching each voxel past the voxels in front of it
+    std::vector<std::vector<Cover>> m_sources; // Occupancy of every source, sorted by voxel
+    size_t m_updatedColumns = 0;
+};
+
+#endif // LIGHTFIELD_H
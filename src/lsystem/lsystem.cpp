@@ -1,34 +1,126 @@
 #include "lsystem.h"
+#include <algorithm>
+#include <utility>
+
+namespace {
+
+// The successor of every symbol with exactly one production, for the packed rewriter
+std::unordered_map<char, std::string> singleSuccessors(const ProductionRules& rules) {
+    std::unordered_map<char, std::string> successors;
+    for (const auto& [symbol, productions] : rules) {
+        if (productions.size() == 1) {
+            successors[symbol] = productions.front().successor;
+        }
+    }
+    return successors;
+}
+
+}
 
 // Constructor
 LSystem::LSystem(const std::string& axiom, const std::unordered_map<char, std::string>& rules, int iterations)
-    : m_axiom(axiom), m_rules(rules), m_iterations(iterations), m_generatedString(axiom) {}
+    : LSystem(axiom, deterministicRules(rules), iterations) {}
+
+LSystem::LSystem(const std::string& axiom, const ProductionRules& rules, int iterations, const std::string& ignore)
+    : m_axiom(axiom), m_rules(rules), m_iterations(iterations),
+      m_packable(!isStochastic(rules) && !isContextSensitive(rules) &&
+                 PackedRules::encodable(axiom, singleSuccessors(rules))),
+      m_packedRules(m_packable ? singleSuccessors(rules) : std::unordered_map<char, std::string>()),
+      m_program(axiom, rules, ignore), m_generatedString(axiom) {}
+
+std::vector<std::unordered_map<char, double>> LSystem::symbolCounts() const {
+    // Alphabet of the axiom and every rule, each symbol gets a row and column of the matrix
+    std::string alphabet;
+    std::unordered_map<char, size_t> index;
+    auto addSymbols = [&](const std::string& symbols) {
+        for (char c : symbols) {
+            if (index.emplace(c, alphabet.size()).second) {
+                alphabet += c;
+            }
+        }
+    };
+    addSymbols(m_axiom);
+    for (const auto& [symbol, productions] : m_rules) {
+        addSymbols(std::string(1, symbol));
+        for (const Production& candidate : productions) {
+            addSymbols(candidate.successor);
+        }
+    }
 
-// Function to apply rules to a given string
-std::string LSystem::applyRules(const std::string& input) {
-    std::string output;
+    // production[a][b]: copies of b that one a turns into, on average over its weighted productions;
+    // symbols without a rule stay themselves
+    size_t size = alphabet.size();
+    std::vector<std::vector<double>> production(size, std::vector<double>(size, 0.0));
+    for (size_t a = 0; a < size; ++a) {
+        auto rule = m_rules.find(alphabet[a]);
+        if (rule == m_rules.end() || rule->second.empty()) {
+            production[a][a] = 1.0;
+            continue;
+        }
+        double total = 0.0;
+        for (const Production& candidate : rule->second) {
+            total += std::max(candidate.weight, 0.0);
+        }
+        for (const Production& candidate : rule->second) {
+            double share = total > 0.0 ? std::max(candidate.weight, 0.0) / total : 1.0 / rule->second.size();
+            for (char c : candidate.successor) {
+                production[a][index[c]] += share;
+            }
+        }
+    }
 
-    // Iterate through each character in the input string
-    for (char c : input) {
-        // If the character has a replacement rule, use it; otherwise, keep the original
-        if (m_rules.find(c) != m_rules.end()) {
-            output += m_rules.at(c); // Apply the rule
-        } else {
-            output += c; // No rule, keep original character
+    std::vector<double> counts(size, 0.0);
+    for (char c : m_axiom) {
+        counts[index[c]] += 1.0;
+    }
+
+    std::vector<std::unordered_map<char, double>> perIteration;
+    for (int i = 0; i <= m_iterations; ++i) {
+        std::unordered_map<char, double>& named = perIteration.emplace_back();
+        for (size_t a = 0; a < size; ++a) {
+            named[alphabet[a]] = counts[a];
+        }
+
+        std::vector<double> next(size, 0.0);
+        for (size_t a = 0; a < size; ++a) {
+            if (counts[a] == 0.0) {
+                continue;
+            }
+            for (size_t b = 0; b < size; ++b) {
+                next[b] += counts[a] * production[a][b];
+            }
         }
+        counts.swap(next);
     }
 
-    return output;
+    return perIteration;
 }
 
 // Function to generate the final L-System string
 std::string LSystem::generate() {
     m_generatedString = m_axiom; // Start with the axiom
+    m_packedString.clear();
+    m_birthIterations.clear();
+    m_birthIterations.appendRepeated(0, m_axiom.size());
 
-    // Apply rules iteratively
-    for (int i = 0; i < m_iterations; ++i) {
-        m_generatedString = applyRules(m_generatedString);
+    // Turtle-only grammars derive at 4 bits per symbol and are unpacked once at the end
+    if (m_packable) {
+        PackedSymbols next;
+        PackedSymbols nextBirths;
+        m_packedString = PackedSymbols::encode(m_axiom);
+        for (int i = 0; i < m_iterations; ++i) {
+            m_packedRules.rewrite(m_packedString, m_birthIterations, i + 1, next, nextBirths);
+            std::swap(m_packedString, next);
+            std::swap(m_birthIterations, nextBirths);
+        }
+        m_generatedString = m_packedString.unpack();
+        return m_generatedString;
     }
 
+    // Other grammars go through the compiled program, see RuleProgram::derive
+    m_program.derive(m_iterations, m_seed, m_generatedString, m_birthIterations);
+    if (m_program.turtleOnly()) {
+        m_packedString = PackedSymbols::encode(m_generatedString);
+    }
     return m_generatedString; // Return the final generated string
 }
@@ -1,8 +1,13 @@
 #ifndef LSYSTEM_H
 #define LSYSTEM_H
 
+#include "packedsymbols.h"
+#include "production.h"
+#include "ruleprogram.h"
+#include <cstdint>
 #include <string>
 #include <unordered_map>
+#include <vector>
 
 class LSystem
 {
@@ -10,17 +15,51 @@ public:
     // Constructor: Initializes the L-System with an axiom, rules, and iteration count
     LSystem(const std::string& axiom, const std::unordered_map<char, std::string>& rules, int iterations);
 
+    // Same with weighted and context-sensitive productions: symbols with several pick one per occurrence, and
+    // context matching skips the symbols in ignore, see RuleProgram::derive
+    LSystem(const std::string& axiom, const ProductionRules& rules, int iterations,
+            const std::string& ignore = kDefaultContextIgnore);
+
     // Generate the L-System string after applying the rules for the specified number of iterations
     std::string generate();
 
+    // Iteration that last rewrote each symbol of the generated string, 0 for symbols kept from the axiom.
+    // Saturates at 15, later iterations all share the last birth
+    const PackedSymbols& birthIterations() const { return m_birthIterations; }
+
+    // The generated string at 4 bits per symbol; empty when the grammar uses symbols outside the turtle alphabet.
+    // Unlike symbolCounts, its histogram gives the counts stochastic and context-sensitive rules actually produced
+    const PackedSymbols& packedString() const { return m_packedString; }
+
+    // How often every symbol occurs after 0, 1, ... iterations, without expanding the string: the axiom's
+    // counts are multiplied by the rules' production matrix once per iteration. Doubles, so counts far past
+    // what could be generated still compare sensibly; stochastic rules give the expected counts, and
+    // context-sensitive ones the counts as if every context matched in proportion to its weight
+    std::vector<std::unordered_map<char, double>> symbolCounts() const;
+
+    int iterations() const { return m_iterations; }
+
+    // Derive a different number of iterations with the same compiled rules
+    void setIterations(int iterations) { m_iterations = iterations; }
+
+    // Seed of the stochastic choices; the same seed always derives the same string
+    void setSeed(uint32_t seed) { m_seed = seed; }
+    bool stochastic() const { return m_program.stochastic(); }
+
+    // The compiled rules, safe to derive from on several threads at once
+    const RuleProgram& program() const { return m_program; }
+
 private:
     std::string m_axiom;                                   // The starting string (axiom)
-    std::unordered_map<char, std::string> m_rules;         // Replacement rules for each character
+    ProductionRules m_rules;                               // Replacement rules for each character
     int m_iterations;                                      // Number of iterations to apply the rules
+    uint32_t m_seed = 1;                                   // Seed of the stochastic choices
+    bool m_packable;                                       // Axiom and rules only use the turtle alphabet
+    PackedRules m_packedRules;                             // The rules compiled for packed strings, when packable
+    RuleProgram m_program;                                 // The rules compiled, for grammars that do not pack
     std::string m_generatedString;                         // The final generated string
-
-    // Function to apply rules to a given input string
-    std::string applyRules(const std::string& input);      // Apply rules to transform the input string
+    PackedSymbols m_packedString;                          // m_generatedString packed, when the grammar allows
+    PackedSymbols m_birthIterations;                       // Birth iteration per symbol of m_generatedString
 };
 
 #endif // LSYSTEM_H
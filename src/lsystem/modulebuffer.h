@@ -0,0 +1,56 @@
+#ifndef MODULEBUFFER_H
+#define MODULEBUFFER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Modules of a parametric L-system as parallel arrays instead of text: one symbol and birth iteration per
+// module, and every module's parameters as a range of one shared float array. The symbols alone read like
+// a derived string, so the turtle walks them the same way
+struct ModuleBuffer {
+    std::string symbols;                  // Symbol of every module
+    std::vector<uint8_t> births;          // Iteration that last rewrote every module, see LSystem::birthIterations
+    std::vector<uint32_t> firstParameter; // Parameters of module i are parameters[firstParameter[i] .. firstParameter[i + 1]]
+    std::vector<float> parameters;
+
+    ModuleBuffer() { firstParameter.push_back(0); }
+
+    size_t size() const { return symbols.size(); }
+    bool empty() const { return symbols.empty(); }
+
+    int parameterCount(size_t module) const {
+        return static_cast<int>(firstParameter[module + 1] - firstParameter[module]);
+    }
+    const float* parametersOf(size_t module) const { return parameters.data() + firstParameter[module]; }
+
+    // Parameter index of module, or fallback when it has fewer parameters
+    float parameter(size_t module, int index, float fallback) const {
+        return index < parameterCount(module) ? parametersOf(module)[index] : fallback;
+    }
+
+    void clear() {
+        symbols.clear();
+        births.clear();
+        firstParameter.assign(1, 0);
+        parameters.clear();
+    }
+
+    void push_back(char symbol, uint8_t birth, const float* values, int count) {
+        symbols.push_back(symbol);
+        births.push_back(birth);
+        parameters.insert(parameters.end(), values, values + count);
+        firstParameter.push_back(static_cast<uint32_t>(parameters.size()));
+    }
+
+    // Room for modules and parameters without touching their contents, to be filled in place
+    void resize(size_t modules, size_t parameterCount) {
+        symbols.resize(modules);
+        births.resize(modules);
+        firstParameter.resize(modules + 1);
+        parameters.resize(parameterCount);
+    }
+};
+
+#endif // MODULEBUFFER_H
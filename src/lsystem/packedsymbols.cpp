@@ -0,0 +1,367 @@
+#include "packedsymbols.h"
+#include <algorithm>
+#include <cstring>
+
+#if defined(__SSE2__)
+#include <immintrin.h>
+// SSSE3 goes past the SSE2 every x86-64 build assumes, so its unpack is compiled on its own and picked at run time
+#if defined(__GNUC__) || defined(__clang__)
+#define PACKEDSYMBOLS_SSSE3 1
+#endif
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+namespace {
+
+// Alphabet padded to 16 entries so every nibble decodes, for the table lookups below
+constexpr char kDecode[16] = {'F', 'X', 'L', '+', '-', '&', '^', '<', '>', '|', '[', ']', '?', '?', '?', '?'};
+
+// Bit 0: low nibble is a bracket, bit 1: high nibble is
+uint8_t bracketFlags(uint8_t byte) {
+    uint8_t low = byte & 0x0F;
+    uint8_t high = byte >> 4;
+    return static_cast<uint8_t>((low >= PackedSymbols::kOpenBracket && low <= PackedSymbols::kCloseBracket) |
+                                ((high >= PackedSymbols::kOpenBracket && high <= PackedSymbols::kCloseBracket) << 1));
+}
+
+#if defined(PACKEDSYMBOLS_SSSE3)
+bool hasSsse3() {
+    static const bool supported = [] {
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("ssse3") != 0;
+    }();
+    return supported;
+}
+
+// Unpack 16 bytes, 32 symbols, per step with one table shuffle per nibble. Returns the bytes done
+__attribute__((target("ssse3"))) size_t unpackSsse3(const uint8_t* bytes, size_t fullBytes, char* text) {
+    const __m128i table = _mm_loadu_si128(reinterpret_cast<const __m128i*>(kDecode));
+    const __m128i lowMask = _mm_set1_epi8(0x0F);
+    size_t i = 0;
+    for (; i + 16 <= fullBytes; i += 16) {
+        __m128i packed = _mm_loadu_si128(reinterpret_cast<const __m128i*>(bytes + i));
+        __m128i low = _mm_shuffle_epi8(table, _mm_and_si128(packed, lowMask));
+        __m128i high = _mm_shuffle_epi8(table, _mm_and_si128(_mm_srli_epi16(packed, 4), lowMask));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(text + 2 * i), _mm_unpacklo_epi8(low, high));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(text + 2 * i + 16), _mm_unpackhi_epi8(low, high));
+    }
+    return i;
+}
+#endif
+
+}
+
+bool PackedSymbols::encodable(const std::string& text) {
+    return std::all_of(text.begin(), text.end(), [](char symbol) { return code(symbol) >= 0; });
+}
+
+PackedSymbols PackedSymbols::encode(const std::string& text) {
+    PackedSymbols packed;
+    packed.reserve(text.size());
+    for (char symbol : text) {
+        packed.push_back(static_cast<uint8_t>(code(symbol)));
+    }
+    return packed;
+}
+
+PackedSymbols PackedSymbols::fromBytes(const uint8_t* bytes, size_t symbols) {
+    PackedSymbols packed;
+    packed.m_bytes.assign(bytes, bytes + (symbols + 1) / 2);
+    packed.m_size = symbols;
+    return packed;
+}
+
+PackedSymbols PackedSymbols::fromUnpacked(const uint8_t* values, size_t count) {
+    PackedSymbols packed;
+    packed.m_bytes.assign((count + 1) / 2, 0);
+    for (size_t i = 0; i < count; ++i) {
+        packed.m_bytes[i >> 1] |= static_cast<uint8_t>(std::min<uint8_t>(values[i], 15) << ((i & 1) * 4));
+    }
+    packed.m_size = count;
+    return packed;
+}
+
+void PackedSymbols::clear() {
+    m_bytes.clear();
+    m_size = 0;
+}
+
+void PackedSymbols::reserve(size_t symbols) {
+    m_bytes.reserve((symbols + 1) / 2);
+}
+
+void PackedSymbols::push_back(uint8_t code) {
+    if (m_size & 1) {
+        m_bytes.back() |= static_cast<uint8_t>(code << 4);
+    } else {
+        m_bytes.push_back(code);
+    }
+    ++m_size;
+}
+
+void PackedSymbols::append(const PackedSymbols& other) {
+    if (other.empty()) {
+        return;
+    }
+
+    // Aligned: the bytes copy as they are
+    if ((m_size & 1) == 0) {
+        m_bytes.insert(m_bytes.end(), other.m_bytes.begin(), other.m_bytes.end());
+        m_size += other.m_size;
+        return;
+    }
+
+    // Half a byte off: every byte of other straddles two of ours
+    size_t first = m_bytes.size() - 1;
+    m_bytes.resize(first + 1 + other.m_bytes.size());
+    uint8_t* out = m_bytes.data() + first;
+    const uint8_t* in = other.m_bytes.data();
+    for (size_t i = 0; i < other.m_bytes.size(); ++i) {
+        out[i] |= static_cast<uint8_t>(in[i] << 4);
+        out[i + 1] = in[i] >> 4;
+    }
+    m_size += other.m_size;
+
+    // An odd other leaves an empty byte behind
+    if (m_bytes.size() > (m_size + 1) / 2) {
+        m_bytes.pop_back();
+    }
+}
+
+void PackedSymbols::appendRepeated(uint8_t code, size_t count) {
+    if (count == 0) {
+        return;
+    }
+    if (m_size & 1) {
+        push_back(code);
+        --count;
+    }
+    m_bytes.insert(m_bytes.end(), count / 2, static_cast<uint8_t>(code | (code << 4)));
+    m_size += count & ~size_t(1);
+    if (count & 1) {
+        push_back(code);
+    }
+}
+
+std::string PackedSymbols::unpack() const {
+    std::string text(m_size, '\0');
+    size_t fullBytes = m_size / 2;
+    size_t i = 0;
+
+#if defined(PACKEDSYMBOLS_SSSE3)
+    if (hasSsse3()) {
+        i = unpackSsse3(m_bytes.data(), fullBytes, text.data());
+    }
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+    const uint8x16_t table = vld1q_u8(reinterpret_cast<const uint8_t*>(kDecode));
+    const uint8x16_t lowMask = vdupq_n_u8(0x0F);
+    for (; i + 16 <= fullBytes; i += 16) {
+        uint8x16_t bytes = vld1q_u8(m_bytes.data() + i);
+        uint8x16_t low = vqtbl1q_u8(table, vandq_u8(bytes, lowMask));
+        uint8x16_t high = vqtbl1q_u8(table, vshrq_n_u8(bytes, 4));
+        vst1q_u8(reinterpret_cast<uint8_t*>(&text[2 * i]), vzip1q_u8(low, high));
+        vst1q_u8(reinterpret_cast<uint8_t*>(&text[2 * i + 16]), vzip2q_u8(low, high));
+    }
+#endif
+
+    for (; i < fullBytes; ++i) {
+        text[2 * i] = kDecode[m_bytes[i] & 0x0F];
+        text[2 * i + 1] = kDecode[m_bytes[i] >> 4];
+    }
+    if (m_size & 1) {
+        text.back() = kDecode[m_bytes.back() & 0x0F];
+    }
+    return text;
+}
+
+std::array<size_t, 16> PackedSymbols::histogram() const {
+    std::array<size_t, 16> counts{};
+    size_t fullBytes = m_size / 2;
+    size_t i = 0;
+
+    // Per-lane byte counters gain at most 2 per step, so they are summed up every 127 steps before they wrap
+    constexpr size_t kStepsPerFlush = 127;
+
+#if defined(__SSE2__)
+    const __m128i lowMask = _mm_set1_epi8(0x0F);
+    while (i + 16 <= fullBytes) {
+        __m128i lanes[16];
+        for (__m128i& lane : lanes) {
+            lane = _mm_setzero_si128();
+        }
+        size_t blockEnd = std::min(fullBytes, i + 16 * kStepsPerFlush);
+        for (; i + 16 <= blockEnd; i += 16) {
+            __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(m_bytes.data() + i));
+            __m128i low = _mm_and_si128(bytes, lowMask);
+            __m128i high = _mm_and_si128(_mm_srli_epi16(bytes, 4), lowMask);
+            for (int c = 0; c < 16; ++c) {
+                __m128i value = _mm_set1_epi8(static_cast<char>(c));
+                lanes[c] = _mm_sub_epi8(lanes[c], _mm_cmpeq_epi8(low, value));
+                lanes[c] = _mm_sub_epi8(lanes[c], _mm_cmpeq_epi8(high, value));
+            }
+        }
+        for (int c = 0; c < 16; ++c) {
+            __m128i sums = _mm_sad_epu8(lanes[c], _mm_setzero_si128());
+            counts[c] += static_cast<size_t>(_mm_cvtsi128_si32(sums)) + static_cast<size_t>(_mm_extract_epi16(sums, 4));
+        }
+    }
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+    const uint8x16_t lowMask = vdupq_n_u8(0x0F);
+    while (i + 16 <= fullBytes) {
+        uint8x16_t lanes[16];
+        for (uint8x16_t& lane : lanes) {
+            lane = vdupq_n_u8(0);
+        }
+        size_t blockEnd = std::min(fullBytes, i + 16 * kStepsPerFlush);
+        for (; i + 16 <= blockEnd; i += 16) {
+            uint8x16_t bytes = vld1q_u8(m_bytes.data() + i);
+            uint8x16_t low = vandq_u8(bytes, lowMask);
+            uint8x16_t high = vshrq_n_u8(bytes, 4);
+            for (int c = 0; c < 16; ++c) {
+                uint8x16_t value = vdupq_n_u8(static_cast<uint8_t>(c));
+                lanes[c] = vsubq_u8(lanes[c], vceqq_u8(low, value));
+                lanes[c] = vsubq_u8(lanes[c], vceqq_u8(high, value));
+            }
+        }
+        for (int c = 0; c < 16; ++c) {
+            counts[c] += vaddlvq_u8(lanes[c]);
+        }
+    }
+#endif
+
+    for (; i < fullBytes; ++i) {
+        counts[m_bytes[i] & 0x0F]++;
+        counts[m_bytes[i] >> 4]++;
+    }
+    if (m_size & 1) {
+        counts[m_bytes.back() & 0x0F]++;
+    }
+    return counts;
+}
+
+std::vector<int32_t> PackedSymbols::matchBrackets() const {
+    std::vector<int32_t> matches(m_size, -1);
+    std::vector<int32_t> open;
+
+    // Bracket at one symbol, pairing it with the innermost open one
+    auto visit = [&](size_t index) {
+        if (at(index) == kOpenBracket) {
+            open.push_back(static_cast<int32_t>(index));
+        } else if (!open.empty()) {
+            matches[index] = open.back();
+            matches[open.back()] = static_cast<int32_t>(index);
+            open.pop_back();
+        }
+    };
+    auto visitByte = [&](size_t byte, uint8_t flags) {
+        if (flags & 1) {
+            visit(2 * byte);
+        }
+        if ((flags & 2) && 2 * byte + 1 < m_size) {
+            visit(2 * byte + 1);
+        }
+    };
+
+    size_t byteCount = m_bytes.size();
+    size_t i = 0;
+
+#if defined(__SSE2__)
+    // Codes 10 and 11 are the only ones whose bits 1 and 3 are both set with bit 2 clear
+    const __m128i lowMask = _mm_set1_epi8(0x0F);
+    const __m128i pattern = _mm_set1_epi8(0x0A);
+    const __m128i select = _mm_set1_epi8(0x0E);
+    for (; i + 16 <= byteCount; i += 16) {
+        __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(m_bytes.data() + i));
+        __m128i low = _mm_cmpeq_epi8(_mm_and_si128(bytes, select), pattern);
+        __m128i high = _mm_cmpeq_epi8(_mm_and_si128(_mm_and_si128(_mm_srli_epi16(bytes, 4), lowMask), select), pattern);
+        int mask = _mm_movemask_epi8(_mm_or_si128(low, high));
+        while (mask != 0) {
+            int lane = __builtin_ctz(mask);
+            mask &= mask - 1;
+            visitByte(i + lane, bracketFlags(m_bytes[i + lane]));
+        }
+    }
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+    const uint8x16_t pattern = vdupq_n_u8(0x0A);
+    const uint8x16_t select = vdupq_n_u8(0x0E);
+    for (; i + 16 <= byteCount; i += 16) {
+        uint8x16_t bytes = vld1q_u8(m_bytes.data() + i);
+        uint8x16_t low = vceqq_u8(vandq_u8(bytes, select), pattern);
+        uint8x16_t high = vceqq_u8(vandq_u8(vshrq_n_u8(bytes, 4), select), pattern);
+        uint8x16_t any = vorrq_u8(low, high);
+        if (vmaxvq_u8(any) == 0) {
+            continue;
+        }
+        for (int lane = 0; lane < 16; ++lane) {
+            uint8_t flags = bracketFlags(m_bytes[i + lane]);
+            if (flags != 0) {
+                visitByte(i + lane, flags);
+            }
+        }
+    }
+#endif
+
+    for (; i < byteCount; ++i) {
+        uint8_t flags = bracketFlags(m_bytes[i]);
+        if (flags != 0) {
+            visitByte(i, flags);
+        }
+    }
+    return matches;
+}
+
+bool PackedRules::encodable(const std::string& axiom, const std::unordered_map<char, std::string>& rules) {
+    if (!PackedSymbols::encodable(axiom)) {
+        return false;
+    }
+    for (const auto& [symbol, replacement] : rules) {
+        if (PackedSymbols::code(symbol) < 0 || !PackedSymbols::encodable(replacement)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+PackedRules::PackedRules(const std::unordered_map<char, std::string>& rules) {
+    for (int code = 0; code < 16; ++code) {
+        m_replacements[code].push_back(static_cast<uint8_t>(code));
+    }
+    for (const auto& [symbol, replacement] : rules) {
+        int code = PackedSymbols::code(symbol);
+        m_rewrites[code] = true;
+        m_replacements[code] = PackedSymbols::encode(replacement);
+    }
+
+    for (int byte = 0; byte < 256; ++byte) {
+        m_pairs[byte] = m_replacements[byte & 0x0F];
+        m_pairs[byte].append(m_replacements[byte >> 4]);
+    }
+}
+
+void PackedRules::rewrite(const PackedSymbols& input, const PackedSymbols& inputBirths, int iteration,
+                          PackedSymbols& output, PackedSymbols& outputBirths) const {
+    output.clear();
+    outputBirths.clear();
+
+    const std::vector<uint8_t>& bytes = input.bytes();
+    size_t fullBytes = input.size() / 2;
+    for (size_t i = 0; i < fullBytes; ++i) {
+        output.append(m_pairs[bytes[i]]);
+    }
+    if (input.size() & 1) {
+        output.append(m_replacements[bytes.back() & 0x0F]);
+    }
+
+    // Births follow symbol by symbol; runs of the same birth are filled a byte at a time
+    uint8_t born = static_cast<uint8_t>(std::min(iteration, 15));
+    outputBirths.reserve(output.size());
+    for (size_t i = 0; i < input.size(); ++i) {
+        uint8_t code = input.at(i);
+        if (m_rewrites[code]) {
+            outputBirths.appendRepeated(born, m_replacements[code].size());
+        } else {
+            outputBirths.push_back(inputBirths.at(i));
+        }
+    }
+}
@@ -0,0 +1,92 @@
+#ifndef PACKEDSYMBOLS_H
+#define PACKEDSYMBOLS_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// A string of 4-bit codes stored two per byte, low nibble first, so the unused high nibble of an odd-sized
+// buffer stays zero. Derived L-system strings use it with the turtle alphabet below at half the memory and
+// bandwidth of a std::string; birth iterations reuse it for values up to 15
+class PackedSymbols
+{
+public:
+    // The symbols interpretLSystem understands, in code order
+    static constexpr char kAlphabet[] = "FXL+-&^<>|[]";
+    static constexpr int kAlphabetSize = 12;
+    static constexpr uint8_t kOpenBracket = 10;
+    static constexpr uint8_t kCloseBracket = 11;
+
+    // Code of a turtle symbol, -1 for symbols outside the alphabet
+    static constexpr int code(char symbol) {
+        for (int i = 0; i < kAlphabetSize; ++i) {
+            if (kAlphabet[i] == symbol) {
+                return i;
+            }
+        }
+        return -1;
+    }
+
+    // True when every symbol of text has a code
+    static bool encodable(const std::string& text);
+
+    // text must be encodable
+    static PackedSymbols encode(const std::string& text);
+
+    // Adopt symbols already packed two per byte, such as the compile-time tables of presetgrammar.h
+    static PackedSymbols fromBytes(const uint8_t* bytes, size_t symbols);
+
+    // Pack values held one per byte, such as ModuleBuffer::births. Values past 15 saturate
+    static PackedSymbols fromUnpacked(const uint8_t* values, size_t count);
+
+    size_t size() const { return m_size; }
+    bool empty() const { return m_size == 0; }
+    uint8_t at(size_t index) const { return (m_bytes[index >> 1] >> ((index & 1) * 4)) & 0x0F; }
+    const std::vector<uint8_t>& bytes() const { return m_bytes; }
+
+    void clear();
+    void reserve(size_t symbols);
+    void push_back(uint8_t code);
+    void append(const PackedSymbols& other);
+    void appendRepeated(uint8_t code, size_t count);
+
+    // One char per symbol through the alphabet, 32 symbols per step with NEON, or SSSE3 where the CPU has it
+    std::string unpack() const;
+
+    // How often each code occurs, 32 symbols per step with NEON or SSE2
+    std::array<size_t, 16> histogram() const;
+
+    // For every '[' the index of its ']' and the other way round, -1 for other symbols and unmatched
+    // brackets. Blocks are scanned with NEON or SSE2 so only the bytes holding a bracket are visited
+    std::vector<int32_t> matchBrackets() const;
+
+private:
+    std::vector<uint8_t> m_bytes;
+    size_t m_size = 0;
+};
+
+// Production rules compiled for rewriting packed strings a byte, two symbols, at a time
+class PackedRules
+{
+public:
+    // True when the axiom and every rule only use the turtle alphabet
+    static bool encodable(const std::string& axiom, const std::unordered_map<char, std::string>& rules);
+
+    // rules must be encodable
+    explicit PackedRules(const std::unordered_map<char, std::string>& rules);
+
+    // One derivation step from input to output. Births track the iteration that last rewrote each symbol:
+    // rewritten symbols are born in iteration, saturating at 15, the others keep their input birth
+    void rewrite(const PackedSymbols& input, const PackedSymbols& inputBirths, int iteration,
+                 PackedSymbols& output, PackedSymbols& outputBirths) const;
+
+private:
+    std::array<bool, 16> m_rewrites{};               // Codes that have a rule
+    std::array<PackedSymbols, 16> m_replacements;    // What each code turns into, itself without a rule
+    std::array<PackedSymbols, 256> m_pairs;          // Both codes of a byte rewritten, appended in one go
+};
+
+#endif // PACKEDSYMBOLS_H
@@ -0,0 +1,281 @@
+#include "parametriclsystem.h"
+#include "utils/parallelfor.h"
+#include <algorithm>
+#include <cctype>
+#include <limits>
+#include <string_view>
+
+namespace {
+
+// Modules per thread below which an iteration is not worth splitting; evaluating arguments costs more per
+// module than copying symbols, so this is lower than RuleProgram's
+constexpr size_t kMinModulesPerThread = 1 << 13;
+
+// Marks a module that is kept as it is
+constexpr uint32_t kNoRule = std::numeric_limits<uint32_t>::max();
+
+// One module as written: its symbol and the text of each argument
+struct ModuleText {
+    char symbol;
+    std::vector<std::string_view> arguments;
+};
+
+// Split text such as "F(l*0.8,w)[+(30)A]" into modules. Arguments end at commas and the closing parenthesis
+// outside nested parentheses, so they may call functions
+bool splitModules(std::string_view text, std::vector<ModuleText>& modules, std::string& error) {
+    size_t i = 0;
+    while (i < text.size()) {
+        if (std::isspace(static_cast<unsigned char>(text[i]))) {
+            ++i;
+            continue;
+        }
+        ModuleText module = {text[i++], {}};
+        if (module.symbol == '(' || module.symbol == ')' || module.symbol == ',') {
+            error = "misplaced \"" + std::string(1, module.symbol) + "\" in \"" + std::string(text) + "\"";
+            return false;
+        }
+        if (i < text.size() && text[i] == '(') {
+            size_t start = ++i;
+            int depth = 1;
+            for (; i < text.size() && depth > 0; ++i) {
+                if (text[i] == '(') {
+                    ++depth;
+                } else if (text[i] == ')' && --depth == 0) {
+                    module.arguments.push_back(text.substr(start, i - start));
+                } else if (text[i] == ',' && depth == 1) {
+                    module.arguments.push_back(text.substr(start, i - start));
+                    start = i + 1;
+                }
+            }
+            if (depth != 0) {
+                error = "unclosed \"(\" in \"" + std::string(text) + "\"";
+                return false;
+            }
+            // "A()" has no parameters rather than one empty one
+            if (module.arguments.size() == 1 && module.arguments[0].find_first_not_of(" \t") == std::string_view::npos) {
+                module.arguments.clear();
+            }
+            if (module.arguments.size() > ParametricLSystem::kMaxParameters) {
+                error = "more than " + std::to_string(ParametricLSystem::kMaxParameters) + " parameters in \"" +
+                        std::string(text) + "\"";
+                return false;
+            }
+        }
+        modules.push_back(std::move(module));
+    }
+    return true;
+}
+
+std::string trimmed(std::string_view text) {
+    size_t begin = text.find_first_not_of(" \t");
+    size_t end = text.find_last_not_of(" \t");
+    return begin == std::string_view::npos ? std::string() : std::string(text.substr(begin, end - begin + 1));
+}
+
+}
+
+bool ParametricLSystem::compile(const std::string& axiom, const std::vector<ParametricRule>& rules, std::string& error) {
+    auto reject = [this] {
+        *this = ParametricLSystem();
+        return false;
+    };
+
+    *this = ParametricLSystem();
+
+    // Axiom arguments are evaluated once, with no parameters to refer to
+    std::vector<ModuleText> modules;
+    if (!splitModules(axiom, modules, error)) {
+        return reject();
+    }
+    for (const ModuleText& module : modules) {
+        float values[kMaxParameters];
+        for (size_t a = 0; a < module.arguments.size(); ++a) {
+            std::vector<Instruction> code;
+            if (!compileExpression(module.arguments[a], {}, code, error)) {
+                return reject();
+            }
+            values[a] = evaluateExpression(code.data(), code.data() + code.size(), nullptr);
+        }
+        m_axiom.push_back(module.symbol, 0, values, static_cast<int>(module.arguments.size()));
+    }
+
+    // Rules are grouped by symbol with a stable sort, so the first match is still the first written
+    std::vector<Rule> compiled;
+    for (const ParametricRule& rule : rules) {
+        std::vector<ModuleText> predecessor;
+        if (!splitModules(rule.predecessor, predecessor, error)) {
+            return reject();
+        }
+        if (predecessor.size() != 1) {
+            error = "predecessor \"" + rule.predecessor + "\" must be a single module";
+            return reject();
+        }
+
+        std::vector<std::string> formals;
+        for (std::string_view argument : predecessor[0].arguments) {
+            std::string formal = trimmed(argument);
+            bool identifier = !formal.empty() && !std::isdigit(static_cast<unsigned char>(formal[0])) &&
+                              std::all_of(formal.begin(), formal.end(), [](char c) {
+                                  return std::isalnum(static_cast<unsigned char>(c)) || c == '_';
+                              });
+            if (!identifier || std::find(formals.begin(), formals.end(), formal) != formals.end()) {
+                error = "predecessor \"" + rule.predecessor + "\" must name distinct parameters";
+                return reject();
+            }
+            formals.push_back(formal);
+        }
+
+        Rule result = {predecessor[0].symbol, static_cast<int>(formals.size()), {0, 0}, {0, 0}, 0};
+        if (!trimmed(rule.condition).empty()) {
+            result.condition.begin = static_cast<uint32_t>(m_code.size());
+            if (!compileExpression(rule.condition, formals, m_code, error)) {
+                return reject();
+            }
+            result.condition.end = static_cast<uint32_t>(m_code.size());
+        }
+
+        std::vector<ModuleText> successor;
+        if (!splitModules(rule.successor, successor, error)) {
+            return reject();
+        }
+        result.successors.begin = static_cast<uint32_t>(m_successors.size());
+        for (const ModuleText& module : successor) {
+            SuccessorModule written = {module.symbol, {static_cast<uint32_t>(m_arguments.size()), 0}};
+            for (std::string_view argument : module.arguments) {
+                uint32_t begin = static_cast<uint32_t>(m_code.size());
+                if (!compileExpression(argument, formals, m_code, error)) {
+                    return reject();
+                }
+                m_arguments.push_back({begin, static_cast<uint32_t>(m_code.size())});
+            }
+            written.arguments.end = static_cast<uint32_t>(m_arguments.size());
+            result.parameters += static_cast<uint32_t>(module.arguments.size());
+            m_successors.push_back(written);
+        }
+        result.successors.end = static_cast<uint32_t>(m_successors.size());
+        compiled.push_back(result);
+    }
+
+    std::stable_sort(compiled.begin(), compiled.end(), [](const Rule& a, const Rule& b) {
+        return static_cast<uint8_t>(a.symbol) < static_cast<uint8_t>(b.symbol);
+    });
+    m_rules = std::move(compiled);
+    for (int c = 0; c <= 256; ++c) {
+        m_firstRule[c] = static_cast<uint32_t>(std::lower_bound(m_rules.begin(), m_rules.end(), c,
+                                                                [](const Rule& rule, int symbol) {
+                                                                    return static_cast<uint8_t>(rule.symbol) < symbol;
+                                                                }) - m_rules.begin());
+    }
+    return true;
+}
+
+uint32_t ParametricLSystem::match(const ModuleBuffer& modules, size_t module) const {
+    uint8_t symbol = static_cast<uint8_t>(modules.symbols[module]);
+    int count = modules.parameterCount(module);
+    const float* parameters = modules.parametersOf(module);
+    for (uint32_t r = m_firstRule[symbol]; r < m_firstRule[symbol + 1]; ++r) {
+        const Rule& rule = m_rules[r];
+        if (rule.formals != count) {
+            continue;
+        }
+        if (rule.condition.begin == rule.condition.end ||
+            evaluateExpression(m_code.data() + rule.condition.begin, m_code.data() + rule.condition.end, parameters) != 0.0f) {
+            return r;
+        }
+    }
+    return kNoRule;
+}
+
+void ParametricLSystem::derive(int iterations, ModuleBuffer& modules) const {
+    iterations = std::clamp(iterations, 0, kMaxIterations);
+    modules = m_axiom;
+    for (int iteration = 1; iteration <= iterations; ++iteration) {
+        rewrite(iteration, modules);
+    }
+}
+
+void ParametricLSystem::rewrite(int iteration, ModuleBuffer& modules) const {
+    size_t count = modules.size();
+    size_t chunks = parallelChunks(count, kMinModulesPerThread);
+    std::vector<size_t> chunkModules(chunks + 1, 0);
+    std::vector<size_t> chunkParameters(chunks + 1, 0);
+    std::vector<uint32_t> chosen(count);
+
+    // Match every module and size each chunk's output, so chunks know where to write without waiting
+    parallelFor(count, chunks, [&](size_t chunk, size_t begin, size_t end) {
+        size_t moduleCount = 0;
+        size_t parameterCount = 0;
+        for (size_t i = begin; i < end; ++i) {
+            uint32_t rule = match(modules, i);
+            chosen[i] = rule;
+            if (rule == kNoRule) {
+                moduleCount += 1;
+                parameterCount += modules.parameterCount(i);
+            } else {
+                moduleCount += m_rules[rule].successors.end - m_rules[rule].successors.begin;
+                parameterCount += m_rules[rule].parameters;
+            }
+        }
+        chunkModules[chunk + 1] = moduleCount;
+        chunkParameters[chunk + 1] = parameterCount;
+    });
+
+    for (size_t chunk = 0; chunk < chunks; ++chunk) {
+        chunkModules[chunk + 1] += chunkModules[chunk];
+        chunkParameters[chunk + 1] += chunkParameters[chunk];
+    }
+    ModuleBuffer next;
+    next.resize(chunkModules[chunks], chunkParameters[chunks]);
+    next.firstParameter[chunkModules[chunks]] = static_cast<uint32_t>(chunkParameters[chunks]);
+
+    // Each chunk writes its own range of modules and parameters of the next iteration
+    uint8_t born = static_cast<uint8_t>(std::clamp(iteration, 0, 15));
+    parallelFor(count, chunks, [&](size_t chunk, size_t begin, size_t end) {
+        size_t out = chunkModules[chunk];
+        size_t outParameter = chunkParameters[chunk];
+        for (size_t i = begin; i < end; ++i) {
+            const float* parameters = modules.parametersOf(i);
+            if (chosen[i] == kNoRule) {
+                int parameterCount = modules.parameterCount(i);
+                next.symbols[out] = modules.symbols[i];
+                next.births[out] = modules.births[i];
+                next.firstParameter[out] = static_cast<uint32_t>(outParameter);
+                std::copy(parameters, parameters + parameterCount, next.parameters.begin() + outParameter);
+                outParameter += parameterCount;
+                ++out;
+                continue;
+            }
+
+            const Rule& rule = m_rules[chosen[i]];
+            for (uint32_t s = rule.successors.begin; s < rule.successors.end; ++s) {
+                const SuccessorModule& successor = m_successors[s];
+                next.symbols[out] = successor.symbol;
+                next.births[out] = born;
+                next.firstParameter[out] = static_cast<uint32_t>(outParameter);
+                for (uint32_t a = successor.arguments.begin; a < successor.arguments.end; ++a) {
+                    const Range& argument = m_arguments[a];
+                    next.parameters[outParameter++] =
+                        evaluateExpression(m_code.data() + argument.begin, m_code.data() + argument.end, parameters);
+                }
+                ++out;
+            }
+        }
+    });
+
+    std::swap(modules, next);
+}
+
+std::unordered_map<char, std::string> ParametricLSystem::skeletonRules() const {
+    std::unordered_map<char, std::string> rules;
+    for (const Rule& rule : m_rules) {
+        std::string successor;
+        for (uint32_t s = rule.successors.begin; s < rule.successors.end; ++s) {
+            successor.push_back(m_successors[s].symbol);
+        }
+        std::string& longest = rules[rule.symbol];
+        if (successor.size() > longest.size()) {
+            longest = successor;
+        }
+    }
+    return rules;
+}
@@ -0,0 +1,80 @@
+#ifndef PARAMETRICLSYSTEM_H
+#define PARAMETRICLSYSTEM_H
+
+#include "expression.h"
+#include "modulebuffer.h"
+#include "ruleprogram.h"
+#include <array>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// One rule of a parametric grammar as written, e.g. predecessor "A(l,w)", condition "l > 0.1" and
+// successor "F(l,w)[&(30)A(l*0.8,w*0.7)]". The condition may be empty
+struct ParametricRule {
+    std::string predecessor;
+    std::string condition;
+    std::string successor;
+};
+
+// A parametric L-system compiled once: every condition and successor argument becomes a range of one
+// shared expression program, and modules are derived as a ModuleBuffer. A module is rewritten by the
+// first rule, in the order written, whose symbol and parameter count match and whose condition holds;
+// modules no rule matches are kept as they are
+class ParametricLSystem
+{
+public:
+    // Births saturate like RuleProgram's, so there is no point deriving further
+    static constexpr int kMaxIterations = RuleProgram::kMaxIterations;
+    static constexpr int kMaxParameters = 8;
+
+    // Compile axiom and rules; axiom arguments must be constant. Returns false and sets error when
+    // a module or expression is malformed, leaving the system empty
+    bool compile(const std::string& axiom, const std::vector<ParametricRule>& rules, std::string& error);
+
+    // Derive iterations times, clamped to kMaxIterations, into modules. Each iteration is rewritten a chunk
+    // of modules per thread, with the same result as on one
+    void derive(int iterations, ModuleBuffer& modules) const;
+
+    // Rewrite modules once, as the given iteration of a derivation. For open L-systems, whose modules are
+    // changed by the environment between rewrites
+    void rewrite(int iteration, ModuleBuffer& modules) const;
+
+    const ModuleBuffer& axiom() const { return m_axiom; }
+
+    // The grammar without parameters or conditions, each symbol taking its longest successor, for
+    // estimating derivation cost with LSystem. Conditions usually stop growth sooner, so it over-estimates
+    std::string skeletonAxiom() const { return m_axiom.symbols; }
+    std::unordered_map<char, std::string> skeletonRules() const;
+
+private:
+    struct Range {
+        uint32_t begin;
+        uint32_t end;
+    };
+
+    struct Rule {
+        char symbol;
+        int formals;          // Parameter count a module needs to match
+        Range condition;      // Empty when the rule always applies
+        Range successors;     // Modules it writes, in m_successors
+        uint32_t parameters;  // Parameters those modules carry together
+    };
+
+    struct SuccessorModule {
+        char symbol;
+        Range arguments; // Argument expressions, in m_arguments
+    };
+
+    uint32_t match(const ModuleBuffer& modules, size_t module) const;
+
+    ModuleBuffer m_axiom;
+    std::vector<Rule> m_rules;                  // Grouped by symbol, in the order written within one
+    std::array<uint32_t, 257> m_firstRule = {}; // Rules of symbol c are m_rules[m_firstRule[c] .. m_firstRule[c + 1]]
+    std::vector<SuccessorModule> m_successors;
+    std::vector<Range> m_arguments;             // Range of m_code computing each argument
+    std::vector<Instruction> m_code;
+};
+
+#endif // PARAMETRICLSYSTEM_H
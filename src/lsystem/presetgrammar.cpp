@@ -0,0 +1,29 @@
+#include "presetgrammar.h"
+#include <utility>
+
+namespace {
+
+template <const auto& Grammar, int Iterations>
+constexpr PresetView view() {
+    const auto& derivation = kPresetDerivation<Grammar, Iterations>;
+    return {std::string_view(derivation.symbols.data(), derivation.symbols.size()), derivation.births.data()};
+}
+
+// One view per iteration count 0 ... kMaxPresetIterations
+template <const auto& Grammar, int... Iterations>
+constexpr std::array<PresetView, sizeof...(Iterations)> views(std::integer_sequence<int, Iterations...>) {
+    return {view<Grammar, Iterations>()...};
+}
+
+constexpr auto kIterationCounts = std::make_integer_sequence<int, kMaxPresetIterations + 1>();
+constexpr std::array<PresetView, kMaxPresetIterations + 1> kTreeViews = views<kTreeGrammar>(kIterationCounts);
+constexpr std::array<PresetView, kMaxPresetIterations + 1> kLeafyTreeViews = views<kLeafyTreeGrammar>(kIterationCounts);
+
+}
+
+PresetView presetDerivation(bool leaves, int iterations) {
+    if (iterations < 0 || iterations > kMaxPresetIterations) {
+        return PresetView();
+    }
+    return leaves ? kLeafyTreeViews[iterations] : kTreeViews[iterations];
+}
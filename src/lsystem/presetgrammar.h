@@ -0,0 +1,143 @@
+#ifndef PRESETGRAMMAR_H
+#define PRESETGRAMMAR_H
+
+#include "packedsymbols.h"
+#include "production.h"
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+// One production of a grammar known at build time
+struct PresetRule {
+    char symbol;
+    std::string_view replacement;
+};
+
+// A derived string with the birth iteration of every symbol, packed two per byte like LSystem::birthIterations
+template <size_t Size>
+struct PresetDerivation {
+    std::array<char, Size> symbols{};
+    std::array<uint8_t, (Size + 1) / 2> births{};
+};
+
+// A grammar known at build time. Its strings are derived by the compiler, see kPresetDerivation
+template <size_t RuleCount>
+struct PresetGrammar {
+    std::string_view axiom;
+    std::array<PresetRule, RuleCount> rules;
+
+    // Rule for symbol, nullptr when it stays itself
+    constexpr const PresetRule* find(char symbol) const {
+        for (const PresetRule& rule : rules) {
+            if (rule.symbol == symbol) {
+                return &rule;
+            }
+        }
+        return nullptr;
+    }
+
+    // True when the axiom and every rule only use the turtle alphabet
+    constexpr bool turtleOnly() const {
+        auto encodable = [](std::string_view text) {
+            for (char c : text) {
+                if (PackedSymbols::code(c) < 0) {
+                    return false;
+                }
+            }
+            return true;
+        };
+        bool result = encodable(axiom);
+        for (const PresetRule& rule : rules) {
+            result = result && PackedSymbols::code(rule.symbol) >= 0 && encodable(rule.replacement);
+        }
+        return result;
+    }
+
+    // Length of what symbol turns into after iterations
+    constexpr size_t expandedSize(char symbol, int iterations) const {
+        const PresetRule* rule = find(symbol);
+        if (iterations == 0 || rule == nullptr) {
+            return 1;
+        }
+        size_t size = 0;
+        for (char c : rule->replacement) {
+            size += expandedSize(c, iterations - 1);
+        }
+        return size;
+    }
+
+    constexpr size_t derivedSize(int iterations) const {
+        size_t size = 0;
+        for (char c : axiom) {
+            size += expandedSize(c, iterations);
+        }
+        return size;
+    }
+
+    // Depth first, one symbol of the axiom at a time, so the result needs no intermediate strings
+    template <size_t Size>
+    constexpr PresetDerivation<Size> derive(int iterations) const {
+        PresetDerivation<Size> derivation;
+        size_t position = 0;
+        for (char c : axiom) {
+            expand(c, 0, iterations, derivation, position);
+        }
+        return derivation;
+    }
+
+    // The same rules for LSystem, which derives iteration counts past the precomputed ones
+    ProductionRules runtimeRules() const {
+        ProductionRules result;
+        for (const PresetRule& rule : rules) {
+            result[rule.symbol].push_back({std::string(rule.replacement), 1.0});
+        }
+        return result;
+    }
+
+private:
+    // symbol was produced by rewrite number iteration, 0 for the axiom, which is also its birth
+    template <size_t Size>
+    constexpr void expand(char symbol, int iteration, int iterations, PresetDerivation<Size>& derivation,
+                          size_t& position) const {
+        const PresetRule* rule = find(symbol);
+        if (iteration == iterations || rule == nullptr) {
+            uint8_t packed = static_cast<uint8_t>(iteration < 15 ? iteration : 15);
+            derivation.symbols[position] = symbol;
+            derivation.births[position / 2] |= static_cast<uint8_t>(packed << ((position & 1) * 4));
+            ++position;
+            return;
+        }
+        for (char c : rule->replacement) {
+            expand(c, iteration + 1, iterations, derivation, position);
+        }
+    }
+};
+
+// The built-in trees of LSystemShapeDataGeneration, without and with leaves
+inline constexpr PresetGrammar<1> kTreeGrammar = {"FFX", {{{'X', "X[-&<X][<++&X]||X[--&>X][+&X]"}}}};
+inline constexpr PresetGrammar<1> kLeafyTreeGrammar = {"FFX", {{{'X', "X[-&<XL][<++&XL]||X[--&>XL][+&XL]"}}}};
+
+static_assert(kTreeGrammar.turtleOnly() && kLeafyTreeGrammar.turtleOnly(), "Presets must only use turtle symbols");
+
+// Grammar derived iterations times by the compiler
+template <const auto& Grammar, int Iterations>
+inline constexpr auto kPresetDerivation = Grammar.template derive<Grammar.derivedSize(Iterations)>(Iterations);
+
+// Iteration counts derived at compile time; the string grows about 6x per iteration, 4 is roughly 8000 symbols.
+// More would outgrow the constant evaluation limits of some compilers
+inline constexpr int kMaxPresetIterations = 4;
+
+// A precomputed derivation in static storage; symbols is empty when there is none
+struct PresetView {
+    std::string_view symbols;
+    const uint8_t* births = nullptr;
+
+    bool empty() const { return symbols.empty(); }
+};
+
+// The built-in tree derived iterations times, or an empty view past kMaxPresetIterations
+PresetView presetDerivation(bool leaves, int iterations);
+
+#endif // PRESETGRAMMAR_H
@@ -0,0 +1,66 @@
+#ifndef PRODUCTION_H
+#define PRODUCTION_H
+
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// One successor a symbol may be rewritten into, picked with probability weight / sum of its weights.
+// A production with a context, written left < symbol > right, only applies where the symbols before and
+// after match, and then takes precedence over the symbol's productions without one
+struct Production {
+    Production() = default;
+    Production(std::string successor, double weight = 1.0, std::string left = {}, std::string right = {})
+        : successor(std::move(successor)), weight(weight), left(std::move(left)), right(std::move(right)) {}
+
+    std::string successor;
+    double weight = 1.0;
+    std::string left;  // Symbols that must precede, nearest last; empty for any
+    std::string right; // Symbols that must follow, nearest first; empty for any
+
+    bool contextual() const { return !left.empty() || !right.empty(); }
+};
+
+// Symbols context matching skips by default: the turtle's turns, which do not separate modules
+inline constexpr const char* kDefaultContextIgnore = "+-&^<>|";
+
+// Productions of every rewritten symbol; a single production makes the symbol deterministic
+using ProductionRules = std::unordered_map<char, std::vector<Production>>;
+
+// One production of weight 1 per rule
+inline ProductionRules deterministicRules(const std::unordered_map<char, std::string>& rules) {
+    ProductionRules productions;
+    for (const auto& [symbol, successor] : rules) {
+        productions[symbol].push_back({successor, 1.0});
+    }
+    return productions;
+}
+
+// True when some symbol has more than one production to choose from in the same context
+inline bool isStochastic(const ProductionRules& rules) {
+    for (const auto& [symbol, productions] : rules) {
+        for (size_t a = 0; a < productions.size(); ++a) {
+            for (size_t b = a + 1; b < productions.size(); ++b) {
+                if (productions[a].left == productions[b].left && productions[a].right == productions[b].right) {
+                    return true;
+                }
+            }
+        }
+    }
+    return false;
+}
+
+// True when some production only applies in a context
+inline bool isContextSensitive(const ProductionRules& rules) {
+    for (const auto& [symbol, productions] : rules) {
+        for (const Production& production : productions) {
+            if (production.contextual()) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+#endif // PRODUCTION_H
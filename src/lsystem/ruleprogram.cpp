@@ -0,0 +1,374 @@
+#include "ruleprogram.h"
+#include "utils/parallelfor.h"
+#include <algorithm>
+#include <array>
+#include <limits>
+
+namespace {
+
+// Expansion lengths past this stop growing; far more than could ever be derived
+constexpr size_t kSaturatedLength = std::numeric_limits<size_t>::max() / 2;
+
+// Symbols per thread below which a stochastic iteration is not worth splitting
+constexpr size_t kMinSymbolsPerThread = 1 << 16;
+
+// Marks a symbol that is kept as it is
+constexpr uint32_t kNoProduction = std::numeric_limits<uint32_t>::max();
+
+}
+
+RuleProgram::RuleProgram(const std::string& axiom, const ProductionRules& rules, const std::string& ignore) {
+    // Dense ids in order of first appearance; a char has at most 256 values, so they fit a byte
+    std::array<int, 256> ids;
+    ids.fill(-1);
+    auto idOf = [&](char symbol) {
+        int& id = ids[static_cast<uint8_t>(symbol)];
+        if (id < 0) {
+            id = static_cast<int>(m_symbols.size());
+            m_symbols.push_back(symbol);
+        }
+        return static_cast<uint8_t>(id);
+    };
+
+    for (char c : axiom) {
+        m_axiom.push_back(idOf(c));
+    }
+    for (const auto& [symbol, productions] : rules) {
+        idOf(symbol);
+        for (const Production& production : productions) {
+            for (char c : production.successor + production.left + production.right) {
+                idOf(c);
+            }
+        }
+    }
+
+    size_t count = m_symbols.size();
+    m_firstProduction.assign(count + 1, 0);
+    for (size_t id = 0; id < count; ++id) {
+        m_firstProduction[id] = static_cast<uint32_t>(m_bodyOffsets.size());
+        auto rule = rules.find(m_symbols[id]);
+        if (rule == rules.end() || rule->second.empty()) {
+            continue;
+        }
+
+        double total = 0.0;
+        for (const Production& production : rule->second) {
+            total += std::max(production.weight, 0.0);
+        }
+        double cumulative = 0.0;
+        for (const Production& production : rule->second) {
+            double weight = total > 0.0 ? std::max(production.weight, 0.0) / total : 1.0 / rule->second.size();
+            cumulative += weight;
+            m_bodyOffsets.push_back(static_cast<uint32_t>(m_bodies.size()));
+            m_cumulativeWeights.push_back(static_cast<float>(cumulative));
+            m_weights.push_back(static_cast<float>(weight));
+            for (char c : production.successor) {
+                m_bodies.push_back(idOf(c));
+            }
+
+            // The left context is stored nearest first, the way matching walks it
+            m_leftOffsets.push_back(static_cast<uint32_t>(m_contexts.size()));
+            for (auto c = production.left.rbegin(); c != production.left.rend(); ++c) {
+                m_contexts.push_back(idOf(*c));
+            }
+            m_rightOffsets.push_back(static_cast<uint32_t>(m_contexts.size()));
+            for (char c : production.right) {
+                m_contexts.push_back(idOf(c));
+            }
+        }
+        m_cumulativeWeights.back() = 1.0f;
+    }
+    m_firstProduction[count] = static_cast<uint32_t>(m_bodyOffsets.size());
+    m_bodyOffsets.push_back(static_cast<uint32_t>(m_bodies.size()));
+    m_stochastic = isStochastic(rules);
+    m_contextSensitive = isContextSensitive(rules);
+
+    // The right context of the last production ends here
+    m_leftOffsets.push_back(static_cast<uint32_t>(m_contexts.size()));
+
+    m_ignored.assign(count, 0);
+    for (size_t id = 0; id < count; ++id) {
+        m_ignored[id] = m_symbols[id] != '[' && m_symbols[id] != ']' && ignore.find(m_symbols[id]) != std::string::npos;
+    }
+    m_openId = ids[static_cast<uint8_t>('[')];
+    m_closeId = ids[static_cast<uint8_t>(']')];
+
+    m_turtleOnly = PackedSymbols::encodable(std::string(m_symbols.begin(), m_symbols.end()));
+    if (m_turtleOnly) {
+        for (char symbol : m_symbols) {
+            m_turtleCodes.push_back(static_cast<uint8_t>(PackedSymbols::code(symbol)));
+        }
+    }
+
+    // Iteration k + 1 of a symbol is the sum of iteration k over its body, the longest body if there are several
+    m_expansionLengths.assign((kMaxIterations + 1) * count, 1);
+    for (int k = 0; k < kMaxIterations; ++k) {
+        const size_t* previous = &m_expansionLengths[k * count];
+        size_t* next = &m_expansionLengths[(k + 1) * count];
+        for (size_t id = 0; id < count; ++id) {
+            if (m_firstProduction[id] == m_firstProduction[id + 1]) {
+                continue;
+            }
+            size_t longest = 0;
+            for (uint32_t p = m_firstProduction[id]; p < m_firstProduction[id + 1]; ++p) {
+                size_t length = 0;
+                for (uint32_t b = m_bodyOffsets[p]; b < m_bodyOffsets[p + 1]; ++b) {
+                    length = std::min(length + previous[m_bodies[b]], kSaturatedLength);
+                }
+                longest = std::max(longest, length);
+            }
+            next[id] = longest;
+        }
+    }
+}
+
+size_t RuleProgram::derivedSize(int iterations) const {
+    iterations = std::clamp(iterations, 0, kMaxIterations);
+    const size_t* lengths = &m_expansionLengths[iterations * m_symbols.size()];
+    size_t size = 0;
+    for (uint8_t id : m_axiom) {
+        size = std::min(size + lengths[id], kSaturatedLength);
+    }
+    return size;
+}
+
+void RuleProgram::derive(int iterations, uint32_t seed, std::string& symbols, PackedSymbols& births) const {
+    iterations = std::clamp(iterations, 0, kMaxIterations);
+    if (m_stochastic || m_contextSensitive) {
+        deriveBreadthFirst(iterations, seed, symbols, births);
+    } else {
+        deriveDepthFirst(iterations, symbols, births);
+    }
+}
+
+void RuleProgram::deriveDepthFirst(int iterations, std::string& symbols, PackedSymbols& births) const {
+    size_t size = derivedSize(iterations);
+    symbols.resize(size);
+    births.clear();
+    births.reserve(size);
+
+    // One frame per production body being walked; depth is the iteration that produced its symbols
+    struct Frame {
+        const uint8_t* next;
+        const uint8_t* end;
+        int depth;
+    };
+    std::vector<Frame> stack;
+    stack.reserve(iterations + 1);
+    stack.push_back({m_axiom.data(), m_axiom.data() + m_axiom.size(), 0});
+
+    size_t position = 0;
+    while (!stack.empty()) {
+        Frame& frame = stack.back();
+        if (frame.next == frame.end) {
+            stack.pop_back();
+            continue;
+        }
+        uint8_t id = *frame.next++;
+        int depth = frame.depth;
+        uint32_t production = m_firstProduction[id];
+        if (depth < iterations && production != m_firstProduction[id + 1]) {
+            const uint8_t* body = m_bodies.data();
+            stack.push_back({body + m_bodyOffsets[production], body + m_bodyOffsets[production + 1], depth + 1});
+            continue;
+        }
+        symbols[position++] = m_symbols[id];
+        births.push_back(static_cast<uint8_t>(depth));
+    }
+}
+
+void RuleProgram::buildContextIndex(const std::vector<uint8_t>& ids, std::vector<int32_t>& before,
+                                    std::vector<int32_t>& after) const {
+    size_t count = ids.size();
+
+    // Bracket-match index: every '[' gets its ']' and the other way round, -1 when unmatched
+    std::vector<int32_t> match;
+    if (m_turtleOnly) {
+        // Turtle strings pack to half a byte per symbol, and the packed scan only visits the bytes holding a bracket
+        PackedSymbols packed;
+        packed.reserve(count);
+        for (uint8_t id : ids) {
+            packed.push_back(m_turtleCodes[id]);
+        }
+        match = packed.matchBrackets();
+    } else {
+        match.assign(count, -1);
+        std::vector<int32_t> open;
+        for (size_t i = 0; i < count; ++i) {
+            if (ids[i] == m_openId) {
+                open.push_back(static_cast<int32_t>(i));
+            } else if (ids[i] == m_closeId && !open.empty()) {
+                match[i] = open.back();
+                match[open.back()] = static_cast<int32_t>(i);
+                open.pop_back();
+            }
+        }
+    }
+
+    // Walking back, a complete side branch is jumped over and a '[' leads on into the parent
+    before.resize(count);
+    for (size_t i = 0; i < count; ++i) {
+        int32_t previous = i > 0 ? before[i - 1] : -1;
+        if (ids[i] == m_closeId && match[i] >= 0) {
+            before[i] = match[i] > 0 ? before[match[i] - 1] : -1;
+        } else if (ids[i] == m_openId || ids[i] == m_closeId || m_ignored[ids[i]]) {
+            before[i] = previous;
+        } else {
+            before[i] = static_cast<int32_t>(i);
+        }
+    }
+
+    // Walking forward, side branches are jumped over and a ']' ends the branch
+    after.assign(count + 1, -1);
+    for (size_t i = count; i-- > 0;) {
+        if (ids[i] == m_closeId) {
+            after[i] = -1;
+        } else if (ids[i] == m_openId) {
+            after[i] = match[i] >= 0 ? after[match[i] + 1] : -1;
+        } else if (m_ignored[ids[i]]) {
+            after[i] = after[i + 1];
+        } else {
+            after[i] = static_cast<int32_t>(i);
+        }
+    }
+}
+
+bool RuleProgram::contextMatches(uint32_t production, const std::vector<uint8_t>& ids, size_t position,
+                                 const std::vector<int32_t>& before, const std::vector<int32_t>& after) const {
+    int32_t k = position > 0 ? before[position - 1] : -1;
+    for (uint32_t c = m_leftOffsets[production]; c < m_rightOffsets[production]; ++c) {
+        if (k < 0 || ids[k] != m_contexts[c]) {
+            return false;
+        }
+        k = k > 0 ? before[k - 1] : -1;
+    }
+    k = after[position + 1];
+    for (uint32_t c = m_rightOffsets[production]; c < m_leftOffsets[production + 1]; ++c) {
+        if (k < 0 || ids[k] != m_contexts[c]) {
+            return false;
+        }
+        k = after[k + 1];
+    }
+    return true;
+}
+
+uint32_t RuleProgram::pick(const std::vector<uint8_t>& ids, size_t position, const std::vector<int32_t>& before,
+                           const std::vector<int32_t>& after, const CounterRng& rng, int iteration) const {
+    uint8_t id = ids[position];
+    uint32_t first = m_firstProduction[id];
+    uint32_t last = m_firstProduction[id + 1];
+    if (first == last) {
+        return kNoProduction;
+    }
+    if (!m_contextSensitive) {
+        uint32_t production = first;
+        if (last - first > 1) {
+            float u = rng.uniform(iteration, position);
+            while (production + 1 < last && u >= m_cumulativeWeights[production]) {
+                ++production;
+            }
+        }
+        return production;
+    }
+
+    // Productions whose context matches shadow those without one; the weights of what is left are renormalized
+    auto hasContext = [&](uint32_t p) { return m_leftOffsets[p] != m_leftOffsets[p + 1]; };
+    bool contextual = false;
+    for (uint32_t p = first; p < last && !contextual; ++p) {
+        contextual = hasContext(p) && contextMatches(p, ids, position, before, after);
+    }
+    auto eligible = [&](uint32_t p) {
+        return contextual ? hasContext(p) && contextMatches(p, ids, position, before, after) : !hasContext(p);
+    };
+
+    float total = 0.0f;
+    uint32_t candidates = 0;
+    uint32_t chosen = kNoProduction;
+    for (uint32_t p = first; p < last; ++p) {
+        if (eligible(p)) {
+            total += m_weights[p];
+            ++candidates;
+            chosen = p;
+        }
+    }
+    if (candidates <= 1) {
+        return chosen;
+    }
+    float u = rng.uniform(iteration, position) * total;
+    for (uint32_t p = first; p < last; ++p) {
+        if (eligible(p) && (u -= m_weights[p]) < 0.0f) {
+            return p;
+        }
+    }
+    return chosen;
+}
+
+void RuleProgram::deriveBreadthFirst(int iterations, uint32_t seed, std::string& symbols, PackedSymbols& births) const {
+    CounterRng rng(seed);
+    std::vector<uint8_t> current = m_axiom;
+    std::vector<uint8_t> currentBirths(current.size(), 0);
+    std::vector<uint8_t> next;
+    std::vector<uint8_t> nextBirths;
+    std::vector<uint32_t> chosen;
+    std::vector<int32_t> before;
+    std::vector<int32_t> after;
+
+    for (int iteration = 1; iteration <= iterations; ++iteration) {
+        size_t count = current.size();
+        size_t chunks = parallelChunks(count, kMinSymbolsPerThread);
+        std::vector<size_t> chunkSizes(chunks + 1, 0);
+        chosen.resize(count);
+        if (m_contextSensitive) {
+            buildContextIndex(current, before, after);
+        }
+
+        // Pick every production and size each chunk's output; the picks only depend on the iteration's
+        // string and (seed, iteration, i)
+        parallelFor(count, chunks, [&](size_t chunk, size_t begin, size_t end) {
+            size_t size = 0;
+            for (size_t i = begin; i < end; ++i) {
+                uint32_t production = pick(current, i, before, after, rng, iteration);
+                chosen[i] = production;
+                size += production == kNoProduction ? 1 : m_bodyOffsets[production + 1] - m_bodyOffsets[production];
+            }
+            chunkSizes[chunk + 1] = size;
+        });
+
+        for (size_t chunk = 0; chunk < chunks; ++chunk) {
+            chunkSizes[chunk + 1] += chunkSizes[chunk];
+        }
+        next.resize(chunkSizes[chunks]);
+        nextBirths.resize(chunkSizes[chunks]);
+
+        // Each chunk writes its own range of the next iteration
+        uint8_t born = static_cast<uint8_t>(std::min(iteration, 15));
+        parallelFor(count, chunks, [&](size_t chunk, size_t begin, size_t end) {
+            size_t out = chunkSizes[chunk];
+            for (size_t i = begin; i < end; ++i) {
+                uint32_t production = chosen[i];
+                if (production == kNoProduction) {
+                    next[out] = current[i];
+                    nextBirths[out] = currentBirths[i];
+                    ++out;
+                    continue;
+                }
+                uint32_t bodyBegin = m_bodyOffsets[production];
+                uint32_t bodyEnd = m_bodyOffsets[production + 1];
+                std::copy(m_bodies.begin() + bodyBegin, m_bodies.begin() + bodyEnd, next.begin() + out);
+                std::fill(nextBirths.begin() + out, nextBirths.begin() + out + (bodyEnd - bodyBegin), born);
+                out += bodyEnd - bodyBegin;
+            }
+        });
+
+        current.swap(next);
+        currentBirths.swap(nextBirths);
+    }
+
+    symbols.resize(current.size());
+    births.clear();
+    births.reserve(current.size());
+    for (size_t i = 0; i < current.size(); ++i) {
+        symbols[i] = m_symbols[current[i]];
+        births.push_back(currentBirths[i]);
+    }
+}
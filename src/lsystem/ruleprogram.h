@@ -0,0 +1,81 @@
+#ifndef RULEPROGRAM_H
+#define RULEPROGRAM_H
+
+#include "counterrng.h"
+#include "packedsymbols.h"
+#include "production.h"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// A grammar compiled once into flat tables: symbols renumbered densely, every production body a range of one
+// shared array, and the length every symbol expands to after each iteration count. Deriving from it
+// needs no map probes and, for deterministic grammars, writes the final string in one pass without
+// intermediate strings
+class RuleProgram
+{
+public:
+    // Births saturate at 15 (see PackedSymbols), so there is no point deriving further
+    static constexpr int kMaxIterations = 15;
+
+    // Context matching skips the symbols in ignore, see derive
+    RuleProgram(const std::string& axiom, const ProductionRules& rules, const std::string& ignore = kDefaultContextIgnore);
+
+    bool stochastic() const { return m_stochastic; }
+    bool contextSensitive() const { return m_contextSensitive; }
+
+    // Whether every symbol of the grammar is in the PackedSymbols alphabet
+    bool turtleOnly() const { return m_turtleOnly; }
+
+    // Length of the string after iterations, clamped to kMaxIterations; saturates instead of overflowing.
+    // Exact for deterministic context-free grammars, otherwise an upper bound taking the longest production
+    size_t derivedSize(int iterations) const;
+
+    // Derive iterations times, clamped to kMaxIterations. births gets the iteration that last rewrote each
+    // symbol, like LSystem::birthIterations. Deterministic context-free grammars expand depth first straight
+    // into symbols and ignore seed. The others rewrite a whole iteration at a time, the symbol at position i
+    // of iteration k picking its production from CounterRng(seed) at (k, i); large iterations are split
+    // across threads with the same result as on one.
+    // Contexts are matched along the branch structure: the left context walks back to the parent past
+    // complete side branches, the right context walks forward along the same branch past side branches and
+    // fails at its end. Ignored symbols are skipped both ways. A bracket-match index built once per iteration
+    // turns each walk into jumps, so matching stays linear in the string
+    void derive(int iterations, uint32_t seed, std::string& symbols, PackedSymbols& births) const;
+
+private:
+    void deriveDepthFirst(int iterations, std::string& symbols, PackedSymbols& births) const;
+    void deriveBreadthFirst(int iterations, uint32_t seed, std::string& symbols, PackedSymbols& births) const;
+
+    // For every position the nearest context symbol at or before it (before) and at or after it (after)
+    // along the branch structure, -1 where there is none
+    void buildContextIndex(const std::vector<uint8_t>& ids, std::vector<int32_t>& before, std::vector<int32_t>& after) const;
+    bool contextMatches(uint32_t production, const std::vector<uint8_t>& ids, size_t position,
+                        const std::vector<int32_t>& before, const std::vector<int32_t>& after) const;
+
+    // Production of the symbol at position, or kNoProduction to keep it. Matching contexts win over none,
+    // and several candidates are weighed with rng at (iteration, position)
+    uint32_t pick(const std::vector<uint8_t>& ids, size_t position, const std::vector<int32_t>& before,
+                  const std::vector<int32_t>& after, const CounterRng& rng, int iteration) const;
+
+    bool m_stochastic = false;
+    bool m_contextSensitive = false;
+    std::vector<char> m_symbols;             // Symbol of every id
+    std::vector<uint8_t> m_axiom;            // Ids of the axiom
+    std::vector<uint32_t> m_firstProduction; // Productions of id i are m_firstProduction[i] .. m_firstProduction[i + 1]
+    std::vector<uint32_t> m_bodyOffsets;     // Body of production p is m_bodies[m_bodyOffsets[p] .. m_bodyOffsets[p + 1]]
+    std::vector<uint8_t> m_bodies;           // Ids of every production body, back to back
+    std::vector<float> m_cumulativeWeights;  // Per production, its symbol's weights up to and including it, summing to 1
+    std::vector<float> m_weights;            // Per production, its own weight
+    std::vector<uint32_t> m_leftOffsets;     // Left context of production p is m_contexts[m_leftOffsets[p] .. m_rightOffsets[p]],
+    std::vector<uint32_t> m_rightOffsets;    // its right context m_contexts[m_rightOffsets[p] .. m_leftOffsets[p + 1]]
+    std::vector<uint8_t> m_contexts;         // Ids of every context, nearest symbol first
+    std::vector<uint8_t> m_ignored;          // Per id, whether context matching skips it
+    int m_openId = -1;                       // Id of '[' and ']', -1 when the grammar has none
+    int m_closeId = -1;
+    bool m_turtleOnly = false;               // Whether every symbol has a PackedSymbols code
+    std::vector<uint8_t> m_turtleCodes;      // Per id, its PackedSymbols code when m_turtleOnly
+    std::vector<size_t> m_expansionLengths;  // [iterations * symbol count + id]: length id turns into
+};
+
+#endif // RULEPROGRAM_H
@@ -0,0 +1,307 @@
+#include "spacecolonization.h"
+#include "counterrng.h"
+#include "utils/parallelfor.h"
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+// Attractors per thread below which a query pass is not worth splitting
+constexpr size_t kMinAttractorsPerThread = 1 << 12;
+
+// Tries at sampling a point inside the crown before giving up on it; each succeeds with probability pi / 6
+constexpr int kSampleAttempts = 32;
+
+// Nodes bucketed by position into cells one influence radius wide, so any node within that radius of a
+// point is in the point's cell or one of its 26 neighbours. Only the crown, widened by the radius, is
+// covered: nodes outside it are too far from every attractor to matter
+class NodeGrid {
+public:
+    NodeGrid(const glm::vec3& low, const glm::vec3& high, float cellSize)
+        : m_low(low), m_cellSize(cellSize),
+          m_dimensions(glm::max(glm::ivec3(glm::ceil((high - low) / cellSize)), glm::ivec3(1))),
+          m_cells(static_cast<size_t>(m_dimensions.x) * m_dimensions.y * m_dimensions.z),
+          m_near(m_cells.size(), 0) {}
+
+    // Cell of position, -1 outside the grid
+    int cellOf(const glm::vec3& position) const {
+        glm::ivec3 cell = glm::ivec3(glm::floor((position - m_low) / m_cellSize));
+        if (glm::any(glm::lessThan(cell, glm::ivec3(0))) || glm::any(glm::greaterThanEqual(cell, m_dimensions))) {
+            return -1;
+        }
+        return (cell.z * m_dimensions.y + cell.y) * m_dimensions.x + cell.x;
+    }
+
+    void clear() {
+        for (int cell : m_used) {
+            m_cells[cell].clear();
+        }
+        m_used.clear();
+        std::fill(m_near.begin(), m_near.end(), 0);
+    }
+
+    // Add a node and flag every cell within one cell of it, whose points may now have a nearer node
+    void insert(uint32_t node, const glm::vec3& position) {
+        int cell = cellOf(position);
+        if (cell < 0) {
+            return;
+        }
+        if (m_cells[cell].empty()) {
+            m_used.push_back(cell);
+        }
+        m_cells[cell].push_back(node);
+        forNeighbours(cell, [&](int neighbour) { m_near[neighbour] = 1; });
+    }
+
+    // Whether some node was inserted near cell since the last clear
+    bool near(int cell) const { return cell >= 0 && m_near[cell]; }
+
+    // Lower nearest and distance2 to the closest node in the cells around cell, if any is closer
+    void closest(int cell, const glm::vec3& point, const std::vector<glm::vec3>& nodes, int& nearest, float& distance2) const {
+        forNeighbours(cell, [&](int neighbour) {
+            for (uint32_t node : m_cells[neighbour]) {
+                glm::vec3 offset = nodes[node] - point;
+                float d2 = glm::dot(offset, offset);
+                if (d2 < distance2) {
+                    distance2 = d2;
+                    nearest = static_cast<int>(node);
+                }
+            }
+        });
+    }
+
+private:
+    template <typename Visit>
+    void forNeighbours(int cell, Visit&& visit) const {
+        glm::ivec3 center(cell % m_dimensions.x, (cell / m_dimensions.x) % m_dimensions.y, cell / (m_dimensions.x * m_dimensions.y));
+        glm::ivec3 low = glm::max(center - 1, glm::ivec3(0));
+        glm::ivec3 high = glm::min(center + 1, m_dimensions - 1);
+        for (int z = low.z; z <= high.z; ++z) {
+            for (int y = low.y; y <= high.y; ++y) {
+                for (int x = low.x; x <= high.x; ++x) {
+                    visit((z * m_dimensions.y + y) * m_dimensions.x + x);
+                }
+            }
+        }
+    }
+
+    glm::vec3 m_low;
+    float m_cellSize;
+    glm::ivec3 m_dimensions;
+    std::vector<std::vector<uint32_t>> m_cells;
+    std::vector<int> m_used;      // Cells holding nodes, to clear only those
+    std::vector<uint8_t> m_near;  // Per cell, whether a node went into it or a neighbour
+};
+
+}
+
+std::vector<TreeSegment> SpaceColonization::grow() {
+    const ColonizationParameters& p = m_parameters;
+
+    // Attractors are uniform in the crown ellipsoid; point i only depends on (seed, i)
+    CounterRng rng(p.seed);
+    size_t attractorCount = static_cast<size_t>(std::max(p.attractors, 0));
+    std::vector<glm::vec3> attractors(attractorCount);
+    std::vector<uint8_t> sampled(attractorCount, 0);
+    parallelFor(attractorCount, parallelChunks(attractorCount, kMinAttractorsPerThread), [&](size_t, size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            for (int attempt = 0; attempt < kSampleAttempts && !sampled[i]; ++attempt) {
+                glm::vec3 unit(rng.uniform(3 * attempt, i), rng.uniform(3 * attempt + 1, i), rng.uniform(3 * attempt + 2, i));
+                unit = unit * 2.0f - 1.0f;
+                if (glm::dot(unit, unit) <= 1.0f) {
+                    attractors[i] = p.crownCenter + unit * p.crownRadii;
+                    sampled[i] = 1;
+                }
+            }
+        }
+    });
+    size_t kept = 0;
+    for (size_t i = 0; i < attractorCount; ++i) {
+        if (sampled[i]) {
+            attractors[kept++] = attractors[i];
+        }
+    }
+    attractors.resize(kept);
+
+    // Nodes in the order they grew, so every parent comes before its children
+    std::vector<glm::vec3> nodes = {p.root};
+    std::vector<int> parents = {-1};
+    std::vector<int> born = {0};
+    std::vector<glm::vec3> directions = {glm::vec3(0.0f, 1.0f, 0.0f)}; // From the parent, unit length
+    std::vector<int> firstChild = {-1};
+    std::vector<int> nextSibling = {-1};
+    auto addNode = [&](int parent, const glm::vec3& direction, int iteration) {
+        int node = static_cast<int>(nodes.size());
+        nodes.push_back(nodes[parent] + direction * p.segmentLength);
+        parents.push_back(parent);
+        born.push_back(iteration);
+        directions.push_back(direction);
+        firstChild.push_back(-1);
+        nextSibling.push_back(firstChild[parent]);
+        firstChild[parent] = node;
+    };
+
+    // Nodes are only ever added, so an attractor's nearest node only changes when a new one lands near it.
+    // The grid holds just the nodes added by the last iteration, and attractors away from all of them skip
+    // the search entirely
+    NodeGrid grid(p.crownCenter - p.crownRadii - p.influenceRadius, p.crownCenter + p.crownRadii + p.influenceRadius,
+                  p.influenceRadius);
+    grid.insert(0, p.root);
+    std::vector<int> cells(attractors.size());
+    std::vector<int> nearest(attractors.size(), -1);
+    std::vector<float> distance2(attractors.size(), p.influenceRadius * p.influenceRadius);
+    for (size_t a = 0; a < attractors.size(); ++a) {
+        cells[a] = grid.cellOf(attractors[a]);
+    }
+
+    std::vector<glm::vec3> pull;
+    std::vector<int> pullCount;
+    bool reachedCrown = false;
+    float kill2 = p.killRadius * p.killRadius;
+    m_iterations = 0;
+    for (int iteration = 1; iteration <= p.maxIterations && !attractors.empty(); ++iteration) {
+        parallelFor(attractors.size(), parallelChunks(attractors.size(), kMinAttractorsPerThread),
+                    [&](size_t, size_t begin, size_t end) {
+            for (size_t a = begin; a < end; ++a) {
+                if (grid.near(cells[a])) {
+                    grid.closest(cells[a], attractors[a], nodes, nearest[a], distance2[a]);
+                }
+            }
+        });
+
+        // Attractors a node reached are consumed; the rest pull their nearest node. Directions are summed in
+        // attractor order, so the sums do not depend on how the queries were split
+        size_t nodeCount = nodes.size();
+        pull.assign(nodeCount, glm::vec3(0.0f));
+        pullCount.assign(nodeCount, 0);
+        size_t alive = 0;
+        for (size_t a = 0; a < attractors.size(); ++a) {
+            if (nearest[a] >= 0 && distance2[a] < kill2) {
+                continue;
+            }
+            if (nearest[a] >= 0) {
+                pull[nearest[a]] += glm::normalize(attractors[a] - nodes[nearest[a]]);
+                ++pullCount[nearest[a]];
+            }
+            attractors[alive] = attractors[a];
+            cells[alive] = cells[a];
+            nearest[alive] = nearest[a];
+            distance2[alive] = distance2[a];
+            ++alive;
+        }
+        attractors.resize(alive);
+        cells.resize(alive);
+        nearest.resize(alive);
+        distance2.resize(alive);
+
+        grid.clear();
+        bool grew = false;
+        for (size_t node = 0; node < nodeCount; ++node) {
+            // Attractors on opposite sides cancel out and would leave the node stuck in place
+            if (pullCount[node] == 0 || glm::dot(pull[node], pull[node]) < 1e-8f) {
+                continue;
+            }
+
+            // Attractors the last child did not get any closer to pull the same way again; growing there
+            // twice would only stack copies of that child
+            glm::vec3 direction = glm::normalize(pull[node]);
+            bool repeated = false;
+            for (int child = firstChild[node]; child >= 0 && !repeated; child = nextSibling[child]) {
+                repeated = glm::dot(directions[child], direction) > 0.99f;
+            }
+            if (repeated) {
+                continue;
+            }
+            addNode(static_cast<int>(node), direction, iteration);
+            grid.insert(static_cast<uint32_t>(nodes.size() - 1), nodes.back());
+            grew = true;
+        }
+
+        // Until the first attractor pulls, the trunk grows straight up towards the crown
+        if (!grew && !reachedCrown) {
+            addNode(static_cast<int>(nodes.size() - 1), glm::vec3(0.0f, 1.0f, 0.0f), iteration);
+            grid.insert(static_cast<uint32_t>(nodes.size() - 1), nodes.back());
+            grew = true;
+        }
+        reachedCrown = reachedCrown || std::any_of(pullCount.begin(), pullCount.end(), [](int count) { return count > 0; });
+
+        m_iterations = iteration;
+        if (!grew) {
+            break;
+        }
+    }
+
+    // Pipe model from the tips down, counting tips on the way; children always come after their parent
+    size_t nodeCount = nodes.size();
+    std::vector<float> pipe(nodeCount, 0.0f);
+    std::vector<int> tips(nodeCount, 0);
+    std::vector<int> continuation(nodeCount, -1); // Child with the most tips, the branch's continuation
+    float tipPipe = std::pow(p.tipThickness, p.pipeExponent);
+    for (size_t node = nodeCount; node-- > 1;) {
+        if (tips[node] == 0) {
+            tips[node] = 1;
+            pipe[node] = tipPipe;
+        }
+        int parent = parents[node];
+        pipe[parent] += pipe[node];
+        tips[parent] += tips[node];
+        if (continuation[parent] < 0 || tips[node] > tips[continuation[parent]]) {
+            continuation[parent] = static_cast<int>(node);
+        }
+    }
+
+    // Wind pivots like the turtle's: a side child starts a branch where it leaves its parent, golden-ratio
+    // phase steps keep siblings apart
+    struct SwayBranch {
+        glm::vec3 origin;
+        float phase;
+        float parentPhase;
+        float parentReach;
+        int depth;
+    };
+    std::vector<SwayBranch> branches(nodeCount);
+    branches[0] = {p.root, 0.0f, 0.0f, 0.0f, 0};
+    int branchCount = 0;
+
+    int lastIteration = std::max(m_iterations, 1) + (p.leaves ? 1 : 0);
+    std::vector<TreeSegment> segments;
+    segments.reserve(nodeCount * (p.leaves ? 2 : 1));
+    for (size_t node = 1; node < nodeCount; ++node) {
+        int parent = parents[node];
+        const SwayBranch& parentBranch = branches[parent];
+        if (continuation[parent] == static_cast<int>(node)) {
+            branches[node] = parentBranch;
+        } else {
+            float phase = std::fmod(parentBranch.phase + 0.618034f * static_cast<float>(++branchCount), 1.0f);
+            branches[node] = {nodes[parent], phase, parentBranch.phase, glm::length(nodes[parent] - parentBranch.origin),
+                              parentBranch.depth + 1};
+        }
+        const SwayBranch& branch = branches[node];
+
+        float thickness = std::pow(pipe[node], 1.0f / p.pipeExponent);
+        TreeSegment segment = {branch.depth == 0 ? SegmentKind::Trunk : SegmentKind::Branch, nodes[parent], nodes[node],
+                               thickness, branch.depth};
+        segment.origin = branch.origin;
+        segment.phase = branch.phase;
+        segment.parentPhase = branch.parentPhase;
+        segment.parentReach = branch.parentReach;
+        segment.birth = static_cast<float>(born[node] - 1) / lastIteration;
+        segment.grown = static_cast<float>(born[node]) / lastIteration;
+        segments.push_back(segment);
+
+        if (p.leaves && continuation[node] < 0) {
+            glm::vec3 direction = glm::normalize(nodes[node] - nodes[parent]);
+            glm::vec3 across = std::abs(direction.y) < 0.9f ? glm::vec3(0.0f, 1.0f, 0.0f) : glm::vec3(1.0f, 0.0f, 0.0f);
+            TreeSegment leaf = {SegmentKind::Leaf, nodes[node], nodes[node] + direction * p.segmentLength, 0.05f,
+                                branch.depth, 1, 3, glm::normalize(glm::cross(direction, across))};
+            leaf.origin = segment.origin;
+            leaf.phase = segment.phase;
+            leaf.parentPhase = segment.parentPhase;
+            leaf.parentReach = segment.parentReach;
+            leaf.birth = segment.grown;
+            leaf.grown = static_cast<float>(born[node] + 1) / lastIteration;
+            segments.push_back(leaf);
+        }
+    }
+    return segments;
+}
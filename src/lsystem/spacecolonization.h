@@ -0,0 +1,47 @@
+#ifndef SPACECOLONIZATION_H
+#define SPACECOLONIZATION_H
+
+#include "treesegment.h"
+#include <cstdint>
+#include <vector>
+
+// Shape of the crown and growth rules of a space colonization tree, in the units the turtle draws in
+struct ColonizationParameters {
+    int attractors = 20000;                          // Points filling the crown, consumed as branches reach them
+    glm::vec3 root = glm::vec3(0.0f, -0.5f, 0.0f);   // Where the trunk starts, like the turtle
+    glm::vec3 crownCenter = glm::vec3(0.0f, 2.0f, 0.0f);
+    glm::vec3 crownRadii = glm::vec3(1.5f, 1.2f, 1.5f); // The crown is this ellipsoid
+    float segmentLength = 0.06f;   // Distance a node grows per iteration
+    float influenceRadius = 0.5f;  // Attractors only pull nodes this close
+    float killRadius = 0.12f;      // Attractors this close to a node are consumed
+    int maxIterations = 400;
+    float tipThickness = 0.006f;   // Diameter of the outermost twigs
+    float pipeExponent = 2.5f;     // A parent's diameter^exponent is the sum over its children's
+    bool leaves = false;           // End every twig in a leaf
+    uint32_t seed = 1;             // Seeds the attractor positions
+};
+
+// Grows a tree towards attractor points scattered through a crown volume (Runions et al.). Every
+// iteration each attractor finds its nearest node within the influence radius, each node with attractors
+// grows one segment towards their mean direction, and attractors a node reached are removed. Nearest-node
+// queries go through a uniform grid of cells one influence radius wide and are split across threads by
+// attractor. The result is the same segment list the turtle produces, so every rendering path takes it
+class SpaceColonization
+{
+public:
+    explicit SpaceColonization(const ColonizationParameters& parameters) : m_parameters(parameters) {}
+
+    // Grow the tree. Thickness follows the pipe model from the tips down, branch depth and wind pivots
+    // follow the largest child as the continuing branch, and growth times come from the iteration every
+    // node appeared in, scaled into [0, 1]
+    std::vector<TreeSegment> grow();
+
+    // Iterations the last grow() ran
+    int iterations() const { return m_iterations; }
+
+private:
+    ColonizationParameters m_parameters;
+    int m_iterations = 0;
+};
+
+#endif // SPACECOLONIZATION_H
@@ -0,0 +1,98 @@
+#include "tessellationpolicy.h"
+#include <algorithm>
+#include <cmath>
+#include <glm/gtc/constants.hpp>
+
+namespace {
+
+// Finest tessellation any segment gets, the old fixed 12x12
+constexpr int kMaxRadialSegments = 12;
+constexpr int kMaxHeightSegments = 4;
+
+// Smallest counts the generators accept
+constexpr int kMinRadialSegments = 3;
+constexpr int kMinLeafStacks = 2;
+
+// Target edge length around the circumference; the thickest trunk (0.08) gets the full 12 slices
+constexpr float kRadialEdge = glm::pi<float>() * 0.08f / kMaxRadialSegments;
+
+// One height segment per this much length, so long segments can still bend once they are animated
+constexpr float kHeightEdge = 0.5f;
+
+}
+
+TessellationPolicy::TessellationPolicy(int triangleBudget)
+    : m_triangleBudget(triangleBudget) {}
+
+void TessellationPolicy::choose(TreeSegment& segment) const {
+    int radial = static_cast<int>(std::ceil(glm::pi<float>() * segment.thickness / kRadialEdge));
+
+    // Every two levels of nesting drop one slice, deep twigs are rarely seen up close
+    radial -= segment.depth / 2;
+    radial = std::clamp(radial, kMinRadialSegments, kMaxRadialSegments);
+
+    if (segment.kind == SegmentKind::Leaf) {
+        segment.radialSegments = radial;
+        segment.heightSegments = std::max(kMinLeafStacks, radial / 2);
+        return;
+    }
+
+    float length = glm::length(segment.end - segment.start);
+    int height = static_cast<int>(std::ceil(length / kHeightEdge));
+    segment.radialSegments = radial;
+    segment.heightSegments = std::clamp(height, 1, kMaxHeightSegments);
+}
+
+int TessellationPolicy::triangleCount(const TreeSegment& segment) {
+    if (segment.kind == SegmentKind::Leaf) {
+        return 2 * segment.heightSegments * segment.radialSegments;
+    }
+
+    // Cylinder body plus two caps, each cap has as many rings as the body has stacks
+    return 6 * segment.heightSegments * segment.radialSegments;
+}
+
+void TessellationPolicy::apply(std::vector<TreeSegment>& segments) const {
+    int total = 0;
+    for (TreeSegment& segment : segments) {
+        choose(segment);
+        total += triangleCount(segment);
+    }
+
+    if (m_triangleBudget <= 0 || total <= m_triangleBudget) {
+        return;
+    }
+
+    // Over budget: strip detail from the deepest segments first, widening to one more level of
+    // nesting each pass, until the tree fits or everything sits at the generators' minimum
+    int maxDepth = 0;
+    for (const TreeSegment& segment : segments) {
+        maxDepth = std::max(maxDepth, segment.depth);
+    }
+
+    for (int depth = maxDepth; total > m_triangleBudget; depth = std::max(depth - 1, 0)) {
+        bool reduced = false;
+
+        for (TreeSegment& segment : segments) {
+            if (segment.depth < depth) {
+                continue;
+            }
+
+            int before = triangleCount(segment);
+            int minStacks = segment.kind == SegmentKind::Leaf ? kMinLeafStacks : 1;
+            segment.heightSegments = std::max(minStacks, segment.heightSegments / 2);
+            segment.radialSegments = std::max(kMinRadialSegments, segment.radialSegments * 2 / 3);
+
+            int after = triangleCount(segment);
+            reduced = reduced || after < before;
+            total -= before - after;
+            if (total <= m_triangleBudget) {
+                break;
+            }
+        }
+
+        if (!reduced && depth == 0) {
+            break;
+        }
+    }
+}
@@ -0,0 +1,27 @@
+#ifndef TESSELLATIONPOLICY_H
+#define TESSELLATIONPOLICY_H
+
+#include <vector>
+#include "lsystem/treesegment.h"
+
+// Chooses how finely each tree segment is tessellated.
+// Radial detail follows the segment's circumference, height detail its length, and deeper
+// branches get less of both; the whole tree is then fit into a triangle budget
+class TessellationPolicy
+{
+public:
+    explicit TessellationPolicy(int triangleBudget);
+
+    // Fill in heightSegments and radialSegments of every segment
+    void apply(std::vector<TreeSegment>& segments) const;
+
+    // Triangles the generators emit for one segment at its current tessellation
+    static int triangleCount(const TreeSegment& segment);
+
+private:
+    void choose(TreeSegment& segment) const;
+
+    int m_triangleBudget;
+};
+
+#endif // TESSELLATIONPOLICY_H
@@ -0,0 +1,38 @@
+#ifndef TREESEGMENT_H
+#define TREESEGMENT_H
+
+#include <glm/glm.hpp>
+
+// What a turtle move draws
+enum class SegmentKind {
+    Trunk,  // 'F'
+    Branch, // 'X'
+    Leaf    // 'L'
+};
+
+// One piece of geometry produced by walking an L-system string, before it is meshed
+struct TreeSegment {
+    SegmentKind kind;
+    glm::vec3 start;        // Turtle position before the move
+    glm::vec3 end;          // Turtle position after the move
+    float thickness;        // Diameter of the segment
+    int depth;              // Bracket nesting of the move, 0 on the trunk
+    int heightSegments = 1; // Tessellation along the segment (stacks for leaves), set by TessellationPolicy
+    int radialSegments = 3; // Tessellation around the segment (slices for leaves), set by TessellationPolicy
+    glm::vec3 side = glm::vec3(0.0f); // Turtle's right direction during the move, orients leaf cards
+    glm::vec3 origin = glm::vec3(0.0f); // Where the branch holding the move leaves its parent, the pivot of its wind sway
+    float phase = 0.0f;       // Wind sway phase of that branch, in [0, 1)
+    float parentPhase = 0.0f; // Wind sway phase of the parent branch
+    float parentReach = 0.0f; // Distance from the parent branch's origin to origin
+    float birth = 0.0f;       // Growth timeline in [0, 1]: the segment starts growing from start at birth
+    float grown = 0.0f;       // and reaches full length at grown
+
+    // Wind hierarchy in the layout the vertex shaders read, see windOffset in animation.glsl
+    glm::vec4 windOrigin() const { return glm::vec4(origin, static_cast<float>(depth) + glm::min(phase, 0.99f)); }
+    glm::vec2 windParent() const { return glm::vec2(parentPhase, parentReach); }
+
+    // Growth anchor and birth in the layout the vertex shaders read, see grow in animation.glsl
+    glm::vec4 growthStart() const { return glm::vec4(start, birth); }
+};
+
+#endif // TREESEGMENT_H
@@ -0,0 +1,281 @@
+#include "tubemesher.h"
+#include <algorithm>
+#include <cmath>
+#include <glm/gtc/constants.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+namespace {
+
+// Joints closer than this are treated as the same point when linking segments
+constexpr float kWeldDistance = 1e-4f;
+
+// One cross-section of the tube
+struct Ring {
+    glm::vec3 center;
+    glm::vec3 tangent;
+    glm::vec3 normal;  // Transported reference direction, angle 0 of the ring
+    float radius;
+    float slope;       // Change of radius per unit length, tilts the normals of tapered tubes
+    float v;           // Texture coordinate along the chain, one repeat per segment like Cylinder
+};
+
+glm::vec3 anyPerpendicular(const glm::vec3& direction) {
+    glm::vec3 axis = std::abs(direction.y) < 0.9f ? glm::vec3(0.0f, 1.0f, 0.0f) : glm::vec3(1.0f, 0.0f, 0.0f);
+    return glm::normalize(glm::cross(axis, direction));
+}
+
+// Carry the reference direction from one ring to the next with the double reflection method,
+// which keeps the frame from twisting around the tube
+glm::vec3 transport(const Ring& from, const glm::vec3& center, const glm::vec3& tangent) {
+    glm::vec3 v1 = center - from.center;
+    float c1 = glm::dot(v1, v1);
+    if (c1 < 1e-12f) {
+        return from.normal;
+    }
+    glm::vec3 normalL = from.normal - (2.0f / c1) * glm::dot(v1, from.normal) * v1;
+    glm::vec3 tangentL = from.tangent - (2.0f / c1) * glm::dot(v1, from.tangent) * v1;
+
+    glm::vec3 v2 = tangent - tangentL;
+    float c2 = glm::dot(v2, v2);
+    glm::vec3 normal = c2 < 1e-12f ? normalL : normalL - (2.0f / c2) * glm::dot(v2, normalL) * v2;
+
+    // Re-orthogonalize against rounding drift over long chains
+    normal -= glm::dot(normal, tangent) * tangent;
+    return glm::normalize(normal);
+}
+
+void pushVertex(const glm::vec3& position, const glm::vec3& normal, const glm::vec2& uv, std::vector<float>& vbo) {
+    vbo.insert(vbo.end(), {position.x, position.y, position.z, normal.x, normal.y, normal.z, uv.x, uv.y});
+}
+
+// Smallest counts a coarser level keeps, like TessellationPolicy's
+constexpr int kMinRadialSegments = 3;
+constexpr int kMinRings = 1;
+
+int scaled(int count, float detail, int minimum) {
+    return std::max(minimum, static_cast<int>(std::lround(count * detail)));
+}
+
+// Sweep: heightSegments rings per segment, scaled by detail; joint rings use the averaged tangent of both sides
+std::vector<Ring> sweep(const std::vector<TreeSegment>& segments, const std::vector<int>& indices, float detail = 1.0f) {
+    std::vector<Ring> rings;
+    for (size_t s = 0; s < indices.size(); ++s) {
+        const TreeSegment& segment = segments[indices[s]];
+        glm::vec3 axis = segment.end - segment.start;
+        float length = glm::length(axis);
+        glm::vec3 direction = length > 0.0f ? axis / length : glm::vec3(0.0f, 1.0f, 0.0f);
+
+        // Thickness is a diameter; the radius runs towards the next segment's, or stays put at the tip
+        float startRadius = 0.5f * segment.thickness;
+        float endRadius = s + 1 < indices.size() ? 0.5f * segments[indices[s + 1]].thickness : startRadius;
+        float slope = length > 0.0f ? (endRadius - startRadius) / length : 0.0f;
+
+        int ringCount = detail == 1.0f ? segment.heightSegments : scaled(segment.heightSegments, detail, kMinRings);
+        for (int j = 0; j < ringCount; ++j) {
+            float t = static_cast<float>(j) / ringCount;
+            glm::vec3 tangent = direction;
+            if (j == 0 && s > 0) {
+                glm::vec3 previous = glm::normalize(segments[indices[s - 1]].end - segments[indices[s - 1]].start);
+                glm::vec3 sum = previous + direction;
+                tangent = glm::dot(sum, sum) > 1e-6f ? glm::normalize(sum) : direction;
+            }
+
+            Ring ring;
+            ring.center = segment.start + t * axis;
+            ring.tangent = tangent;
+            ring.normal = rings.empty() ? anyPerpendicular(tangent) : transport(rings.back(), ring.center, tangent);
+            ring.radius = glm::mix(startRadius, endRadius, t);
+            ring.slope = slope;
+            ring.v = static_cast<float>(s) + t;
+            rings.push_back(ring);
+        }
+
+        if (s + 1 == indices.size()) {
+            Ring tip;
+            tip.center = segment.end;
+            tip.tangent = direction;
+            tip.normal = transport(rings.back(), tip.center, direction);
+            tip.radius = endRadius;
+            tip.slope = slope;
+            tip.v = static_cast<float>(s) + 1.0f;
+            rings.push_back(tip);
+        }
+    }
+    return rings;
+}
+
+}
+
+TubeMesher::TubeMesher(const std::vector<TreeSegment>& segments)
+    : m_segments(segments) {
+    findChains();
+}
+
+// A segment continues the open chain at its own bracket depth when it starts where that chain ends
+// and is of the same kind; anything deeper was closed by a ']' and can no longer be continued
+void TubeMesher::findChains() {
+    std::vector<int> openChain; // Chain index per bracket depth, -1 when none
+
+    for (int i = 0; i < static_cast<int>(m_segments.size()); ++i) {
+        const TreeSegment& segment = m_segments[i];
+        if (segment.kind == SegmentKind::Leaf) {
+            continue;
+        }
+
+        int depth = segment.depth;
+        openChain.resize(depth + 1, -1);
+
+        int chain = openChain[depth];
+        if (chain >= 0) {
+            const TreeSegment& last = m_segments[m_chains[chain].back()];
+            if (last.kind != segment.kind || glm::length(last.end - segment.start) > kWeldDistance) {
+                chain = -1;
+            }
+        }
+
+        if (chain < 0) {
+            chain = static_cast<int>(m_chains.size());
+            m_chains.emplace_back();
+            openChain[depth] = chain;
+        }
+        m_chains[chain].push_back(i);
+    }
+}
+
+SegmentKind TubeMesher::kind(size_t chain) const {
+    return m_segments[m_chains[chain].front()].kind;
+}
+
+int TubeMesher::triangleCount(size_t chain) const {
+    int radial = 0;
+    int rings = 0;
+    for (int index : m_chains[chain]) {
+        radial = std::max(radial, m_segments[index].radialSegments);
+        rings += m_segments[index].heightSegments;
+    }
+
+    // Body between consecutive rings plus the fan over the tip
+    return 2 * rings * radial + radial;
+}
+
+std::vector<TubeMesher::Joint> TubeMesher::joints(size_t chain) const {
+    const std::vector<int>& indices = m_chains[chain];
+    std::vector<Ring> rings = sweep(m_segments, indices);
+
+    // Every segment starts with its joint ring, followed by its heightSegments - 1 inner rings
+    std::vector<Joint> joints;
+    joints.reserve(indices.size() + 1);
+    size_t ring = 0;
+    for (int index : indices) {
+        const Ring& joint = rings[ring];
+        joints.push_back({joint.center, joint.tangent, joint.normal, joint.radius});
+        ring += m_segments[index].heightSegments;
+    }
+    const Ring& tip = rings.back();
+    joints.push_back({tip.center, tip.tangent, tip.normal, tip.radius});
+    return joints;
+}
+
+void TubeMesher::mesh(size_t chain, std::vector<float>& vertices, glm::mat4& modelMatrix) const {
+    std::vector<std::vector<float>> levels;
+    meshLevels(chain, {1.0f}, levels, modelMatrix);
+    vertices = std::move(levels.front());
+}
+
+void TubeMesher::meshLevels(size_t chain, const std::vector<float>& details, std::vector<std::vector<float>>& levels,
+                            glm::mat4& modelMatrix) const {
+    levels.resize(details.size());
+    for (size_t level = 0; level < details.size(); ++level) {
+        sweepMesh(chain, details[level], levels[level]);
+    }
+
+    // Move the tube into its unit box. Normals are stretched by the box size so that the inverse
+    // transpose of modelMatrix, which the shaders apply, turns them back into world-space normals
+    glm::vec3 boxMin(levels[0][0], levels[0][1], levels[0][2]);
+    glm::vec3 boxMax = boxMin;
+    for (const std::vector<float>& vertices : levels) {
+        for (size_t v = 0; v < vertices.size(); v += 8) {
+            glm::vec3 position(vertices[v], vertices[v + 1], vertices[v + 2]);
+            boxMin = glm::min(boxMin, position);
+            boxMax = glm::max(boxMax, position);
+        }
+    }
+    glm::vec3 center = 0.5f * (boxMin + boxMax);
+    glm::vec3 size = glm::max(boxMax - boxMin, glm::vec3(1e-5f));
+
+    for (std::vector<float>& vertices : levels) {
+        for (size_t v = 0; v < vertices.size(); v += 8) {
+            glm::vec3 position = (glm::vec3(vertices[v], vertices[v + 1], vertices[v + 2]) - center) / size;
+            glm::vec3 normal = glm::normalize(glm::vec3(vertices[v + 3], vertices[v + 4], vertices[v + 5]) * size);
+            vertices[v] = position.x;
+            vertices[v + 1] = position.y;
+            vertices[v + 2] = position.z;
+            vertices[v + 3] = normal.x;
+            vertices[v + 4] = normal.y;
+            vertices[v + 5] = normal.z;
+        }
+    }
+
+    modelMatrix = glm::translate(glm::mat4(1.0f), center) * glm::scale(glm::mat4(1.0f), size);
+}
+
+void TubeMesher::sweepMesh(size_t chain, float detail, std::vector<float>& vertices) const {
+    vertices.clear();
+    const std::vector<int>& indices = m_chains[chain];
+
+    // Welded rings need the same slice count, so the chain takes its finest segment's
+    int radial = 0;
+    for (int index : indices) {
+        radial = std::max(radial, m_segments[index].radialSegments);
+    }
+    radial = detail == 1.0f ? radial : scaled(radial, detail, kMinRadialSegments);
+
+    std::vector<Ring> rings = sweep(m_segments, indices, detail);
+
+    float thetaStep = 2.0f * glm::pi<float>() / radial;
+    auto ringPoint = [&](const Ring& ring, int slice, glm::vec3& position, glm::vec3& normal) {
+        glm::vec3 binormal = glm::cross(ring.tangent, ring.normal);
+        float theta = slice * thetaStep;
+        glm::vec3 radialDirection = std::cos(theta) * ring.normal + std::sin(theta) * binormal;
+        position = ring.center + ring.radius * radialDirection;
+        normal = glm::normalize(radialDirection - ring.slope * ring.tangent);
+    };
+
+    vertices.reserve(static_cast<size_t>(triangleCount(chain)) * 3 * 8);
+
+    for (size_t r = 0; r + 1 < rings.size(); ++r) {
+        for (int i = 0; i < radial; ++i) {
+            glm::vec3 bottomLeft, bottomRight, topLeft, topRight;
+            glm::vec3 normalBottomLeft, normalBottomRight, normalTopLeft, normalTopRight;
+            ringPoint(rings[r], i, bottomLeft, normalBottomLeft);
+            ringPoint(rings[r], i + 1, bottomRight, normalBottomRight);
+            ringPoint(rings[r + 1], i, topLeft, normalTopLeft);
+            ringPoint(rings[r + 1], i + 1, topRight, normalTopRight);
+
+            float uLeft = static_cast<float>(i) / radial;
+            float uRight = static_cast<float>(i + 1) / radial;
+
+            pushVertex(bottomLeft, normalBottomLeft, glm::vec2(uLeft, rings[r].v), vertices);
+            pushVertex(bottomRight, normalBottomRight, glm::vec2(uRight, rings[r].v), vertices);
+            pushVertex(topRight, normalTopRight, glm::vec2(uRight, rings[r + 1].v), vertices);
+
+            pushVertex(bottomLeft, normalBottomLeft, glm::vec2(uLeft, rings[r].v), vertices);
+            pushVertex(topRight, normalTopRight, glm::vec2(uRight, rings[r + 1].v), vertices);
+            pushVertex(topLeft, normalTopLeft, glm::vec2(uLeft, rings[r + 1].v), vertices);
+        }
+    }
+
+    // The chain's start sits inside its parent or on the ground, only the tip is open
+    const Ring& tip = rings.back();
+    for (int i = 0; i < radial; ++i) {
+        glm::vec3 edge1, edge2, unused;
+        ringPoint(tip, i, edge1, unused);
+        ringPoint(tip, i + 1, edge2, unused);
+
+        float theta1 = i * thetaStep;
+        float theta2 = (i + 1) * thetaStep;
+        pushVertex(tip.center, tip.tangent, glm::vec2(0.5f), vertices);
+        pushVertex(edge1, tip.tangent, glm::vec2(0.5f + 0.5f * std::cos(theta1), 0.5f + 0.5f * std::sin(theta1)), vertices);
+        pushVertex(edge2, tip.tangent, glm::vec2(0.5f + 0.5f * std::cos(theta2), 0.5f + 0.5f * std::sin(theta2)), vertices);
+    }
+}
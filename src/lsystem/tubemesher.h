@@ -0,0 +1,59 @@
+#ifndef TUBEMESHER_H
+#define TUBEMESHER_H
+
+#include <vector>
+#include <glm/glm.hpp>
+#include "lsystem/treesegment.h"
+
+// Meshes runs of connected trunk or branch segments as single welded tubes.
+// A ring is swept along each chain with parallel-transport frames and its radius interpolated
+// between segment thicknesses, so joints share vertices and only the tip of a chain is capped
+class TubeMesher
+{
+public:
+    explicit TubeMesher(const std::vector<TreeSegment>& segments);
+
+    // Segment indices of every chain, in the order the turtle drew them
+    const std::vector<std::vector<int>>& chains() const { return m_chains; }
+
+    // Kind shared by every segment of a chain
+    SegmentKind kind(size_t chain) const;
+
+    // Triangles of one chain, 8 floats per vertex like the shape generators. Vertices are stored in
+    // the unit box around the tube and modelMatrix maps that box to world space, so the tube
+    // culls and bounds like every other shape
+    void mesh(size_t chain, std::vector<float>& vertices, glm::mat4& modelMatrix) const;
+
+    // mesh() once per entry of details, with the slice and ring counts of every segment scaled by it, for
+    // LOD levels. Counts stay at least 3 slices and 1 ring per segment. All levels share one unit box, so
+    // the one modelMatrix fits every level
+    void meshLevels(size_t chain, const std::vector<float>& details, std::vector<std::vector<float>>& levels,
+                    glm::mat4& modelMatrix) const;
+
+    // Triangles mesh() emits for one chain
+    int triangleCount(size_t chain) const;
+
+    // One ring of the tube mesh() sweeps: tangent and normal span its frame, angle 0 lies along normal
+    struct Joint {
+        glm::vec3 center;
+        glm::vec3 tangent;
+        glm::vec3 normal;
+        float radius;
+    };
+
+    // The rings mesh() sweeps at the start of every segment of a chain and at its tip, one more than the
+    // chain has segments. Joint tangents average both sides and normals are transported along the chain,
+    // so anything built per segment from two consecutive joints meets its neighbours without cracks
+    std::vector<Joint> joints(size_t chain) const;
+
+private:
+    void findChains();
+
+    // Triangles of one chain at detail, in world space
+    void sweepMesh(size_t chain, float detail, std::vector<float>& vertices) const;
+
+    const std::vector<TreeSegment>& m_segments;
+    std::vector<std::vector<int>> m_chains;
+};
+
+#endif // TUBEMESHER_H
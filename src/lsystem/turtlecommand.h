@@ -0,0 +1,93 @@
+#ifndef TURTLECOMMAND_H
+#define TURTLECOMMAND_H
+
+#include "packedsymbols.h"
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <glm/glm.hpp>
+
+// What interpretLSystem does for a symbol, numbered like the PackedSymbols codes so the
+// interpreter switches over a dense range and compiles to a single jump table
+enum class TurtleCommand : uint8_t {
+    Trunk,      // F
+    Branch,     // X
+    Leaf,       // L
+    YawLeft,    // +
+    YawRight,   // -
+    RollRight,  // &
+    RollLeft,   // ^
+    PitchDown,  // <
+    PitchUp,    // >
+    TurnAround, // |
+    Push,       // [
+    Pop,        // ]
+    None        // Everything else
+};
+
+// Command of every char, generated from the packed alphabet at compile time
+inline constexpr std::array<TurtleCommand, 256> kTurtleCommands = [] {
+    std::array<TurtleCommand, 256> commands{};
+    for (int c = 0; c < 256; ++c) {
+        int code = PackedSymbols::code(static_cast<char>(c));
+        commands[c] = code < 0 ? TurtleCommand::None : static_cast<TurtleCommand>(code);
+    }
+    return commands;
+}();
+
+static_assert(kTurtleCommands['['] == TurtleCommand::Push && kTurtleCommands[']'] == TurtleCommand::Pop,
+              "TurtleCommand must follow the order of PackedSymbols::kAlphabet");
+
+// Segment lengths a move draws without a length parameter
+inline float turtleStep(TurtleCommand command) {
+    switch (command) {
+    case TurtleCommand::Trunk:
+        return 1.0f;
+    case TurtleCommand::Branch:
+    case TurtleCommand::Leaf:
+        return 0.5f;
+    default:
+        return 0.0f;
+    }
+}
+
+// v rotated by radians about axis, in the opposite sense to glm::rotate, as the turtle has always turned
+inline glm::vec3 turtleRotate(const glm::vec3& axis, float radians, const glm::vec3& v) {
+    glm::vec3 a = glm::normalize(axis);
+    float c = std::cos(radians);
+    float s = std::sin(radians);
+    float t = 1.0f - c;
+    glm::mat3 rotation(c + a.x * a.x * t, a.x * a.y * t - a.z * s, a.x * a.z * t + a.y * s,
+                       a.x * a.y * t + a.z * s, c + a.y * a.y * t, a.y * a.z * t - a.x * s,
+                       a.x * a.z * t - a.y * s, a.y * a.z * t + a.x * s, c + a.z * a.z * t);
+    return rotation * v;
+}
+
+// Apply a turn command to the turtle's frame; the axis not turned about is rebuilt from the other two.
+// TurnAround always turns by 180 degrees
+inline void turnTurtle(TurtleCommand command, float radians, glm::vec3& grow, glm::vec3& forward, glm::vec3& right) {
+    switch (command) {
+    case TurtleCommand::YawLeft:
+    case TurtleCommand::YawRight:
+        grow = glm::normalize(turtleRotate(forward, command == TurtleCommand::YawLeft ? radians : -radians, grow));
+        right = glm::normalize(glm::cross(grow, forward));
+        break;
+    case TurtleCommand::RollRight:
+    case TurtleCommand::RollLeft:
+    case TurtleCommand::TurnAround:
+        radians = command == TurtleCommand::TurnAround ? glm::radians(180.0f)
+                  : command == TurtleCommand::RollLeft ? radians : -radians;
+        forward = glm::normalize(turtleRotate(grow, radians, forward));
+        right = glm::normalize(glm::cross(grow, forward));
+        break;
+    case TurtleCommand::PitchDown:
+    case TurtleCommand::PitchUp:
+        grow = glm::normalize(turtleRotate(right, command == TurtleCommand::PitchUp ? radians : -radians, grow));
+        forward = glm::normalize(glm::cross(right, grow));
+        break;
+    default:
+        break;
+    }
+}
+
+#endif // TURTLECOMMAND_H
@@ -41,6 +41,8 @@ void MainWindow::initialize() {
     filters_label->setFont(font);
     QLabel *ec_label = new QLabel("Extra Credit");
     ec_label->setFont(font);
+    QLabel *performance_label = new QLabel("Performance");
+    performance_label->setFont(font);
 
     QLabel *param1_label = new QLabel("Iteration:");
     QLabel *param2_label = new QLabel("Length");
@@ -56,6 +58,8 @@ void MainWindow::initialize() {
     filter2->setChecked(false);
 
     saveImage = new QPushButton("Save image");
+    loadGrammar = new QPushButton("Load grammar");
+    builtInGrammar = new QPushButton("Built-in grammar");
 
     QGroupBox *p1Layout = new QGroupBox();
     QHBoxLayout *l1 = new QHBoxLayout();
@@ -201,7 +205,129 @@ void MainWindow::initialize() {
     ec4 = new QCheckBox("Leaf");
     ec4->setChecked(false);
 
+    // Performance
+    QLabel *forest_size_label = new QLabel("Forest Trees:");
+    forestSizeBox = new QSpinBox();
+    forestSizeBox->setMinimum(1);
+    forestSizeBox->setMaximum(2000);
+    forestSizeBox->setSingleStep(6);
+    forestSizeBox->setValue(settings.forestSize);
+
+    gpuCulling = new QCheckBox("GPU Culling");
+    gpuCulling->setChecked(false);
+
+    occlusionCulling = new QCheckBox("Occlusion Culling");
+    occlusionCulling->setChecked(false);
+
+    QLabel *lod_bias_label = new QLabel("LOD Bias:");
+    lodBiasBox = new QDoubleSpinBox();
+    lodBiasBox->setMinimum(-2.f);
+    lodBiasBox->setMaximum(2.f);
+    lodBiasBox->setSingleStep(0.25f);
+    lodBiasBox->setValue(settings.lodBias);
+
+    QLabel *triangle_budget_label = new QLabel("Tree Triangle Budget:");
+    triangleBudgetBox = new QSpinBox();
+    triangleBudgetBox->setMinimum(1000);
+    triangleBudgetBox->setMaximum(5000000);
+    triangleBudgetBox->setSingleStep(10000);
+    triangleBudgetBox->setValue(settings.treeTriangleBudget);
+
+    impostors = new QCheckBox("Impostors");
+    impostors->setChecked(false);
+
+    QLabel *impostor_distance_label = new QLabel("Impostor Distance:");
+    impostorDistanceBox = new QDoubleSpinBox();
+    impostorDistanceBox->setMinimum(1.f);
+    impostorDistanceBox->setMaximum(500.f);
+    impostorDistanceBox->setSingleStep(5.f);
+    impostorDistanceBox->setValue(settings.impostorDistance);
+
+    tubeBranches = new QCheckBox("Weld Branch Tubes");
+    tubeBranches->setChecked(true);
+
+    tessellatedBranches = new QCheckBox("GPU Tessellated Branches");
+    tessellatedBranches->setChecked(false);
+
+    capsuleTwigs = new QCheckBox("Capsule Twigs");
+    capsuleTwigs->setChecked(false);
+
+    QLabel *capsule_thickness_label = new QLabel("Capsule Below Thickness:");
+    capsuleThicknessBox = new QDoubleSpinBox();
+    capsuleThicknessBox->setDecimals(3);
+    capsuleThicknessBox->setMinimum(0.001f);
+    capsuleThicknessBox->setMaximum(0.1f);
+    capsuleThicknessBox->setSingleStep(0.005f);
+    capsuleThicknessBox->setValue(settings.capsuleThickness);
+
+    leafCards = new QCheckBox("Leaf Cards");
+    leafCards->setChecked(true);
+
+    staticBatch = new QCheckBox("Bake Static Batch");
+    staticBatch->setChecked(false);
+
+    QLabel *generation_budget_label = new QLabel("Generation Budget (ms, 0 = none):");
+    generationBudgetBox = new QDoubleSpinBox();
+    generationBudgetBox->setMinimum(0.f);
+    generationBudgetBox->setMaximum(60000.f);
+    generationBudgetBox->setSingleStep(250.f);
+    generationBudgetBox->setValue(settings.generationBudgetMs);
+
+    QLabel *tree_seed_label = new QLabel("Tree Seed (stochastic grammars):");
+    treeSeedBox = new QSpinBox();
+    treeSeedBox->setMinimum(0);
+    treeSeedBox->setMaximum(99999);
+    treeSeedBox->setValue(settings.treeSeed);
+
+    spaceColonization = new QCheckBox("Space Colonization");
+    spaceColonization->setChecked(false);
+
+    QLabel *attractor_count_label = new QLabel("Attractors:");
+    attractorCountBox = new QSpinBox();
+    attractorCountBox->setMinimum(1000);
+    attractorCountBox->setMaximum(200000);
+    attractorCountBox->setSingleStep(1000);
+    attractorCountBox->setValue(settings.attractorCount);
+
+    openGrowth = new QCheckBox("Open Growth Towards Light (parametric grammars)");
+    openGrowth->setChecked(false);
+
+    adaptiveExpansion = new QCheckBox("Expand Only What The Camera Resolves");
+    adaptiveExpansion->setChecked(false);
+
+    QLabel *expansion_pixels_label = new QLabel("Expansion Threshold (pixels):");
+    expansionPixelsBox = new QDoubleSpinBox();
+    expansionPixelsBox->setMinimum(0.5f);
+    expansionPixelsBox->setMaximum(100.0f);
+    expansionPixelsBox->setSingleStep(0.5f);
+    expansionPixelsBox->setValue(settings.expansionPixels);
+
+    depthLod = new QCheckBox("Fewer Iterations For Far Forest Trees");
+    depthLod->setChecked(false);
+
+    QLabel *depth_lod_distance_label = new QLabel("Full Iteration Distance:");
+    depthLodDistanceBox = new QDoubleSpinBox();
+    depthLodDistanceBox->setMinimum(1.0f);
+    depthLodDistanceBox->setMaximum(200.0f);
+    depthLodDistanceBox->setSingleStep(1.0f);
+    depthLodDistanceBox->setValue(settings.depthLodDistance);
+
+    growthAnimation = new QCheckBox("Animate Growth");
+    growthAnimation->setChecked(false);
+
+    QLabel *wind_strength_label = new QLabel("Wind Strength:");
+    windStrengthBox = new QDoubleSpinBox();
+    windStrengthBox->setDecimals(3);
+    windStrengthBox->setMinimum(0.0f);
+    windStrengthBox->setMaximum(0.1f);
+    windStrengthBox->setSingleStep(0.005f);
+    windStrengthBox->setValue(settings.windStrength);
+
+    statsLabel = new QLabel("Occluded Trees: 0 / 0");
+
     vLayout->addWidget(saveImage);
+    vLayout->addWidget(loadGrammar);
+    vLayout->addWidget(builtInGrammar);
     vLayout->addWidget(tesselation_label);
     vLayout->addWidget(param1_label);
     vLayout->addWidget(p1Layout);
@@ -227,6 +353,43 @@ void MainWindow::initialize() {
     vLayout->addWidget(ec2);
     vLayout->addWidget(ec3);
     vLayout->addWidget(ec4);
+    vLayout->addWidget(performance_label);
+    vLayout->addWidget(forest_size_label);
+    vLayout->addWidget(forestSizeBox);
+    vLayout->addWidget(gpuCulling);
+    vLayout->addWidget(occlusionCulling);
+    vLayout->addWidget(lod_bias_label);
+    vLayout->addWidget(lodBiasBox);
+    vLayout->addWidget(triangle_budget_label);
+    vLayout->addWidget(triangleBudgetBox);
+    vLayout->addWidget(impostors);
+    vLayout->addWidget(impostor_distance_label);
+    vLayout->addWidget(impostorDistanceBox);
+    vLayout->addWidget(tubeBranches);
+    vLayout->addWidget(tessellatedBranches);
+    vLayout->addWidget(capsuleTwigs);
+    vLayout->addWidget(capsule_thickness_label);
+    vLayout->addWidget(capsuleThicknessBox);
+    vLayout->addWidget(leafCards);
+    vLayout->addWidget(staticBatch);
+    vLayout->addWidget(generation_budget_label);
+    vLayout->addWidget(generationBudgetBox);
+    vLayout->addWidget(tree_seed_label);
+    vLayout->addWidget(treeSeedBox);
+    vLayout->addWidget(spaceColonization);
+    vLayout->addWidget(attractor_count_label);
+    vLayout->addWidget(attractorCountBox);
+    vLayout->addWidget(openGrowth);
+    vLayout->addWidget(adaptiveExpansion);
+    vLayout->addWidget(expansion_pixels_label);
+    vLayout->addWidget(expansionPixelsBox);
+    vLayout->addWidget(depthLod);
+    vLayout->addWidget(depth_lod_distance_label);
+    vLayout->addWidget(depthLodDistanceBox);
+    vLayout->addWidget(growthAnimation);
+    vLayout->addWidget(wind_strength_label);
+    vLayout->addWidget(windStrengthBox);
+    vLayout->addWidget(statsLabel);
 
     mainLayout->addWidget(scrollArea, 1);
     mainLayout->addWidget(aspectRatioWidget, 3);
@@ -262,6 +425,7 @@ void MainWindow::connectUIElements() {
    // connectUploadFile();
     // connectLSystemGenerate();
     connectSaveImage();
+    connectGrammar();
     connectParam1();
     connectParam2();
     connectParam3();
@@ -271,6 +435,7 @@ void MainWindow::connectUIElements() {
     connect(tBool, &QCheckBox::clicked, this, &MainWindow::onToonEnable);
     connectToonSlider();
     connectExtraCredit();
+    connectPerformance();
 }
 
 void MainWindow::connectPerPixelFilter() {
@@ -285,6 +450,11 @@ void MainWindow::connectSaveImage() {
     connect(saveImage, &QPushButton::clicked, this, &MainWindow::onSaveImage);
 }
 
+void MainWindow::connectGrammar() {
+    connect(loadGrammar, &QPushButton::clicked, this, &MainWindow::onLoadGrammar);
+    connect(builtInGrammar, &QPushButton::clicked, this, &MainWindow::onBuiltInGrammar);
+}
+
 void MainWindow::connectParam1() {
     connect(p1Slider, &QSlider::valueChanged, this, &MainWindow::onValChangeP1);
     connect(p1Box, static_cast<void(QSpinBox::*)(int)>(&QSpinBox::valueChanged),
@@ -334,6 +504,49 @@ void MainWindow::connectExtraCredit() {
     connect(ec4, &QCheckBox::clicked, this, &MainWindow::onExtraCredit4);
 }
 
+void MainWindow::connectPerformance() {
+    connect(forestSizeBox, static_cast<void(QSpinBox::*)(int)>(&QSpinBox::valueChanged),
+            this, &MainWindow::onValChangeForestSize);
+    connect(gpuCulling, &QCheckBox::clicked, this, &MainWindow::onGpuCulling);
+    connect(occlusionCulling, &QCheckBox::clicked, this, &MainWindow::onOcclusionCulling);
+    connect(lodBiasBox, static_cast<void(QDoubleSpinBox::*)(double)>(&QDoubleSpinBox::valueChanged),
+            this, &MainWindow::onValChangeLodBias);
+    connect(triangleBudgetBox, static_cast<void(QSpinBox::*)(int)>(&QSpinBox::valueChanged),
+            this, &MainWindow::onValChangeTriangleBudget);
+    connect(impostors, &QCheckBox::clicked, this, &MainWindow::onImpostors);
+    connect(tubeBranches, &QCheckBox::clicked, this, &MainWindow::onTubeBranches);
+    connect(tessellatedBranches, &QCheckBox::clicked, this, &MainWindow::onTessellatedBranches);
+    connect(capsuleTwigs, &QCheckBox::clicked, this, &MainWindow::onCapsuleTwigs);
+    connect(capsuleThicknessBox, static_cast<void(QDoubleSpinBox::*)(double)>(&QDoubleSpinBox::valueChanged),
+            this, &MainWindow::onValChangeCapsuleThickness);
+    connect(leafCards, &QCheckBox::clicked, this, &MainWindow::onLeafCards);
+    connect(staticBatch, &QCheckBox::clicked, this, &MainWindow::onStaticBatch);
+    connect(generationBudgetBox, static_cast<void(QDoubleSpinBox::*)(double)>(&QDoubleSpinBox::valueChanged),
+            this, &MainWindow::onValChangeGenerationBudget);
+    connect(treeSeedBox, static_cast<void(QSpinBox::*)(int)>(&QSpinBox::valueChanged),
+            this, &MainWindow::onValChangeTreeSeed);
+    connect(spaceColonization, &QCheckBox::clicked, this, &MainWindow::onSpaceColonization);
+    connect(attractorCountBox, static_cast<void(QSpinBox::*)(int)>(&QSpinBox::valueChanged),
+            this, &MainWindow::onValChangeAttractorCount);
+    connect(openGrowth, &QCheckBox::clicked, this, &MainWindow::onOpenGrowth);
+    connect(adaptiveExpansion, &QCheckBox::clicked, this, &MainWindow::onAdaptiveExpansion);
+    connect(expansionPixelsBox, static_cast<void(QDoubleSpinBox::*)(double)>(&QDoubleSpinBox::valueChanged),
+            this, &MainWindow::onValChangeExpansionPixels);
+    connect(depthLod, &QCheckBox::clicked, this, &MainWindow::onDepthLod);
+    connect(depthLodDistanceBox, static_cast<void(QDoubleSpinBox::*)(double)>(&QDoubleSpinBox::valueChanged),
+            this, &MainWindow::onValChangeDepthLodDistance);
+    connect(growthAnimation, &QCheckBox::clicked, this, &MainWindow::onGrowthAnimation);
+    connect(windStrengthBox, static_cast<void(QDoubleSpinBox::*)(double)>(&QDoubleSpinBox::valueChanged),
+            this, &MainWindow::onValChangeWindStrength);
+    connect(impostorDistanceBox, static_cast<void(QDoubleSpinBox::*)(double)>(&QDoubleSpinBox::valueChanged),
+            this, &MainWindow::onValChangeImpostorDistance);
+
+    // Render stats are refreshed a few times a second rather than every frame
+    statsTimer = new QTimer(this);
+    connect(statsTimer, &QTimer::timeout, this, &MainWindow::onUpdateStats);
+    statsTimer->start(250);
+}
+
 void MainWindow::onPerPixelFilter() {
     settings.perPixelFilter = !settings.perPixelFilter;
     realtime->settingsChanged();
@@ -370,6 +583,25 @@ void MainWindow::onLSystem() {
     realtime->lSystemGeneration();
 }
 
+void MainWindow::onLoadGrammar() {
+    QString grammarFilePath = QFileDialog::getOpenFileName(this, tr("Load Grammar"),
+                                                           QDir::currentPath()
+                                                               .append(QDir::separator())
+                                                               .append("grammars"), tr("Grammar Files (*.json)"));
+    if (grammarFilePath.isNull()) {
+        return;
+    }
+
+    settings.grammarFilePath = grammarFilePath.toStdString();
+    std::cout << "Loaded grammar: \"" << settings.grammarFilePath << "\"." << std::endl;
+    realtime->settingsChanged();
+}
+
+void MainWindow::onBuiltInGrammar() {
+    settings.grammarFilePath.clear();
+    realtime->settingsChanged();
+}
+
 void MainWindow::onSaveImage() {
     std::string sceneName = settings.sceneFilePath.substr(0, settings.sceneFilePath.find_last_of("."));
     sceneName = sceneName.substr(sceneName.find_last_of("/")+1);
@@ -472,3 +704,147 @@ void MainWindow::onExtraCredit4() {
     settings.extraCredit4 = !settings.extraCredit4;
     realtime->settingsChanged();
 }
+
+// Performance:
+
+void MainWindow::onValChangeForestSize(int newValue) {
+    settings.forestSize = newValue;
+    realtime->settingsChanged();
+}
+
+void MainWindow::onGpuCulling() {
+    settings.gpuCulling = !settings.gpuCulling;
+    realtime->settingsChanged();
+}
+
+void MainWindow::onOcclusionCulling() {
+    settings.occlusionCulling = !settings.occlusionCulling;
+    realtime->settingsChanged();
+}
+
+void MainWindow::onValChangeLodBias(double newValue) {
+    settings.lodBias = newValue;
+    realtime->settingsChanged();
+}
+
+void MainWindow::onValChangeTriangleBudget(int newValue) {
+    settings.treeTriangleBudget = newValue;
+    realtime->settingsChanged();
+}
+
+void MainWindow::onImpostors() {
+    settings.impostors = !settings.impostors;
+    realtime->settingsChanged();
+}
+
+void MainWindow::onTubeBranches() {
+    settings.tubeBranches = !settings.tubeBranches;
+    realtime->settingsChanged();
+}
+
+void MainWindow::onTessellatedBranches() {
+    settings.tessellatedBranches = !settings.tessellatedBranches;
+    realtime->settingsChanged();
+}
+
+void MainWindow::onCapsuleTwigs() {
+    settings.capsuleTwigs = !settings.capsuleTwigs;
+    realtime->settingsChanged();
+}
+
+void MainWindow::onValChangeCapsuleThickness(double newValue) {
+    settings.capsuleThickness = newValue;
+    realtime->settingsChanged();
+}
+
+void MainWindow::onLeafCards() {
+    settings.leafCards = !settings.leafCards;
+    realtime->settingsChanged();
+}
+
+void MainWindow::onStaticBatch() {
+    settings.staticBatch = !settings.staticBatch;
+    realtime->settingsChanged();
+}
+
+void MainWindow::onValChangeGenerationBudget(double newValue) {
+    settings.generationBudgetMs = newValue;
+    realtime->settingsChanged();
+}
+
+void MainWindow::onValChangeTreeSeed(int newValue) {
+    settings.treeSeed = newValue;
+    realtime->settingsChanged();
+}
+
+void MainWindow::onSpaceColonization() {
+    settings.spaceColonization = !settings.spaceColonization;
+    realtime->settingsChanged();
+}
+
+void MainWindow::onValChangeAttractorCount(int newValue) {
+    settings.attractorCount = newValue;
+    realtime->settingsChanged();
+}
+
+void MainWindow::onOpenGrowth() {
+    settings.openGrowth = !settings.openGrowth;
+    realtime->settingsChanged();
+}
+
+void MainWindow::onAdaptiveExpansion() {
+    settings.adaptiveExpansion = !settings.adaptiveExpansion;
+    realtime->settingsChanged();
+}
+
+void MainWindow::onValChangeExpansionPixels(double newValue) {
+    settings.expansionPixels = newValue;
+    realtime->settingsChanged();
+}
+
+void MainWindow::onDepthLod() {
+    settings.depthLod = !settings.depthLod;
+    realtime->settingsChanged();
+}
+
+void MainWindow::onValChangeDepthLodDistance(double newValue) {
+    settings.depthLodDistance = newValue;
+    realtime->settingsChanged();
+}
+
+void MainWindow::onGrowthAnimation() {
+    settings.growthAnimation = !settings.growthAnimation;
+    realtime->settingsChanged();
+}
+
+void MainWindow::onValChangeWindStrength(double newValue) {
+    settings.windStrength = newValue;
+    realtime->settingsChanged();
+}
+
+void MainWindow::onValChangeImpostorDistance(double newValue) {
+    settings.impostorDistance = newValue;
+    realtime->settingsChanged();
+}
+
+void MainWindow::onUpdateStats() {
+    const RenderStats& stats = realtime->renderStats();
+    QString iterations = QString("Iterations: %1 (est. %2 ms, took %3 ms)")
+                             .arg(stats.generatedIterations)
+                             .arg(stats.estimatedMilliseconds, 0, 'f', 0)
+                             .arg(stats.generatedMilliseconds, 0, 'f', 0);
+    if (stats.generatedIterations < stats.requestedIterations) {
+        iterations = QString("Iterations: %1 of %2, over budget (est. %3 ms)")
+                         .arg(stats.generatedIterations).arg(stats.requestedIterations)
+                         .arg(stats.estimatedMilliseconds, 0, 'f', 0);
+    }
+    if (stats.expansionProxies >= 0) {
+        iterations = QString("%1\nUnexpanded Subtrees: %2").arg(iterations).arg(stats.expansionProxies);
+    }
+    if (stats.shallowTrees >= 0) {
+        iterations = QString("%1\nShallower Trees: %2").arg(iterations).arg(stats.shallowTrees);
+    }
+    statsLabel->setText(QString("Occluded Trees: %1 / %2\nImpostor Trees: %3\nShape Vertices: %4\n%5")
+                            .arg(stats.occludedTrees).arg(stats.forestTrees).arg(stats.impostorTrees)
+                            .arg(stats.shapeVertices).arg(iterations));
+}
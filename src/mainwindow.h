@@ -6,6 +6,8 @@
 #include <QSpinBox>
 #include <QDoubleSpinBox>
 #include <QPushButton>
+#include <QLabel>
+#include <QTimer>
 #include "realtime.h"
 #include "utils/aspectratiowidget/aspectratiowidget.hpp"
 
@@ -31,7 +33,9 @@ private:
     // void connectUploadFile();
     void connectLSystemGenerate();
     void connectSaveImage();
+    void connectGrammar();
     void connectExtraCredit();
+    void connectPerformance();
 
     Realtime *realtime;
     AspectRatioWidget *aspectRatioWidget;
@@ -40,6 +44,8 @@ private:
     // QPushButton *uploadFile;
     // QPushButton *lSystem;
     QPushButton *saveImage;
+    QPushButton *loadGrammar;
+    QPushButton *builtInGrammar;
     QSlider *p1Slider;
     QSlider *p2Slider;
     QSlider *p3Slider;
@@ -63,12 +69,42 @@ private:
     QCheckBox *ec3;
     QCheckBox *ec4;
 
+    // Performance:
+    QSpinBox *forestSizeBox;
+    QCheckBox *gpuCulling;
+    QCheckBox *occlusionCulling;
+    QDoubleSpinBox *lodBiasBox;
+    QSpinBox *triangleBudgetBox;
+    QCheckBox *impostors;
+    QCheckBox *tubeBranches;
+    QCheckBox *tessellatedBranches;
+    QCheckBox *capsuleTwigs;
+    QDoubleSpinBox *capsuleThicknessBox;
+    QCheckBox *leafCards;
+    QCheckBox *staticBatch;
+    QDoubleSpinBox *generationBudgetBox;
+    QSpinBox *treeSeedBox;
+    QCheckBox *spaceColonization;
+    QSpinBox *attractorCountBox;
+    QCheckBox *openGrowth;
+    QCheckBox *adaptiveExpansion;
+    QDoubleSpinBox *expansionPixelsBox;
+    QCheckBox *depthLod;
+    QDoubleSpinBox *depthLodDistanceBox;
+    QCheckBox *growthAnimation;
+    QDoubleSpinBox *windStrengthBox;
+    QDoubleSpinBox *impostorDistanceBox;
+    QLabel *statsLabel;
+    QTimer *statsTimer;
+
 private slots:
     void onPerPixelFilter();
     void onKernelBasedFilter();
     // void onUploadFile();
     void onLSystem();
     void onSaveImage();
+    void onLoadGrammar();
+    void onBuiltInGrammar();
     void onValChangeP1(int newValue);
     void onValChangeP2(int newValue);
     void onValChangeP3(int newValue);
@@ -85,4 +121,31 @@ private slots:
     void onExtraCredit2();
     void onExtraCredit3();
     void onExtraCredit4();
+
+    // Performance:
+    void onValChangeForestSize(int newValue);
+    void onGpuCulling();
+    void onOcclusionCulling();
+    void onValChangeLodBias(double newValue);
+    void onValChangeTriangleBudget(int newValue);
+    void onImpostors();
+    void onTubeBranches();
+    void onTessellatedBranches();
+    void onCapsuleTwigs();
+    void onValChangeCapsuleThickness(double newValue);
+    void onLeafCards();
+    void onStaticBatch();
+    void onValChangeGenerationBudget(double newValue);
+    void onValChangeTreeSeed(int newValue);
+    void onSpaceColonization();
+    void onValChangeAttractorCount(int newValue);
+    void onOpenGrowth();
+    void onAdaptiveExpansion();
+    void onValChangeExpansionPixels(double newValue);
+    void onDepthLod();
+    void onValChangeDepthLodDistance(double newValue);
+    void onGrowthAnimation();
+    void onValChangeWindStrength(double newValue);
+    void onValChangeImpostorDistance(double newValue);
+    void onUpdateStats();
 };
@@ -6,8 +6,12 @@
 #include <iostream>
 #include "glm/ext/matrix_clip_space.hpp"
 #include "glm/ext/matrix_transform.hpp"
+#include "lsystem/counterrng.h"
 #include "lsystem/lsystem.h"
+#include "lsystem/presetgrammar.h"
+#include "lsystem/spacecolonization.h"
 #include "settings.h"
+#include "utils/parallelfor.h"
 #include "utils/shaderloader.h"
 
 // ================== Project 5: Lights, Camera
@@ -63,6 +67,68 @@ void Realtime::finish() {
     glDeleteVertexArrays(1, &m_particleVAO);
     glDeleteBuffers(1, &m_particleVBO);
 
+    // For GPU Forest Culling
+    glDeleteProgram(m_cull_shader);
+    glDeleteVertexArrays(1, &m_treeInstanceVAO);
+    glDeleteBuffers(1, &m_treeInstanceVBO);
+    glDeleteBuffers(kCullSlots * 2, &m_culledInstanceVBO[0][0]);
+    glDeleteQueries(kCullSlots * 2, &m_cullQuery[0][0]);
+    glDeleteBuffers(1, &m_treeIndirectBuffer);
+    glDeleteVertexArrays(1, &m_visibleTreeInstanceVAO);
+    glDeleteBuffers(1, &m_visibleTreeInstanceVBO);
+
+    // For Mesh LOD and Static Batch
+    m_meshCache.clear();
+    releaseStaticBatch();
+
+    // For Impostors
+    glDeleteProgram(m_impostor_bake_shader);
+    glDeleteProgram(m_impostor_shader);
+    glDeleteTextures(1, &m_impostorAlbedo);
+    glDeleteTextures(1, &m_impostorNormalDepth);
+    glDeleteRenderbuffers(1, &m_impostorRenderbuffer);
+    glDeleteFramebuffers(1, &m_impostorFBO);
+    glDeleteVertexArrays(1, &m_impostorVAO);
+    glDeleteBuffers(1, &m_impostorQuadVBO);
+    glDeleteBuffers(1, &m_impostorInstanceVBO);
+
+    // For Tessellated Branches
+    glDeleteProgram(m_branch_patch_shader);
+    glDeleteProgram(m_branch_patch_depth_shader);
+    glDeleteVertexArrays(1, &m_branchPatchVAO);
+    glDeleteBuffers(1, &m_branchPatchVBO);
+    glDeleteBuffers(1, &m_branchPatchInstanceVBO);
+    glDeleteBuffers(1, &m_branchPatchDataBuffer);
+    glDeleteTextures(1, &m_branchPatchDataTexture);
+
+    // For Capsule Twigs
+    glDeleteProgram(m_capsule_shader);
+    glDeleteProgram(m_capsule_depth_shader);
+    glDeleteProgram(m_capsule_bake_shader);
+    glDeleteVertexArrays(1, &m_capsuleVAO);
+    glDeleteBuffers(1, &m_capsuleQuadVBO);
+    glDeleteBuffers(1, &m_capsuleDataBuffer);
+    glDeleteTextures(1, &m_capsuleDataTexture);
+
+    // For Leaf Cards
+    glDeleteProgram(m_leaf_shader);
+    glDeleteProgram(m_leaf_depth_shader);
+    glDeleteProgram(m_leaf_bake_shader);
+    glDeleteVertexArrays(1, &m_leafCardVAO);
+    glDeleteBuffers(1, &m_leafCardVBO);
+    glDeleteBuffers(1, &m_leafDataBuffer);
+    glDeleteTextures(1, &m_leafDataTexture);
+
+    // For Occlusion Culling
+    glDeleteProgram(m_occlusion_shader);
+    glDeleteVertexArrays(1, &m_boxVAO);
+    glDeleteBuffers(1, &m_boxVBO);
+    glDeleteBuffers(1, &m_meshedTreeVBO);
+    glDeleteBuffers(1, &m_shadowTreeVBO);
+    if (!m_treeQueries.empty()) {
+        glDeleteQueries(static_cast<GLsizei>(m_treeQueries.size()), m_treeQueries.data());
+    }
+
     this->doneCurrent();
 }
 
@@ -111,6 +177,18 @@ void Realtime::initializeGL() { // TODO: m_Data should be finished
     // Particles Initialization
     initializeParticles();
 
+    // GPU culling of forest instances
+    initializeGpuCulling();
+
+    // Occlusion queries against forest tree boxes
+    initializeOcclusion();
+
+    // Impostor atlas and quads for far forest trees
+    initializeImpostors();
+    initializeBranchPatches();
+    initializeCapsules();
+    initializeLeafCards();
+
     // load texture for all the textures
     loadTexture(":/resources/images/treeTrunk.jpg", m_trunk_texture);
     loadTexture(":/resources/images/treeTrunk.jpg", m_branch_texture);
@@ -293,46 +371,80 @@ void Realtime::paintGL() {
     paintFBOTexture(m_fbo_texture, settings.perPixelFilter, settings.kernelBasedFilter);
 }
 
-void Realtime::renderShadowMap(){
+// View of the directional light the shadow map and the light field of open growth are rendered from
+glm::mat4 Realtime::lightViewMatrix() const {
     const CustomLightData& directionalLight = lights[0];
 
-    glUseProgram(m_depth_shader);
-
-    // Set the light's projection matrix (orthographic projection is suitable for directional light)
-    glm::mat4 lightProjection = glm::ortho(-20.0f, 20.0f, -20.0f, 20.0f, 1.0f, 50.0f);
-
-    // Set the light's view matrix
     glm::vec3 sceneCenter = glm::vec3(0.0f, 0.0f, 0.0f); // Assume the scene center is at the origin
     glm::vec3 lightDir = glm::normalize(glm::vec3(directionalLight.direction));
     glm::vec3 lightPos = sceneCenter - lightDir * 20.0f; // Place the light at the opposite direction of the scene center
-    glm::mat4 lightView = glm::lookAt(
+    return glm::lookAt(
         lightPos,                 // Light position
         lightPos + lightDir,      // Light's target direction
         glm::vec3(0.0f, 1.0f, 0.0f) // Up direction in world coordinates
         );
+}
+
+void Realtime::renderShadowMap(){
+    glUseProgram(m_depth_shader);
+
+    // Set the light's projection matrix (orthographic projection is suitable for directional light)
+    glm::mat4 lightProjection = glm::ortho(-kShadowExtent, kShadowExtent, -kShadowExtent, kShadowExtent, kShadowNear, kShadowFar);
 
     // Compute the light-space matrix
-    lightSpaceMatrix = lightProjection * lightView;
+    lightSpaceMatrix = lightProjection * lightViewMatrix();
 
     // Pass the light-space matrix to the depth shader
     glUniformMatrix4fv(glGetUniformLocation(m_depth_shader, "lightSpaceMatrix"), 1, GL_FALSE, &lightSpaceMatrix[0][0]);
 
+    // Shadows sway with the same wind as the lit geometry
+    setAnimationUniforms(m_depth_shader);
+
     // Begin rendering to the Shadow Map
     glBindFramebuffer(GL_FRAMEBUFFER, shadowFBO);
     glViewport(0, 0, m_fbo_width, m_fbo_height);
     glClear(GL_DEPTH_BUFFER_BIT);
 
-    // Render L-System geometry
-    for (const ShapeData& shape : m_shapeData) {
-        glBindVertexArray(shape.vao);
+    // Render L-System geometry that falls inside the light's frustum
+    cullBoxes(Frustum::fromMatrix(lightSpaceMatrix), m_shapeBounds, m_shadowVisible);
+    hideOtherDepths(m_shadowVisible); // Trees cast the shadow of the depth picked for them last frame
+
+    for (size_t i = 0; i < m_shapeData.size(); ++i) {
+        if (!m_shadowVisible[i]) {
+            continue;
+        }
+        const ShapeData& shape = m_shapeData[i];
+
+        // Cached meshes reuse the level the camera picked last frame; shadows don't need the dither fade
+        GLuint vao = shape.vao;
+        int firstVertex = shape.firstVertex;
+        int vertexCount = shape.vertexCount;
+        if (shape.meshId >= 0 && m_shapeLod.size() == m_shapeData.size()) {
+            const MeshLevel& mesh = m_meshCache.level(shape.meshId, m_shapeLod[i].level);
+            vao = mesh.vao;
+            firstVertex = 0;
+            vertexCount = mesh.vertexCount;
+        }
+        glBindVertexArray(vao);
 
         // Pass the model matrix to the depth shader
         glUniformMatrix4fv(glGetUniformLocation(m_depth_shader, "modelMatrix"), 1, GL_FALSE, &shape.modelMatrix[0][0]);
+        setAnimationAttributes(shape);
 
-        glDrawArrays(GL_TRIANGLES, 0, shape.vertexCount);
+        glDrawArrays(GL_TRIANGLES, firstVertex, vertexCount);
         glBindVertexArray(0);
     }
 
+    if (m_instancedForest) {
+        renderTreeInstancesShadow();
+    }
+
+    // Impostor trees still cast the shadow of their meshes, so every tree the light sees is kept
+    m_shadowTreeCount = uploadVisibleTrees(Frustum::fromMatrix(lightSpaceMatrix), false, m_shadowTreeVBO);
+    renderBranchPatchesShadow();
+    renderCapsulesShadow();
+    renderLeafCardsShadow();
+
     glBindFramebuffer(GL_FRAMEBUFFER, 0);
     glUseProgram(0);
 }
@@ -386,6 +498,11 @@ void Realtime::resizeGL(int w, int h) {
 
 void clearShapeData(std::vector<ShapeData>& shapeData) {
     for (ShapeData& shape : shapeData) {
+        // Shared meshes belong to the mesh cache, batch groups to the static batch
+        if (shape.meshId >= 0 || shape.batchGroup >= 0) {
+            continue;
+        }
+
         // Delete the associated OpenGL resources
         glDeleteBuffers(1, &shape.vbo);        // Delete the Vertex Buffer Object (VBO)
         glDeleteVertexArrays(1, &shape.vao);  // Delete the Vertex Array Object (VAO)
@@ -420,34 +537,190 @@ void clearShapeData(std::vector<ShapeData>& shapeData) {
 // This is the method for generating L System
 void Realtime::LSystemShapeDataGeneration() {
     clearShapeData(m_shapeData);
+    m_adaptiveActive = false;
+    m_stats.expansionProxies = -1;
 
-    // Define the axiom (tree starts with a trunk)
-    std::string axiom = "FFX";
-    std::unordered_map<char, std::string> rules;
+    // Instanced forest trees never enter m_shapeData, so their template buffers are freed separately
+    if (m_instancedForest) {
+        clearShapeData(templateTree);
+    }
 
-    if(settings.extraCredit4){
-    rules = {
-        {'X', "X[-&<XL][<++&XL]||X[--&>XL][+&XL]"},
-    };
-    }else{
-    rules = {
-        {'X', "X[-&<X][<++&X]||X[--&>X][+&X]"},
-    };
+    // A space colonization tree ignores the grammar; it grows as far as the attractors lead it
+    if (settings.spaceColonization) {
+        ColonizationParameters parameters;
+        parameters.attractors = settings.attractorCount;
+        parameters.seed = static_cast<uint32_t>(settings.treeSeed);
+        parameters.leaves = settings.extraCredit4;
+        SpaceColonization colonization(parameters);
+
+        QElapsedTimer timer;
+        timer.start();
+        buildTree(colonization.grow(), 0);
+
+        m_stats.requestedIterations = colonization.iterations();
+        m_stats.generatedIterations = colonization.iterations();
+        m_stats.estimatedMilliseconds = 0.0;
+        m_stats.generatedMilliseconds = timer.nsecsElapsed() * 1e-6;
+        return;
     }
 
+    // The grammar file if one is loaded, else the built-in tree; recompiled only when that changes
+    updateGrammar();
+    bool builtIn = settings.grammarFilePath.empty();
+
     // Set the number of iterations (use fixed value for testing or user parameters)
     int iterations = settings.shapeParameter1; // Number of iterations to generate the tree structure
-
-    // Generate the L-System string
-    LSystem lSystem(axiom, rules, iterations);
-    std::string lSystemString = lSystem.generate();
+    m_lSystem.setIterations(iterations);
+    m_lSystem.setSeed(settings.treeSeed);
+
+    // Predict the cost first from symbol counts alone; past the budget, derive as many iterations as fit
+    // instead of freezing on the full request
+    std::vector<DerivationCost> costs = m_costModel.estimate(m_lSystem, settings.treeTriangleBudget);
+    int affordable = DerivationCostModel::affordableIterations(costs, settings.generationBudgetMs);
+    m_stats.requestedIterations = iterations;
+    m_stats.generatedIterations = affordable;
+    m_stats.estimatedMilliseconds = costs.back().milliseconds;
+    if (affordable < iterations) {
+        std::cerr << "L-system: " << iterations << " iterations estimated at " << costs.back().milliseconds
+                  << " ms, over the " << settings.generationBudgetMs << " ms budget; generating " << affordable << std::endl;
+        m_lSystem.setIterations(affordable);
+    }
 
     // Set angle and length based on user parameters
-    float angle = 5.5f * settings.shapeParameter3;    // Base angle
-    float length = settings.shapeParameter2 * 0.1f;    // Segment length
+    float angle = m_grammar.angleScale * settings.shapeParameter3;    // Base angle
+    float length = settings.shapeParameter2 * m_grammar.lengthScale;  // Segment length
+
+    QElapsedTimer timer;
+    timer.start();
+
+    // An open L-system grows step by step against the light field, each tree of a forest in its own place
+    if (settings.openGrowth && m_grammar.parametric()) {
+        growOpenForest(settings.extraCredit2 ? std::max(settings.forestSize, 1) : 1, affordable, angle, length);
+        m_stats.generatedMilliseconds = timer.nsecsElapsed() * 1e-6;
+        return;
+    }
+
+    // The lone tree of a deterministic grammar expands only what the camera resolves. Its cost follows the
+    // screen rather than the iterations, so it gets all it asked for. Forests copy one tree to every distance
+    // and keep it whole
+    if (settings.adaptiveExpansion && !settings.extraCredit2 && !m_grammar.parametric() &&
+        m_adaptive.compile(m_grammar.axiom, m_grammar.rules, iterations, angle, length, glm::vec3(0.0f, -0.5f, 0.0f))) {
+        m_adaptiveActive = true;
+        m_adaptiveAngle = angle;
+        m_adaptiveLength = length;
+        refineExpansion(true);
+        m_stats.generatedIterations = iterations;
+        m_stats.generatedMilliseconds = timer.nsecsElapsed() * 1e-6;
+        return;
+    }
+
+    // A copied forest draws far trees derived at fewer iterations; every depth is derived and meshed once.
+    // Stochastic forests have no one tree to copy
+    if (settings.depthLod && settings.extraCredit2 && !settings.gpuCulling && !m_lSystem.stochastic() && affordable > 1) {
+        buildDepthLevels(affordable, angle, length);
+        m_stats.generatedMilliseconds = timer.nsecsElapsed() * 1e-6;
+        return;
+    }
+
+    // A stochastic forest grows every tree from its own seed, one tree per thread, instead of copying one tree
+    if (settings.extraCredit2 && m_lSystem.stochastic()) {
+        int numTrees = std::max(settings.forestSize, 1);
+        std::vector<std::string> strings(numTrees);
+        std::vector<PackedSymbols> births(numTrees);
+        const RuleProgram& program = m_lSystem.program();
+        parallelFor(numTrees, parallelChunks(numTrees, 1), [&](size_t, size_t begin, size_t end) {
+            for (size_t tree = begin; tree < end; ++tree) {
+                uint32_t seed = CounterRng::treeSeed(settings.treeSeed, static_cast<uint32_t>(tree));
+                program.derive(affordable, seed, strings[tree], births[tree]);
+            }
+        });
+        double deriveMilliseconds = timer.nsecsElapsed() * 1e-6;
+
+        timer.restart();
+        interpretForest(strings, births, angle, length);
+        double interpretMilliseconds = timer.nsecsElapsed() * 1e-6;
+
+        // The model predicts one tree; calibrate it on the average one
+        m_costModel.calibrate(costs[affordable], deriveMilliseconds / numTrees, interpretMilliseconds / numTrees);
+        m_stats.generatedMilliseconds = deriveMilliseconds + interpretMilliseconds;
+        return;
+    }
+
+    // Small iteration counts of the built-in trees were derived by the compiler; the rest are derived here
+    std::string derived;
+    ModuleBuffer modules;
+    std::string_view lSystemString;
+    PackedSymbols birthIterations;
+    PresetView preset = builtIn ? presetDerivation(settings.extraCredit4, affordable) : PresetView();
+    if (!preset.empty()) {
+        lSystemString = preset.symbols;
+        birthIterations = PackedSymbols::fromBytes(preset.births, preset.symbols.size());
+    } else if (m_grammar.parametric()) {
+        m_parametric.derive(affordable, modules);
+        lSystemString = modules.symbols;
+        birthIterations = PackedSymbols::fromUnpacked(modules.births.data(), modules.size());
+    } else {
+        derived = m_lSystem.generate();
+        lSystemString = derived;
+        birthIterations = m_lSystem.birthIterations();
+    }
+    double deriveMilliseconds = preset.empty() ? timer.nsecsElapsed() * 1e-6 : 0.0;
 
     // Interpret the generated L-System string to create geometry
-    interpretLSystem(lSystemString, angle, length);
+    timer.restart();
+    interpretLSystem(lSystemString, birthIterations, angle, length, m_grammar.parametric() ? &modules : nullptr);
+    double interpretMilliseconds = timer.nsecsElapsed() * 1e-6;
+
+    // A packed derivation has its real counts at hand, which is what the measured times were spent on
+    bool counted = preset.empty() && !m_grammar.parametric() && !m_lSystem.packedString().empty();
+    m_costModel.calibrate(counted ? DerivationCostModel::counted(m_lSystem.packedString()) : costs[affordable],
+                          deriveMilliseconds, interpretMilliseconds);
+    m_stats.generatedMilliseconds = deriveMilliseconds + interpretMilliseconds;
+}
+
+// Load the grammar named by settings and compile it into m_lSystem, unless it is the one already compiled.
+// A grammar file that does not read falls back to the built-in tree and is not retried until it changes
+void Realtime::updateGrammar() {
+    std::string source = settings.grammarFilePath.empty() ? (settings.extraCredit4 ? ":leafy" : ":tree")
+                                                          : settings.grammarFilePath;
+    if (source == m_grammarSource) {
+        return;
+    }
+    m_grammarSource = source;
+
+    GrammarFileReader reader(settings.grammarFilePath);
+    bool loaded = !settings.grammarFilePath.empty() && reader.readJSON();
+    std::string error;
+    if (loaded) {
+        m_grammar = reader.getGrammarData();
+
+        // A parametric grammar that does not compile falls back like a file that does not read
+        if (m_grammar.parametric() && !m_parametric.compile(m_grammar.axiom, m_grammar.parametricRules, error)) {
+            std::cerr << "Failed to compile grammar file: " << settings.grammarFilePath << ": " << error
+                      << ", using the built-in tree" << std::endl;
+            loaded = false;
+        }
+    }
+    if (!loaded) {
+        if (!settings.grammarFilePath.empty() && error.empty()) {
+            std::cerr << "Failed to load grammar file: " << settings.grammarFilePath << ", using the built-in tree" << std::endl;
+        }
+
+        // The built-in trees, with leaves or without (see presetgrammar.h); both start with a trunk
+        const PresetGrammar<1>& preset = settings.extraCredit4 ? kLeafyTreeGrammar : kTreeGrammar;
+        m_grammar = GrammarData();
+        m_grammar.name = settings.extraCredit4 ? "Leafy tree" : "Tree";
+        m_grammar.axiom = std::string(preset.axiom);
+        m_grammar.rules = preset.runtimeRules();
+    }
+
+    // Parametric grammars derive from m_parametric, compiled above; m_lSystem only estimates their cost, see
+    // skeletonRules
+    if (m_grammar.parametric()) {
+        m_lSystem = LSystem(m_parametric.skeletonAxiom(), m_parametric.skeletonRules(), settings.shapeParameter1);
+    } else {
+        m_lSystem = LSystem(m_grammar.axiom, m_grammar.rules, settings.shapeParameter1, m_grammar.ignore);
+    }
 }
 
 // We call this method when we click on the 'L System Generation' Button
@@ -476,6 +749,11 @@ void Realtime::settingsChanged() {
 
     if (settings.shapeParameter4 != previousSettings.shapeParameter4) {
         updateLights();
+
+        // Open growth followed the old light
+        if (settings.openGrowth) {
+            LSystemShapeDataGeneration();
+        }
     }
 
     // Check if leaf is enabled
@@ -483,10 +761,43 @@ void Realtime::settingsChanged() {
         LSystemShapeDataGeneration();
     }
 
-    if(settings.extraCredit2 != previousSettings.extraCredit2){
+    if(settings.extraCredit2 != previousSettings.extraCredit2 ||
+       settings.forestSize != previousSettings.forestSize ||
+       settings.gpuCulling != previousSettings.gpuCulling ||
+       settings.treeTriangleBudget != previousSettings.treeTriangleBudget ||
+       settings.impostors != previousSettings.impostors ||
+       settings.staticBatch != previousSettings.staticBatch ||
+       settings.tubeBranches != previousSettings.tubeBranches ||
+       settings.tessellatedBranches != previousSettings.tessellatedBranches ||
+       settings.capsuleTwigs != previousSettings.capsuleTwigs ||
+       settings.capsuleThickness != previousSettings.capsuleThickness ||
+       settings.leafCards != previousSettings.leafCards ||
+       settings.generationBudgetMs != previousSettings.generationBudgetMs ||
+       settings.grammarFilePath != previousSettings.grammarFilePath ||
+       settings.treeSeed != previousSettings.treeSeed ||
+       settings.spaceColonization != previousSettings.spaceColonization ||
+       settings.attractorCount != previousSettings.attractorCount ||
+       settings.openGrowth != previousSettings.openGrowth ||
+       settings.adaptiveExpansion != previousSettings.adaptiveExpansion ||
+       settings.depthLod != previousSettings.depthLod){
         LSystemShapeDataGeneration();
     }
 
+    // A new threshold re-cuts the adaptive tree as if the camera had moved
+    if(settings.expansionPixels != previousSettings.expansionPixels && m_adaptiveActive){
+        m_adaptiveView = glm::mat4(0.0f);
+        refineExpansion(false);
+    }
+
+    if(settings.occlusionCulling != previousSettings.occlusionCulling){
+        resetOcclusion();
+    }
+
+    // Turning the growth animation on plays it from a bare trunk
+    if(settings.growthAnimation && !previousSettings.growthAnimation){
+        m_growthStartTime = m_time;
+    }
+
     if(settings.extraCredit1 != previousSettings.extraCredit1){
         // do nothing but just do want to call update() to paintGL again
     }
@@ -627,6 +938,11 @@ void Realtime::timerEvent(QTimerEvent *event) {
     // Update the view matrix
     m_view = glm::lookAt(eye, center, up);
 
+    // The adaptive tree follows the camera
+    if (m_adaptiveActive) {
+        refineExpansion(false);
+    }
+
     // Update Particles
     if(settings.extraCredit3){
         updateParticles(deltaTime);
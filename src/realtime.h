@@ -8,6 +8,19 @@
 #include <GL/glew.h>
 #include <glm/glm.hpp>
 
+#include "render/frustumculler.h"
+#include "render/renderqueue.h"
+#include "shapes/meshcache.h"
+#include "lsystem/adaptivederivation.h"
+#include "lsystem/derivationcost.h"
+#include "lsystem/lightfield.h"
+#include "lsystem/lsystem.h"
+#include "lsystem/modulebuffer.h"
+#include "lsystem/packedsymbols.h"
+#include "lsystem/parametriclsystem.h"
+#include "lsystem/treesegment.h"
+#include "utils/grammarfilereader.h"
+#include <string_view>
 #include <unordered_map>
 #include <QElapsedTimer>
 #include <QOpenGLWidget>
@@ -22,6 +35,7 @@ struct ShapeData {
     glm::vec4 diffuse;
     glm::vec4 specular;
     float shininess;
+    uint32_t materialId;   // Index into the material table, used for render queue sorting
     glm::mat4 modelMatrix; // Transformation matrix for the shape
     bool textureUsed;
     // only textureUsed is true, the blow data will be used
@@ -29,6 +43,44 @@ struct ShapeData {
     float blend;
     float repeatU;
     float repeatV;
+    int meshId = -1;       // Shared LOD chain in m_meshCache, -1 when the shape owns its vao and vbo
+    int firstVertex = 0;   // First vertex of the shape in its vbo
+    int batchGroup = -1;   // Material group of the static batch this shape draws, -1 otherwise
+    glm::vec4 windOrigin = glm::vec4(0.0f, 0.0f, 0.0f, -1.0f); // Branch origin and depth + phase for the wind, w < 0 keeps the shape still
+    glm::vec2 windParent = glm::vec2(0.0f); // Parent branch's phase and distance to its origin
+    glm::vec4 growthStart = glm::vec4(0.0f); // Growth anchor and birth time, see TreeSegment::growthStart
+    float growthEnd = 0.0f;                  // Time the shape is fully grown, <= growthStart.w keeps it grown
+};
+
+// Free the buffers every shape owns, see realtime.cpp
+void clearShapeData(std::vector<ShapeData>& shapeData);
+
+struct MaterialEntry {
+    glm::vec4 ambient;
+    glm::vec4 diffuse;
+    glm::vec4 specular;
+    float shininess;
+};
+
+// How drawRenderQueue instances each shape, used by the GPU-culled forest
+struct InstanceDraw {
+    GLuint instanceBuffer;  // One vec4 world offset per instance, bound to attribute 3
+    GLsizei instanceCount;  // Instance count when no indirect buffer is used
+    GLuint indirectBuffer;  // One DrawArraysIndirectCommand per shape (0 if unused)
+};
+
+// Per-frame counters shown in the Performance panel
+struct RenderStats {
+    int forestTrees = 0;   // Trees in the forest
+    int occludedTrees = 0; // Trees rejected by last frame's occlusion queries
+    int shapeVertices = 0; // Vertices of the LOD levels picked for m_shapeData, faded shapes count twice
+    int impostorTrees = 0; // Forest trees drawn as impostor quads
+    int requestedIterations = 0; // Iterations asked for by the last generation
+    int generatedIterations = 0; // Iterations it ran, fewer when the estimate was over budget
+    double estimatedMilliseconds = 0.0; // Predicted cost of the requested iterations
+    double generatedMilliseconds = 0.0; // Measured time of the generation that ran
+    int expansionProxies = -1; // Subtrees adaptive expansion left unexpanded, -1 when it is off
+    int shallowTrees = -1;     // Forest trees drawn derived at fewer iterations, -1 when depth LOD is off
 };
 
 struct Particle {
@@ -54,6 +106,7 @@ struct TurtleState {
     glm::vec3 growDirection;    // Y-axis equivalent: direction in which the turtle "grows"
     glm::vec3 forwardDirection; // Z-axis equivalent: direction the turtle is "facing"
     glm::vec3 rightDirection;   // X-axis equivalent: right-hand direction
+    float pathLength = 0.0f;    // Distance walked from the root along the current branch
 
     TurtleState(const glm::vec3& pos,
                 const glm::vec3& growDir = glm::vec3(0.0f, 1.0f, 0.0f),
@@ -75,9 +128,19 @@ public:
     // Below is new logic for l system
     glm::mat4 customRotate(const glm::vec3& axis, float radians);
     void LSystemShapeDataGeneration();
+    void updateGrammar();
     void lSystemGeneration();
-    void initializeBase();
-    void interpretLSystem(const std::string& lSystemString, float angle, float length);
+    void initializeBase(float radius = 8.0f);
+    void interpretLSystem(std::string_view lSystemString, const PackedSymbols& birthIterations, float angle, float length,
+                          const ModuleBuffer* modules = nullptr);
+    void interpretForest(const std::vector<std::string>& lSystemStrings, const std::vector<PackedSymbols>& birthIterations,
+                         float angle, float length);
+    void growOpenForest(int numTrees, int iterations, float angle, float length);
+    void refineExpansion(bool rebuild);
+    std::vector<TreeSegment> walkTurtle(std::string_view lSystemString, const PackedSymbols& birthIterations, float angle, float length,
+                                        const ModuleBuffer* modules = nullptr, std::vector<EnvironmentQuery>* queries = nullptr);
+    void buildTree(std::vector<TreeSegment> segments, int placedTrees, std::vector<std::vector<TreeSegment>> depthLevels = {});
+    void meshTreeSegments(const std::vector<TreeSegment>& segments, bool patchBranches);
     void generateShape(PrimitiveType type, std::vector<GLfloat> &vertices);
     glm::mat4 calculateModelMatrix(const glm::vec3 &start, const glm::vec3 &end, float thickness);
     void createShapeData(
@@ -93,8 +156,35 @@ public:
         float repeatU = 1.0f, // Default U texture repeat
         float repeatV = 1.0f  // Default V texture repeat
         );
+    void createShapeData(
+        int meshId,
+        const glm::vec4& ambientColor,
+        const glm::vec4& diffuseColor,
+        const glm::vec4& specularColor,
+        float shininess,
+        const GLuint& texture,
+        const glm::mat4& modelMatrix,
+        bool isBase,
+        float blend = 1.0f,
+        float repeatU = 1.0f,
+        float repeatV = 1.0f
+        );
+    void storeShapeData(
+        ShapeData& shapeData,
+        const glm::vec4& ambientColor,
+        const glm::vec4& diffuseColor,
+        const glm::vec4& specularColor,
+        float shininess,
+        const GLuint& texture,
+        const glm::mat4& modelMatrix,
+        bool isBase,
+        float blend,
+        float repeatU,
+        float repeatV
+        );
     void settingsChanged();
     void saveViewportImage(std::string filePath);
+    const RenderStats& renderStats() const { return m_stats; }
 
 public slots:
     void tick(QTimerEvent* event);                      // Called once per tick of m_timer
@@ -119,7 +209,7 @@ private:
     // Tick Related Variables
     int m_timer;                                        // Stores timer which attempts to run ~60 times per second
     QElapsedTimer m_elapsedTimer;                       // Stores timer which keeps track of actual time between frames
-    float m_time;                                        // Keeps track of actual time
+    float m_time = 0.0f;                                 // Keeps track of actual time
 
     // Input Related Variables
     bool m_mouseDown = false;                           // Stores state of left mouse button
@@ -135,6 +225,185 @@ private:
     // For original Gemoetry painting
     void paintGeometry();
 
+    // For Render Queue
+    RenderQueue m_renderQueue;
+    std::vector<MaterialEntry> m_materials; // Distinct materials seen so far, indexed by ShapeData::materialId
+    uint32_t registerMaterial(const glm::vec4& ambient, const glm::vec4& diffuse, const glm::vec4& specular, float shininess);
+    void submitShapes(const glm::mat4& view, const glm::mat4& proj, float farPlane);
+    void drawRenderQueue(const std::vector<ShapeData>& shapes, const InstanceDraw* instances = nullptr,
+                         const std::vector<LodSelection>* lods = nullptr);
+
+    // For Mesh LOD
+    MeshCache m_meshCache;                   // Shared segment meshes, several tessellations each
+    std::vector<LodSelection> m_shapeLod;    // Level picked per entry of m_shapeData by the last submitShapes
+    void selectShapeLods(const glm::mat4& view, const glm::mat4& proj);
+
+    // For Frustum Culling
+    BoundsSoA m_shapeBounds;              // World-space box per entry of m_shapeData
+    std::vector<uint8_t> m_shapeVisible;  // Camera frustum result per shape
+    std::vector<uint8_t> m_shadowVisible; // Light frustum result per shape
+    std::vector<int> m_shapeTreeIndex;    // Forest tree each shape belongs to, -1 for everything else
+    BoundsSoA m_treeBounds;               // World-space box per forest tree
+    std::vector<uint8_t> m_treeVisible;   // Frustum result per tree of the last uploadVisibleTrees
+    GLuint m_meshedTreeVBO = 0;           // Trees drawn as meshes this frame, from paintLSystem
+    int m_meshedTreeCount = 0;
+    GLuint m_shadowTreeVBO = 0;           // Trees inside the light's frustum, from renderShadowMap
+    int m_shadowTreeCount = 0;
+    void rebuildShapeBounds();
+    int uploadVisibleTrees(const Frustum& frustum, bool meshedOnly, GLuint buffer);
+    void computeTreeBounds();
+    void growTreeBounds(const std::vector<TreeSegment>& segments);
+
+    // For Iteration Depth LOD
+    std::vector<uint8_t> m_shapeTreeDepth; // Iterations of the tree copy each shape belongs to, 0 for every depth
+    std::vector<uint8_t> m_treeDepth;      // Iterations each forest tree is drawn with, kept between frames
+    int m_depthLevels = 0;                 // Deepest level built, 0 when forest trees have a single depth
+    void buildDepthLevels(int iterations, float angle, float length);
+    void selectTreeDepths();
+    void hideOtherDepths(std::vector<uint8_t>& visible) const;
+
+    // For Occlusion Culling
+    GLuint m_occlusion_shader;
+    GLuint m_boxVAO = 0;
+    GLuint m_boxVBO = 0;
+    int m_boxVertexCount = 0;
+    GLenum m_occlusionQueryTarget = GL_ANY_SAMPLES_PASSED;
+    std::vector<GLuint> m_treeQueries;        // One query per forest tree, issued every frame
+    std::vector<uint8_t> m_treeOccluded;      // Last known result per tree
+    std::vector<uint8_t> m_treeQueryIssued;   // Trees the camera was inside of get no query and count as visible
+    bool m_occlusionPending = false;          // Whether m_treeQueries hold results from last frame
+    GLuint m_visibleTreeInstanceVBO = 0;      // Instances still drawn as meshes, fed to the GPU cull
+    GLuint m_visibleTreeInstanceVAO = 0;
+    int m_visibleTreeCount = 0;
+    RenderStats m_stats;
+    void initializeOcclusion();
+    void resetOcclusion();
+    void readOcclusionResults();
+    void issueOcclusionQueries();
+
+    // For Impostors
+    GLuint m_impostor_bake_shader;
+    GLuint m_impostor_shader;
+    GLuint m_impostorFBO = 0;
+    GLuint m_impostorAlbedo = 0;              // Atlas of baked views, color with coverage in alpha
+    GLuint m_impostorNormalDepth = 0;         // Atlas of baked views, world normal and frame depth
+    GLuint m_impostorRenderbuffer = 0;
+    GLuint m_impostorVAO = 0;
+    GLuint m_impostorQuadVBO = 0;
+    GLuint m_impostorInstanceVBO = 0;
+    bool m_impostorReady = false;             // Whether the atlas holds the current templateTree
+    std::vector<uint8_t> m_treeImpostor;      // Per forest tree, drawn as an impostor this frame
+    std::vector<glm::vec4> m_impostorInstances;
+    bool m_meshTreeSubset = false;            // Instanced forest culls m_visibleTreeInstanceVBO instead of every tree
+    void initializeImpostors();
+    void makeImpostorFBO();
+    void bakeImpostor();
+    void selectTreeRepresentations();
+    void paintImpostors();
+
+    // For Static Batch
+    GLuint m_batchVAO = 0;
+    GLuint m_batchVBO = 0;
+    std::vector<std::pair<glm::vec3, glm::vec3>> m_batchBounds; // World-space box per batch group
+    std::vector<ShapeData> m_batchShapes;     // Baked template tree groups drawn by the instanced forest
+    std::vector<ShapeData> bakeStaticBatch(const std::vector<ShapeData>& shapes);
+    void releaseStaticBatch();
+    const std::vector<ShapeData>& instancedShapes() const;
+
+    // For Tessellated Branches
+    struct PatchRange {
+        int first = 0;                        // First patch vertex (capsule instance)
+        int count = 0;                        // Patch vertices, two per segment (capsule instances)
+    };
+    GLuint m_branch_patch_shader = 0;
+    GLuint m_branch_patch_depth_shader = 0;
+    GLuint m_branchPatchVAO = 0;
+    GLuint m_branchPatchVBO = 0;
+    GLuint m_branchPatchInstanceVBO = 0;
+    GLuint m_branchPatchDataBuffer = 0;       // Two vec4 per segment, read through m_branchPatchDataTexture
+    GLuint m_branchPatchDataTexture = 0;
+    PatchRange m_branchPatchRanges[2];        // Trunk, then branch segments of the template tree
+    int m_branchPatchInstanceCount = 0;
+    bool m_branchPatchesSupported = false;
+    void initializeBranchPatches();
+    void uploadBranchPatches(const std::vector<TreeSegment>& segments);
+    void drawBranchPatches(GLuint program, const PatchRange& range);
+    void paintBranchPatches();
+    void renderBranchPatchesShadow();
+
+    // For Capsule Twigs
+    GLuint m_capsule_shader = 0;
+    GLuint m_capsule_depth_shader = 0;
+    GLuint m_capsule_bake_shader = 0;
+    GLuint m_capsuleVAO = 0;
+    GLuint m_capsuleQuadVBO = 0;
+    GLuint m_capsuleDataBuffer = 0;           // Four vec4 per template capsule, read through m_capsuleDataTexture
+    GLuint m_capsuleDataTexture = 0;
+    PatchRange m_capsuleRanges[2];            // Trunk, then branch capsules of the template tree
+    void initializeCapsules();
+    void uploadCapsules(const std::vector<TreeSegment>& capsules);
+    void drawCapsules(GLuint program, GLuint treeBuffer, int treeCount);
+    void paintCapsules();
+    void renderCapsulesShadow();
+    void bakeCapsules(const glm::mat4& view, const glm::mat4& projection, const glm::vec3& viewDirection);
+
+    // For Leaf Cards
+    GLuint m_leaf_shader = 0;
+    GLuint m_leaf_depth_shader = 0;
+    GLuint m_leaf_bake_shader = 0;
+    GLuint m_leafCardVAO = 0;
+    GLuint m_leafCardVBO = 0;
+    GLuint m_leafDataBuffer = 0;              // Three vec4 per template leaf, read through m_leafDataTexture
+    GLuint m_leafDataTexture = 0;
+    int m_leafCardVertexCount = 0;
+    int m_leafCount = 0;
+    void initializeLeafCards();
+    void uploadLeafCards(const std::vector<TreeSegment>& leaves);
+    void drawLeafCards(GLuint program, GLuint treeBuffer, int treeCount);
+    void paintLeafCards();
+    void renderLeafCardsShadow();
+    void bakeLeafCards(const glm::mat4& view, const glm::mat4& projection);
+
+    // For GPU Forest Culling
+    enum CullTarget { CULL_CAMERA = 0, CULL_SHADOW = 1 };
+    bool m_instancedForest = false;           // Forest trees are drawn as instances of templateTree
+    float m_growthStartTime = 0.0f;           // m_time at which the growth animation last restarted
+
+    // View-dependent expansion of the lone tree, see realtimeexpansion.cpp
+    AdaptiveDerivation m_adaptive;
+    bool m_adaptiveActive = false;            // Whether the tree shown is m_adaptive's current cut
+    float m_adaptiveAngle = 0.0f;             // Turtle angle and length it was derived with
+    float m_adaptiveLength = 0.0f;
+    glm::mat4 m_adaptiveView = glm::mat4(0.0f); // Camera the cut was last refined for
+    glm::mat4 m_adaptiveProj = glm::mat4(0.0f);
+    DerivationCostModel m_costModel;          // Predicts generation cost, calibrated by every generation
+    GrammarData m_grammar;                       // Grammar of the tree, from a grammar file or built in
+    std::string m_grammarSource;                 // Grammar file or built-in tree m_lSystem was compiled from
+    LSystem m_lSystem{"", ProductionRules(), 0}; // m_grammar compiled, kept across generations
+    ParametricLSystem m_parametric;              // m_grammar compiled, when it is parametric
+    std::vector<glm::vec4> m_treeInstances;   // xyz: world offset of each forest tree
+    glm::vec3 m_treeBoundsMin;                // Bounding box of templateTree
+    glm::vec3 m_treeBoundsMax;
+    glm::vec3 m_treeBoundsCenter;             // Bounding sphere of templateTree
+    float m_treeBoundsRadius = 0.0f;
+    GLuint m_cull_shader;
+    GLuint m_treeInstanceVBO = 0;
+    GLuint m_treeInstanceVAO = 0;
+    static constexpr int kCullSlots = 3;      // One output drawn, one whose count may still be pending, one written
+    GLuint m_culledInstanceVBO[kCullSlots][2]; // [slot][CullTarget] compacted visible instances
+    GLuint m_cullQuery[kCullSlots][2];        // Primitives written by each cull
+    GLuint m_treeIndirectBuffer = 0;          // Indirect commands per template shape (query buffer path)
+    bool m_useQueryBuffer = false;            // GL 4.4 query buffer objects let the GPU feed its own instance count
+    int m_cullSlotFrame[kCullSlots][2] = {};  // [slot][CullTarget] frame that last culled into the slot
+    int m_cullDrawSlot[2] = {-1, -1};         // [CullTarget] slot m_cullVisibleCount was read from, -1 before any
+    GLuint m_cullVisibleCount[2] = {0, 0};    // [CullTarget] count of m_cullDrawSlot, drawn again while newer ones are pending
+    int m_cullFrame = 0;
+    void initializeGpuCulling();
+    void uploadTreeInstances();
+    InstanceDraw cullTreeInstances(const glm::mat4& viewProj, CullTarget target);
+    void paintTreeInstances();
+    void renderTreeInstancesShadow();
+
     // For L System
     glm::mat4 m_model = glm::mat4(1);
     glm::mat4 m_view  = glm::mat4(1);
@@ -154,6 +423,10 @@ private:
     int maxParticles = 1000; // Particle Number
 
     // For Shadow
+    static constexpr float kShadowExtent = 20.0f; // The shadow map covers [-extent, extent] across the light
+    static constexpr float kShadowNear = 1.0f;
+    static constexpr float kShadowFar = 50.0f;
+    glm::mat4 lightViewMatrix() const;
     glm::mat4 lightSpaceMatrix;
     GLuint shadowFBO;
     GLuint shadowTexture;
@@ -169,6 +442,10 @@ private:
     void initializeLights();
     void updateLights();
     void paintLSystem();
+    void setSceneUniforms(GLuint program);
+    void setAnimationUniforms(GLuint program);
+    void setAnimationAttributes(const ShapeData& shape);
+    float growthTime() const;
 
     // Task 30: Update the paintTexture function signature
     void paintFBOTexture(GLuint texture, bool enablePerPixelFilter, bool enableKernelFilter);
@@ -0,0 +1,129 @@
+#include "realtime.h"
+#include <limits>
+#include <map>
+#include <utility>
+#include <glm/glm.hpp>
+
+// Floats per batch vertex: position, normal and uv like the meshes, then the wind and growth data of its shape
+static constexpr int kBatchStride = 19;
+
+// Concatenate every cached-mesh shape of shapes into one buffer, transformed to world space on the CPU.
+// Vertices are grouped by material and texture; one ShapeData per group is returned, drawing its range of the
+// buffer with an identity model matrix, so the whole set costs one draw per material
+std::vector<ShapeData> Realtime::bakeStaticBatch(const std::vector<ShapeData>& shapes) {
+    releaseStaticBatch();
+
+    std::map<std::pair<uint32_t, GLuint>, size_t> groupIndex;
+    std::vector<std::vector<GLfloat>> groupVertices;
+    std::vector<const ShapeData*> groupMaterial; // First shape of each group, supplies its material and texture
+
+    for (const ShapeData& shape : shapes) {
+        if (shape.meshId < 0) {
+            continue;
+        }
+
+        GLuint texture = shape.textureUsed ? shape.diffuseTexture : 0;
+        auto key = std::make_pair(shape.materialId, texture);
+        auto found = groupIndex.find(key);
+        if (found == groupIndex.end()) {
+            found = groupIndex.emplace(key, groupVertices.size()).first;
+            groupVertices.emplace_back();
+            groupMaterial.push_back(&shape);
+            m_batchBounds.emplace_back(glm::vec3(std::numeric_limits<float>::max()), glm::vec3(std::numeric_limits<float>::lowest()));
+        }
+        std::vector<GLfloat>& out = groupVertices[found->second];
+        std::pair<glm::vec3, glm::vec3>& bounds = m_batchBounds[found->second];
+
+        // Normals are transformed here too, so the batch needs no normal matrix
+        glm::mat4 modelMatrix = shape.modelMatrix;
+        glm::mat3 normalMatrix = glm::inverse(glm::transpose(glm::mat3(modelMatrix)));
+
+        const std::vector<float>& vertices = m_meshCache.vertices(shape.meshId);
+        out.reserve(out.size() + vertices.size() / 8 * kBatchStride);
+        for (size_t v = 0; v + 8 <= vertices.size(); v += 8) {
+            glm::vec3 position = glm::vec3(modelMatrix * glm::vec4(vertices[v], vertices[v + 1], vertices[v + 2], 1.0f));
+            glm::vec3 normal = glm::normalize(normalMatrix * glm::vec3(vertices[v + 3], vertices[v + 4], vertices[v + 5]));
+
+            const glm::vec4& wind = shape.windOrigin;
+            const glm::vec4& growth = shape.growthStart;
+            out.insert(out.end(), {position.x, position.y, position.z, normal.x, normal.y, normal.z, vertices[v + 6], vertices[v + 7],
+                                   wind.x, wind.y, wind.z, wind.w, shape.windParent.x, shape.windParent.y,
+                                   growth.x, growth.y, growth.z, growth.w, shape.growthEnd});
+            bounds.first = glm::min(bounds.first, position);
+            bounds.second = glm::max(bounds.second, position);
+        }
+    }
+
+    std::vector<ShapeData> batchShapes;
+    if (groupVertices.empty()) {
+        return batchShapes;
+    }
+
+    // One buffer, groups back to back
+    std::vector<GLfloat> batch;
+    for (const std::vector<GLfloat>& group : groupVertices) {
+        batch.insert(batch.end(), group.begin(), group.end());
+    }
+
+    glGenVertexArrays(1, &m_batchVAO);
+    glGenBuffers(1, &m_batchVBO);
+    glBindVertexArray(m_batchVAO);
+    glBindBuffer(GL_ARRAY_BUFFER, m_batchVBO);
+    glBufferData(GL_ARRAY_BUFFER, batch.size() * sizeof(GLfloat), batch.data(), GL_STATIC_DRAW);
+
+    GLsizei stride = kBatchStride * sizeof(GLfloat);
+    glEnableVertexAttribArray(0); // Vertex position
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, reinterpret_cast<void *>(0));
+
+    glEnableVertexAttribArray(1); // Normals
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, stride, reinterpret_cast<void *>(3 * sizeof(GLfloat)));
+
+    glEnableVertexAttribArray(2); // UV coordinates
+    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, stride, reinterpret_cast<void *>(6 * sizeof(GLfloat)));
+
+    glEnableVertexAttribArray(6); // Wind origin, depth and phase
+    glVertexAttribPointer(6, 4, GL_FLOAT, GL_FALSE, stride, reinterpret_cast<void *>(8 * sizeof(GLfloat)));
+
+    glEnableVertexAttribArray(7); // Wind parent phase and reach
+    glVertexAttribPointer(7, 2, GL_FLOAT, GL_FALSE, stride, reinterpret_cast<void *>(12 * sizeof(GLfloat)));
+
+    glEnableVertexAttribArray(8); // Growth anchor and birth
+    glVertexAttribPointer(8, 4, GL_FLOAT, GL_FALSE, stride, reinterpret_cast<void *>(14 * sizeof(GLfloat)));
+
+    glEnableVertexAttribArray(9); // Growth end
+    glVertexAttribPointer(9, 1, GL_FLOAT, GL_FALSE, stride, reinterpret_cast<void *>(18 * sizeof(GLfloat)));
+
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindVertexArray(0);
+
+    int firstVertex = 0;
+    for (size_t group = 0; group < groupVertices.size(); ++group) {
+        ShapeData shapeData = *groupMaterial[group];
+        shapeData.vao = m_batchVAO;
+        shapeData.vbo = m_batchVBO;
+        shapeData.firstVertex = firstVertex;
+        shapeData.vertexCount = static_cast<int>(groupVertices[group].size() / kBatchStride);
+        shapeData.modelMatrix = glm::mat4(1.0f);
+        shapeData.meshId = -1;
+        shapeData.batchGroup = static_cast<int>(group);
+        batchShapes.push_back(shapeData);
+
+        firstVertex += shapeData.vertexCount;
+    }
+
+    return batchShapes;
+}
+
+void Realtime::releaseStaticBatch() {
+    glDeleteBuffers(1, &m_batchVBO);
+    glDeleteVertexArrays(1, &m_batchVAO);
+    m_batchVBO = 0;
+    m_batchVAO = 0;
+    m_batchBounds.clear();
+    m_batchShapes.clear();
+}
+
+// Shapes the instanced forest draws per tree: the baked groups when the static batch is on, else templateTree
+const std::vector<ShapeData>& Realtime::instancedShapes() const {
+    return m_batchShapes.empty() ? templateTree : m_batchShapes;
+}
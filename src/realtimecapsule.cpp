@@ -0,0 +1,200 @@
+#include "realtime.h"
+#include "settings.h"
+#include "utils/shaderloader.h"
+#include <glm/glm.hpp>
+
+// Per-capsule data: start and radius, end, wind origin, wind parent with birth and grown times
+static constexpr int kCapsuleVec4s = 4;
+
+// Capsule data lives in a buffer texture on its own slot, after the branch patch data
+static constexpr int kCapsuleDataSlot = 7;
+
+// Same wood material as the meshed branches
+static const glm::vec4 kWoodAmbient(0.4f, 0.3f, 0.2f, 1.0f);
+static const glm::vec4 kWoodDiffuse(0.5f, 0.4f, 0.3f, 1.0f);
+static const glm::vec4 kWoodSpecular(0.1f, 0.1f, 0.1f, 1.0f);
+
+void Realtime::initializeCapsules() {
+    m_capsule_shader = ShaderLoader::createShaderProgram(":/resources/shaders/capsule.vert", ":/resources/shaders/capsule.frag");
+    m_capsule_depth_shader = ShaderLoader::createShaderProgram(":/resources/shaders/capsule.vert", ":/resources/shaders/capsuledepth.frag");
+    m_capsule_bake_shader = ShaderLoader::createShaderProgram(":/resources/shaders/capsule.vert", ":/resources/shaders/capsulebake.frag");
+
+    // Bounding quad, placed around each capsule in the vertex shader
+    std::vector<GLfloat> corners = {-1.0f, -1.0f,  1.0f, -1.0f,  -1.0f, 1.0f,  1.0f, 1.0f};
+    glGenBuffers(1, &m_capsuleQuadVBO);
+    glGenVertexArrays(1, &m_capsuleVAO);
+    glBindVertexArray(m_capsuleVAO);
+
+    glBindBuffer(GL_ARRAY_BUFFER, m_capsuleQuadVBO);
+    glBufferData(GL_ARRAY_BUFFER, corners.size() * sizeof(GLfloat), corners.data(), GL_STATIC_DRAW);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(GLfloat), reinterpret_cast<void *>(0));
+
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindVertexArray(0);
+
+    glGenBuffers(1, &m_capsuleDataBuffer);
+    glGenTextures(1, &m_capsuleDataTexture);
+    glBindBuffer(GL_TEXTURE_BUFFER, m_capsuleDataBuffer);
+    glBindTexture(GL_TEXTURE_BUFFER, m_capsuleDataTexture);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, m_capsuleDataBuffer);
+    glBindTexture(GL_TEXTURE_BUFFER, 0);
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+}
+
+// Upload the template tree's thin segments, trunk first. Called before the impostor bake, which draws them too;
+// an empty list turns the capsules off
+void Realtime::uploadCapsules(const std::vector<TreeSegment>& capsules) {
+    for (PatchRange& range : m_capsuleRanges) {
+        range = PatchRange();
+    }
+    if (capsules.empty()) {
+        return;
+    }
+
+    // Four vec4 per capsule; 64 bytes and a 4 vertex quad instead of a cylinder mesh
+    std::vector<glm::vec4> data;
+    data.reserve(kCapsuleVec4s * capsules.size());
+    for (int kind = 0; kind < 2; ++kind) {
+        SegmentKind wanted = kind == 0 ? SegmentKind::Trunk : SegmentKind::Branch;
+        m_capsuleRanges[kind].first = static_cast<int>(data.size() / kCapsuleVec4s);
+
+        for (const TreeSegment& capsule : capsules) {
+            if (capsule.kind != wanted) {
+                continue;
+            }
+            data.push_back(glm::vec4(capsule.start, 0.5f * capsule.thickness));
+            data.push_back(glm::vec4(capsule.end, 0.0f));
+            data.push_back(capsule.windOrigin());
+            data.push_back(glm::vec4(capsule.windParent(), capsule.birth, capsule.grown));
+        }
+        m_capsuleRanges[kind].count = static_cast<int>(data.size() / kCapsuleVec4s) - m_capsuleRanges[kind].first;
+    }
+
+    glBindBuffer(GL_TEXTURE_BUFFER, m_capsuleDataBuffer);
+    glBufferData(GL_TEXTURE_BUFFER, data.size() * sizeof(glm::vec4), data.data(), GL_STATIC_DRAW);
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+}
+
+// Capsule buffer and wood textures for program, every capsule once per tree offset in treeBuffer or once at
+// the origin without one. GL 4.1 has no base instance, so each kind's range is passed as uniforms
+void Realtime::drawCapsules(GLuint program, GLuint treeBuffer, int treeCount) {
+    glUniform1i(glGetUniformLocation(program, "capsuleData"), kCapsuleDataSlot);
+    glUniform1i(glGetUniformLocation(program, "Texture"), 1);
+    GLint firstLoc = glGetUniformLocation(program, "firstCapsule");
+    GLint countLoc = glGetUniformLocation(program, "capsuleCount");
+
+    glActiveTexture(GL_TEXTURE0 + kCapsuleDataSlot);
+    glBindTexture(GL_TEXTURE_BUFFER, m_capsuleDataTexture);
+    glActiveTexture(GL_TEXTURE1);
+
+    glBindVertexArray(m_capsuleVAO);
+    if (treeBuffer == 0) {
+        // A single tree keeps the default (0, 0, 0, 1) offset
+        glDisableVertexAttribArray(3);
+    } else {
+        glBindBuffer(GL_ARRAY_BUFFER, treeBuffer);
+        glVertexAttribPointer(3, 4, GL_FLOAT, GL_FALSE, 4 * sizeof(GLfloat), reinterpret_cast<void *>(0));
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        glEnableVertexAttribArray(3);
+    }
+
+    GLuint textures[2] = {m_trunk_texture, m_branch_texture};
+    for (int kind = 0; kind < 2; ++kind) {
+        const PatchRange& range = m_capsuleRanges[kind];
+        if (range.count == 0) {
+            continue;
+        }
+
+        // The offset advances once every range.count instances, so every tree draws the whole range
+        glVertexAttribDivisor(3, range.count);
+        glUniform1i(firstLoc, range.first);
+        glUniform1i(countLoc, range.count);
+        glBindTexture(GL_TEXTURE_2D, textures[kind]);
+        glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, range.count * treeCount);
+    }
+
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glBindVertexArray(0);
+    glActiveTexture(GL_TEXTURE0 + kCapsuleDataSlot);
+    glBindTexture(GL_TEXTURE_BUFFER, 0);
+    glActiveTexture(GL_TEXTURE1);
+}
+
+// Main pass over the trees drawn as meshes, after the meshed shapes so the ray-cast depth tests against them
+void Realtime::paintCapsules() {
+    bool forest = !m_treeInstances.empty();
+    if (m_capsuleRanges[0].count + m_capsuleRanges[1].count == 0 || (forest && m_meshedTreeCount == 0)) {
+        return;
+    }
+
+    GLuint program = m_capsule_shader;
+    glUseProgram(program);
+    glUniformMatrix4fv(glGetUniformLocation(program, "viewMatrix"), 1, GL_FALSE, &m_view[0][0]);
+    glUniformMatrix4fv(glGetUniformLocation(program, "projMatrix"), 1, GL_FALSE, &m_proj[0][0]);
+    glUniformMatrix4fv(glGetUniformLocation(program, "lightSpaceMatrix"), 1, GL_FALSE, &lightSpaceMatrix[0][0]);
+    glUniform3fv(glGetUniformLocation(program, "cameraPosition"), 1, &eye[0]);
+    glUniform1i(glGetUniformLocation(program, "orthographic"), false);
+    setAnimationUniforms(program);
+
+    // Only the first light is used, like the impostors
+    const CustomLightData& light = lights[0];
+    glUniform4fv(glGetUniformLocation(program, "material.ambient"), 1, &kWoodAmbient[0]);
+    glUniform4fv(glGetUniformLocation(program, "material.diffuse"), 1, &kWoodDiffuse[0]);
+    glUniform4fv(glGetUniformLocation(program, "material.specular"), 1, &kWoodSpecular[0]);
+    glUniform1f(glGetUniformLocation(program, "material.shininess"), 32.0f);
+    glUniform1i(glGetUniformLocation(program, "textureUsed"), true);
+    glUniform1f(glGetUniformLocation(program, "blend"), 1.0f);
+    glUniform4fv(glGetUniformLocation(program, "lightColor"), 1, &light.color[0]);
+    glUniform3fv(glGetUniformLocation(program, "lightDirection"), 1, &glm::vec3(light.direction)[0]);
+    glUniform1f(glGetUniformLocation(program, "ka"), 0.5f);
+    glUniform1f(glGetUniformLocation(program, "kd"), 0.5f);
+    glUniform1f(glGetUniformLocation(program, "ks"), 0.5f);
+    glUniform1i(glGetUniformLocation(program, "toonShadingEnable"), settings.toonEnable);
+    glUniform1i(glGetUniformLocation(program, "toonColorLevel"), settings.toonLevel);
+    glUniform1i(glGetUniformLocation(program, "shadowMapEnable"), settings.extraCredit1);
+
+    // Slot 2 keeps the shadow map bound by paintLSystem
+    glUniform1i(glGetUniformLocation(program, "shadowMap"), 2);
+
+    drawCapsules(program, forest ? m_meshedTreeVBO : 0, forest ? m_meshedTreeCount : 1);
+    glUseProgram(m_shader);
+}
+
+// Shadow pass over the trees inside the light's frustum into the bound shadow FBO, rays run parallel to the light
+void Realtime::renderCapsulesShadow() {
+    bool forest = !m_treeInstances.empty();
+    if (m_capsuleRanges[0].count + m_capsuleRanges[1].count == 0 || (forest && m_shadowTreeCount == 0)) {
+        return;
+    }
+
+    GLuint program = m_capsule_depth_shader;
+    glm::mat4 identity(1.0f);
+    glm::vec3 rayDirection = glm::normalize(glm::vec3(lights[0].direction));
+    glUseProgram(program);
+    glUniformMatrix4fv(glGetUniformLocation(program, "viewMatrix"), 1, GL_FALSE, &lightSpaceMatrix[0][0]);
+    glUniformMatrix4fv(glGetUniformLocation(program, "projMatrix"), 1, GL_FALSE, &identity[0][0]);
+    glUniform1i(glGetUniformLocation(program, "orthographic"), true);
+    glUniform3fv(glGetUniformLocation(program, "rayDirection"), 1, &rayDirection[0]);
+    setAnimationUniforms(program);
+
+    drawCapsules(program, forest ? m_shadowTreeVBO : 0, forest ? m_shadowTreeCount : 1);
+    glUseProgram(m_depth_shader);
+}
+
+// One frame of the impostor bake, rays run parallel to the frame's view direction. Only the template tree,
+// so the tree offsets are left out
+void Realtime::bakeCapsules(const glm::mat4& view, const glm::mat4& projection, const glm::vec3& viewDirection) {
+    GLuint program = m_capsule_bake_shader;
+    glm::vec3 rayDirection = -viewDirection;
+    glUseProgram(program);
+    glUniformMatrix4fv(glGetUniformLocation(program, "viewMatrix"), 1, GL_FALSE, &view[0][0]);
+    glUniformMatrix4fv(glGetUniformLocation(program, "projMatrix"), 1, GL_FALSE, &projection[0][0]);
+    glUniform1i(glGetUniformLocation(program, "orthographic"), true);
+    glUniform3fv(glGetUniformLocation(program, "rayDirection"), 1, &rayDirection[0]);
+    glUniform4fv(glGetUniformLocation(program, "diffuse"), 1, &kWoodDiffuse[0]);
+    glUniform1i(glGetUniformLocation(program, "textureUsed"), true);
+    glUniform1f(glGetUniformLocation(program, "blend"), 1.0f);
+
+    drawCapsules(program, 0, 1);
+}
@@ -0,0 +1,217 @@
+#include "realtime.h"
+#include "settings.h"
+#include "shapes/vbogenerator.h"
+#include "utils/shaderloader.h"
+#include <algorithm>
+#include <glm/glm.hpp>
+
+// Recompute the world-space bounding box of every shape, called whenever m_shapeData is regenerated.
+// Every primitive fits in the unit box [-0.5, 0.5]^3 in object space, so the model matrix alone bounds it
+void Realtime::rebuildShapeBounds() {
+    m_shapeBounds.clear();
+
+    for (const ShapeData& shape : m_shapeData) {
+        // Batch groups are already in world space and bounded when they are baked
+        if (shape.batchGroup >= 0) {
+            m_shapeBounds.add(m_batchBounds[shape.batchGroup].first, m_batchBounds[shape.batchGroup].second);
+            continue;
+        }
+
+        glm::vec3 boxMin, boxMax;
+        BoundsSoA::transformUnitBox(shape.modelMatrix, boxMin, boxMax);
+        m_shapeBounds.add(boxMin, boxMax);
+    }
+
+    // Shapes added outside the forest loop don't belong to any tree and are drawn at every depth
+    m_shapeTreeIndex.resize(m_shapeData.size(), -1);
+    m_shapeTreeDepth.resize(m_shapeData.size(), 0);
+
+    m_treeBounds.clear();
+    for (const glm::vec4& tree : m_treeInstances) {
+        m_treeBounds.add(m_treeBoundsMin + glm::vec3(tree), m_treeBoundsMax + glm::vec3(tree));
+    }
+}
+
+// Upload to buffer the offsets of the forest trees inside frustum, for the geometry drawn per tree outside
+// m_shapeData. With meshedOnly, occluded trees and trees drawn as impostors are left out too, like
+// submitShapes leaves out their shapes through m_shapeTreeIndex. Returns the number of trees uploaded
+int Realtime::uploadVisibleTrees(const Frustum& frustum, bool meshedOnly, GLuint buffer) {
+    cullBoxes(frustum, m_treeBounds, m_treeVisible);
+
+    std::vector<glm::vec4> trees;
+    trees.reserve(m_treeInstances.size());
+    for (size_t i = 0; i < m_treeInstances.size(); ++i) {
+        if (!m_treeVisible[i] || (meshedOnly && (m_treeOccluded[i] || m_treeImpostor[i]))) {
+            continue;
+        }
+        trees.push_back(m_treeInstances[i]);
+    }
+
+    if (!trees.empty()) {
+        glBindBuffer(GL_ARRAY_BUFFER, buffer);
+        glBufferData(GL_ARRAY_BUFFER, trees.size() * sizeof(glm::vec4), trees.data(), GL_STREAM_DRAW);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+    return static_cast<int>(trees.size());
+}
+
+// Bounding box and sphere of templateTree in tree space, shared by every forest instance
+void Realtime::computeTreeBounds() {
+    glm::vec3 treeMin(0.0f), treeMax(0.0f);
+    for (size_t i = 0; i < templateTree.size(); ++i) {
+        glm::vec3 boxMin, boxMax;
+        BoundsSoA::transformUnitBox(templateTree[i].modelMatrix, boxMin, boxMax);
+        treeMin = i == 0 ? boxMin : glm::min(treeMin, boxMin);
+        treeMax = i == 0 ? boxMax : glm::max(treeMax, boxMax);
+    }
+    m_treeBoundsMin = treeMin;
+    m_treeBoundsMax = treeMax;
+    m_treeBoundsCenter = 0.5f * (treeMin + treeMax);
+    m_treeBoundsRadius = 0.5f * glm::length(treeMax - treeMin);
+}
+
+// Widen the template tree's bounds by segments that are drawn without a ShapeData of their own
+void Realtime::growTreeBounds(const std::vector<TreeSegment>& segments) {
+    if (segments.empty()) {
+        return;
+    }
+
+    bool empty = templateTree.empty();
+    for (const TreeSegment& segment : segments) {
+        glm::vec3 reach(0.5f * segment.thickness);
+        glm::vec3 boxMin = glm::min(segment.start, segment.end) - reach;
+        glm::vec3 boxMax = glm::max(segment.start, segment.end) + reach;
+        m_treeBoundsMin = empty ? boxMin : glm::min(m_treeBoundsMin, boxMin);
+        m_treeBoundsMax = empty ? boxMax : glm::max(m_treeBoundsMax, boxMax);
+        empty = false;
+    }
+    m_treeBoundsCenter = 0.5f * (m_treeBoundsMin + m_treeBoundsMax);
+    m_treeBoundsRadius = 0.5f * glm::length(m_treeBoundsMax - m_treeBoundsMin);
+}
+
+void Realtime::initializeOcclusion() {
+    m_occlusion_shader = ShaderLoader::createShaderProgram(":/resources/shaders/occlusion.vert", ":/resources/shaders/occlusion.frag");
+
+    // Unit cube stretched over each tree's box in the vertex shader
+    std::vector<GLfloat> boxVertices;
+    generateVBOBasedOnType(1, 1, boxVertices, PrimitiveType::PRIMITIVE_CUBE);
+    m_boxVertexCount = boxVertices.size() / 8;
+
+    glGenBuffers(1, &m_boxVBO);
+    glGenVertexArrays(1, &m_boxVAO);
+    glBindVertexArray(m_boxVAO);
+    glBindBuffer(GL_ARRAY_BUFFER, m_boxVBO);
+    glBufferData(GL_ARRAY_BUFFER, boxVertices.size() * sizeof(GLfloat), boxVertices.data(), GL_STATIC_DRAW);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(GLfloat), reinterpret_cast<void *>(0));
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindVertexArray(0);
+
+    // Per-frame tree offsets for the capsules and leaf cards, see uploadVisibleTrees
+    glGenBuffers(1, &m_meshedTreeVBO);
+    glGenBuffers(1, &m_shadowTreeVBO);
+
+    // Conservative queries may stop rasterizing at the first sample, but need GL 4.3 or ES3 compatibility
+    m_occlusionQueryTarget = (GLEW_VERSION_4_3 || GLEW_ARB_ES3_compatibility) ? GL_ANY_SAMPLES_PASSED_CONSERVATIVE
+                                                                               : GL_ANY_SAMPLES_PASSED;
+}
+
+// One query per forest tree, every tree starts out visible
+void Realtime::resetOcclusion() {
+    if (!m_treeQueries.empty()) {
+        glDeleteQueries(static_cast<GLsizei>(m_treeQueries.size()), m_treeQueries.data());
+    }
+
+    m_treeQueries.assign(m_treeInstances.size(), 0);
+    if (!m_treeQueries.empty()) {
+        glGenQueries(static_cast<GLsizei>(m_treeQueries.size()), m_treeQueries.data());
+    }
+    m_treeOccluded.assign(m_treeInstances.size(), 0);
+    m_treeQueryIssued.assign(m_treeInstances.size(), 0);
+    m_occlusionPending = false;
+
+    m_stats.forestTrees = static_cast<int>(m_treeInstances.size());
+    m_stats.occludedTrees = 0;
+}
+
+// Pick up last frame's query results without waiting on the GPU.
+// A result that isn't ready yet keeps the tree's previous state
+void Realtime::readOcclusionResults() {
+    if (!settings.occlusionCulling || !m_occlusionPending) {
+        std::fill(m_treeOccluded.begin(), m_treeOccluded.end(), 0);
+    } else {
+        for (size_t i = 0; i < m_treeQueries.size(); ++i) {
+            if (!m_treeQueryIssued[i]) {
+                m_treeOccluded[i] = 0;
+                continue;
+            }
+
+            GLuint available = 0;
+            glGetQueryObjectuiv(m_treeQueries[i], GL_QUERY_RESULT_AVAILABLE, &available);
+            if (!available) {
+                continue;
+            }
+
+            GLuint anySamplesPassed = 0;
+            glGetQueryObjectuiv(m_treeQueries[i], GL_QUERY_RESULT, &anySamplesPassed);
+            m_treeOccluded[i] = anySamplesPassed == 0;
+        }
+    }
+
+    int occluded = 0;
+    for (uint8_t treeOccluded : m_treeOccluded) {
+        occluded += treeOccluded;
+    }
+    m_stats.forestTrees = static_cast<int>(m_treeInstances.size());
+    m_stats.occludedTrees = occluded;
+}
+
+// Test every tree's box against the depth buffer of the finished main pass.
+// Occluded trees were skipped this frame, their boxes tell us whether they come back next frame
+void Realtime::issueOcclusionQueries() {
+    if (!settings.occlusionCulling || m_treeQueries.empty()) {
+        m_occlusionPending = false;
+        return;
+    }
+
+    glUseProgram(m_occlusion_shader);
+    glUniformMatrix4fv(glGetUniformLocation(m_occlusion_shader, "viewMatrix"), 1, GL_FALSE, &m_view[0][0]);
+    glUniformMatrix4fv(glGetUniformLocation(m_occlusion_shader, "projMatrix"), 1, GL_FALSE, &m_proj[0][0]);
+    GLint boxMinLoc = glGetUniformLocation(m_occlusion_shader, "boxMin");
+    GLint boxMaxLoc = glGetUniformLocation(m_occlusion_shader, "boxMax");
+
+    // Boxes must not show up or occlude each other, and the camera may be looking at their back faces
+    glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+    glDepthMask(GL_FALSE);
+    glDisable(GL_CULL_FACE);
+    glBindVertexArray(m_boxVAO);
+
+    // Near plane margin, a box this close to the eye could be clipped away while still covering the view
+    float margin = settings.nearPlane;
+
+    for (size_t i = 0; i < m_treeQueries.size(); ++i) {
+        glm::vec3 offset(m_treeInstances[i]);
+        glm::vec3 boxMin = m_treeBoundsMin + offset;
+        glm::vec3 boxMax = m_treeBoundsMax + offset;
+
+        if (glm::all(glm::greaterThan(eye, boxMin - margin)) && glm::all(glm::lessThan(eye, boxMax + margin))) {
+            m_treeQueryIssued[i] = 0;
+            continue;
+        }
+
+        glUniform3fv(boxMinLoc, 1, &boxMin[0]);
+        glUniform3fv(boxMaxLoc, 1, &boxMax[0]);
+        glBeginQuery(m_occlusionQueryTarget, m_treeQueries[i]);
+        glDrawArrays(GL_TRIANGLES, 0, m_boxVertexCount);
+        glEndQuery(m_occlusionQueryTarget);
+        m_treeQueryIssued[i] = 1;
+    }
+
+    glBindVertexArray(0);
+    glEnable(GL_CULL_FACE);
+    glDepthMask(GL_TRUE);
+    glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+    glUseProgram(0);
+
+    m_occlusionPending = true;
+}
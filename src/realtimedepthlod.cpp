@@ -0,0 +1,57 @@
+#include "realtime.h"
+#include "settings.h"
+#include "lsystem/depthlod.h"
+#include <glm/glm.hpp>
+
+// Derive the tree at every iteration count up to iterations and build the forest with all of them, the full
+// tree for near trees and the shallower ones for far trees. Each shallower derivation is a fraction of the
+// next, so deriving them all costs little more than the full one
+void Realtime::buildDepthLevels(int iterations, float angle, float length) {
+    std::vector<std::vector<TreeSegment>> levels(iterations);
+    for (int depth = 1; depth <= iterations; ++depth) {
+        if (m_grammar.parametric()) {
+            ModuleBuffer modules;
+            m_parametric.derive(depth, modules);
+            levels[depth - 1] = walkTurtle(modules.symbols, PackedSymbols::fromUnpacked(modules.births.data(), modules.size()),
+                                           angle, length, &modules);
+        } else {
+            m_lSystem.setIterations(depth);
+            std::string derived = m_lSystem.generate();
+            levels[depth - 1] = walkTurtle(derived, m_lSystem.birthIterations(), angle, length);
+        }
+    }
+    m_lSystem.setIterations(iterations);
+
+    std::vector<TreeSegment> full = std::move(levels.back());
+    levels.pop_back();
+    buildTree(std::move(full), 0, std::move(levels));
+}
+
+// Pick the depth every forest tree is drawn with from its distance to the camera, see treeDepthAt
+void Realtime::selectTreeDepths() {
+    if (m_depthLevels == 0) {
+        m_stats.shallowTrees = -1;
+        return;
+    }
+
+    m_stats.shallowTrees = 0;
+    for (size_t i = 0; i < m_treeInstances.size(); ++i) {
+        glm::vec3 treeCenter = m_treeBoundsCenter + glm::vec3(m_treeInstances[i]);
+        int depth = treeDepthAt(glm::distance(eye, treeCenter), settings.depthLodDistance, m_depthLevels, m_treeDepth[i]);
+        m_treeDepth[i] = static_cast<uint8_t>(depth);
+        m_stats.shallowTrees += depth < m_depthLevels ? 1 : 0;
+    }
+}
+
+// Clear the visibility of every tree shape copied at another depth than its tree is drawn with
+void Realtime::hideOtherDepths(std::vector<uint8_t>& visible) const {
+    if (m_depthLevels == 0) {
+        return;
+    }
+    for (size_t i = 0; i < visible.size(); ++i) {
+        int tree = m_shapeTreeIndex[i];
+        if (tree >= 0 && m_shapeTreeDepth[i] != 0 && m_shapeTreeDepth[i] != m_treeDepth[tree]) {
+            visible[i] = 0;
+        }
+    }
+}
@@ -0,0 +1,35 @@
+#include "realtime.h"
+#include "settings.h"
+
+// Refine m_adaptive for the camera and rebuild the tree when its cut changed, or always with rebuild, as when
+// the tree was just compiled. Refining again for an unchanged camera does nothing; a camera move keeps the
+// growth animation where it was
+void Realtime::refineExpansion(bool rebuild) {
+    if (!rebuild && m_view == m_adaptiveView && m_proj == m_adaptiveProj) {
+        return;
+    }
+    m_adaptiveView = m_view;
+    m_adaptiveProj = m_proj;
+    bool changed = m_adaptive.refine(m_view, m_proj, static_cast<float>(m_height), settings.expansionPixels);
+    m_stats.expansionProxies = m_adaptive.proxies();
+    if (!changed && !rebuild) {
+        return;
+    }
+
+    ModuleBuffer modules;
+    m_adaptive.emit(modules);
+    if (rebuild) {
+        interpretLSystem(modules.symbols, PackedSymbols::fromUnpacked(modules.births.data(), modules.size()), m_adaptiveAngle,
+                         m_adaptiveLength, &modules);
+        return;
+    }
+
+    // Called between frames, so the context has to be made current for the new buffers
+    makeCurrent();
+    float growthStartTime = m_growthStartTime;
+    clearShapeData(m_shapeData);
+    interpretLSystem(modules.symbols, PackedSymbols::fromUnpacked(modules.births.data(), modules.size()), m_adaptiveAngle,
+                     m_adaptiveLength, &modules);
+    m_growthStartTime = growthStartTime;
+    doneCurrent();
+}
@@ -0,0 +1,235 @@
+#include "realtime.h"
+#include "settings.h"
+#include "utils/shaderloader.h"
+#include <algorithm>
+#include <cstddef>
+#include <glm/glm.hpp>
+
+// Layout glDrawArraysIndirect reads from GL_DRAW_INDIRECT_BUFFER
+struct DrawArraysIndirectCommand {
+    GLuint count;
+    GLuint instanceCount;
+    GLuint first;
+    GLuint baseInstance;
+};
+
+void Realtime::initializeGpuCulling() {
+    m_cull_shader = ShaderLoader::createShaderProgram(
+        {{GL_VERTEX_SHADER, ":/resources/shaders/cull.vert"},
+         {GL_GEOMETRY_SHADER, ":/resources/shaders/cull.geom"}},
+        {"culledInstance"});
+
+    // Source instance buffer, read as one point per tree by the cull pass
+    glGenBuffers(1, &m_treeInstanceVBO);
+    glGenVertexArrays(1, &m_treeInstanceVAO);
+    glBindVertexArray(m_treeInstanceVAO);
+    glBindBuffer(GL_ARRAY_BUFFER, m_treeInstanceVBO);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, 4 * sizeof(GLfloat), reinterpret_cast<void *>(0));
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindVertexArray(0);
+
+    glGenBuffers(1, &m_visibleTreeInstanceVBO);
+    glGenVertexArrays(1, &m_visibleTreeInstanceVAO);
+    glBindVertexArray(m_visibleTreeInstanceVAO);
+    glBindBuffer(GL_ARRAY_BUFFER, m_visibleTreeInstanceVBO);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, 4 * sizeof(GLfloat), reinterpret_cast<void *>(0));
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindVertexArray(0);
+
+    // Compacted outputs and their primitive counters, triple buffered per target
+    glGenBuffers(kCullSlots * 2, &m_culledInstanceVBO[0][0]);
+    glGenQueries(kCullSlots * 2, &m_cullQuery[0][0]);
+    glGenBuffers(1, &m_treeIndirectBuffer);
+
+    // On GL 4.4+ the query result can be written into the indirect buffer on the GPU,
+    // on our 4.1 core profile the count is read back a frame late instead
+    m_useQueryBuffer = GLEW_VERSION_4_4 || GLEW_ARB_query_buffer_object;
+}
+
+// Upload m_treeInstances and size every buffer the cull pass writes to
+void Realtime::uploadTreeInstances() {
+    GLsizeiptr instanceBytes = m_treeInstances.size() * sizeof(glm::vec4);
+
+    glBindBuffer(GL_ARRAY_BUFFER, m_treeInstanceVBO);
+    glBufferData(GL_ARRAY_BUFFER, instanceBytes, m_treeInstances.data(), GL_STATIC_DRAW);
+
+    // Same trees, rewritten every frame with only those that passed occlusion
+    glBindBuffer(GL_ARRAY_BUFFER, m_visibleTreeInstanceVBO);
+    glBufferData(GL_ARRAY_BUFFER, instanceBytes, m_treeInstances.data(), GL_DYNAMIC_DRAW);
+    m_visibleTreeCount = static_cast<int>(m_treeInstances.size());
+
+    for (int slot = 0; slot < kCullSlots; ++slot) {
+        for (int target = 0; target < 2; ++target) {
+            glBindBuffer(GL_ARRAY_BUFFER, m_culledInstanceVBO[slot][target]);
+            glBufferData(GL_ARRAY_BUFFER, instanceBytes, nullptr, GL_DYNAMIC_COPY);
+        }
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    // One indirect command per template shape; instanceCount is filled in by the GPU after each cull
+    const std::vector<ShapeData>& shapes = instancedShapes();
+    std::vector<DrawArraysIndirectCommand> commands;
+    commands.reserve(shapes.size());
+    for (const ShapeData& shape : shapes) {
+        commands.push_back({static_cast<GLuint>(shape.vertexCount), 0, static_cast<GLuint>(shape.firstVertex), 0});
+    }
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, m_treeIndirectBuffer);
+    glBufferData(GL_DRAW_INDIRECT_BUFFER, commands.size() * sizeof(DrawArraysIndirectCommand), commands.data(), GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+
+    // The outputs were reallocated, so no count read before describes them
+    m_cullDrawSlot[CULL_CAMERA] = -1;
+    m_cullDrawSlot[CULL_SHADOW] = -1;
+}
+
+// Run the cull pass for one target and return how the template tree should be instanced for it
+InstanceDraw Realtime::cullTreeInstances(const glm::mat4& viewProj, CullTarget target) {
+    // Slots culled after the one drawn still wait for their counts. Read the newest that is ready; queries
+    // finish in order, so the older ones are then superseded
+    int& drawSlot = m_cullDrawSlot[target];
+    int current = m_cullFrame % kCullSlots;
+    if (!m_useQueryBuffer && drawSlot >= 0) {
+        int pending[kCullSlots - 1];
+        int pendingCount = 0;
+        for (int slot = 0; slot < kCullSlots; ++slot) {
+            if (slot != drawSlot && m_cullSlotFrame[slot][target] > m_cullSlotFrame[drawSlot][target]) {
+                pending[pendingCount++] = slot;
+            }
+        }
+        std::sort(pending, pending + pendingCount,
+                  [&](int a, int b) { return m_cullSlotFrame[a][target] > m_cullSlotFrame[b][target]; });
+        for (int i = 0; i < pendingCount; ++i) {
+            GLuint available = GL_FALSE;
+            glGetQueryObjectuiv(m_cullQuery[pending[i]][target], GL_QUERY_RESULT_AVAILABLE, &available);
+            if (available) {
+                glGetQueryObjectuiv(m_cullQuery[pending[i]][target], GL_QUERY_RESULT, &m_cullVisibleCount[target]);
+                drawSlot = pending[i];
+                pendingCount = i;
+                break;
+            }
+        }
+
+        // This cull must not overwrite the buffer drawn or the newest one pending. When the GPU is two culls
+        // behind, wait for the newer so the older can be reused
+        if (pendingCount == kCullSlots - 1) {
+            glGetQueryObjectuiv(m_cullQuery[pending[0]][target], GL_QUERY_RESULT, &m_cullVisibleCount[target]);
+            drawSlot = pending[0];
+            pendingCount = 0;
+        }
+        for (int slot = 0; slot < kCullSlots; ++slot) {
+            if (slot != drawSlot && (pendingCount == 0 || slot != pending[0])) {
+                current = slot;
+                break;
+            }
+        }
+    }
+    GLuint outputBuffer = m_culledInstanceVBO[current][target];
+    GLuint query = m_cullQuery[current][target];
+    m_cullSlotFrame[current][target] = m_cullFrame;
+
+    Frustum frustum = Frustum::fromMatrix(viewProj);
+
+    glUseProgram(m_cull_shader);
+    glUniform4fv(glGetUniformLocation(m_cull_shader, "frustumPlanes"), 6, &frustum.planes[0][0]);
+    glUniform3fv(glGetUniformLocation(m_cull_shader, "boundsCenter"), 1, &m_treeBoundsCenter[0]);
+    glUniform1f(glGetUniformLocation(m_cull_shader, "boundsRadius"), m_treeBoundsRadius);
+
+    // Vertex shader tests, geometry shader compacts into the feedback buffer, nothing is rasterized
+    glEnable(GL_RASTERIZER_DISCARD);
+    glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, outputBuffer);
+    glBeginQuery(GL_TRANSFORM_FEEDBACK_PRIMITIVES_WRITTEN, query);
+    glBeginTransformFeedback(GL_POINTS);
+
+    // The camera cull skips occluded and impostor trees; shadows still need every tree
+    if (target == CULL_CAMERA && m_meshTreeSubset) {
+        glBindVertexArray(m_visibleTreeInstanceVAO);
+        glDrawArrays(GL_POINTS, 0, m_visibleTreeCount);
+    } else {
+        glBindVertexArray(m_treeInstanceVAO);
+        glDrawArrays(GL_POINTS, 0, static_cast<GLsizei>(m_treeInstances.size()));
+    }
+
+    glEndTransformFeedback();
+    glEndQuery(GL_TRANSFORM_FEEDBACK_PRIMITIVES_WRITTEN);
+    glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, 0);
+    glDisable(GL_RASTERIZER_DISCARD);
+    glBindVertexArray(0);
+    glUseProgram(0);
+
+    if (m_useQueryBuffer) {
+        // The GPU copies this cull's count into every command's instanceCount, no CPU readback at all
+        glBindBuffer(GL_QUERY_BUFFER, m_treeIndirectBuffer);
+        for (size_t i = 0; i < instancedShapes().size(); ++i) {
+            size_t offset = i * sizeof(DrawArraysIndirectCommand) + offsetof(DrawArraysIndirectCommand, instanceCount);
+            glGetQueryObjectuiv(query, GL_QUERY_RESULT, reinterpret_cast<GLuint *>(offset));
+        }
+        glBindBuffer(GL_QUERY_BUFFER, 0);
+        return {outputBuffer, 0, m_treeIndirectBuffer};
+    }
+
+    if (drawSlot < 0) {
+        // Nothing culled since the outputs were sized, so wait on this cull once
+        glGetQueryObjectuiv(query, GL_QUERY_RESULT, &m_cullVisibleCount[target]);
+        drawSlot = current;
+    }
+
+    // Draw the newest compacted buffer whose count has been read, usually last frame's. While the GPU is behind
+    // the same buffer is drawn again with its own count, at worst a frame or two stale
+    return {m_culledInstanceVBO[drawSlot][target], static_cast<GLsizei>(m_cullVisibleCount[target]), 0};
+}
+
+// Main pass for the instanced forest, drawn with m_shader after the regular shapes
+void Realtime::paintTreeInstances() {
+    InstanceDraw draw = cullTreeInstances(m_proj * m_view, CULL_CAMERA);
+
+    // The cull pass switched programs; m_shader keeps the uniforms paintLSystem already set
+    glUseProgram(m_shader);
+
+    const std::vector<ShapeData>& shapes = instancedShapes();
+    m_renderQueue.clear();
+    for (uint32_t i = 0; i < shapes.size(); ++i) {
+        const ShapeData& shape = shapes[i];
+        GLuint texture = shape.textureUsed ? shape.diffuseTexture : 0;
+        m_renderQueue.submit(RenderQueue::makeKey(RenderQueue::PASS_OPAQUE, m_shader, texture, shape.materialId, 0.0f), i);
+    }
+    m_renderQueue.sort();
+    drawRenderQueue(shapes, &draw);
+
+    // Both targets have been culled this frame, so next frame writes the next slot
+    m_cullFrame++;
+}
+
+// Shadow pass for the instanced forest, drawn with m_depth_shader into the bound shadow FBO
+void Realtime::renderTreeInstancesShadow() {
+    InstanceDraw draw = cullTreeInstances(lightSpaceMatrix, CULL_SHADOW);
+
+    glUseProgram(m_depth_shader);
+    GLint modelLoc = glGetUniformLocation(m_depth_shader, "modelMatrix");
+
+    const std::vector<ShapeData>& shapes = instancedShapes();
+    for (size_t i = 0; i < shapes.size(); ++i) {
+        const ShapeData& shape = shapes[i];
+        glBindVertexArray(shape.vao);
+        glUniformMatrix4fv(modelLoc, 1, GL_FALSE, &shape.modelMatrix[0][0]);
+        setAnimationAttributes(shape);
+
+        glBindBuffer(GL_ARRAY_BUFFER, draw.instanceBuffer);
+        glEnableVertexAttribArray(3);
+        glVertexAttribPointer(3, 4, GL_FLOAT, GL_FALSE, 4 * sizeof(GLfloat), reinterpret_cast<void *>(0));
+        glVertexAttribDivisor(3, 1);
+
+        if (draw.indirectBuffer != 0) {
+            glBindBuffer(GL_DRAW_INDIRECT_BUFFER, draw.indirectBuffer);
+            glDrawArraysIndirect(GL_TRIANGLES, reinterpret_cast<void *>(i * sizeof(DrawArraysIndirectCommand)));
+        } else {
+            glDrawArraysInstanced(GL_TRIANGLES, shape.firstVertex, shape.vertexCount, draw.instanceCount);
+        }
+        glDisableVertexAttribArray(3);
+    }
+
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+    glBindVertexArray(0);
+}
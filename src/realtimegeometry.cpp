@@ -5,6 +5,8 @@
 
 void Realtime::generateShapeData(){
     m_shapeData.clear(); // Clear any existing shape data
+    m_shapeTreeIndex.clear();
+    m_shapeTreeDepth.clear();
 
     for (const RenderShapeData& shape : sceneLoader.getShapes()) {
         m_data.clear(); // clear m_data to store vboData
@@ -49,6 +51,7 @@ void Realtime::generateShapeData(){
         shapeData.diffuse = shape.primitive.material.cDiffuse;
         shapeData.specular = shape.primitive.material.cSpecular;
         shapeData.shininess = shape.primitive.material.shininess;
+        shapeData.materialId = registerMaterial(shapeData.ambient, shapeData.diffuse, shapeData.specular, shapeData.shininess);
 
         if(shape.primitive.material.textureMap.isUsed){ // if there is texture
             shapeData.textureUsed = true;
@@ -96,6 +99,8 @@ void Realtime::generateShapeData(){
         // Add to shape data collection
         m_shapeData.push_back(shapeData);
     }
+
+    rebuildShapeBounds();
 }
 
 void Realtime::paintGeometry(){
@@ -165,59 +170,9 @@ void Realtime::paintGeometry(){
         glUniform1f(glGetUniformLocation(m_shader, (baseName + ".angle").c_str()), light.angle);
     }
 
-    for (const ShapeData& shapeData : m_shapeData) {
-        glBindVertexArray(shapeData.vao);
-
-        // Set model matrix uniform
-        GLint modelLoc = glGetUniformLocation(m_shader, "modelMatrix");
-        glUniformMatrix4fv(modelLoc, 1, GL_FALSE, &shapeData.modelMatrix[0][0]);
-
-        glm::mat3 normalMatrix = glm::inverse(glm::transpose(shapeData.modelMatrix));
-        GLint normalMatrixLocation = glGetUniformLocation(m_shader, "normalMatrix");
-        glUniformMatrix3fv(normalMatrixLocation, 1, GL_FALSE, &normalMatrix[0][0]);
-
-        // Set material properties
-        GLint ambientLoc = glGetUniformLocation(m_shader, "material.ambient");
-        glUniform4fv(ambientLoc, 1, &shapeData.ambient[0]);
-
-        GLint diffuseLoc = glGetUniformLocation(m_shader, "material.diffuse");
-        glUniform4fv(diffuseLoc, 1, &shapeData.diffuse[0]);
-
-        GLint specularLoc = glGetUniformLocation(m_shader, "material.specular");
-        glUniform4fv(specularLoc, 1, &shapeData.specular[0]);
-
-        GLint shininessLoc = glGetUniformLocation(m_shader, "material.shininess");
-        glUniform1f(shininessLoc, shapeData.shininess);
-
-        if (shapeData.textureUsed) {
-            // Pass the textureUsed uniform
-            GLint textureUsedLocation = glGetUniformLocation(m_shader, "textureUsed");
-            glUniform1i(textureUsedLocation, true); // Set to true
-
-            // Pass the texture to shader (already bound to slot 1 as per your setup)
-            GLint textureLocation = glGetUniformLocation(m_shader, "Texture");
-            glActiveTexture(GL_TEXTURE1); // Set the active texture slot
-            glBindTexture(GL_TEXTURE_2D, shapeData.diffuseTexture);
-            glUniform1i(textureLocation, 1); // Slot 1
-
-            // Pass blend value
-            GLint blendLocation = glGetUniformLocation(m_shader, "blend");
-            glUniform1f(blendLocation, shapeData.blend);
-
-            // Pass repeatU and repeatV values
-            GLint repeatULocation = glGetUniformLocation(m_shader, "repeatU");
-            glUniform1f(repeatULocation, shapeData.repeatU);
-
-            GLint repeatVLocation = glGetUniformLocation(m_shader, "repeatV");
-            glUniform1f(repeatVLocation, shapeData.repeatV);
-        }
-
-        // Draw the shape
-        glDrawArrays(GL_TRIANGLES, 0, shapeData.vertexCount);
-
-        // Unbind VAO (optional for good practice)
-        glBindVertexArray(0);
-    }
+    // Draw every shape through the sorted render queue
+    submitShapes(sceneLoader.getViewMatrix(), sceneLoader.getProjMatrix(), sceneLoader.getCamera().farPlane);
+    drawRenderQueue(m_shapeData);
 
     glUseProgram(0);  // Unbind the shader program
 
@@ -0,0 +1,281 @@
+#include "realtime.h"
+#include "settings.h"
+#include "utils/shaderloader.h"
+#include <iostream>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+// Atlas layout: kImpostorFrames x kImpostorFrames views of the tree, each kImpostorFrameSize pixels square
+static constexpr int kImpostorFrames = 8;
+static constexpr int kImpostorFrameSize = 128;
+
+// Direction towards the viewer for a point e in [-1, 1]^2 of the hemi-octahedral map (upper hemisphere only,
+// trees are never seen from below the ground). Must match hemiOctDecode in impostor.vert
+static glm::vec3 hemiOctDecode(const glm::vec2& e) {
+    glm::vec2 t = 0.5f * glm::vec2(e.x + e.y, e.x - e.y);
+    return glm::normalize(glm::vec3(t.x, 1.0f - std::abs(t.x) - std::abs(t.y), t.y));
+}
+
+// Right and up axes of a frame looking along -viewDirection. Must match frameBasis in impostor.vert
+static void frameBasis(const glm::vec3& viewDirection, glm::vec3& right, glm::vec3& up) {
+    right = std::abs(viewDirection.y) > 0.999f ? glm::vec3(1.0f, 0.0f, 0.0f)
+                                               : glm::normalize(glm::cross(glm::vec3(0.0f, 1.0f, 0.0f), viewDirection));
+    up = glm::cross(viewDirection, right);
+}
+
+void Realtime::initializeImpostors() {
+    m_impostor_bake_shader = ShaderLoader::createShaderProgram(":/resources/shaders/phong.vert", ":/resources/shaders/impostorbake.frag");
+    m_impostor_shader = ShaderLoader::createShaderProgram(":/resources/shaders/impostor.vert", ":/resources/shaders/impostor.frag");
+
+    makeImpostorFBO();
+
+    // Camera-facing quad, expanded around each far tree in the vertex shader
+    std::vector<GLfloat> corners = {-1.0f, -1.0f,  1.0f, -1.0f,  -1.0f, 1.0f,  1.0f, 1.0f};
+    glGenBuffers(1, &m_impostorQuadVBO);
+    glGenBuffers(1, &m_impostorInstanceVBO);
+    glGenVertexArrays(1, &m_impostorVAO);
+    glBindVertexArray(m_impostorVAO);
+
+    glBindBuffer(GL_ARRAY_BUFFER, m_impostorQuadVBO);
+    glBufferData(GL_ARRAY_BUFFER, corners.size() * sizeof(GLfloat), corners.data(), GL_STATIC_DRAW);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(GLfloat), reinterpret_cast<void *>(0));
+
+    // One tree offset per instance, same layout as the instanced forest
+    glBindBuffer(GL_ARRAY_BUFFER, m_impostorInstanceVBO);
+    glEnableVertexAttribArray(3);
+    glVertexAttribPointer(3, 4, GL_FLOAT, GL_FALSE, 4 * sizeof(GLfloat), reinterpret_cast<void *>(0));
+    glVertexAttribDivisor(3, 1);
+
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindVertexArray(0);
+}
+
+void Realtime::makeImpostorFBO() {
+    int atlasSize = kImpostorFrames * kImpostorFrameSize;
+
+    // Albedo with coverage in alpha
+    glGenTextures(1, &m_impostorAlbedo);
+    glBindTexture(GL_TEXTURE_2D, m_impostorAlbedo);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, atlasSize, atlasSize, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+    // World-space normal in rgb, depth within the frame in alpha
+    glGenTextures(1, &m_impostorNormalDepth);
+    glBindTexture(GL_TEXTURE_2D, m_impostorNormalDepth);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, atlasSize, atlasSize, 0, GL_RGBA, GL_FLOAT, nullptr);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    glGenRenderbuffers(1, &m_impostorRenderbuffer);
+    glBindRenderbuffer(GL_RENDERBUFFER, m_impostorRenderbuffer);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, atlasSize, atlasSize);
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+    glGenFramebuffers(1, &m_impostorFBO);
+    glBindFramebuffer(GL_FRAMEBUFFER, m_impostorFBO);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, m_impostorAlbedo, 0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, m_impostorNormalDepth, 0);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, m_impostorRenderbuffer);
+
+    GLenum drawBuffers[2] = {GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1};
+    glDrawBuffers(2, drawBuffers);
+
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+        std::cerr << "Impostor FBO is not complete!" << std::endl;
+    }
+
+    glBindFramebuffer(GL_FRAMEBUFFER, m_defaultFBO);
+}
+
+// Render templateTree with its capsules and leaf cards from every direction of the hemi-octahedral grid into its
+// frame of the atlas
+void Realtime::bakeImpostor() {
+    m_impostorReady = false;
+    bool capsules = m_capsuleRanges[0].count + m_capsuleRanges[1].count > 0;
+    if (templateTree.empty() && m_leafCount == 0 && !capsules) {
+        return;
+    }
+
+    // Baking can happen outside paintGL, so put back whatever target was bound
+    GLint previousFramebuffer = 0;
+    GLint previousViewport[4];
+    glGetIntegerv(GL_FRAMEBUFFER_BINDING, &previousFramebuffer);
+    glGetIntegerv(GL_VIEWPORT, previousViewport);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, m_impostorFBO);
+    int atlasSize = kImpostorFrames * kImpostorFrameSize;
+    glViewport(0, 0, atlasSize, atlasSize);
+
+    // Empty texels: no coverage, up-facing normal, farthest depth
+    GLfloat clearAlbedo[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+    GLfloat clearNormalDepth[4] = {0.5f, 1.0f, 0.5f, 1.0f};
+    glClearBufferfv(GL_COLOR, 0, clearAlbedo);
+    glClearBufferfv(GL_COLOR, 1, clearNormalDepth);
+    glClear(GL_DEPTH_BUFFER_BIT);
+
+    glUseProgram(m_impostor_bake_shader);
+    glUniform1i(glGetUniformLocation(m_impostor_bake_shader, "Texture"), 1);
+    GLint viewLoc = glGetUniformLocation(m_impostor_bake_shader, "viewMatrix");
+    GLint projLoc = glGetUniformLocation(m_impostor_bake_shader, "projMatrix");
+    GLint modelLoc = glGetUniformLocation(m_impostor_bake_shader, "modelMatrix");
+    GLint normalMatrixLoc = glGetUniformLocation(m_impostor_bake_shader, "normalMatrix");
+    GLint diffuseLoc = glGetUniformLocation(m_impostor_bake_shader, "diffuse");
+    GLint textureUsedLoc = glGetUniformLocation(m_impostor_bake_shader, "textureUsed");
+    GLint blendLoc = glGetUniformLocation(m_impostor_bake_shader, "blend");
+    GLint repeatULoc = glGetUniformLocation(m_impostor_bake_shader, "repeatU");
+    GLint repeatVLoc = glGetUniformLocation(m_impostor_bake_shader, "repeatV");
+
+    // Orthographic box around the bounding sphere, the eye sits one radius outside it
+    float radius = m_treeBoundsRadius;
+    glm::mat4 projection = glm::ortho(-radius, radius, -radius, radius, radius, 3.0f * radius);
+    glUniformMatrix4fv(projLoc, 1, GL_FALSE, &projection[0][0]);
+
+    glActiveTexture(GL_TEXTURE1);
+    glDisable(GL_CULL_FACE);
+
+    for (int frameY = 0; frameY < kImpostorFrames; ++frameY) {
+        for (int frameX = 0; frameX < kImpostorFrames; ++frameX) {
+            glm::vec2 e = (glm::vec2(frameX, frameY) + 0.5f) / static_cast<float>(kImpostorFrames) * 2.0f - 1.0f;
+            glm::vec3 viewDirection = hemiOctDecode(e);
+            glm::vec3 right, up;
+            frameBasis(viewDirection, right, up);
+
+            glm::mat4 view = glm::lookAt(m_treeBoundsCenter + viewDirection * (2.0f * radius), m_treeBoundsCenter, up);
+            glUniformMatrix4fv(viewLoc, 1, GL_FALSE, &view[0][0]);
+            glViewport(frameX * kImpostorFrameSize, frameY * kImpostorFrameSize, kImpostorFrameSize, kImpostorFrameSize);
+
+            for (const ShapeData& shape : templateTree) {
+                glUniformMatrix4fv(modelLoc, 1, GL_FALSE, &shape.modelMatrix[0][0]);
+                glm::mat3 normalMatrix = glm::inverse(glm::transpose(glm::mat3(shape.modelMatrix)));
+                glUniformMatrix3fv(normalMatrixLoc, 1, GL_FALSE, &normalMatrix[0][0]);
+                glUniform4fv(diffuseLoc, 1, &shape.diffuse[0]);
+                glUniform1i(textureUsedLoc, shape.textureUsed);
+                if (shape.textureUsed) {
+                    glBindTexture(GL_TEXTURE_2D, shape.diffuseTexture);
+                    glUniform1f(blendLoc, shape.blend);
+                    glUniform1f(repeatULoc, shape.repeatU);
+                    glUniform1f(repeatVLoc, shape.repeatV);
+                }
+
+                glBindVertexArray(shape.vao);
+                glDrawArrays(GL_TRIANGLES, 0, shape.vertexCount);
+            }
+
+            if (capsules) {
+                bakeCapsules(view, projection, viewDirection);
+                glUseProgram(m_impostor_bake_shader);
+            }
+            if (m_leafCount > 0) {
+                bakeLeafCards(view, projection);
+                glUseProgram(m_impostor_bake_shader);
+            }
+        }
+    }
+
+    glBindVertexArray(0);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glEnable(GL_CULL_FACE);
+    glUseProgram(0);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, previousFramebuffer);
+    glViewport(previousViewport[0], previousViewport[1], previousViewport[2], previousViewport[3]);
+
+    m_impostorReady = true;
+}
+
+// Decide per forest tree whether it is drawn as a mesh or an impostor this frame, and upload the instance
+// lists each representation draws from. Occluded trees get neither
+void Realtime::selectTreeRepresentations() {
+    // A baked copied forest has no per-tree shapes left to swap out
+    bool bakedCopies = !m_instancedForest && m_batchVAO != 0;
+    bool useImpostors = settings.impostors && m_impostorReady && !bakedCopies;
+    m_treeImpostor.assign(m_treeInstances.size(), 0);
+    m_impostorInstances.clear();
+
+    std::vector<glm::vec4> meshInstances;
+    meshInstances.reserve(m_treeInstances.size());
+
+    for (size_t i = 0; i < m_treeInstances.size(); ++i) {
+        if (m_treeOccluded[i]) {
+            continue;
+        }
+
+        glm::vec3 treeCenter = m_treeBoundsCenter + glm::vec3(m_treeInstances[i]);
+        if (useImpostors && glm::distance(eye, treeCenter) > settings.impostorDistance) {
+            m_treeImpostor[i] = 1;
+            m_impostorInstances.push_back(m_treeInstances[i]);
+        } else {
+            meshInstances.push_back(m_treeInstances[i]);
+        }
+    }
+    m_stats.impostorTrees = static_cast<int>(m_impostorInstances.size());
+
+    if (!m_impostorInstances.empty()) {
+        glBindBuffer(GL_ARRAY_BUFFER, m_impostorInstanceVBO);
+        glBufferData(GL_ARRAY_BUFFER, m_impostorInstances.size() * sizeof(glm::vec4), m_impostorInstances.data(), GL_STREAM_DRAW);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    // The instanced forest feeds only its mesh trees to the GPU frustum cull
+    m_meshTreeSubset = m_instancedForest && (settings.occlusionCulling || useImpostors);
+    if (!m_meshTreeSubset) {
+        return;
+    }
+
+    m_visibleTreeCount = static_cast<int>(meshInstances.size());
+    glBindBuffer(GL_ARRAY_BUFFER, m_visibleTreeInstanceVBO);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, meshInstances.size() * sizeof(glm::vec4), meshInstances.data());
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+// Draw every far tree as one quad, shaded from the baked albedo and normals. Expects paintLSystem's
+// shadow map binding and m_view/m_proj
+void Realtime::paintImpostors() {
+    if (m_impostorInstances.empty()) {
+        return;
+    }
+
+    glUseProgram(m_impostor_shader);
+    glUniformMatrix4fv(glGetUniformLocation(m_impostor_shader, "viewMatrix"), 1, GL_FALSE, &m_view[0][0]);
+    glUniformMatrix4fv(glGetUniformLocation(m_impostor_shader, "projMatrix"), 1, GL_FALSE, &m_proj[0][0]);
+    glUniformMatrix4fv(glGetUniformLocation(m_impostor_shader, "lightSpaceMatrix"), 1, GL_FALSE, &lightSpaceMatrix[0][0]);
+    glUniform3fv(glGetUniformLocation(m_impostor_shader, "cameraPosition"), 1, &eye[0]);
+    glUniform3fv(glGetUniformLocation(m_impostor_shader, "treeCenter"), 1, &m_treeBoundsCenter[0]);
+    glUniform1f(glGetUniformLocation(m_impostor_shader, "treeRadius"), m_treeBoundsRadius);
+    glUniform1i(glGetUniformLocation(m_impostor_shader, "framesPerSide"), kImpostorFrames);
+
+    // Same lighting inputs as phong.frag, only the first light is used at this distance
+    const CustomLightData& light = lights[0];
+    glUniform4fv(glGetUniformLocation(m_impostor_shader, "lightColor"), 1, &light.color[0]);
+    glUniform3fv(glGetUniformLocation(m_impostor_shader, "lightDirection"), 1, &glm::vec3(light.direction)[0]);
+    glUniform1f(glGetUniformLocation(m_impostor_shader, "ka"), 0.5f);
+    glUniform1f(glGetUniformLocation(m_impostor_shader, "kd"), 0.5f);
+    glUniform1i(glGetUniformLocation(m_impostor_shader, "toonShadingEnable"), settings.toonEnable);
+    glUniform1i(glGetUniformLocation(m_impostor_shader, "toonColorLevel"), settings.toonLevel);
+    glUniform1i(glGetUniformLocation(m_impostor_shader, "shadowMapEnable"), settings.extraCredit1);
+
+    // Slot 2 keeps the shadow map bound by paintLSystem
+    glUniform1i(glGetUniformLocation(m_impostor_shader, "shadowMap"), 2);
+    glUniform1i(glGetUniformLocation(m_impostor_shader, "albedoAtlas"), 3);
+    glUniform1i(glGetUniformLocation(m_impostor_shader, "normalDepthAtlas"), 4);
+    glActiveTexture(GL_TEXTURE3);
+    glBindTexture(GL_TEXTURE_2D, m_impostorAlbedo);
+    glActiveTexture(GL_TEXTURE4);
+    glBindTexture(GL_TEXTURE_2D, m_impostorNormalDepth);
+
+    glBindVertexArray(m_impostorVAO);
+    glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, static_cast<GLsizei>(m_impostorInstances.size()));
+    glBindVertexArray(0);
+
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glActiveTexture(GL_TEXTURE3);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glUseProgram(0);
+}
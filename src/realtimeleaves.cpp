@@ -0,0 +1,200 @@
+#include "realtime.h"
+#include "settings.h"
+#include "utils/shaderloader.h"
+#include <random>
+#include <glm/glm.hpp>
+#include <glm/gtc/constants.hpp>
+
+// Leaf data lives in a buffer texture on its own slot, next to the impostor atlases
+static constexpr int kLeafDataSlot = 5;
+
+void Realtime::initializeLeafCards() {
+    m_leaf_shader = ShaderLoader::createShaderProgram(":/resources/shaders/leaf.vert", ":/resources/shaders/phong.frag");
+    m_leaf_depth_shader = ShaderLoader::createShaderProgram(":/resources/shaders/leaf.vert", ":/resources/shaders/leafdepth.frag");
+    m_leaf_bake_shader = ShaderLoader::createShaderProgram(":/resources/shaders/leaf.vert", ":/resources/shaders/impostorbake.frag");
+
+    // Two crossed quads, the leaf grows from y = 0 to y = 1
+    std::vector<GLfloat> card = {
+        // Quad across the turtle's right direction
+        -0.5f, 0.0f, 0.0f,  0.0f, 0.0f, 1.0f,  0.0f, 0.0f,
+         0.5f, 0.0f, 0.0f,  0.0f, 0.0f, 1.0f,  1.0f, 0.0f,
+         0.5f, 1.0f, 0.0f,  0.0f, 0.0f, 1.0f,  1.0f, 1.0f,
+        -0.5f, 0.0f, 0.0f,  0.0f, 0.0f, 1.0f,  0.0f, 0.0f,
+         0.5f, 1.0f, 0.0f,  0.0f, 0.0f, 1.0f,  1.0f, 1.0f,
+        -0.5f, 1.0f, 0.0f,  0.0f, 0.0f, 1.0f,  0.0f, 1.0f,
+        // Quad across the front direction
+        0.0f, 0.0f,  0.5f,  1.0f, 0.0f, 0.0f,  0.0f, 0.0f,
+        0.0f, 0.0f, -0.5f,  1.0f, 0.0f, 0.0f,  1.0f, 0.0f,
+        0.0f, 1.0f, -0.5f,  1.0f, 0.0f, 0.0f,  1.0f, 1.0f,
+        0.0f, 0.0f,  0.5f,  1.0f, 0.0f, 0.0f,  0.0f, 0.0f,
+        0.0f, 1.0f, -0.5f,  1.0f, 0.0f, 0.0f,  1.0f, 1.0f,
+        0.0f, 1.0f,  0.5f,  1.0f, 0.0f, 0.0f,  0.0f, 1.0f,
+    };
+    m_leafCardVertexCount = static_cast<int>(card.size() / 8);
+
+    glGenBuffers(1, &m_leafCardVBO);
+    glGenVertexArrays(1, &m_leafCardVAO);
+    glBindVertexArray(m_leafCardVAO);
+
+    glBindBuffer(GL_ARRAY_BUFFER, m_leafCardVBO);
+    glBufferData(GL_ARRAY_BUFFER, card.size() * sizeof(GLfloat), card.data(), GL_STATIC_DRAW);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(GLfloat), reinterpret_cast<void *>(0));
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(GLfloat), reinterpret_cast<void *>(3 * sizeof(GLfloat)));
+    glEnableVertexAttribArray(2);
+    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(GLfloat), reinterpret_cast<void *>(6 * sizeof(GLfloat)));
+
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindVertexArray(0);
+
+    glGenBuffers(1, &m_leafDataBuffer);
+    glGenTextures(1, &m_leafDataTexture);
+    glBindBuffer(GL_TEXTURE_BUFFER, m_leafDataBuffer);
+    glBindTexture(GL_TEXTURE_BUFFER, m_leafDataTexture);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, m_leafDataBuffer);
+    glBindTexture(GL_TEXTURE_BUFFER, 0);
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+}
+
+// Upload the template tree's leaves: base and length, growth direction and spin, turtle right and tint, wind origin,
+// and wind parent with the birth and grown times.
+// Called before the impostor bake, which draws them too; an empty list turns the cards off
+void Realtime::uploadLeafCards(const std::vector<TreeSegment>& leaves) {
+    m_leafCount = static_cast<int>(leaves.size());
+    if (leaves.empty()) {
+        return;
+    }
+
+    // Fixed seed, so a tree looks the same every time it is regenerated
+    std::mt19937 random(1234u);
+    std::uniform_real_distribution<float> spin(0.0f, glm::two_pi<float>());
+    std::uniform_real_distribution<float> scale(0.8f, 1.2f);
+    std::uniform_real_distribution<float> tint(0.0f, 1.0f);
+
+    std::vector<glm::vec4> data;
+    data.reserve(5 * leaves.size());
+    for (const TreeSegment& leaf : leaves) {
+        glm::vec3 axis = leaf.end - leaf.start;
+        float length = glm::length(axis);
+        glm::vec3 grow = length > 0.0f ? axis / length : glm::vec3(0.0f, 1.0f, 0.0f);
+
+        // Keep the turtle's right direction perpendicular to the leaf even after rounding
+        glm::vec3 side = leaf.side - glm::dot(leaf.side, grow) * grow;
+        side = glm::dot(side, side) > 1e-8f ? glm::normalize(side)
+                                            : glm::normalize(glm::cross(std::abs(grow.y) < 0.9f ? glm::vec3(0.0f, 1.0f, 0.0f) : glm::vec3(1.0f, 0.0f, 0.0f), grow));
+
+        data.push_back(glm::vec4(leaf.start, length * scale(random)));
+        data.push_back(glm::vec4(grow, spin(random)));
+        data.push_back(glm::vec4(side, tint(random)));
+        data.push_back(leaf.windOrigin());
+        data.push_back(glm::vec4(leaf.windParent(), leaf.birth, leaf.grown));
+    }
+
+    glBindBuffer(GL_TEXTURE_BUFFER, m_leafDataBuffer);
+    glBufferData(GL_TEXTURE_BUFFER, data.size() * sizeof(glm::vec4), data.data(), GL_STATIC_DRAW);
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+}
+
+// Leaf buffer, leaf texture and card mesh for program, once per tree offset in treeBuffer or once at the
+// origin without one; cards are seen from both sides
+void Realtime::drawLeafCards(GLuint program, GLuint treeBuffer, int treeCount) {
+    glUniform1i(glGetUniformLocation(program, "leafData"), kLeafDataSlot);
+    glUniform1i(glGetUniformLocation(program, "leafCount"), m_leafCount);
+    glUniform1i(glGetUniformLocation(program, "Texture"), 1);
+
+    glActiveTexture(GL_TEXTURE0 + kLeafDataSlot);
+    glBindTexture(GL_TEXTURE_BUFFER, m_leafDataTexture);
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, m_leaf_texture);
+
+    glBindVertexArray(m_leafCardVAO);
+    if (treeBuffer == 0) {
+        // A single tree keeps the default (0, 0, 0, 1) offset
+        glDisableVertexAttribArray(3);
+    } else {
+        // The offset advances once every leafCount instances, so every tree draws all leaves
+        glBindBuffer(GL_ARRAY_BUFFER, treeBuffer);
+        glVertexAttribPointer(3, 4, GL_FLOAT, GL_FALSE, 4 * sizeof(GLfloat), reinterpret_cast<void *>(0));
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        glEnableVertexAttribArray(3);
+        glVertexAttribDivisor(3, m_leafCount);
+    }
+
+    glDisable(GL_CULL_FACE);
+    glDrawArraysInstanced(GL_TRIANGLES, 0, m_leafCardVertexCount, m_leafCount * treeCount);
+    glBindVertexArray(0);
+    glEnable(GL_CULL_FACE);
+
+    glActiveTexture(GL_TEXTURE0 + kLeafDataSlot);
+    glBindTexture(GL_TEXTURE_BUFFER, 0);
+    glActiveTexture(GL_TEXTURE1);
+}
+
+// Main pass over the trees drawn as meshes, lit by phong.frag with the same scene uniforms as m_shader
+void Realtime::paintLeafCards() {
+    bool forest = !m_treeInstances.empty();
+    if (m_leafCount == 0 || (forest && m_meshedTreeCount == 0)) {
+        return;
+    }
+
+    GLuint program = m_leaf_shader;
+    glUseProgram(program);
+    setSceneUniforms(program);
+
+    // Same leaf material as the sphere leaves
+    glm::vec4 ambient(0.0f, 0.8f, 0.0f, 1.0f);
+    glm::vec4 diffuse(0.1f, 0.9f, 0.1f, 1.0f);
+    glm::vec4 specular(0.5f, 0.5f, 0.5f, 1.0f);
+    glUniform4fv(glGetUniformLocation(program, "material.ambient"), 1, &ambient[0]);
+    glUniform4fv(glGetUniformLocation(program, "material.diffuse"), 1, &diffuse[0]);
+    glUniform4fv(glGetUniformLocation(program, "material.specular"), 1, &specular[0]);
+    glUniform1f(glGetUniformLocation(program, "material.shininess"), 16.0f);
+    glUniform1i(glGetUniformLocation(program, "textureUsed"), true);
+    glUniform1f(glGetUniformLocation(program, "blend"), 1.0f);
+    glUniform1f(glGetUniformLocation(program, "repeatU"), 1.0f);
+    glUniform1f(glGetUniformLocation(program, "repeatV"), 1.0f);
+    glUniform1f(glGetUniformLocation(program, "lodFade"), 0.0f);
+    glUniform1i(glGetUniformLocation(program, "leafCard"), true);
+
+    drawLeafCards(program, forest ? m_meshedTreeVBO : 0, forest ? m_meshedTreeCount : 1);
+    glUseProgram(m_shader);
+}
+
+// Shadow pass over the trees inside the light's frustum into the bound shadow FBO, alpha-tested like the main pass
+void Realtime::renderLeafCardsShadow() {
+    bool forest = !m_treeInstances.empty();
+    if (m_leafCount == 0 || (forest && m_shadowTreeCount == 0)) {
+        return;
+    }
+
+    GLuint program = m_leaf_depth_shader;
+    glm::mat4 identity(1.0f);
+    glUseProgram(program);
+    glUniformMatrix4fv(glGetUniformLocation(program, "viewMatrix"), 1, GL_FALSE, &lightSpaceMatrix[0][0]);
+    glUniformMatrix4fv(glGetUniformLocation(program, "projMatrix"), 1, GL_FALSE, &identity[0][0]);
+    setAnimationUniforms(program);
+
+    drawLeafCards(program, forest ? m_shadowTreeVBO : 0, forest ? m_shadowTreeCount : 1);
+    glUseProgram(m_depth_shader);
+}
+
+// One frame of the impostor bake; only the template tree, so the tree offsets are left out
+void Realtime::bakeLeafCards(const glm::mat4& view, const glm::mat4& projection) {
+    GLuint program = m_leaf_bake_shader;
+    glm::vec4 diffuse(0.1f, 0.9f, 0.1f, 1.0f);
+    glUseProgram(program);
+    glUniformMatrix4fv(glGetUniformLocation(program, "viewMatrix"), 1, GL_FALSE, &view[0][0]);
+    glUniformMatrix4fv(glGetUniformLocation(program, "projMatrix"), 1, GL_FALSE, &projection[0][0]);
+    glUniform4fv(glGetUniformLocation(program, "diffuse"), 1, &diffuse[0]);
+    glUniform1i(glGetUniformLocation(program, "textureUsed"), true);
+    glUniform1f(glGetUniformLocation(program, "blend"), 1.0f);
+    glUniform1f(glGetUniformLocation(program, "repeatU"), 1.0f);
+    glUniform1f(glGetUniformLocation(program, "repeatV"), 1.0f);
+    glUniform1i(glGetUniformLocation(program, "leafCard"), true);
+
+    drawLeafCards(program, 0, 1);
+
+    // The whole bake is two-sided, drawLeafCards turned culling back on
+    glDisable(GL_CULL_FACE);
+}
@@ -0,0 +1,46 @@
+#include "realtime.h"
+#include "settings.h"
+#include <glm/glm.hpp>
+
+// Pick a tessellation level for every visible shape in m_shapeData that draws a cached mesh.
+// The level follows the shape's projected size, so thin or distant segments get fewer vertices
+void Realtime::selectShapeLods(const glm::mat4& view, const glm::mat4& proj) {
+    m_shapeLod.assign(m_shapeData.size(), LodSelection());
+    m_stats.shapeVertices = 0;
+
+    // Pixels covered by one world unit at view depth 1
+    float pixelsPerUnit = 0.5f * proj[1][1] * m_fbo_height;
+
+    for (size_t i = 0; i < m_shapeData.size(); ++i) {
+        if (!m_shapeVisible[i]) {
+            continue;
+        }
+        const ShapeData& shape = m_shapeData[i];
+        if (shape.meshId < 0) {
+            m_stats.shapeVertices += shape.vertexCount;
+            continue;
+        }
+
+        // Cylinders are tessellated around their axis, so only the cross section counts; spheres use their largest axis.
+        // Welded tubes bend inside their box, whose thinnest side is still at least the tube's diameter
+        float sizeX = glm::length(glm::vec3(shape.modelMatrix[0]));
+        float sizeY = glm::length(glm::vec3(shape.modelMatrix[1]));
+        float sizeZ = glm::length(glm::vec3(shape.modelMatrix[2]));
+        float worldSize = glm::max(sizeX, sizeZ);
+        PrimitiveType type = m_meshCache.type(shape.meshId);
+        if (type == PrimitiveType::PRIMITIVE_SPHERE) {
+            worldSize = glm::max(worldSize, sizeY);
+        } else if (type == PrimitiveType::PRIMITIVE_MESH) {
+            worldSize = glm::min(glm::min(sizeX, sizeY), sizeZ);
+        }
+
+        float viewDepth = glm::max(-(view * shape.modelMatrix[3]).z, settings.nearPlane);
+        LodSelection lod = MeshCache::selectLod(worldSize * pixelsPerUnit / viewDepth, settings.lodBias);
+        m_shapeLod[i] = lod;
+
+        m_stats.shapeVertices += m_meshCache.level(shape.meshId, lod.level).vertexCount;
+        if (lod.fade > 0.0f) {
+            m_stats.shapeVertices += m_meshCache.level(shape.meshId, lod.level + 1).vertexCount;
+        }
+    }
+}
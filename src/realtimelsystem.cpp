@@ -1,9 +1,19 @@
 #include "realtime.h"
+#include "lsystem/tessellationpolicy.h"
+#include "lsystem/tubemesher.h"
+#include "lsystem/turtlecommand.h"
+#include "settings.h"
+#include "utils/parallelfor.h"
 #include "shapes/vbogenerator.h"
+#include <algorithm>
+#include <cmath>
 #include <stack>
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 
+// Length of one play of the growth animation
+static constexpr float kGrowthSeconds = 12.0f;
+
 // Helper Function to take rotate
 glm::mat4 Realtime::customRotate(const glm::vec3& axis, float radians) {
     glm::vec3 normalizedAxis = glm::normalize(axis);
@@ -88,10 +98,9 @@ void Realtime::updateLights() {
     directionalLight.direction = glm::vec4(currentDirection, 0.0f); // Update direction
 }
 
-void Realtime::initializeBase() {
-    float radius = 8.0f; // Expand the ground radius
+void Realtime::initializeBase(float radius) {
     float margin = 4.0f; // Add extra margin around the edges
-    float baseWidth = (radius * 2.0f) + margin; // New width is the diameter + margin, total = 20
+    float baseWidth = (radius * 2.0f) + margin; // New width is the diameter + margin, total = 20 for the default radius of 8
 
     // Set the new ground size (including width, depth, and thickness)
     glm::vec3 baseSize = glm::vec3(baseWidth, 0.2f, baseWidth); // Thickness increased from 0.1f to 0.2f
@@ -115,177 +124,539 @@ void Realtime::initializeBase() {
         );
 }
 
-void Realtime::interpretLSystem(const std::string& lSystemString, float angle, float length) {
-    m_shapeData.clear();
-    templateTree.clear();
+// Trees are placed on concentric rings of 6, 12, 18, ... trees, 4 units apart. Returns the ground radius,
+// which covers the outermost ring with the same margin as the single ring forest
+static float layoutForest(int numTrees, std::vector<glm::vec4>& positions) {
+    float ringSpacing = 4.0f;
+    int ring = 1;
+    int placedTrees = 0;
+
+    while (placedTrees < numTrees) {
+        int treesInRing = std::min(6 * ring, numTrees - placedTrees);
+        float angleStep = 360.0f / treesInRing;
+        float radius = ringSpacing * ring;
+
+        for (int i = 0; i < treesInRing; i++) {
+            float angleRadians = glm::radians(angleStep * i);
+
+            float xOffset = radius * std::cos(angleRadians);
+            float zOffset = radius * std::sin(angleRadians);
+
+            positions.push_back(glm::vec4(xOffset, 0.0f, zOffset, 1.0f));
+        }
+
+        placedTrees += treesInRing;
+        ring++;
+    }
+
+    return std::max(8.0f, ringSpacing * (ring - 1) + 4.0f);
+}
 
+void Realtime::interpretLSystem(std::string_view lSystemString, const PackedSymbols& birthIterations, float angle, float length,
+                                const ModuleBuffer* modules) {
+    buildTree(walkTurtle(lSystemString, birthIterations, angle, length, modules), 0);
+}
+
+// Grow one tree per derived string, each at its place in the forest rings, and build them as one.
+// For stochastic grammars, whose trees all differ and cannot share a template
+void Realtime::interpretForest(const std::vector<std::string>& lSystemStrings, const std::vector<PackedSymbols>& birthIterations,
+                               float angle, float length) {
+    std::vector<glm::vec4> positions;
+    layoutForest(static_cast<int>(lSystemStrings.size()), positions);
+
+    std::vector<TreeSegment> forest;
+    for (size_t tree = 0; tree < lSystemStrings.size(); ++tree) {
+        glm::vec3 offset(positions[tree]);
+        for (TreeSegment& segment : walkTurtle(lSystemStrings[tree], birthIterations[tree], angle, length)) {
+            segment.start += offset;
+            segment.end += offset;
+            segment.origin += offset;
+            forest.push_back(segment);
+        }
+    }
+    buildTree(std::move(forest), static_cast<int>(lSystemStrings.size()));
+}
+
+// Grow an open L-system: after every rewrite each tree is walked, the light field takes every tree's segments,
+// and each ?(e) module gets the exposure where the turtle reached it as e, which the grammar's conditions
+// read at the next rewrite. Trees shade one another, so a forest grows together, one tree per thread
+void Realtime::growOpenForest(int numTrees, int iterations, float angle, float length) {
+    // Voxels are a little smaller than a forest tree's crown; light through a full one drops to a third
+    constexpr float kLightVoxelSize = 0.5f;
+    constexpr float kLightExtinction = 1.1f;
+
+    bool forest = settings.extraCredit2;
+    std::vector<glm::vec4> positions;
+    if (forest) {
+        layoutForest(numTrees, positions);
+    } else {
+        positions.assign(numTrees, glm::vec4(0.0f, 0.0f, 0.0f, 1.0f));
+    }
+
+    LightField light(lightViewMatrix(), kShadowExtent, kShadowNear, kShadowFar, kLightVoxelSize, kLightExtinction);
+    std::vector<ModuleBuffer> trees(numTrees, m_parametric.axiom());
+    std::vector<std::vector<TreeSegment>> segments(numTrees);
+    std::vector<std::vector<EnvironmentQuery>> queries(numTrees);
+    auto forEachTree = [&](auto&& body) {
+        parallelFor(numTrees, parallelChunks(numTrees, 1), [&](size_t, size_t begin, size_t end) {
+            for (size_t tree = begin; tree < end; ++tree) {
+                body(tree);
+            }
+        });
+    };
+
+    iterations = std::clamp(iterations, 0, ParametricLSystem::kMaxIterations);
+    for (int iteration = 0;; ++iteration) {
+        forEachTree([&](size_t tree) {
+            const ModuleBuffer& modules = trees[tree];
+            glm::vec3 offset(positions[tree]);
+            queries[tree].clear();
+            segments[tree] = walkTurtle(modules.symbols, PackedSymbols::fromUnpacked(modules.births.data(), modules.size()),
+                                        angle, length, &modules, &queries[tree]);
+            for (TreeSegment& segment : segments[tree]) {
+                segment.start += offset;
+                segment.end += offset;
+                segment.origin += offset;
+            }
+            for (EnvironmentQuery& query : queries[tree]) {
+                query.position += offset;
+            }
+        });
+        if (iteration == iterations) {
+            break;
+        }
+
+        light.update(segments);
+        forEachTree([&](size_t tree) {
+            ModuleBuffer& modules = trees[tree];
+            for (const EnvironmentQuery& query : queries[tree]) {
+                if (modules.parameterCount(query.module) > 0) {
+                    modules.parameters[modules.firstParameter[query.module]] = light.exposure(query.position);
+                }
+            }
+            m_parametric.rewrite(iteration + 1, modules);
+        });
+    }
+
+    std::vector<TreeSegment> grown;
+    for (std::vector<TreeSegment>& tree : segments) {
+        grown.insert(grown.end(), tree.begin(), tree.end());
+    }
+    buildTree(std::move(grown), forest ? numTrees : 0);
+}
+
+// Walk a derived string with the turtle, growth times scaled into [0, 1]. With modules, the parameters of
+// each symbol override the sliders: F(l,w), X(l,w) and L(l,w) move l segment lengths with width w, and
+// turns are by their first parameter in degrees, and % modules stand in for whole subtrees. With queries, every
+// ? module is noted with where it was reached
+std::vector<TreeSegment> Realtime::walkTurtle(std::string_view lSystemString, const PackedSymbols& birthIterations, float angle, float length,
+                                              const ModuleBuffer* modules, std::vector<EnvironmentQuery>* queries) {
     // Initialize turtle state and stack
     std::stack<TurtleState> stateStack;
     TurtleState turtle(glm::vec3(0.0f, -0.5f, 0.0f)); // Start at origin with default directions
 
-    for (char c : lSystemString) {
-        switch (c) {
-        case 'F': { // Root or Trunk
-            glm::vec3 newPosition = turtle.position + turtle.growDirection * length;
+    // Walk the string once to collect segments, they are tessellated and meshed together afterwards
+    std::vector<TreeSegment> segments;
+
+    // Wind pivot of the branch the turtle is drawing, saved and restored with the turtle state
+    struct SwayBranch {
+        glm::vec3 origin;
+        float phase;
+        float parentPhase;
+        float parentReach;
+    };
+    std::stack<SwayBranch> branchStack;
+    SwayBranch branch = {turtle.position, 0.0f, 0.0f, 0.0f};
+    int branchCount = 0;
+    auto swayWithBranch = [&](TreeSegment& segment) {
+        segment.origin = branch.origin;
+        segment.phase = branch.phase;
+        segment.parentPhase = branch.parentPhase;
+        segment.parentReach = branch.parentReach;
+    };
+
+    // Growth is ordered by birth iteration first, then by distance walked from the root
+    std::vector<int> segmentIterations;
+    auto growWithPath = [&](TreeSegment& segment, size_t symbol, float moved) {
+        segmentIterations.push_back(symbol < birthIterations.size() ? birthIterations.at(symbol) : 0);
+        segment.birth = turtle.pathLength;
+        segment.grown = turtle.pathLength + moved;
+        turtle.pathLength += moved;
+    };
+
+    auto parameter = [&](size_t symbol, int index, float fallback) {
+        return modules ? modules->parameter(symbol, index, fallback) : fallback;
+    };
+    auto turnAt = [&](size_t symbol) { return glm::radians(parameter(symbol, 0, angle)); };
+
+    for (size_t i = 0; i < lSystemString.size(); ++i) {
+        if (queries && lSystemString[i] == kLightQuerySymbol) {
+            queries->push_back({i, turtle.position});
+        }
 
-            std::vector<GLfloat> trunkVertices;
-            generateShape(PrimitiveType::PRIMITIVE_CYLINDER, trunkVertices);
+        // A subtree too small to resolve, see AdaptiveDerivation: one branch to where it leads, or to its middle
+        // when it comes back, a leaf card its size when it has leaves, and the turtle left where it would leave it
+        if (modules && lSystemString[i] == kProxySymbol && modules->parameterCount(i) == SubtreeProxy::kParameters) {
+            SubtreeProxy proxy = SubtreeProxy::read(modules->parametersOf(i));
+            glm::vec3 reach = glm::distance(proxy.position, turtle.position) > 1e-4f ? proxy.position : proxy.center;
+            float step = glm::distance(reach, turtle.position);
+            glm::vec3 direction = step > 1e-4f ? (reach - turtle.position) / step : turtle.growDirection;
+            if (step > 1e-4f) {
+                float thickness = glm::max(0.08f - 0.01f * turtle.position.y, 0.005f);
+                segments.push_back({SegmentKind::Branch, turtle.position, reach, thickness, static_cast<int>(stateStack.size())});
+                swayWithBranch(segments.back());
+                growWithPath(segments.back(), i, step);
+            }
+            if (proxy.leaves > 0.0f && proxy.radius > 0.0f) {
+                float thickness = glm::max(0.05f - 0.001f * proxy.center.y, 0.005f);
+                segments.push_back({SegmentKind::Leaf, proxy.center - direction * (0.5f * proxy.radius),
+                                    proxy.center + direction * (0.5f * proxy.radius), thickness,
+                                    static_cast<int>(stateStack.size()), 1, 3, turtle.rightDirection});
+                swayWithBranch(segments.back());
+                growWithPath(segments.back(), i, 0.0f);
+            }
+            turtle.position = proxy.position;
+            turtle.growDirection = proxy.grow;
+            turtle.forwardDirection = proxy.forward;
+            turtle.rightDirection = proxy.right;
+            continue;
+        }
+        TurtleCommand command = kTurtleCommands[static_cast<uint8_t>(lSystemString[i])];
+        switch (command) {
+        case TurtleCommand::Trunk: { // Root or Trunk
+            float step = length * parameter(i, 0, turtleStep(TurtleCommand::Trunk));
+            glm::vec3 newPosition = turtle.position + turtle.growDirection * step;
 
             float thickness = 0.08f - 0.01f * turtle.position.y;
-            thickness = glm::max(thickness, 0.005f);
+            thickness = parameter(i, 1, glm::max(thickness, 0.005f));
 
-            glm::mat4 modelMatrix = calculateModelMatrix(turtle.position, newPosition, thickness);
-
-            createShapeData(
-                trunkVertices,
-                glm::vec4(0.4f, 0.3f, 0.2f, 1.0f), // Root ambient color
-                glm::vec4(0.5f, 0.4f, 0.3f, 1.0f), // Root diffuse color
-                glm::vec4(0.1f, 0.1f, 0.1f, 1.0f), // Root specular color
-                32.0f,                              // Shininess
-                m_trunk_texture,  // Texture
-                modelMatrix,                      // Model matrix
-                false                             // not base
-                );
+            segments.push_back({SegmentKind::Trunk, turtle.position, newPosition, thickness, static_cast<int>(stateStack.size())});
+            swayWithBranch(segments.back());
+            growWithPath(segments.back(), i, step);
 
             turtle.position = newPosition;
             break;
         }
-        case 'X': { // Branch
-            glm::vec3 newPosition = turtle.position + turtle.growDirection * (length * 0.5f);
-
-            std::vector<GLfloat> branchVertices;
-            generateShape(PrimitiveType::PRIMITIVE_CYLINDER, branchVertices);
+        case TurtleCommand::Branch: { // Branch
+            float step = length * parameter(i, 0, turtleStep(TurtleCommand::Branch));
+            glm::vec3 newPosition = turtle.position + turtle.growDirection * step;
 
             float thickness = 0.08f - 0.01f * turtle.position.y;
-            thickness = glm::max(thickness, 0.005f);
-
-            glm::mat4 modelMatrix = calculateModelMatrix(turtle.position, newPosition, thickness);
+            thickness = parameter(i, 1, glm::max(thickness, 0.005f));
 
-            createShapeData(
-                branchVertices,
-                glm::vec4(0.4f, 0.3f, 0.2f, 1.0f), // Branch ambient color
-                glm::vec4(0.5f, 0.4f, 0.3f, 1.0f), // Branch diffuse color
-                glm::vec4(0.1f, 0.1f, 0.1f, 1.0f), // Branch specular color
-                32.0f,                              // Shininess
-                m_branch_texture,  // Texture
-                modelMatrix,                      // Model matrix
-                false                             // not base
-                );
+            segments.push_back({SegmentKind::Branch, turtle.position, newPosition, thickness, static_cast<int>(stateStack.size())});
+            swayWithBranch(segments.back());
+            growWithPath(segments.back(), i, step);
 
             turtle.position = newPosition;
             break;
         }
-        case 'L': { // Create a leaf
-            glm::vec3 newPosition = turtle.position + turtle.growDirection * (length * 0.5f);
-
-            std::vector<GLfloat> leafVertices;
-            generateShape(PrimitiveType::PRIMITIVE_SPHERE, leafVertices); // Use cone as leaf
+        case TurtleCommand::Leaf: { // Create a leaf
+            float step = length * parameter(i, 0, turtleStep(TurtleCommand::Leaf));
+            glm::vec3 newPosition = turtle.position + turtle.growDirection * step;
 
             float thickness = 0.05f - 0.001f * turtle.position.y;
-            thickness = glm::max(thickness, 0.005f);
-
-            glm::mat4 modelMatrix = calculateModelMatrix(turtle.position, newPosition, thickness);
+            thickness = parameter(i, 1, glm::max(thickness, 0.005f));
 
-            createShapeData(
-                leafVertices,
-                glm::vec4(0.0f, 0.8f, 0.0f, 1.0f), // Leaf ambient color
-                glm::vec4(0.1f, 0.9f, 0.1f, 1.0f), // Leaf diffuse color
-                glm::vec4(0.5f, 0.5f, 0.5f, 1.0f), // Leaf specular color
-                16.0f,                              // Shininess
-                m_leaf_texture,  // Leaf texture
-                modelMatrix,                      // Model matrix
-                false                             // not base
-                );
+            segments.push_back({SegmentKind::Leaf, turtle.position, newPosition, thickness, static_cast<int>(stateStack.size()),
+                                1, 3, turtle.rightDirection});
+            swayWithBranch(segments.back());
+            growWithPath(segments.back(), i, step);
 
             turtle.position = newPosition;
             break;
         }
-        case '+': { // Rotate GrowDirection left/right (Yaw)
-            glm::mat4 rotationMatrix = customRotate(turtle.forwardDirection, glm::radians(angle));
-            turtle.growDirection = glm::normalize(glm::vec3(rotationMatrix * glm::vec4(turtle.growDirection, 0.0f)));
-            turtle.rightDirection = glm::normalize(glm::cross(turtle.growDirection, turtle.forwardDirection));
-            break;
-        }
-        case '-': { // Rotate GrowDirection right/left (Yaw, opposite)
-            glm::mat4 rotationMatrix = customRotate(turtle.forwardDirection, glm::radians(-angle));
-            turtle.growDirection = glm::normalize(glm::vec3(rotationMatrix * glm::vec4(turtle.growDirection, 0.0f)));
-            turtle.rightDirection = glm::normalize(glm::cross(turtle.growDirection, turtle.forwardDirection));
-            break;
-        }
-        case '&': { // Roll GrowDirection clockwise (Roll)
-            glm::mat4 rotationMatrix = customRotate(turtle.growDirection, glm::radians(-angle));
-            turtle.forwardDirection = glm::normalize(glm::vec3(rotationMatrix * glm::vec4(turtle.forwardDirection, 0.0f)));
-            turtle.rightDirection = glm::normalize(glm::cross(turtle.growDirection, turtle.forwardDirection));
-            break;
-        }
-        case '^': { // Roll GrowDirection counter-clockwise (Roll, opposite)
-            glm::mat4 rotationMatrix = customRotate(turtle.growDirection, glm::radians(angle));
-            turtle.forwardDirection = glm::normalize(glm::vec3(rotationMatrix * glm::vec4(turtle.forwardDirection, 0.0f)));
-            turtle.rightDirection = glm::normalize(glm::cross(turtle.growDirection, turtle.forwardDirection));
-            break;
-        }
-        case '<': { // Rotate GrowDirection forward/backward (Pitch)
-            glm::mat4 rotationMatrix = customRotate(turtle.rightDirection, glm::radians(-angle));
-            turtle.growDirection = glm::normalize(glm::vec3(rotationMatrix * glm::vec4(turtle.growDirection, 0.0f)));
-            turtle.forwardDirection = glm::normalize(glm::cross(turtle.rightDirection, turtle.growDirection));
-            break;
-        }
-        case '>': { // Rotate GrowDirection backward/forward (Pitch, opposite)
-            glm::mat4 rotationMatrix = customRotate(turtle.rightDirection, glm::radians(angle));
-            turtle.growDirection = glm::normalize(glm::vec3(rotationMatrix * glm::vec4(turtle.growDirection, 0.0f)));
-            turtle.forwardDirection = glm::normalize(glm::cross(turtle.rightDirection, turtle.growDirection));
-            break;
-        }
-        case '|': { // Turn around (Rotate 180 degrees)
-            glm::mat4 rotationMatrix = customRotate(turtle.growDirection, glm::radians(180.0f));
-            turtle.forwardDirection = glm::normalize(glm::vec3(rotationMatrix * glm::vec4(turtle.forwardDirection, 0.0f)));
-            turtle.rightDirection = glm::normalize(glm::cross(turtle.growDirection, turtle.forwardDirection));
+        case TurtleCommand::YawLeft:    // Rotate GrowDirection left/right (Yaw)
+        case TurtleCommand::YawRight:
+        case TurtleCommand::RollRight:  // Roll about GrowDirection
+        case TurtleCommand::RollLeft:
+        case TurtleCommand::PitchDown:  // Rotate GrowDirection forward/backward (Pitch)
+        case TurtleCommand::PitchUp:
+        case TurtleCommand::TurnAround: // Turn around (Rotate 180 degrees)
+            turnTurtle(command, turnAt(i), turtle.growDirection, turtle.forwardDirection, turtle.rightDirection);
             break;
-        }
-        case '[': { // Save current state
+        case TurtleCommand::Push: { // Save current state
             stateStack.push(turtle);
+
+            // A new branch pivots where it leaves its parent; golden-ratio steps keep sibling phases apart
+            branchStack.push(branch);
+            float phase = std::fmod(branch.phase + 0.618034f * static_cast<float>(++branchCount), 1.0f);
+            branch = {turtle.position, phase, branch.phase, glm::length(turtle.position - branch.origin)};
             break;
         }
-        case ']': { // Restore saved state
+        case TurtleCommand::Pop: { // Restore saved state
             if (!stateStack.empty()) {
                 turtle = stateStack.top();
                 stateStack.pop();
+                branch = branchStack.top();
+                branchStack.pop();
             }
             break;
         }
-        default:
+        case TurtleCommand::None:
             break;
         }
     }
 
-    // Form Forest
-    if(settings.extraCredit2){
+    // Path lengths become fractions of the longest path and each iteration that drew something gets the next
+    // unit of time, so a segment starts growing only once the one it grows from is done. Iterations whose
+    // symbols were all rewritten later leave no gap. The timeline is then scaled into [0, 1]
+    std::vector<int> drawnIterations = segmentIterations;
+    std::sort(drawnIterations.begin(), drawnIterations.end());
+    drawnIterations.erase(std::unique(drawnIterations.begin(), drawnIterations.end()), drawnIterations.end());
+    for (int& iteration : segmentIterations) {
+        iteration = static_cast<int>(std::lower_bound(drawnIterations.begin(), drawnIterations.end(), iteration) - drawnIterations.begin());
+    }
 
-        int numTrees = 6;
-        float radius = 4.0f;
-        float angleStep = 360.0f / numTrees;
-        initializeBase();
+    float longestPath = 1e-6f;
+    for (const TreeSegment& segment : segments) {
+        longestPath = std::max(longestPath, segment.grown);
+    }
+    float timeline = 1e-6f;
+    for (size_t s = 0; s < segments.size(); ++s) {
+        TreeSegment& segment = segments[s];
+        segment.birth = segmentIterations[s] + segment.birth / longestPath;
+        segment.grown = segmentIterations[s] + segment.grown / longestPath;
+        timeline = std::max(timeline, segment.grown);
+    }
+    for (TreeSegment& segment : segments) {
+        segment.birth /= timeline;
+        segment.grown /= timeline;
+    }
+    return segments;
+}
 
-        for (int i = 0; i < numTrees; i++) {
-            float angleDegrees = angleStep * i;
-            float angleRadians = glm::radians(angleDegrees);
+// Mesh and upload the segments of one tree, copied or instanced over the forest, or with placedTrees > 0
+// the segments of that many distinct trees already at their places. With depthLevels, the same tree derived
+// at 1, 2, ... fewer iterations is copied over the forest too, for far trees to be drawn with, see
+// realtimedepthlod.cpp. Every level is meshed then, leaves and twigs included
+void Realtime::buildTree(std::vector<TreeSegment> segments, int placedTrees, std::vector<std::vector<TreeSegment>> depthLevels) {
+    m_shapeData.clear();
+    m_shapeTreeIndex.clear();
+    m_shapeTreeDepth.clear();
+    templateTree.clear();
+    m_meshCache.releaseAddedChains(); // The previous tree's tubes
+    bool depthLod = !depthLevels.empty() && settings.extraCredit2 && placedTrees == 0;
+    m_depthLevels = depthLod ? static_cast<int>(depthLevels.size()) + 1 : 0;
+
+    // A regenerated tree grows again from the start
+    m_growthStartTime = m_time;
+
+    releaseStaticBatch();
+
+    // Leaves become instanced cards instead of spheres and stay out of the triangle budget, see realtimeleaves.cpp
+    std::vector<TreeSegment> leaves;
+    if (settings.leafCards && !depthLod) {
+        auto firstLeaf = std::stable_partition(segments.begin(), segments.end(), [](const TreeSegment& segment) {
+            return segment.kind != SegmentKind::Leaf;
+        });
+        leaves.assign(firstLeaf, segments.end());
+        segments.erase(firstLeaf, segments.end());
+    }
 
-            float xOffset = radius * std::cos(angleRadians);
-            float zOffset = radius * std::sin(angleRadians);
+    // Thin and deep segments get fewer slices, and the whole tree stays within the triangle budget
+    TessellationPolicy(settings.treeTriangleBudget * std::max(placedTrees, 1)).apply(segments);
+
+    // Twigs thinner than the threshold are ray-cast as capsules instead of meshed, see realtimecapsule.cpp
+    std::vector<TreeSegment> capsules;
+    if (settings.capsuleTwigs && !depthLod) {
+        auto firstThin = std::stable_partition(segments.begin(), segments.end(), [&](const TreeSegment& segment) {
+            return segment.kind == SegmentKind::Leaf || segment.thickness >= settings.capsuleThickness;
+        });
+        capsules.assign(firstThin, segments.end());
+        segments.erase(firstThin, segments.end());
+    }
+
+    // Tessellated branches are built on the GPU from the segments themselves, see realtimetessellation.cpp
+    bool patchBranches = settings.tessellatedBranches && m_branchPatchesSupported && !depthLod;
 
-            glm::mat4 translation = glm::translate(glm::mat4(1.0f), glm::vec3(xOffset, 0.0f, zOffset));
+    meshTreeSegments(segments, patchBranches);
 
-            for (const ShapeData &shape : templateTree) {
-                ShapeData newShape = shape;
-                newShape.modelMatrix = translation * newShape.modelMatrix;
-                m_shapeData.push_back(newShape);
+    computeTreeBounds();
+
+    // Wood drawn outside templateTree still has to fit the forest's cull and occlusion bounds
+    growTreeBounds(capsules);
+    growTreeBounds(leaves);
+    if (patchBranches) {
+        growTreeBounds(segments);
+    }
+
+    // Capsules and cards are uploaded before the bake, which draws them into the impostor atlas
+    uploadCapsules(capsules);
+    uploadLeafCards(leaves);
+
+    // Far forest trees are drawn from views of the template baked now
+    m_impostorReady = false;
+    if (settings.extraCredit2 && settings.impostors && !patchBranches && placedTrees == 0) {
+        bakeImpostor();
+    }
+
+    // Form Forest
+    m_treeInstances.clear();
+    m_instancedForest = settings.extraCredit2 && settings.gpuCulling && placedTrees == 0 && !depthLod;
+
+    if (placedTrees > 0) {
+        // Every tree is already in place and different, so the forest is drawn as one tree
+        std::vector<glm::vec4> positions;
+        m_shapeData = templateTree;
+        initializeBase(layoutForest(placedTrees, positions));
+    } else if(settings.extraCredit2){
+        initializeBase(layoutForest(settings.forestSize, m_treeInstances));
+
+        if (m_instancedForest) {
+            // Trees stay as one template drawn per visible instance, see realtimeforest.cpp
+            if (settings.staticBatch) {
+                m_batchShapes = bakeStaticBatch(templateTree);
+            }
+            uploadTreeInstances();
+        } else {
+            // Remember which tree each copied shape came from so occluded trees can be skipped, and at which
+            // depth so only the one picked for the tree is drawn
+            m_shapeTreeIndex.resize(m_shapeData.size(), -1);
+            m_shapeTreeDepth.resize(m_shapeData.size(), 0);
+            auto copyToForest = [&](int depth) {
+                for (size_t tree = 0; tree < m_treeInstances.size(); ++tree) {
+                    glm::mat4 translation = glm::translate(glm::mat4(1.0f), glm::vec3(m_treeInstances[tree]));
+
+                    for (const ShapeData &shape : templateTree) {
+                        ShapeData newShape = shape;
+                        newShape.modelMatrix = translation * newShape.modelMatrix;
+                        newShape.windOrigin += glm::vec4(glm::vec3(m_treeInstances[tree]), 0.0f);
+                        newShape.growthStart += glm::vec4(glm::vec3(m_treeInstances[tree]), 0.0f);
+                        m_shapeData.push_back(newShape);
+                        m_shapeTreeIndex.push_back(static_cast<int>(tree));
+                        m_shapeTreeDepth.push_back(static_cast<uint8_t>(depth));
+                    }
+                }
+            };
+            copyToForest(m_depthLevels);
+
+            // Each shallower level has a fraction of the shapes of the next, so all of them together add
+            // little to the full tree. The full template stays templateTree
+            if (depthLod) {
+                std::vector<ShapeData> fullTree = std::move(templateTree);
+                for (size_t level = 0; level < depthLevels.size(); ++level) {
+                    templateTree.clear();
+                    TessellationPolicy(settings.treeTriangleBudget).apply(depthLevels[level]);
+                    meshTreeSegments(depthLevels[level], false);
+                    copyToForest(static_cast<int>(level) + 1);
+                }
+                templateTree = std::move(fullTree);
             }
+            m_treeDepth.assign(m_treeInstances.size(), static_cast<uint8_t>(m_depthLevels));
         }
 
     } else {
         m_shapeData = templateTree;
         initializeBase();
     }
+
+    // Every segment collapses into one pre-transformed range per material, only the ground stays separate.
+    // Depth levels have to stay apart to be swapped, so they are not batched
+    if (settings.staticBatch && !m_instancedForest && !depthLod) {
+        std::vector<ShapeData> batchShapes = bakeStaticBatch(m_shapeData);
+        m_shapeData.erase(std::remove_if(m_shapeData.begin(), m_shapeData.end(),
+                                         [](const ShapeData& shape) { return shape.meshId >= 0; }),
+                          m_shapeData.end());
+        m_shapeData.insert(m_shapeData.end(), batchShapes.begin(), batchShapes.end());
+        m_shapeTreeIndex.clear();
+        m_shapeTreeDepth.clear();
+    }
+
+    uploadBranchPatches(patchBranches ? segments : std::vector<TreeSegment>());
+
+    resetOcclusion();
+    rebuildShapeBounds();
+}
+
+// Append one shape per segment to templateTree, with connected wood welded into tubes unless the tessellated
+// branches draw it
+void Realtime::meshTreeSegments(const std::vector<TreeSegment>& segments, bool patchBranches) {
+    // Connected trunk and branch segments become one welded tube each, leaves are meshed below. Every tube
+    // is swept at each level of the mesh cache, so it switches levels like the cached primitives
+    if (settings.tubeBranches && !patchBranches) {
+        TubeMesher mesher(segments);
+        std::vector<float> details;
+        for (int lod = 0; lod < MeshCache::LOD_LEVELS; ++lod) {
+            details.push_back(MeshCache::levelScale(lod));
+        }
+        std::vector<std::vector<GLfloat>> levels;
+
+        for (size_t chain = 0; chain < mesher.chains().size(); ++chain) {
+            glm::mat4 modelMatrix;
+            mesher.meshLevels(chain, details, levels, modelMatrix);
+            createShapeData(
+                m_meshCache.addChain(PrimitiveType::PRIMITIVE_MESH, levels),
+                glm::vec4(0.4f, 0.3f, 0.2f, 1.0f), // Wood ambient color
+                glm::vec4(0.5f, 0.4f, 0.3f, 1.0f), // Wood diffuse color
+                glm::vec4(0.1f, 0.1f, 0.1f, 1.0f), // Wood specular color
+                32.0f,                              // Shininess
+                mesher.kind(chain) == SegmentKind::Trunk ? m_trunk_texture : m_branch_texture,
+                modelMatrix,                      // Unit box of the tube to world space
+                false                             // not base
+                );
+
+            // A chain never leaves its branch, so its first segment carries the wind pivot for all of it
+            const TreeSegment& first = segments[mesher.chains()[chain].front()];
+            templateTree.back().windOrigin = first.windOrigin();
+            templateTree.back().windParent = first.windParent();
+
+            // The tube grows as a whole from its base over the time of all its segments
+            templateTree.back().growthStart = first.growthStart();
+            templateTree.back().growthEnd = segments[mesher.chains()[chain].back()].grown;
+        }
+    }
+
+    for (const TreeSegment& segment : segments) {
+        if ((settings.tubeBranches || patchBranches) && segment.kind != SegmentKind::Leaf) {
+            continue;
+        }
+
+        glm::mat4 modelMatrix = calculateModelMatrix(segment.start, segment.end, segment.thickness);
+
+        switch (segment.kind) {
+        case SegmentKind::Trunk:
+            createShapeData(
+                m_meshCache.lodChain(PrimitiveType::PRIMITIVE_CYLINDER, segment.heightSegments, segment.radialSegments),
+                glm::vec4(0.4f, 0.3f, 0.2f, 1.0f), // Root ambient color
+                glm::vec4(0.5f, 0.4f, 0.3f, 1.0f), // Root diffuse color
+                glm::vec4(0.1f, 0.1f, 0.1f, 1.0f), // Root specular color
+                32.0f,                              // Shininess
+                m_trunk_texture,  // Texture
+                modelMatrix,                      // Model matrix
+                false                             // not base
+                );
+            break;
+        case SegmentKind::Branch:
+            createShapeData(
+                m_meshCache.lodChain(PrimitiveType::PRIMITIVE_CYLINDER, segment.heightSegments, segment.radialSegments),
+                glm::vec4(0.4f, 0.3f, 0.2f, 1.0f), // Branch ambient color
+                glm::vec4(0.5f, 0.4f, 0.3f, 1.0f), // Branch diffuse color
+                glm::vec4(0.1f, 0.1f, 0.1f, 1.0f), // Branch specular color
+                32.0f,                              // Shininess
+                m_branch_texture,  // Texture
+                modelMatrix,                      // Model matrix
+                false                             // not base
+                );
+            break;
+        case SegmentKind::Leaf:
+            createShapeData(
+                m_meshCache.lodChain(PrimitiveType::PRIMITIVE_SPHERE, segment.heightSegments, segment.radialSegments),
+                glm::vec4(0.0f, 0.8f, 0.0f, 1.0f), // Leaf ambient color
+                glm::vec4(0.1f, 0.9f, 0.1f, 1.0f), // Leaf diffuse color
+                glm::vec4(0.5f, 0.5f, 0.5f, 1.0f), // Leaf specular color
+                16.0f,                              // Shininess
+                m_leaf_texture,  // Leaf texture
+                modelMatrix,                      // Model matrix
+                false                             // not base
+                );
+            break;
+        }
+        templateTree.back().windOrigin = segment.windOrigin();
+        templateTree.back().windParent = segment.windParent();
+        templateTree.back().growthStart = segment.growthStart();
+        templateTree.back().growthEnd = segment.grown;
+    }
 }
 
 void Realtime::generateShape(PrimitiveType type, std::vector<GLfloat> &vertices) {
@@ -364,11 +735,59 @@ void Realtime::createShapeData(
 
     shapeData.vertexCount = vertices.size() / 8;
 
+    // Cleanup
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindVertexArray(0);
+
+    storeShapeData(shapeData, ambientColor, diffuseColor, specularColor, shininess, texture, modelMatrix, isBase, blend, repeatU, repeatV);
+}
+
+// Same as above, but the shape draws the shared unit mesh meshId from m_meshCache instead of owning one
+void Realtime::createShapeData(
+    int meshId,
+    const glm::vec4& ambientColor,
+    const glm::vec4& diffuseColor,
+    const glm::vec4& specularColor,
+    float shininess,
+    const GLuint& texture,
+    const glm::mat4& modelMatrix,
+    bool isBase,
+    float blend,
+    float repeatU,
+    float repeatV
+    ) {
+    ShapeData shapeData;
+
+    // The finest level doubles as the shape's own mesh for passes that don't pick a level
+    const MeshLevel& mesh = m_meshCache.level(meshId, 0);
+    shapeData.vao = mesh.vao;
+    shapeData.vbo = mesh.vbo;
+    shapeData.vertexCount = mesh.vertexCount;
+    shapeData.meshId = meshId;
+
+    storeShapeData(shapeData, ambientColor, diffuseColor, specularColor, shininess, texture, modelMatrix, isBase, blend, repeatU, repeatV);
+}
+
+// Material, texture and transform shared by both createShapeData overloads
+void Realtime::storeShapeData(
+    ShapeData& shapeData,
+    const glm::vec4& ambientColor,
+    const glm::vec4& diffuseColor,
+    const glm::vec4& specularColor,
+    float shininess,
+    const GLuint& texture,
+    const glm::mat4& modelMatrix,
+    bool isBase,
+    float blend,
+    float repeatU,
+    float repeatV
+    ) {
     // Set material properties
     shapeData.ambient = ambientColor;
     shapeData.diffuse = diffuseColor;
     shapeData.specular = specularColor;
     shapeData.shininess = shininess;
+    shapeData.materialId = registerMaterial(ambientColor, diffuseColor, specularColor, shininess);
 
     // Use provided texture
     if (texture != 0) {
@@ -389,106 +808,115 @@ void Realtime::createShapeData(
     } else {
         templateTree.push_back(shapeData);
     }
-
-    // Cleanup
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-    glBindVertexArray(0);
 }
 
-void Realtime::paintLSystem() {
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-    glUseProgram(m_shader);
-
+// Camera, shadow, shading and light uniforms phong.frag reads, for every program that uses it
+void Realtime::setSceneUniforms(GLuint program) {
     // Pass view and projection matrices
-    glUniformMatrix4fv(glGetUniformLocation(m_shader, "viewMatrix"), 1, GL_FALSE, &m_view[0][0]);
-    glUniformMatrix4fv(glGetUniformLocation(m_shader, "projMatrix"), 1, GL_FALSE, &m_proj[0][0]);
+    glUniformMatrix4fv(glGetUniformLocation(program, "viewMatrix"), 1, GL_FALSE, &m_view[0][0]);
+    glUniformMatrix4fv(glGetUniformLocation(program, "projMatrix"), 1, GL_FALSE, &m_proj[0][0]);
 
     // Pass light space matrix
-    glUniformMatrix4fv(glGetUniformLocation(m_shader, "lightSpaceMatrix"), 1, GL_FALSE, &lightSpaceMatrix[0][0]);
+    glUniformMatrix4fv(glGetUniformLocation(program, "lightSpaceMatrix"), 1, GL_FALSE, &lightSpaceMatrix[0][0]);
 
     // Bind shadow texture and wether the shadow map is enabled
     glActiveTexture(GL_TEXTURE2);
     glBindTexture(GL_TEXTURE_2D, shadowTexture);
-    glUniform1i(glGetUniformLocation(m_shader, "shadowMap"), 2);
+    glUniform1i(glGetUniformLocation(program, "shadowMap"), 2);
 
-    glUniform1i(glGetUniformLocation(m_shader, "toonColorLevel"), settings.toonLevel);
-    glUniform1i(glGetUniformLocation(m_shader, "toonShadingEnable"), settings.toonEnable);
-    glUniform1i(glGetUniformLocation(m_shader, "shadowMapEnable"), settings.extraCredit1);
+    glUniform1i(glGetUniformLocation(program, "toonColorLevel"), settings.toonLevel);
+    glUniform1i(glGetUniformLocation(program, "toonShadingEnable"), settings.toonEnable);
+    glUniform1i(glGetUniformLocation(program, "shadowMapEnable"), settings.extraCredit1);
 
     // Pass camera position
-    glUniform4fv(glGetUniformLocation(m_shader, "cameraPosition"), 1, &glm::vec4(eye, 1.0f)[0]);
+    glUniform4fv(glGetUniformLocation(program, "cameraPosition"), 1, &glm::vec4(eye, 1.0f)[0]);
 
     // Set ka, kd, ks coefficients
     float ka = 0.5f;
     float kd = 0.5f;
     float ks = 0.5f;
 
-    glUniform1f(glGetUniformLocation(m_shader, "ka"), ka);
-    glUniform1f(glGetUniformLocation(m_shader, "kd"), kd);
-    glUniform1f(glGetUniformLocation(m_shader, "ks"), ks);
+    glUniform1f(glGetUniformLocation(program, "ka"), ka);
+    glUniform1f(glGetUniformLocation(program, "kd"), kd);
+    glUniform1f(glGetUniformLocation(program, "ks"), ks);
 
     // Pass light data
     int numLights = std::min(static_cast<int>(lights.size()), 8); // Max 8 lights
-    glUniform1i(glGetUniformLocation(m_shader, "numLights"), numLights);
+    glUniform1i(glGetUniformLocation(program, "numLights"), numLights);
 
     for (int i = 0; i < numLights; ++i) {
         const CustomLightData& light = lights[i];
         std::string baseName = "lights[" + std::to_string(i) + "]";
 
-        glUniform4fv(glGetUniformLocation(m_shader, (baseName + ".color").c_str()), 1, &light.color[0]);
-        glUniform3fv(glGetUniformLocation(m_shader, (baseName + ".function").c_str()), 1, &light.function[0]);
-        glUniform4fv(glGetUniformLocation(m_shader, (baseName + ".position").c_str()), 1, &light.position[0]);
-        glUniform4fv(glGetUniformLocation(m_shader, (baseName + ".direction").c_str()), 1, &light.direction[0]);
-        glUniform1i(glGetUniformLocation(m_shader, (baseName + ".type").c_str()), light.type);
-        glUniform1f(glGetUniformLocation(m_shader, (baseName + ".penumbra").c_str()), light.penumbra);
-        glUniform1f(glGetUniformLocation(m_shader, (baseName + ".angle").c_str()), light.angle);
+        glUniform4fv(glGetUniformLocation(program, (baseName + ".color").c_str()), 1, &light.color[0]);
+        glUniform3fv(glGetUniformLocation(program, (baseName + ".function").c_str()), 1, &light.function[0]);
+        glUniform4fv(glGetUniformLocation(program, (baseName + ".position").c_str()), 1, &light.position[0]);
+        glUniform4fv(glGetUniformLocation(program, (baseName + ".direction").c_str()), 1, &light.direction[0]);
+        glUniform1i(glGetUniformLocation(program, (baseName + ".type").c_str()), light.type);
+        glUniform1f(glGetUniformLocation(program, (baseName + ".penumbra").c_str()), light.penumbra);
+        glUniform1f(glGetUniformLocation(program, (baseName + ".angle").c_str()), light.angle);
     }
 
-    // Draw L-System geometry (use existing logic)
-    for (const ShapeData& shape : m_shapeData) {
-        glBindVertexArray(shape.vao);
-
-        // Set material properties
-        glUniform4fv(glGetUniformLocation(m_shader, "material.ambient"), 1, &shape.ambient[0]);
-        glUniform4fv(glGetUniformLocation(m_shader, "material.diffuse"), 1, &shape.diffuse[0]);
-        glUniform4fv(glGetUniformLocation(m_shader, "material.specular"), 1, &shape.specular[0]);
-        glUniform1f(glGetUniformLocation(m_shader, "material.shininess"), shape.shininess);
-
-        // Set model matrix
-        glUniformMatrix4fv(glGetUniformLocation(m_shader, "modelMatrix"), 1, GL_FALSE, &shape.modelMatrix[0][0]);
-
-        // Set normal matrix
-        glm::mat3 normalMatrix = glm::inverse(glm::transpose(glm::mat3(shape.modelMatrix)));
-        GLint normalMatrixLocation = glGetUniformLocation(m_shader, "normalMatrix");
-        glUniformMatrix3fv(normalMatrixLocation, 1, GL_FALSE, &normalMatrix[0][0]);
-
-        if (shape.textureUsed) {
-            // Pass the textureUsed uniform
-            GLint textureUsedLocation = glGetUniformLocation(m_shader, "textureUsed");
-            glUniform1i(textureUsedLocation, true); // Set to true
-
-            // Pass the texture to shader (already bound to slot 1 as per your setup)
-            GLint textureLocation = glGetUniformLocation(m_shader, "Texture");
-            glActiveTexture(GL_TEXTURE1); // Set the active texture slot
-            glBindTexture(GL_TEXTURE_2D, shape.diffuseTexture);
-            glUniform1i(textureLocation, 1); // Slot 1
-
-            // Pass blend value
-            GLint blendLocation = glGetUniformLocation(m_shader, "blend");
-            glUniform1f(blendLocation, shape.blend);
-
-            // Pass repeatU and repeatV values
-            GLint repeatULocation = glGetUniformLocation(m_shader, "repeatU");
-            glUniform1f(repeatULocation, shape.repeatU);
-
-            GLint repeatVLocation = glGetUniformLocation(m_shader, "repeatV");
-            glUniform1f(repeatVLocation, shape.repeatV);
-        }
+    setAnimationUniforms(program);
+}
 
-        glDrawArrays(GL_TRIANGLES, 0, shape.vertexCount);
+// Wind block, clock and growth time for every program whose vertex shader has windOffset and grow; both
+// animations are computed there, so nothing is uploaded per frame besides these few floats
+void Realtime::setAnimationUniforms(GLuint program) {
+    glm::vec3 direction = glm::normalize(glm::vec3(1.0f, 0.0f, 0.35f));
+    glUniform3fv(glGetUniformLocation(program, "wind.direction"), 1, &direction[0]);
+    glUniform1f(glGetUniformLocation(program, "wind.strength"), settings.windStrength);
+    glUniform1f(glGetUniformLocation(program, "wind.frequency"), 0.4f);
+    glUniform1f(glGetUniformLocation(program, "wind.flutter"), 3.0f);
+    glUniform1f(glGetUniformLocation(program, "time"), m_time);
+
+    glUniform1i(glGetUniformLocation(program, "growing"), settings.growthAnimation);
+    glUniform1f(glGetUniformLocation(program, "growthTime"), growthTime());
+}
 
-        glBindVertexArray(0);
+// Position on the growth timeline, 0 when the animation (re)starts and 1 once the tree is fully grown
+float Realtime::growthTime() const {
+    return std::clamp((m_time - m_growthStartTime) / kGrowthSeconds, 0.0f, 1.0f);
+}
+
+// Shapes drawn from shared meshes carry their wind and growth data as constant attributes 6 to 9,
+// VAOs that store it per vertex (the static batch) override these
+void Realtime::setAnimationAttributes(const ShapeData& shape) {
+    glVertexAttrib4fv(6, &shape.windOrigin[0]);
+    glVertexAttrib2fv(7, &shape.windParent[0]);
+    glVertexAttrib4fv(8, &shape.growthStart[0]);
+    glVertexAttrib1f(9, shape.growthEnd);
+}
+
+void Realtime::paintLSystem() {
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+    // Trees whose boxes were hidden last frame are skipped this frame, far ones become impostors or shallower trees
+    readOcclusionResults();
+    selectTreeRepresentations();
+    selectTreeDepths();
+
+    // Geometry drawn per tree outside m_shapeData follows the trees drawn as meshes
+    m_meshedTreeCount = uploadVisibleTrees(Frustum::fromMatrix(m_proj * m_view), true, m_meshedTreeVBO);
+
+    glUseProgram(m_shader);
+    setSceneUniforms(m_shader);
+
+    // Draw L-System geometry through the sorted render queue
+    submitShapes(m_view, m_proj, settings.farPlane);
+    drawRenderQueue(m_shapeData, nullptr, &m_shapeLod);
+
+    if (m_instancedForest) {
+        paintTreeInstances();
     }
 
+    paintBranchPatches();
+    paintCapsules();
+    paintLeafCards();
+    paintImpostors();
+
+    // With the depth buffer complete, test every tree's box for next frame
+    issueOcclusionQueries();
+
     glUseProgram(0);
 }
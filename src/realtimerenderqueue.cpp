@@ -0,0 +1,176 @@
+#include "realtime.h"
+#include "settings.h"
+#include <glm/glm.hpp>
+
+// Return the id of a material, adding it to the material table the first time it is seen
+uint32_t Realtime::registerMaterial(const glm::vec4& ambient, const glm::vec4& diffuse, const glm::vec4& specular, float shininess) {
+    for (uint32_t i = 0; i < m_materials.size(); ++i) {
+        const MaterialEntry& entry = m_materials[i];
+        if (entry.ambient == ambient && entry.diffuse == diffuse &&
+            entry.specular == specular && entry.shininess == shininess) {
+            return i;
+        }
+    }
+
+    m_materials.push_back({ambient, diffuse, specular, shininess});
+    return static_cast<uint32_t>(m_materials.size() - 1);
+}
+
+// Fill the render queue with every shape in m_shapeData inside the view frustum, not occluded and not
+// replaced by an impostor, and sort it
+void Realtime::submitShapes(const glm::mat4& view, const glm::mat4& proj, float farPlane) {
+    m_renderQueue.clear();
+    cullBoxes(Frustum::fromMatrix(proj * view), m_shapeBounds, m_shapeVisible);
+    hideOtherDepths(m_shapeVisible);
+    selectShapeLods(view, proj);
+
+    for (uint32_t i = 0; i < m_shapeData.size(); ++i) {
+        if (!m_shapeVisible[i]) {
+            continue;
+        }
+        int tree = m_shapeTreeIndex[i];
+        if (tree >= 0 && (m_treeOccluded[tree] || m_treeImpostor[tree])) {
+            continue;
+        }
+        const ShapeData& shape = m_shapeData[i];
+
+        // View-space depth of the shape's origin, normalized by the far plane
+        float viewDepth = -(view * shape.modelMatrix[3]).z;
+        float depth = viewDepth / farPlane;
+
+        GLuint texture = shape.textureUsed ? shape.diffuseTexture : 0;
+        uint64_t key = RenderQueue::makeKey(RenderQueue::PASS_OPAQUE, m_shader, texture, shape.materialId, depth);
+        m_renderQueue.submit(key, i);
+    }
+
+    m_renderQueue.sort();
+}
+
+// Draw the sorted render queue with m_shader, only touching state that differs from the previous item.
+// Item indices refer to shapes; when instances is set every shape is drawn once per visible instance.
+// When lods is set, shapes with a cached mesh draw the level picked for them, dithering in the next one while fading
+void Realtime::drawRenderQueue(const std::vector<ShapeData>& shapes, const InstanceDraw* instances,
+                               const std::vector<LodSelection>* lods) {
+    GLint modelLoc = glGetUniformLocation(m_shader, "modelMatrix");
+    GLint normalMatrixLoc = glGetUniformLocation(m_shader, "normalMatrix");
+    GLint ambientLoc = glGetUniformLocation(m_shader, "material.ambient");
+    GLint diffuseLoc = glGetUniformLocation(m_shader, "material.diffuse");
+    GLint specularLoc = glGetUniformLocation(m_shader, "material.specular");
+    GLint shininessLoc = glGetUniformLocation(m_shader, "material.shininess");
+    GLint textureUsedLoc = glGetUniformLocation(m_shader, "textureUsed");
+    GLint textureLoc = glGetUniformLocation(m_shader, "Texture");
+    GLint blendLoc = glGetUniformLocation(m_shader, "blend");
+    GLint repeatULoc = glGetUniformLocation(m_shader, "repeatU");
+    GLint repeatVLoc = glGetUniformLocation(m_shader, "repeatV");
+    GLint lodFadeLoc = glGetUniformLocation(m_shader, "lodFade");
+    GLint lodFadeInLoc = glGetUniformLocation(m_shader, "lodFadeIn");
+
+    // No dithering unless a fading shape asks for it
+    float boundFade = 0.0f;
+    bool boundFadeIn = false;
+    glUniform1f(lodFadeLoc, boundFade);
+    glUniform1i(lodFadeInLoc, boundFadeIn);
+    auto setFade = [&](float fade, bool fadeIn) {
+        if (fade != boundFade) {
+            glUniform1f(lodFadeLoc, fade);
+            boundFade = fade;
+        }
+        if (fadeIn != boundFadeIn) {
+            glUniform1i(lodFadeInLoc, fadeIn);
+            boundFadeIn = fadeIn;
+        }
+    };
+
+    // Texture always lives in slot 1
+    glActiveTexture(GL_TEXTURE1);
+    glUniform1i(textureLoc, 1);
+
+    bool first = true;
+    uint32_t boundMaterial = 0;
+    GLuint boundTexture = 0;
+    glm::vec3 boundTextureParams(0.0f);
+
+    for (const DrawItem& item : m_renderQueue.items()) {
+        const ShapeData& shape = shapes[item.index];
+
+        // Material uniforms
+        if (first || shape.materialId != boundMaterial) {
+            glUniform4fv(ambientLoc, 1, &shape.ambient[0]);
+            glUniform4fv(diffuseLoc, 1, &shape.diffuse[0]);
+            glUniform4fv(specularLoc, 1, &shape.specular[0]);
+            glUniform1f(shininessLoc, shape.shininess);
+            boundMaterial = shape.materialId;
+        }
+
+        // Texture binding
+        GLuint texture = shape.textureUsed ? shape.diffuseTexture : 0;
+        if (first || texture != boundTexture) {
+            glUniform1i(textureUsedLoc, shape.textureUsed);
+            glBindTexture(GL_TEXTURE_2D, texture);
+            boundTexture = texture;
+        }
+
+        if (shape.textureUsed) {
+            glm::vec3 textureParams(shape.blend, shape.repeatU, shape.repeatV);
+            if (first || textureParams != boundTextureParams) {
+                glUniform1f(blendLoc, shape.blend);
+                glUniform1f(repeatULoc, shape.repeatU);
+                glUniform1f(repeatVLoc, shape.repeatV);
+                boundTextureParams = textureParams;
+            }
+        }
+        first = false;
+
+        // Per-item transforms
+        glUniformMatrix4fv(modelLoc, 1, GL_FALSE, &shape.modelMatrix[0][0]);
+        glm::mat3 normalMatrix = glm::inverse(glm::transpose(glm::mat3(shape.modelMatrix)));
+        glUniformMatrix3fv(normalMatrixLoc, 1, GL_FALSE, &normalMatrix[0][0]);
+        setAnimationAttributes(shape);
+
+        if (instances == nullptr && lods != nullptr && shape.meshId >= 0) {
+            const LodSelection& lod = (*lods)[item.index];
+            const MeshLevel& mesh = m_meshCache.level(shape.meshId, lod.level);
+            setFade(lod.fade, false);
+            glBindVertexArray(mesh.vao);
+            glDrawArrays(GL_TRIANGLES, 0, mesh.vertexCount);
+
+            // The coarser level covers exactly the pixels the finer one dithered away
+            if (lod.fade > 0.0f) {
+                const MeshLevel& coarser = m_meshCache.level(shape.meshId, lod.level + 1);
+                setFade(lod.fade, true);
+                glBindVertexArray(coarser.vao);
+                glDrawArrays(GL_TRIANGLES, 0, coarser.vertexCount);
+            }
+            continue;
+        }
+
+        setFade(0.0f, false);
+        glBindVertexArray(shape.vao);
+        if (instances == nullptr) {
+            glDrawArrays(GL_TRIANGLES, shape.firstVertex, shape.vertexCount);
+            continue;
+        }
+
+        // Point attribute 3 of this shape's VAO at the instance buffer, one offset per instance
+        glBindBuffer(GL_ARRAY_BUFFER, instances->instanceBuffer);
+        glEnableVertexAttribArray(3);
+        glVertexAttribPointer(3, 4, GL_FLOAT, GL_FALSE, 4 * sizeof(GLfloat), reinterpret_cast<void *>(0));
+        glVertexAttribDivisor(3, 1);
+
+        if (instances->indirectBuffer != 0) {
+            glBindBuffer(GL_DRAW_INDIRECT_BUFFER, instances->indirectBuffer);
+            glDrawArraysIndirect(GL_TRIANGLES, reinterpret_cast<void *>(item.index * 4 * sizeof(GLuint)));
+        } else {
+            glDrawArraysInstanced(GL_TRIANGLES, shape.firstVertex, shape.vertexCount, instances->instanceCount);
+        }
+
+        // The VAO may be a shared cached mesh, later non-instanced draws need the default offset back
+        glDisableVertexAttribArray(3);
+    }
+
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+    glBindVertexArray(0);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    setFade(0.0f, false);
+}
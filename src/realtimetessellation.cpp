@@ -0,0 +1,221 @@
+#include "realtime.h"
+#include "lsystem/tubemesher.h"
+#include "settings.h"
+#include "utils/shaderloader.h"
+#include <cstddef>
+#include <glm/glm.hpp>
+#include <glm/gtc/packing.hpp>
+
+// Wanted on-screen length of one tessellated edge, lower is finer
+static constexpr float kPixelsPerEdge = 8.0f;
+
+// Per-segment wind and growth data lives in a buffer texture, on the slot after the leaf data
+static constexpr int kPatchDataSlot = 6;
+
+// One patch control point as stored in m_branchPatchVBO
+struct PatchPoint {
+    glm::vec4 point;  // Position and radius at this end of the segment
+    uint32_t tangent; // Tube frame at this end, see TubeMesher::joints; packed 10 bits per component
+    uint32_t normal;
+};
+
+void Realtime::initializeBranchPatches() {
+    // Tessellation stages are core since GL 4.0, so always there on our 4.1 profile; checked anyway for older drivers
+    m_branchPatchesSupported = GLEW_VERSION_4_0 || GLEW_ARB_tessellation_shader;
+    if (!m_branchPatchesSupported) {
+        return;
+    }
+
+    m_branch_patch_shader = ShaderLoader::createShaderProgram(
+        {{GL_VERTEX_SHADER, ":/resources/shaders/branchpatch.vert"},
+         {GL_TESS_CONTROL_SHADER, ":/resources/shaders/branchpatch.tesc"},
+         {GL_TESS_EVALUATION_SHADER, ":/resources/shaders/branchpatch.tese"},
+         {GL_FRAGMENT_SHADER, ":/resources/shaders/phong.frag"}});
+    m_branch_patch_depth_shader = ShaderLoader::createShaderProgram(
+        {{GL_VERTEX_SHADER, ":/resources/shaders/branchpatch.vert"},
+         {GL_TESS_CONTROL_SHADER, ":/resources/shaders/branchpatch.tesc"},
+         {GL_TESS_EVALUATION_SHADER, ":/resources/shaders/branchpatch.tese"},
+         {GL_FRAGMENT_SHADER, ":/resources/shaders/depth.frag"}});
+
+    glGenBuffers(1, &m_branchPatchVBO);
+    glGenBuffers(1, &m_branchPatchInstanceVBO);
+    glGenVertexArrays(1, &m_branchPatchVAO);
+    glBindVertexArray(m_branchPatchVAO);
+
+    // Two points per segment: position and radius, then the tube's tangent and normal there
+    GLsizei stride = sizeof(PatchPoint);
+    glBindBuffer(GL_ARRAY_BUFFER, m_branchPatchVBO);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, stride, reinterpret_cast<void *>(offsetof(PatchPoint, point)));
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(1, 4, GL_INT_2_10_10_10_REV, GL_TRUE, stride, reinterpret_cast<void *>(offsetof(PatchPoint, tangent)));
+    glEnableVertexAttribArray(2);
+    glVertexAttribPointer(2, 4, GL_INT_2_10_10_10_REV, GL_TRUE, stride, reinterpret_cast<void *>(offsetof(PatchPoint, normal)));
+
+    // One tree offset per instance, same layout as the instanced forest
+    glBindBuffer(GL_ARRAY_BUFFER, m_branchPatchInstanceVBO);
+    glEnableVertexAttribArray(3);
+    glVertexAttribPointer(3, 4, GL_FLOAT, GL_FALSE, 4 * sizeof(GLfloat), reinterpret_cast<void *>(0));
+    glVertexAttribDivisor(3, 1);
+
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindVertexArray(0);
+
+    glGenBuffers(1, &m_branchPatchDataBuffer);
+    glGenTextures(1, &m_branchPatchDataTexture);
+    glBindBuffer(GL_TEXTURE_BUFFER, m_branchPatchDataBuffer);
+    glBindTexture(GL_TEXTURE_BUFFER, m_branchPatchDataTexture);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, m_branchPatchDataBuffer);
+    glBindTexture(GL_TEXTURE_BUFFER, 0);
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+}
+
+// Upload the trunk and branch segments as patches, trunk first, and one instance per tree.
+// Called after the forest is laid out; an empty list turns the patches off
+void Realtime::uploadBranchPatches(const std::vector<TreeSegment>& segments) {
+    for (PatchRange& range : m_branchPatchRanges) {
+        range = PatchRange();
+    }
+    if (!m_branchPatchesSupported || segments.empty()) {
+        return;
+    }
+
+    // Both ends of a segment take the tube's frame and radius at that joint, so neighbouring patches sweep the
+    // same ring there. The wind origin, wind parent and growth times of each segment go to the buffer texture
+    // in patch order
+    TubeMesher mesher(segments);
+    std::vector<PatchPoint> points[2];
+    std::vector<glm::vec4> data[2];
+    auto patchPoint = [](const TubeMesher::Joint& joint) {
+        return PatchPoint{glm::vec4(joint.center, joint.radius), glm::packSnorm3x10_1x2(glm::vec4(joint.tangent, 0.0f)),
+                          glm::packSnorm3x10_1x2(glm::vec4(joint.normal, 0.0f))};
+    };
+    for (size_t chain = 0; chain < mesher.chains().size(); ++chain) {
+        const std::vector<int>& indices = mesher.chains()[chain];
+        std::vector<TubeMesher::Joint> joints = mesher.joints(chain);
+        int kind = mesher.kind(chain) == SegmentKind::Trunk ? 0 : 1;
+
+        for (size_t s = 0; s < indices.size(); ++s) {
+            const TreeSegment& segment = segments[indices[s]];
+            points[kind].push_back(patchPoint(joints[s]));
+            points[kind].push_back(patchPoint(joints[s + 1]));
+            data[kind].push_back(segment.windOrigin());
+            data[kind].push_back(glm::vec4(segment.windParent(), segment.birth, segment.grown));
+        }
+    }
+
+    std::vector<PatchPoint> vertices;
+    std::vector<glm::vec4> segmentData;
+    for (int kind = 0; kind < 2; ++kind) {
+        m_branchPatchRanges[kind] = {static_cast<int>(vertices.size()), static_cast<int>(points[kind].size())};
+        vertices.insert(vertices.end(), points[kind].begin(), points[kind].end());
+        segmentData.insert(segmentData.end(), data[kind].begin(), data[kind].end());
+    }
+
+    // A single tree is one instance at the origin
+    std::vector<glm::vec4> instances = m_treeInstances;
+    if (instances.empty()) {
+        instances.push_back(glm::vec4(0.0f, 0.0f, 0.0f, 1.0f));
+    }
+    m_branchPatchInstanceCount = static_cast<int>(instances.size());
+
+    glBindBuffer(GL_ARRAY_BUFFER, m_branchPatchVBO);
+    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(PatchPoint), vertices.data(), GL_STATIC_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, m_branchPatchInstanceVBO);
+    glBufferData(GL_ARRAY_BUFFER, instances.size() * sizeof(glm::vec4), instances.data(), GL_STATIC_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    glBindBuffer(GL_TEXTURE_BUFFER, m_branchPatchDataBuffer);
+    glBufferData(GL_TEXTURE_BUFFER, segmentData.size() * sizeof(glm::vec4), segmentData.data(), GL_STATIC_DRAW);
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+}
+
+// Draw the patches of range; gl_PrimitiveID restarts at every draw, so firstSegment tells the shaders where the
+// range's segment data starts
+void Realtime::drawBranchPatches(GLuint program, const PatchRange& range) {
+    glUniform1i(glGetUniformLocation(program, "firstSegment"), range.first / 2);
+    glDrawArraysInstanced(GL_PATCHES, range.first, range.count, m_branchPatchInstanceCount);
+}
+
+// Main pass, lit by phong.frag with the same scene uniforms as m_shader
+void Realtime::paintBranchPatches() {
+    if (m_branchPatchRanges[0].count + m_branchPatchRanges[1].count == 0) {
+        return;
+    }
+
+    GLuint program = m_branch_patch_shader;
+    glUseProgram(program);
+    setSceneUniforms(program);
+    glUniform2f(glGetUniformLocation(program, "viewportSize"), m_fbo_width, m_fbo_height);
+    glUniform1f(glGetUniformLocation(program, "pixelsPerEdge"), kPixelsPerEdge);
+
+    // Wood materials, the same as the meshed trunk and branches
+    glm::vec4 ambient(0.4f, 0.3f, 0.2f, 1.0f);
+    glm::vec4 diffuse(0.5f, 0.4f, 0.3f, 1.0f);
+    glm::vec4 specular(0.1f, 0.1f, 0.1f, 1.0f);
+    glUniform4fv(glGetUniformLocation(program, "material.ambient"), 1, &ambient[0]);
+    glUniform4fv(glGetUniformLocation(program, "material.diffuse"), 1, &diffuse[0]);
+    glUniform4fv(glGetUniformLocation(program, "material.specular"), 1, &specular[0]);
+    glUniform1f(glGetUniformLocation(program, "material.shininess"), 32.0f);
+    glUniform1i(glGetUniformLocation(program, "textureUsed"), true);
+    glUniform1i(glGetUniformLocation(program, "Texture"), 1);
+    glUniform1f(glGetUniformLocation(program, "blend"), 1.0f);
+    glUniform1f(glGetUniformLocation(program, "repeatU"), 1.0f);
+    glUniform1f(glGetUniformLocation(program, "repeatV"), 1.0f);
+    glUniform1f(glGetUniformLocation(program, "lodFade"), 0.0f);
+
+    glUniform1i(glGetUniformLocation(program, "segmentData"), kPatchDataSlot);
+    glActiveTexture(GL_TEXTURE0 + kPatchDataSlot);
+    glBindTexture(GL_TEXTURE_BUFFER, m_branchPatchDataTexture);
+
+    glPatchParameteri(GL_PATCH_VERTICES, 2);
+    glBindVertexArray(m_branchPatchVAO);
+    glActiveTexture(GL_TEXTURE1);
+
+    GLuint textures[2] = {m_trunk_texture, m_branch_texture};
+    for (int kind = 0; kind < 2; ++kind) {
+        const PatchRange& range = m_branchPatchRanges[kind];
+        if (range.count == 0) {
+            continue;
+        }
+        glBindTexture(GL_TEXTURE_2D, textures[kind]);
+        drawBranchPatches(program, range);
+    }
+
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glBindVertexArray(0);
+    glActiveTexture(GL_TEXTURE0 + kPatchDataSlot);
+    glBindTexture(GL_TEXTURE_BUFFER, 0);
+    glActiveTexture(GL_TEXTURE1);
+    glUseProgram(m_shader);
+}
+
+// Shadow pass into the bound shadow FBO, tessellated for the light's view
+void Realtime::renderBranchPatchesShadow() {
+    if (m_branchPatchRanges[0].count + m_branchPatchRanges[1].count == 0) {
+        return;
+    }
+
+    GLuint program = m_branch_patch_depth_shader;
+    glm::mat4 identity(1.0f);
+    glUseProgram(program);
+    glUniformMatrix4fv(glGetUniformLocation(program, "viewMatrix"), 1, GL_FALSE, &lightSpaceMatrix[0][0]);
+    glUniformMatrix4fv(glGetUniformLocation(program, "projMatrix"), 1, GL_FALSE, &identity[0][0]);
+    glUniformMatrix4fv(glGetUniformLocation(program, "lightSpaceMatrix"), 1, GL_FALSE, &lightSpaceMatrix[0][0]);
+    glUniform2f(glGetUniformLocation(program, "viewportSize"), m_fbo_width, m_fbo_height);
+    glUniform1f(glGetUniformLocation(program, "pixelsPerEdge"), kPixelsPerEdge);
+    setAnimationUniforms(program);
+
+    glUniform1i(glGetUniformLocation(program, "segmentData"), kPatchDataSlot);
+    glActiveTexture(GL_TEXTURE0 + kPatchDataSlot);
+    glBindTexture(GL_TEXTURE_BUFFER, m_branchPatchDataTexture);
+
+    // Both kinds are adjacent in the buffer and need no material here
+    glPatchParameteri(GL_PATCH_VERTICES, 2);
+    glBindVertexArray(m_branchPatchVAO);
+    drawBranchPatches(program, {0, m_branchPatchRanges[0].count + m_branchPatchRanges[1].count});
+    glBindVertexArray(0);
+    glBindTexture(GL_TEXTURE_BUFFER, 0);
+    glActiveTexture(GL_TEXTURE0);
+    glUseProgram(m_depth_shader);
+}
@@ -0,0 +1,141 @@
+#include "frustumculler.h"
+#include <algorithm>
+
+#if defined(__AVX__) || defined(__SSE2__)
+#include <immintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+Frustum Frustum::fromMatrix(const glm::mat4& viewProj) {
+    // Rows of the (column-major) matrix
+    glm::vec4 row0(viewProj[0][0], viewProj[1][0], viewProj[2][0], viewProj[3][0]);
+    glm::vec4 row1(viewProj[0][1], viewProj[1][1], viewProj[2][1], viewProj[3][1]);
+    glm::vec4 row2(viewProj[0][2], viewProj[1][2], viewProj[2][2], viewProj[3][2]);
+    glm::vec4 row3(viewProj[0][3], viewProj[1][3], viewProj[2][3], viewProj[3][3]);
+
+    Frustum frustum;
+    frustum.planes[0] = row3 + row0; // Left
+    frustum.planes[1] = row3 - row0; // Right
+    frustum.planes[2] = row3 + row1; // Bottom
+    frustum.planes[3] = row3 - row1; // Top
+    frustum.planes[4] = row3 + row2; // Near
+    frustum.planes[5] = row3 - row2; // Far
+    return frustum;
+}
+
+void BoundsSoA::clear() {
+    minX.clear(); minY.clear(); minZ.clear();
+    maxX.clear(); maxY.clear(); maxZ.clear();
+    m_count = 0;
+}
+
+void BoundsSoA::add(const glm::vec3& boxMin, const glm::vec3& boxMax) {
+    // Grow the padded arrays a whole SIMD block at a time
+    if (m_count % 8 == 0) {
+        size_t padded = m_count + 8;
+        minX.resize(padded, 0.0f); minY.resize(padded, 0.0f); minZ.resize(padded, 0.0f);
+        maxX.resize(padded, 0.0f); maxY.resize(padded, 0.0f); maxZ.resize(padded, 0.0f);
+    }
+
+    minX[m_count] = boxMin.x; minY[m_count] = boxMin.y; minZ[m_count] = boxMin.z;
+    maxX[m_count] = boxMax.x; maxY[m_count] = boxMax.y; maxZ[m_count] = boxMax.z;
+    m_count++;
+}
+
+void BoundsSoA::transformUnitBox(const glm::mat4& modelMatrix, glm::vec3& boxMin, glm::vec3& boxMax) {
+    // Center moves with the translation, half extents are the absolute linear part applied to (0.5, 0.5, 0.5)
+    glm::vec3 center(modelMatrix[3]);
+    glm::vec3 extent = 0.5f * (glm::abs(glm::vec3(modelMatrix[0])) +
+                               glm::abs(glm::vec3(modelMatrix[1])) +
+                               glm::abs(glm::vec3(modelMatrix[2])));
+    boxMin = center - extent;
+    boxMax = center + extent;
+}
+
+void cullBoxes(const Frustum& frustum, const BoundsSoA& bounds, std::vector<uint8_t>& visible) {
+    const size_t count = bounds.size();
+    visible.resize(count);
+
+    // For each plane only the box corner furthest along the plane normal matters,
+    // so pick the min or max array per axis once per plane instead of per box
+    const float* cornerX[6];
+    const float* cornerY[6];
+    const float* cornerZ[6];
+    for (int p = 0; p < 6; ++p) {
+        const glm::vec4& plane = frustum.planes[p];
+        cornerX[p] = plane.x >= 0.0f ? bounds.maxX.data() : bounds.minX.data();
+        cornerY[p] = plane.y >= 0.0f ? bounds.maxY.data() : bounds.minY.data();
+        cornerZ[p] = plane.z >= 0.0f ? bounds.maxZ.data() : bounds.minZ.data();
+    }
+
+    // Each block of 8 boxes produces an 8-bit mask of culled boxes
+    for (size_t block = 0; block < count; block += 8) {
+        int outsideMask = 0;
+
+#if defined(__AVX__)
+        __m256 outside = _mm256_setzero_ps();
+        for (int p = 0; p < 6; ++p) {
+            const glm::vec4& plane = frustum.planes[p];
+            __m256 distance = _mm256_add_ps(
+                _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(plane.x), _mm256_loadu_ps(cornerX[p] + block)),
+                              _mm256_mul_ps(_mm256_set1_ps(plane.y), _mm256_loadu_ps(cornerY[p] + block))),
+                _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(plane.z), _mm256_loadu_ps(cornerZ[p] + block)),
+                              _mm256_set1_ps(plane.w)));
+            outside = _mm256_or_ps(outside, _mm256_cmp_ps(distance, _mm256_setzero_ps(), _CMP_LT_OQ));
+        }
+        outsideMask = _mm256_movemask_ps(outside);
+#elif defined(__SSE2__)
+        // Two 4-wide halves per block
+        for (int half = 0; half < 2; ++half) {
+            size_t offset = block + half * 4;
+            __m128 outside = _mm_setzero_ps();
+            for (int p = 0; p < 6; ++p) {
+                const glm::vec4& plane = frustum.planes[p];
+                __m128 distance = _mm_add_ps(
+                    _mm_add_ps(_mm_mul_ps(_mm_set1_ps(plane.x), _mm_loadu_ps(cornerX[p] + offset)),
+                               _mm_mul_ps(_mm_set1_ps(plane.y), _mm_loadu_ps(cornerY[p] + offset))),
+                    _mm_add_ps(_mm_mul_ps(_mm_set1_ps(plane.z), _mm_loadu_ps(cornerZ[p] + offset)),
+                               _mm_set1_ps(plane.w)));
+                outside = _mm_or_ps(outside, _mm_cmplt_ps(distance, _mm_setzero_ps()));
+            }
+            outsideMask |= _mm_movemask_ps(outside) << (half * 4);
+        }
+#elif defined(__ARM_NEON)
+        for (int half = 0; half < 2; ++half) {
+            size_t offset = block + half * 4;
+            uint32x4_t outside = vdupq_n_u32(0);
+            for (int p = 0; p < 6; ++p) {
+                const glm::vec4& plane = frustum.planes[p];
+                float32x4_t distance = vdupq_n_f32(plane.w);
+                distance = vmlaq_n_f32(distance, vld1q_f32(cornerX[p] + offset), plane.x);
+                distance = vmlaq_n_f32(distance, vld1q_f32(cornerY[p] + offset), plane.y);
+                distance = vmlaq_n_f32(distance, vld1q_f32(cornerZ[p] + offset), plane.z);
+                outside = vorrq_u32(outside, vcltq_f32(distance, vdupq_n_f32(0.0f)));
+            }
+            uint32_t lanes[4];
+            vst1q_u32(lanes, outside);
+            for (int lane = 0; lane < 4; ++lane) {
+                outsideMask |= (lanes[lane] ? 1 : 0) << (half * 4 + lane);
+            }
+        }
+#else
+        for (int lane = 0; lane < 8; ++lane) {
+            size_t i = block + lane;
+            for (int p = 0; p < 6; ++p) {
+                const glm::vec4& plane = frustum.planes[p];
+                float distance = plane.x * cornerX[p][i] + plane.y * cornerY[p][i] + plane.z * cornerZ[p][i] + plane.w;
+                if (distance < 0.0f) {
+                    outsideMask |= 1 << lane;
+                    break;
+                }
+            }
+        }
+#endif
+
+        size_t blockEnd = std::min(count, block + 8);
+        for (size_t i = block; i < blockEnd; ++i) {
+            visible[i] = (outsideMask >> (i - block)) & 1 ? 0 : 1;
+        }
+    }
+}
@@ -0,0 +1,36 @@
+#ifndef FRUSTUMCULLER_H
+#define FRUSTUMCULLER_H
+
+#include <cstdint>
+#include <vector>
+#include <glm/glm.hpp>
+
+// Six clip planes (ax + by + cz + d >= 0 is inside) extracted from a view-projection matrix
+struct Frustum {
+    glm::vec4 planes[6];
+
+    static Frustum fromMatrix(const glm::mat4& viewProj);
+};
+
+// World-space axis-aligned boxes stored structure-of-arrays, padded to a multiple of 8 for the SIMD kernel
+class BoundsSoA
+{
+public:
+    void clear();
+    void add(const glm::vec3& boxMin, const glm::vec3& boxMax);
+    size_t size() const { return m_count; }
+
+    // World-space box of the unit primitive [-0.5, 0.5]^3 under modelMatrix
+    static void transformUnitBox(const glm::mat4& modelMatrix, glm::vec3& boxMin, glm::vec3& boxMax);
+
+    std::vector<float> minX, minY, minZ;
+    std::vector<float> maxX, maxY, maxZ;
+
+private:
+    size_t m_count = 0;
+};
+
+// Test every box against the frustum, writing 1 (visible) or 0 (culled) per box into visible
+void cullBoxes(const Frustum& frustum, const BoundsSoA& bounds, std::vector<uint8_t>& visible);
+
+#endif // FRUSTUMCULLER_H
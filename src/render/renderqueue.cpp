@@ -0,0 +1,74 @@
+#include "renderqueue.h"
+#include <algorithm>
+
+// Key layout (most significant first):
+// | pass 4 | program 8 | texture 12 | material 16 | depth 24 |
+namespace {
+constexpr int kDepthBits    = 24;
+constexpr int kMaterialBits = 16;
+constexpr int kTextureBits  = 12;
+constexpr int kProgramBits  = 8;
+
+constexpr int kMaterialShift = kDepthBits;
+constexpr int kTextureShift  = kMaterialShift + kMaterialBits;
+constexpr int kProgramShift  = kTextureShift + kTextureBits;
+constexpr int kPassShift     = kProgramShift + kProgramBits;
+
+constexpr uint64_t mask(int bits) { return (uint64_t(1) << bits) - 1; }
+}
+
+uint64_t RenderQueue::makeKey(Pass pass, uint32_t program, uint32_t texture, uint32_t material, float depth) {
+    // Quantize the depth, flipping it for the transparent pass so far items come first
+    float clampedDepth = std::clamp(depth, 0.0f, 1.0f);
+    if (pass == PASS_TRANSPARENT) {
+        clampedDepth = 1.0f - clampedDepth;
+    }
+    uint64_t depthBits = static_cast<uint64_t>(clampedDepth * static_cast<float>(mask(kDepthBits)));
+
+    return (static_cast<uint64_t>(pass) << kPassShift) |
+           ((program & mask(kProgramBits)) << kProgramShift) |
+           ((texture & mask(kTextureBits)) << kTextureShift) |
+           ((material & mask(kMaterialBits)) << kMaterialShift) |
+           (depthBits & mask(kDepthBits));
+}
+
+void RenderQueue::clear() {
+    m_items.clear();
+}
+
+void RenderQueue::submit(uint64_t sortKey, uint32_t index) {
+    m_items.push_back({sortKey, index});
+}
+
+void RenderQueue::sort() {
+    const size_t count = m_items.size();
+    if (count < 2) {
+        return;
+    }
+    m_scratch.resize(count);
+
+    // 8 passes of 8 bits each, least significant byte first
+    for (int shift = 0; shift < 64; shift += 8) {
+        size_t histogram[256] = {};
+        for (const DrawItem& item : m_items) {
+            histogram[(item.sortKey >> shift) & 0xFF]++;
+        }
+
+        // Every key shares this byte, so the pass would be a plain copy
+        if (histogram[(m_items[0].sortKey >> shift) & 0xFF] == count) {
+            continue;
+        }
+
+        size_t offset = 0;
+        for (size_t& bucket : histogram) {
+            size_t bucketSize = bucket;
+            bucket = offset;
+            offset += bucketSize;
+        }
+
+        for (const DrawItem& item : m_items) {
+            m_scratch[histogram[(item.sortKey >> shift) & 0xFF]++] = item;
+        }
+        m_items.swap(m_scratch);
+    }
+}
@@ -0,0 +1,39 @@
+#ifndef RENDERQUEUE_H
+#define RENDERQUEUE_H
+
+#include <cstdint>
+#include <vector>
+
+// One queued draw: the packed sort key and the index of the shape it draws
+struct DrawItem {
+    uint64_t sortKey;
+    uint32_t index;
+};
+
+class RenderQueue
+{
+public:
+    // Passes occupy the top bits of the key, so every opaque item is drawn before any transparent one
+    enum Pass {
+        PASS_OPAQUE = 0,
+        PASS_TRANSPARENT = 1
+    };
+
+    // Pack pass | program | texture | material | depth into one 64-bit key.
+    // depth is a normalized view distance in [0, 1]; opaque items sort front-to-back, transparent back-to-front
+    static uint64_t makeKey(Pass pass, uint32_t program, uint32_t texture, uint32_t material, float depth);
+
+    void clear();
+    void submit(uint64_t sortKey, uint32_t index);
+
+    // LSD radix sort of the submitted items by their sort keys
+    void sort();
+
+    const std::vector<DrawItem>& items() const { return m_items; }
+
+private:
+    std::vector<DrawItem> m_items;    // Items submitted this frame
+    std::vector<DrawItem> m_scratch;  // Ping-pong buffer for the radix passes
+};
+
+#endif // RENDERQUEUE_H
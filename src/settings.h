@@ -5,6 +5,7 @@
 
 struct Settings {
     std::string sceneFilePath;
+    std::string grammarFilePath; // JSON grammar of the tree, empty for the built-in ones
     int shapeParameter1 = 1;
     int shapeParameter2 = 1;
     int shapeParameter3 = 1;
@@ -19,6 +20,30 @@ struct Settings {
     bool extraCredit2 = false;
     bool extraCredit3 = false;
     bool extraCredit4 = false;
+    int forestSize = 6;         // Number of trees in forest mode
+    bool gpuCulling = false;    // Cull forest trees on the GPU and draw them instanced
+    bool occlusionCulling = false; // Skip forest trees hidden behind others, using last frame's queries
+    float lodBias = 0.0f;       // Mesh LOD bias, each +1 switches to coarser levels at twice the screen size
+    int treeTriangleBudget = 200000; // Triangles one tree may use before its deepest segments lose detail
+    bool impostors = false;     // Draw far forest trees as baked octahedral impostors
+    float impostorDistance = 30.0f; // Distance from the camera beyond which a tree becomes an impostor
+    bool tubeBranches = true;   // Mesh connected trunk and branch segments as one welded tube
+    bool tessellatedBranches = false; // Build trunk and branch surfaces in tessellation shaders from the segment list
+    bool capsuleTwigs = false;  // Ray-cast thin twigs as capsules on camera-facing quads
+    float capsuleThickness = 0.03f; // Segments thinner than this become capsules
+    bool leafCards = true;      // Draw leaves as instanced alpha-tested crossed quads instead of spheres
+    bool staticBatch = false;   // Bake the tree into one pre-transformed buffer, one draw per material
+    float generationBudgetMs = 2000.0f; // Estimated generation time over which fewer iterations are derived, 0 for no cap
+    bool growthAnimation = false; // Grow the trees in the vertex shaders from their segments' birth times
+    int treeSeed = 1;           // Seed of stochastic grammars; forest trees derive their own seeds from it
+    bool spaceColonization = false; // Grow the tree towards attractor points in a crown instead of from the grammar
+    int attractorCount = 20000; // Attractor points space colonization scatters through the crown
+    bool openGrowth = false;    // Grow parametric grammars as open L-systems whose ?(e) modules read the light field
+    bool adaptiveExpansion = false; // Expand the lone tree only as far as the camera resolves it
+    float expansionPixels = 4.0f; // Subtrees smaller than this on screen stay unexpanded proxies
+    bool depthLod = false;      // Draw far forest trees derived at fewer iterations, each depth meshed once
+    float depthLodDistance = 12.0f; // Distance within which forest trees keep every iteration, one fewer per doubling
+    float windStrength = 0.01f; // Trunk bend of the vertex-shader wind per squared unit of height, 0 keeps trees still
 };
 
 
@@ -0,0 +1,144 @@
+#include "meshcache.h"
+#include "shapes/vbogenerator.h"
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+// Tessellation of each level relative to level 0
+constexpr float kLevelScale[MeshCache::LOD_LEVELS] = {1.0f, 0.6f, 0.35f, 0.2f};
+
+// Smallest projected size in pixels at which each level is still used; anything smaller drops to the last level
+constexpr float kLevelMinPixels[MeshCache::LOD_LEVELS - 1] = {48.0f, 16.0f, 6.0f};
+
+// Width of the dither fade above each switch, as a fraction of its threshold
+constexpr float kFadeBand = 0.25f;
+
+}
+
+int MeshCache::lodChain(PrimitiveType type, int param1, int param2) {
+    auto key = std::make_tuple(static_cast<int>(type), param1, param2);
+    auto found = m_chainIndex.find(key);
+    if (found != m_chainIndex.end()) {
+        return found->second;
+    }
+
+    LodChain chain;
+    chain.type = type;
+
+    std::vector<float> vertices;
+    for (int lod = 0; lod < LOD_LEVELS; ++lod) {
+        // The generators clamp to their own minimum tessellation
+        int levelParam1 = std::max(1, static_cast<int>(std::lround(param1 * kLevelScale[lod])));
+        int levelParam2 = std::max(1, static_cast<int>(std::lround(param2 * kLevelScale[lod])));
+
+        generateVBOBasedOnType(levelParam1, levelParam2, vertices, type);
+        chain.levels[lod] = upload(vertices);
+        if (lod == 0) {
+            chain.vertices = vertices;
+        }
+    }
+
+    m_chains.push_back(chain);
+    int index = static_cast<int>(m_chains.size() - 1);
+    m_chainIndex[key] = index;
+    return index;
+}
+
+int MeshCache::addChain(PrimitiveType type, const std::vector<std::vector<float>>& levels) {
+    LodChain chain;
+    chain.type = type;
+    chain.added = true;
+    for (int lod = 0; lod < LOD_LEVELS; ++lod) {
+        chain.levels[lod] = upload(levels[lod]);
+    }
+    chain.vertices = levels[0];
+
+    if (!m_freeChains.empty()) {
+        int index = m_freeChains.back();
+        m_freeChains.pop_back();
+        m_chains[index] = std::move(chain);
+        return index;
+    }
+    m_chains.push_back(std::move(chain));
+    return static_cast<int>(m_chains.size() - 1);
+}
+
+void MeshCache::releaseAddedChains() {
+    for (size_t index = 0; index < m_chains.size(); ++index) {
+        LodChain& chain = m_chains[index];
+        if (!chain.added) {
+            continue;
+        }
+        for (MeshLevel& level : chain.levels) {
+            glDeleteBuffers(1, &level.vbo);
+            glDeleteVertexArrays(1, &level.vao);
+            level = MeshLevel();
+        }
+        chain.vertices.clear();
+        chain.added = false;
+        m_freeChains.push_back(static_cast<int>(index));
+    }
+}
+
+float MeshCache::levelScale(int lod) {
+    return kLevelScale[lod];
+}
+
+LodSelection MeshCache::selectLod(float pixelSize, float bias) {
+    float biasScale = std::exp2(bias);
+
+    LodSelection selection;
+    for (int lod = 0; lod < LOD_LEVELS - 1; ++lod) {
+        float threshold = kLevelMinPixels[lod] * biasScale;
+        if (pixelSize >= threshold) {
+            // Close to the switch, start fading towards the coarser level
+            float fadeStart = threshold * (1.0f + kFadeBand);
+            if (pixelSize < fadeStart) {
+                selection.fade = (fadeStart - pixelSize) / (fadeStart - threshold);
+            }
+            selection.level = static_cast<uint8_t>(lod);
+            return selection;
+        }
+    }
+
+    selection.level = LOD_LEVELS - 1;
+    return selection;
+}
+
+void MeshCache::clear() {
+    for (LodChain& chain : m_chains) {
+        for (MeshLevel& level : chain.levels) {
+            glDeleteBuffers(1, &level.vbo);
+            glDeleteVertexArrays(1, &level.vao);
+        }
+    }
+    m_chains.clear();
+    m_chainIndex.clear();
+    m_freeChains.clear();
+}
+
+MeshLevel MeshCache::upload(const std::vector<float>& vertices) {
+    MeshLevel mesh;
+    glGenVertexArrays(1, &mesh.vao);
+    glGenBuffers(1, &mesh.vbo);
+
+    glBindVertexArray(mesh.vao);
+    glBindBuffer(GL_ARRAY_BUFFER, mesh.vbo);
+    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(GLfloat), vertices.data(), GL_STATIC_DRAW);
+
+    glEnableVertexAttribArray(0); // Vertex position
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(GLfloat), reinterpret_cast<void *>(0));
+
+    glEnableVertexAttribArray(1); // Normals
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(GLfloat), reinterpret_cast<void *>(3 * sizeof(GLfloat)));
+
+    glEnableVertexAttribArray(2); // UV coordinates
+    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(GLfloat), reinterpret_cast<void *>(6 * sizeof(GLfloat)));
+
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindVertexArray(0);
+
+    mesh.vertexCount = static_cast<int>(vertices.size() / 8);
+    return mesh;
+}
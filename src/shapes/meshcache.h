@@ -0,0 +1,73 @@
+#ifndef MESHCACHE_H
+#define MESHCACHE_H
+
+#ifdef __APPLE__
+#define GL_SILENCE_DEPRECATION
+#endif
+#include <GL/glew.h>
+
+#include <cstdint>
+#include <map>
+#include <tuple>
+#include <vector>
+#include "utils/scenedata.h"
+
+// One uploaded tessellation of a primitive, vertices laid out as pos | normal | uv
+struct MeshLevel {
+    GLuint vao = 0;
+    GLuint vbo = 0;
+    int vertexCount = 0;
+};
+
+// Level chosen for one shape this frame. When fade > 0 the next coarser level is
+// dithered in over the same pixels, so switching levels never pops
+struct LodSelection {
+    uint8_t level = 0;
+    float fade = 0.0f;
+};
+
+// Unit primitives shared by every shape that uses them, each kept at LOD_LEVELS tessellations
+class MeshCache
+{
+public:
+    static constexpr int LOD_LEVELS = 4;
+
+    // Index of the LOD chain whose finest level is (param1, param2), uploading it on first use
+    int lodChain(PrimitiveType type, int param1, int param2);
+
+    // Upload a chain the caller tessellated itself, LOD_LEVELS vertex lists finest first, such as a welded
+    // tube. It is not shared and stays until releaseAddedChains, whose freed indices later chains reuse
+    int addChain(PrimitiveType type, const std::vector<std::vector<float>>& levels);
+    void releaseAddedChains();
+
+    // Tessellation of level lod relative to level 0
+    static float levelScale(int lod);
+
+    const MeshLevel& level(int chain, int lod) const { return m_chains[chain].levels[lod]; }
+    PrimitiveType type(int chain) const { return m_chains[chain].type; }
+
+    // CPU copy of the finest level, for baking shapes into one buffer
+    const std::vector<float>& vertices(int chain) const { return m_chains[chain].vertices; }
+
+    // Pick a level from the shape's projected size in pixels, bias > 0 favours coarser levels
+    static LodSelection selectLod(float pixelSize, float bias);
+
+    // Delete every uploaded mesh, needs the GL context current
+    void clear();
+
+private:
+    struct LodChain {
+        PrimitiveType type;
+        MeshLevel levels[LOD_LEVELS];
+        std::vector<float> vertices;
+        bool added = false; // From addChain
+    };
+
+    static MeshLevel upload(const std::vector<float>& vertices);
+
+    std::vector<LodChain> m_chains;
+    std::map<std::tuple<int, int, int>, int> m_chainIndex; // (type, param1, param2) -> index into m_chains
+    std::vector<int> m_freeChains;                         // Slots of released added chains
+};
+
+#endif // MESHCACHE_H
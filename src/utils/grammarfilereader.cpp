@@ -0,0 +1,274 @@
+#include "grammarfilereader.h"
+
+#include <iostream>
+
+#include <QFile>
+#include <QJsonDocument>
+
+GrammarFileReader::GrammarFileReader(const std::string &filename) {
+    file_name = filename;
+}
+
+GrammarData GrammarFileReader::getGrammarData() const {
+    return m_grammar;
+}
+
+bool GrammarFileReader::readJSON() {
+    // Read the file
+    QFile file(file_name.c_str());
+    if (!file.open(QFile::ReadOnly)) {
+        std::cout << "could not open " << file_name << std::endl;
+        return false;
+    }
+
+    // Load the JSON document
+    QByteArray fileContents = file.readAll();
+    QJsonParseError jsonError;
+    QJsonDocument doc = QJsonDocument::fromJson(fileContents, &jsonError);
+    if (doc.isNull()) {
+        std::cout << "could not parse " << file_name << std::endl;
+        std::cout << "parse error at line " << jsonError.offset << ": "
+                  << jsonError.errorString().toStdString() << std::endl;
+        return false;
+    }
+    file.close();
+
+    if (!doc.isObject()) {
+        std::cout << "document is not an object" << std::endl;
+        return false;
+    }
+
+    QJsonObject grammarfile = doc.object();
+
+    QStringList requiredFields = {"axiom", "rules"};
+    QStringList optionalFields = {"name", "angleScale", "lengthScale", "ignore"};
+    QStringList allFields = requiredFields + optionalFields;
+    for (auto &field : grammarfile.keys()) {
+        if (!allFields.contains(field)) {
+            std::cout << "unknown field \"" << field.toStdString() << "\" on root object" << std::endl;
+            return false;
+        }
+    }
+    for (auto &field : requiredFields) {
+        if (!grammarfile.contains(field)) {
+            std::cout << "missing required field \"" << field.toStdString() << "\" on root object" << std::endl;
+            return false;
+        }
+    }
+
+    if (grammarfile.contains("name")) {
+        if (!grammarfile["name"].isString()) {
+            std::cout << "grammar name must be of type string" << std::endl;
+            return false;
+        }
+        m_grammar.name = grammarfile["name"].toString().toStdString();
+    }
+
+    if (!grammarfile["axiom"].isString() || grammarfile["axiom"].toString().isEmpty()) {
+        std::cout << "grammar axiom must be a non-empty string" << std::endl;
+        return false;
+    }
+    m_grammar.axiom = grammarfile["axiom"].toString().toStdString();
+    if (!validateBrackets(m_grammar.axiom, "axiom")) {
+        return false;
+    }
+
+    // An object maps symbols to successors; an array lists the rules of a parametric grammar
+    if (grammarfile["rules"].isArray()) {
+        if (!parseParametricRules(grammarfile["rules"].toArray())) {
+            std::cout << "could not parse \"rules\"" << std::endl;
+            return false;
+        }
+    } else if (!grammarfile["rules"].isObject()) {
+        std::cout << "grammar rules must be of type object or array" << std::endl;
+        return false;
+    } else if (!parseRules(grammarfile["rules"].toObject())) {
+        std::cout << "could not parse \"rules\"" << std::endl;
+        return false;
+    }
+
+    if (grammarfile.contains("angleScale")) {
+        if (!grammarfile["angleScale"].isDouble()) {
+            std::cout << "grammar angleScale must be a floating-point value" << std::endl;
+            return false;
+        }
+        m_grammar.angleScale = grammarfile["angleScale"].toDouble();
+    }
+    if (grammarfile.contains("lengthScale")) {
+        if (!grammarfile["lengthScale"].isDouble() || grammarfile["lengthScale"].toDouble() <= 0.0) {
+            std::cout << "grammar lengthScale must be a positive floating-point value" << std::endl;
+            return false;
+        }
+        m_grammar.lengthScale = grammarfile["lengthScale"].toDouble();
+    }
+
+    if (grammarfile.contains("ignore")) {
+        // Brackets delimit branches, which context matching always follows
+        std::string ignore = grammarfile["ignore"].toString().toStdString();
+        if (!grammarfile["ignore"].isString() || ignore.find_first_of("[]") != std::string::npos) {
+            std::cout << "grammar ignore must be a string without brackets" << std::endl;
+            return false;
+        }
+        m_grammar.ignore = ignore;
+    }
+
+    std::cout << "Finished reading " << file_name << std::endl;
+    return true;
+}
+
+/**
+ * Parse the rules object into m_grammar.rules, one key per rule: a single character, optionally with a
+ * left context before a '<' and a right context after a '>'.
+ */
+bool GrammarFileReader::parseRules(const QJsonObject &rules) {
+    for (auto &key : rules.keys()) {
+        std::string name = key.toStdString();
+
+        // A plain string is a single production; an array lists weighted choices
+        if (rules[key].isArray()) {
+            QJsonArray productions = rules[key].toArray();
+            if (productions.isEmpty()) {
+                std::cout << "rule for \"" << name << "\" must list at least one production" << std::endl;
+                return false;
+            }
+            for (const QJsonValue &production : productions) {
+                if (!parseProduction(production, name)) {
+                    return false;
+                }
+            }
+        } else if (!parseProduction(rules[key], name)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Parse one production of the rule named key: a successor string, or an object with a successor and a weight.
+ */
+bool GrammarFileReader::parseProduction(const QJsonValue &production, const std::string &key) {
+    // A key longer than one character reads left < symbol > right, either context may be left out. '<' and '>'
+    // only separate contexts there, so a context cannot contain them
+    Production parsed;
+    std::string symbol = key;
+    if (key.size() > 1) {
+        size_t less = key.find('<');
+        size_t greater = key.find('>');
+        size_t begin = less == std::string::npos ? 0 : less + 1;
+        size_t end = greater == std::string::npos ? key.size() : greater;
+        bool extraLess = key.find('<', begin) != std::string::npos;
+        bool extraGreater = greater != std::string::npos && key.find('>', greater + 1) != std::string::npos;
+        if (extraLess || extraGreater || end != begin + 1) {
+            std::cout << "rule key \"" << key << "\" must be a single character, optionally as left<symbol>right" << std::endl;
+            return false;
+        }
+        symbol = key.substr(begin, 1);
+        parsed.left = less == std::string::npos ? "" : key.substr(0, less);
+        parsed.right = greater == std::string::npos ? "" : key.substr(greater + 1);
+        if (parsed.left.find_first_of("[]") != std::string::npos || parsed.right.find_first_of("[]") != std::string::npos) {
+            std::cout << "contexts of rule \"" << key << "\" cannot contain brackets" << std::endl;
+            return false;
+        }
+    } else if (key.empty()) {
+        std::cout << "rule key must not be empty" << std::endl;
+        return false;
+    }
+
+    if (production.isString()) {
+        parsed.successor = production.toString().toStdString();
+    } else if (production.isObject()) {
+        QJsonObject object = production.toObject();
+        for (auto &field : object.keys()) {
+            if (field != "successor" && field != "weight") {
+                std::cout << "unknown field \"" << field.toStdString() << "\" on production of \"" << key << "\"" << std::endl;
+                return false;
+            }
+        }
+        if (!object["successor"].isString()) {
+            std::cout << "production of \"" << key << "\" must contain a successor string" << std::endl;
+            return false;
+        }
+        parsed.successor = object["successor"].toString().toStdString();
+        if (object.contains("weight")) {
+            if (!object["weight"].isDouble() || object["weight"].toDouble() <= 0.0) {
+                std::cout << "production weight of \"" << key << "\" must be a positive floating-point value" << std::endl;
+                return false;
+            }
+            parsed.weight = object["weight"].toDouble();
+        }
+    } else {
+        std::cout << "rule for \"" << key << "\" must be a string, an object or an array of them" << std::endl;
+        return false;
+    }
+
+    if (!validateBrackets(parsed.successor, "rule for \"" + key + "\"")) {
+        return false;
+    }
+    m_grammar.rules[symbol[0]].push_back(parsed);
+    return true;
+}
+
+/**
+ * Parse the rules of a parametric grammar into m_grammar.parametricRules, then compile them with the axiom
+ * so malformed modules and expressions are reported now rather than when deriving.
+ */
+bool GrammarFileReader::parseParametricRules(const QJsonArray &rules) {
+    if (rules.isEmpty()) {
+        std::cout << "grammar rules must list at least one rule" << std::endl;
+        return false;
+    }
+    for (const QJsonValue &value : rules) {
+        if (!value.isObject()) {
+            std::cout << "parametric rule must be of type object" << std::endl;
+            return false;
+        }
+        QJsonObject rule = value.toObject();
+        for (auto &field : rule.keys()) {
+            if (field != "predecessor" && field != "condition" && field != "successor") {
+                std::cout << "unknown field \"" << field.toStdString() << "\" on parametric rule" << std::endl;
+                return false;
+            }
+        }
+        if (!rule["predecessor"].isString() || !rule["successor"].isString() ||
+            (rule.contains("condition") && !rule["condition"].isString())) {
+            std::cout << "parametric rule must contain predecessor and successor strings, and an optional condition string" << std::endl;
+            return false;
+        }
+
+        ParametricRule parsed;
+        parsed.predecessor = rule["predecessor"].toString().toStdString();
+        parsed.condition = rule["condition"].toString().toStdString();
+        parsed.successor = rule["successor"].toString().toStdString();
+        if (!validateBrackets(parsed.successor, "rule for \"" + parsed.predecessor + "\"")) {
+            return false;
+        }
+        m_grammar.parametricRules.push_back(parsed);
+    }
+
+    ParametricLSystem compiled;
+    std::string error;
+    if (!compiled.compile(m_grammar.axiom, m_grammar.parametricRules, error)) {
+        std::cout << error << std::endl;
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Brackets must pair up within the axiom and within every rule, so derived strings stay balanced.
+ */
+bool GrammarFileReader::validateBrackets(const std::string &symbols, const std::string &where) const {
+    int depth = 0;
+    for (char c : symbols) {
+        if (c == '[') {
+            ++depth;
+        } else if (c == ']' && --depth < 0) {
+            break;
+        }
+    }
+    if (depth != 0) {
+        std::cout << where << " has unbalanced brackets" << std::endl;
+        return false;
+    }
+    return true;
+}
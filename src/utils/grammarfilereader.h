@@ -0,0 +1,56 @@
+#pragma once
+
+#include "lsystem/parametriclsystem.h"
+#include "lsystem/production.h"
+
+#include <string>
+
+#include <QJsonArray>
+#include <QJsonObject>
+
+// An L-system grammar as read from a grammar file
+struct GrammarData {
+    std::string name;
+    std::string axiom;
+    ProductionRules rules;
+    std::vector<ParametricRule> parametricRules; // Set instead of rules by parametric grammars
+    std::string ignore = kDefaultContextIgnore;  // Symbols context-sensitive rules look past
+    float angleScale = 5.5f;  // Degrees of every turn per step of the Angle slider
+    float lengthScale = 0.1f; // Segment length per step of the Length slider
+
+    bool parametric() const { return !parametricRules.empty(); }
+};
+
+// Parses a JSON grammar file in the same way ScenefileReader reads scenes:
+// {
+//   "name": "Tree",                                  (optional)
+//   "axiom": "FFX",
+//   "rules": {"X": "X[-&<X][<++&X]||X[--&>X][+&X]"},  one single-char key per rule, either a successor
+//            {"A": [{"successor": "F[+A]", "weight": 2},  or weighted choices, picked per occurrence
+//                   {"successor": "F[-A]", "weight": 1}]}
+//            {"B<A>C": "B"}                             keys may add a left and/or right context
+//   "rules": [{"predecessor": "A(l,w)",              or, for a parametric grammar, an array of rules
+//              "condition": "l > 0.1",               tried in order, with an optional condition
+//              "successor": "F(l,w)[&(30)A(l*0.8,w*0.7)]"}]
+//   "angleScale": 5.5,                               (optional)
+//   "lengthScale": 0.1,                              (optional)
+//   "ignore": "+-&^<>|"                              (optional) symbols contexts skip over
+// }
+class GrammarFileReader {
+public:
+    GrammarFileReader(const std::string &filename);
+
+    // Parse and validate the grammar file. Returns false if the grammar is invalid.
+    bool readJSON();
+
+    GrammarData getGrammarData() const;
+
+private:
+    bool parseRules(const QJsonObject &rules);
+    bool parseParametricRules(const QJsonArray &rules);
+    bool parseProduction(const QJsonValue &production, const std::string &key);
+    bool validateBrackets(const std::string &symbols, const std::string &where) const;
+
+    std::string file_name;
+    GrammarData m_grammar;
+};
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <thread>
+#include <vector>
+
+// Number of chunks parallelFor splits count items into: one per hardware thread, but none smaller than
+// minChunk items, so small inputs stay on the calling thread
+inline size_t parallelChunks(size_t count, size_t minChunk) {
+    size_t threads = std::max(1u, std::thread::hardware_concurrency());
+    size_t chunks = std::min(threads, (count + minChunk - 1) / std::max<size_t>(minChunk, 1));
+    return std::max<size_t>(chunks, 1);
+}
+
+// Run body(chunk, begin, end) over chunks contiguous ranges of [0, count), the first on the calling thread,
+// and return once all are done. Chunk boundaries only depend on count and chunks
+template <typename Body>
+void parallelFor(size_t count, size_t chunks, Body&& body) {
+    auto range = [&](size_t chunk) { return count * chunk / chunks; };
+    std::vector<std::thread> workers;
+    workers.reserve(chunks - 1);
+    for (size_t chunk = 1; chunk < chunks; ++chunk) {
+        workers.emplace_back([&, chunk] { body(chunk, range(chunk), range(chunk + 1)); });
+    }
+    body(size_t(0), range(0), range(1));
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+}
@@ -8,6 +8,8 @@
 #include <QFile>
 #include <QTextStream>
 #include <iostream>
+#include <utility>
+#include <vector>
 
 class ShaderLoader{
 public:
@@ -44,20 +46,54 @@ public:
         return programID;
     }
 
+    // Create a program from any combination of stages (e.g. vertex + geometry, or vertex + tessellation + fragment).
+    // Varyings named in feedbackVaryings are captured interleaved by transform feedback.
+    static GLuint createShaderProgram(const std::vector<std::pair<GLenum, const char *>> &stages,
+                                      const std::vector<const char *> &feedbackVaryings = {}){
+        GLuint programID = glCreateProgram();
+        std::vector<GLuint> shaderIDs;
+        for (const auto &[shaderType, filepath] : stages) {
+            GLuint shaderID = createShader(shaderType, filepath);
+            glAttachShader(programID, shaderID);
+            shaderIDs.push_back(shaderID);
+        }
+
+        // Feedback varyings must be declared before linking
+        if (!feedbackVaryings.empty()) {
+            glTransformFeedbackVaryings(programID, static_cast<GLsizei>(feedbackVaryings.size()),
+                                        feedbackVaryings.data(), GL_INTERLEAVED_ATTRIBS);
+        }
+        glLinkProgram(programID);
+
+        // Print the info log if error
+        GLint status;
+        glGetProgramiv(programID, GL_LINK_STATUS, &status);
+
+        if (status == GL_FALSE) {
+            GLint length;
+            glGetProgramiv(programID, GL_INFO_LOG_LENGTH, &length);
+
+            std::string log(length, '\0');
+            glGetProgramInfoLog(programID, length, nullptr, &log[0]);
+
+            glDeleteProgram(programID);
+            throw std::runtime_error(log);
+        }
+
+        // Shaders no longer necessary, stored in program
+        for (GLuint shaderID : shaderIDs) {
+            glDeleteShader(shaderID);
+        }
+
+        return programID;
+    }
+
 private:
     static GLuint createShader(GLenum shaderType, const char *filepath){
         GLuint shaderID = glCreateShader(shaderType);
 
         // Read shader file.
-        std::string code;
-        QString filepathStr = QString(filepath);
-        QFile file(filepathStr);
-        if (file.open(QIODevice::ReadOnly | QIODevice::Text)) {
-            QTextStream stream(&file);
-            code = stream.readAll().toStdString();
-        }else{
-            throw std::runtime_error(std::string("Failed to open shader: ")+filepath);
-        }
+        std::string code = readShader(QString(filepath));
 
         // Compile shader code.
         const char *codePtr = code.c_str();
@@ -81,4 +117,28 @@ private:
 
         return shaderID;
     }
+
+    // Read a shader file and splice in the files named by its #include "name" lines,
+    // looked up next to it, so snippets shared by several shaders exist only once
+    static std::string readShader(const QString &filepath){
+        QFile file(filepath);
+        if (!file.open(QIODevice::ReadOnly | QIODevice::Text)) {
+            throw std::runtime_error("Failed to open shader: " + filepath.toStdString());
+        }
+        QString directory = filepath.left(filepath.lastIndexOf('/') + 1);
+
+        std::string code;
+        QTextStream stream(&file);
+        while (!stream.atEnd()) {
+            QString line = stream.readLine();
+            QString trimmed = line.trimmed();
+            if (trimmed.startsWith("#include")) {
+                QString name = trimmed.section('"', 1, 1);
+                code += readShader(directory + name);
+            } else {
+                code += line.toStdString() + "\n";
+            }
+        }
+        return code;
+    }
 };
@@ -0,0 +1,175 @@
+#include "check.h"
+#include "lsystem/adaptivederivation.h"
+#include "lsystem/lsystem.h"
+#include "lsystem/turtlecommand.h"
+#include <glm/gtc/matrix_transform.hpp>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+static const std::string kAxiom = "FFX";
+static const std::unordered_map<char, std::string> kRules = {{'X', "X[-&<XL][<++&XL]||X[--&>XL][+&XL]"}, {'F', "FF"}};
+static constexpr int kIterations = 6;
+static constexpr float kAngle = 22.0f;
+static constexpr float kLength = 0.01f;
+static const glm::vec3 kRoot(0.0f, -0.5f, 0.0f);
+static const glm::mat4 kProjection = glm::perspective(glm::radians(30.0f), 1.5f, 0.1f, 100.0f);
+
+static glm::mat4 viewFrom(float distance) {
+    return glm::lookAt(glm::vec3(0.0f, 2.0f, distance), glm::vec3(0.0f, 2.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+}
+
+struct Move {
+    glm::vec3 start;
+    glm::vec3 end;
+};
+
+// The turtle's moves over modules, jumping to a proxy's exit state and collecting the proxies on the way
+static std::vector<Move> walk(const ModuleBuffer& modules, std::vector<SubtreeProxy>& proxies) {
+    struct State {
+        glm::vec3 position, grow, forward, right;
+    };
+    State turtle = {kRoot, glm::vec3(0.0f, 1.0f, 0.0f), glm::vec3(0.0f, 0.0f, -1.0f), glm::vec3(1.0f, 0.0f, 0.0f)};
+    std::vector<State> stack;
+    std::vector<Move> moves;
+    for (size_t i = 0; i < modules.size(); ++i) {
+        if (modules.symbols[i] == kProxySymbol) {
+            SubtreeProxy proxy = SubtreeProxy::read(modules.parametersOf(i));
+            proxies.push_back(proxy);
+            turtle = {proxy.position, proxy.grow, proxy.forward, proxy.right};
+            continue;
+        }
+        TurtleCommand command = kTurtleCommands[static_cast<uint8_t>(modules.symbols[i])];
+        switch (command) {
+        case TurtleCommand::Trunk:
+        case TurtleCommand::Branch:
+        case TurtleCommand::Leaf: {
+            glm::vec3 end = turtle.position + turtle.grow * (kLength * turtleStep(command));
+            moves.push_back({turtle.position, end});
+            turtle.position = end;
+            break;
+        }
+        case TurtleCommand::Push:
+            stack.push_back(turtle);
+            break;
+        case TurtleCommand::Pop:
+            turtle = stack.back();
+            stack.pop_back();
+            break;
+        default:
+            turnTurtle(command, glm::radians(kAngle), turtle.grow, turtle.forward, turtle.right);
+        }
+    }
+    return moves;
+}
+
+static AdaptiveDerivation compiled() {
+    AdaptiveDerivation adaptive;
+    CHECK(adaptive.compile(kAxiom, deterministicRules(kRules), kIterations, kAngle, kLength, kRoot));
+    CHECK(!adaptive.empty());
+    return adaptive;
+}
+
+// With no threshold every subtree is expanded, which is the full derivation, births included
+static void testZeroThresholdIsFullDerivation() {
+    LSystem full(kAxiom, kRules, kIterations);
+    std::string derived = full.generate();
+
+    AdaptiveDerivation adaptive = compiled();
+    CHECK(adaptive.refine(viewFrom(8.0f), kProjection, 800.0f, 0.0f));
+    ModuleBuffer modules;
+    adaptive.emit(modules);
+    CHECK(adaptive.proxies() == 0);
+    CHECK(modules.symbols == derived);
+    for (size_t i = 0; i < derived.size() && i < modules.size(); ++i) {
+        CHECK(modules.births[i] == full.birthIterations().at(i));
+    }
+}
+
+// Every move drawn past a proxy is one the full tree draws, so proxies leave the turtle where their subtree
+// would, and every move the full tree draws is either drawn or inside the sphere of a proxy
+static void testProxiesStandInForSubtrees() {
+    ModuleBuffer full;
+    AdaptiveDerivation reference = compiled();
+    reference.refine(viewFrom(8.0f), kProjection, 800.0f, 0.0f);
+    reference.emit(full);
+    std::vector<SubtreeProxy> none;
+    std::vector<Move> fullMoves = walk(full, none);
+
+    AdaptiveDerivation adaptive = compiled();
+    adaptive.refine(viewFrom(8.0f), kProjection, 800.0f, 30.0f);
+    ModuleBuffer modules;
+    adaptive.emit(modules);
+    std::vector<SubtreeProxy> proxies;
+    std::vector<Move> moves = walk(modules, proxies);
+    CHECK(adaptive.proxies() > 0);
+    CHECK(static_cast<int>(proxies.size()) == adaptive.proxies());
+    CHECK(moves.size() < fullMoves.size());
+
+    auto drawnByFull = [&](const Move& move) {
+        for (const Move& candidate : fullMoves) {
+            if (glm::distance(candidate.start, move.start) < 1e-4f && glm::distance(candidate.end, move.end) < 1e-4f) {
+                return true;
+            }
+        }
+        return false;
+    };
+    for (const Move& move : moves) {
+        CHECK(drawnByFull(move));
+    }
+
+    for (const Move& move : fullMoves) {
+        bool covered = false;
+        for (const Move& drawn : moves) {
+            covered = covered || glm::distance(drawn.end, move.end) < 1e-4f;
+        }
+        for (const SubtreeProxy& proxy : proxies) {
+            covered = covered || (glm::distance(move.start, proxy.center) <= proxy.radius + 1e-4f &&
+                                  glm::distance(move.end, proxy.center) <= proxy.radius + 1e-4f);
+        }
+        CHECK(covered);
+    }
+}
+
+// Refining for the same view again changes nothing; moving away collapses subtrees and coming back gives the
+// same cut as before
+static void testRefineFollowsCamera() {
+    AdaptiveDerivation adaptive = compiled();
+    CHECK(adaptive.refine(viewFrom(4.0f), kProjection, 800.0f, 4.0f));
+    ModuleBuffer near;
+    adaptive.emit(near);
+    CHECK(!adaptive.refine(viewFrom(4.0f), kProjection, 800.0f, 4.0f));
+
+    CHECK(adaptive.refine(viewFrom(300.0f), kProjection, 800.0f, 4.0f));
+    ModuleBuffer far;
+    adaptive.emit(far);
+    CHECK(far.size() < near.size());
+
+    adaptive.refine(viewFrom(4.0f), kProjection, 800.0f, 4.0f);
+    ModuleBuffer back;
+    adaptive.emit(back);
+    CHECK(back.symbols == near.symbols);
+    CHECK(back.parameters == near.parameters);
+}
+
+// Grammars whose subtrees depend on more than their symbol cannot be expanded lazily
+static void testRejectedGrammars() {
+    AdaptiveDerivation adaptive;
+    ProductionRules stochastic = {{'X', {{"FX", 1.0}, {"X", 1.0}}}};
+    CHECK(!adaptive.compile("X", stochastic, 4, kAngle, kLength, kRoot));
+    CHECK(adaptive.empty());
+
+    ProductionRules contextual = {{'X', {{"FX", 1.0, "F", ""}}}};
+    CHECK(!adaptive.compile("FX", contextual, 4, kAngle, kLength, kRoot));
+
+    CHECK(!adaptive.compile("X", deterministicRules({{'X', "F[X"}}), 4, kAngle, kLength, kRoot));
+    CHECK(adaptive.empty());
+}
+
+int main() {
+    testZeroThresholdIsFullDerivation();
+    testProxiesStandInForSubtrees();
+    testRefineFollowsCamera();
+    testRejectedGrammars();
+    return checkResult();
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cmath>
+#include <iostream>
+
+// Just enough of a test framework for the unit tests: a failed check prints where and what, the test goes on,
+// and the test's main returns checkResult() so CTest sees the failure
+
+inline int& checkFailures() {
+    static int failures = 0;
+    return failures;
+}
+
+#define CHECK(condition)                                                                    \
+    do {                                                                                    \
+        if (!(condition)) {                                                                 \
+            std::cerr << __FILE__ << ":" << __LINE__ << ": CHECK(" #condition ") failed\n"; \
+            ++checkFailures();                                                              \
+        }                                                                                   \
+    } while (false)
+
+#define CHECK_NEAR(actual, expected, tolerance)                                                           \
+    do {                                                                                                  \
+        double checkActual = (actual);                                                                    \
+        double checkExpected = (expected);                                                                \
+        if (!(std::abs(checkActual - checkExpected) <= (tolerance))) {                                    \
+            std::cerr << __FILE__ << ":" << __LINE__ << ": CHECK_NEAR(" #actual ", " #expected ") failed: " \
+                      << checkActual << " vs " << checkExpected << "\n";                                  \
+            ++checkFailures();                                                                            \
+        }                                                                                                 \
+    } while (false)
+
+inline int checkResult() {
+    if (checkFailures() > 0) {
+        std::cerr << checkFailures() << " check(s) failed\n";
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,225 @@
+#include "check.h"
+#include "lsystem/ruleprogram.h"
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Reference context walks, one symbol at a time. Walking left, a complete side branch is skipped and an
+// opening bracket leads back to the parent; walking right, side branches are skipped and the branch's
+// closing bracket ends the context. Ignored symbols are skipped both ways
+static bool leftMatches(const std::string& s, size_t position, const std::string& context, const std::string& ignore) {
+    long k = static_cast<long>(position) - 1;
+    for (long c = static_cast<long>(context.size()) - 1; c >= 0; --c) {
+        while (k >= 0) {
+            if (s[k] == ']') {
+                int depth = 1;
+                for (--k; k >= 0 && depth > 0; --k) {
+                    depth += s[k] == ']' ? 1 : s[k] == '[' ? -1 : 0;
+                }
+            } else if (s[k] == '[' || ignore.find(s[k]) != std::string::npos) {
+                --k;
+            } else {
+                break;
+            }
+        }
+        if (k < 0 || s[k] != context[c]) {
+            return false;
+        }
+        --k;
+    }
+    return true;
+}
+
+static bool rightMatches(const std::string& s, size_t position, const std::string& context, const std::string& ignore) {
+    size_t k = position + 1;
+    for (char c : context) {
+        while (k < s.size()) {
+            if (s[k] == '[') {
+                int depth = 1;
+                for (++k; k < s.size() && depth > 0; ++k) {
+                    depth += s[k] == '[' ? 1 : s[k] == ']' ? -1 : 0;
+                }
+            } else if (ignore.find(s[k]) != std::string::npos) {
+                ++k;
+            } else {
+                break;
+            }
+        }
+        if (k >= s.size() || s[k] != c) {
+            return false;
+        }
+        ++k;
+    }
+    return true;
+}
+
+// Reference derivation: a production whose context matches wins over one without, and symbols with neither
+// are kept. The grammars below have at most one candidate per symbol, so there is nothing to draw
+static std::string rewrite(const std::string& axiom, const ProductionRules& rules, const std::string& ignore,
+                           int iterations, std::vector<int>& births) {
+    std::string symbols = axiom;
+    births.assign(symbols.size(), 0);
+    for (int iteration = 1; iteration <= iterations; ++iteration) {
+        std::string next;
+        std::vector<int> nextBirths;
+        for (size_t i = 0; i < symbols.size(); ++i) {
+            const Production* chosen = nullptr;
+            auto rule = rules.find(symbols[i]);
+            if (rule != rules.end()) {
+                for (const Production& production : rule->second) {
+                    if (production.contextual() && leftMatches(symbols, i, production.left, ignore) &&
+                        rightMatches(symbols, i, production.right, ignore)) {
+                        chosen = &production;
+                    }
+                }
+                for (const Production& production : rule->second) {
+                    if (!chosen && !production.contextual()) {
+                        chosen = &production;
+                    }
+                }
+            }
+            if (chosen) {
+                next += chosen->successor;
+                nextBirths.insert(nextBirths.end(), chosen->successor.size(), std::min(iteration, 15));
+            } else {
+                next += symbols[i];
+                nextBirths.push_back(births[i]);
+            }
+        }
+        symbols = std::move(next);
+        births = std::move(nextBirths);
+    }
+    return symbols;
+}
+
+static void checkMatchesReference(const std::string& axiom, const ProductionRules& rules, const std::string& ignore,
+                                  int iterations) {
+    RuleProgram program(axiom, rules, ignore);
+    CHECK(program.contextSensitive());
+    for (int n = 0; n <= iterations; ++n) {
+        std::vector<int> expectedBirths;
+        std::string expected = rewrite(axiom, rules, ignore, n, expectedBirths);
+
+        std::string symbols;
+        PackedSymbols births;
+        program.derive(n, 0, symbols, births);
+        CHECK(symbols == expected);
+        CHECK(births.size() == expected.size());
+        for (size_t i = 0; i < births.size() && i < expectedBirths.size(); ++i) {
+            CHECK(births.at(i) == expectedBirths[i]);
+        }
+        CHECK(program.derivedSize(n) >= symbols.size());
+    }
+}
+
+// A signal sent up the main axis from its base: b < a -> b, b -> a. It skips the side branches on the way
+// and the turns the turtle makes, entering every branch from the module it grows from
+static void testAcropetalSignal() {
+    ProductionRules rules;
+    rules['a'] = {{"b", 1.0, "b", ""}};
+    rules['b'] = {{"a", 1.0}};
+    RuleProgram program("baa[+a]a", rules);
+
+    std::string symbols;
+    PackedSymbols births;
+    program.derive(1, 0, symbols, births);
+    CHECK(symbols == "aba[+a]a");
+    program.derive(2, 0, symbols, births);
+    CHECK(symbols == "aab[+a]a");
+    program.derive(3, 0, symbols, births);
+    CHECK(symbols == "aaa[+b]b");
+}
+
+// Contexts of several symbols, on both sides, with a production that grows branches
+static const ProductionRules& mixedRules() {
+    static const ProductionRules rules = [] {
+        ProductionRules result;
+        result['a'] = {{"b", 1.0, "b", ""}, {"a", 1.0}};
+        result['b'] = {{"c", 1.0, "", "a"}, {"a", 1.0}};
+        result['c'] = {{"c[-a]", 1.0, "ab", ""}};
+        result['d'] = {{"a", 1.0, "a", "cb"}};
+        return result;
+    }();
+    return rules;
+}
+
+// Random balanced strings over the grammar's symbols, turns and brackets, from a fixed seed
+static std::string randomAxiom(uint32_t& state, size_t length) {
+    std::string axiom;
+    int depth = 0;
+    while (axiom.size() < length) {
+        state = state * 1664525u + 1013904223u;
+        uint32_t pick = (state >> 16) % 9;
+        if (pick == 7 && depth < 3) {
+            axiom += '[';
+            ++depth;
+        } else if (pick == 8 && depth > 0) {
+            axiom += ']';
+            --depth;
+        } else if (pick < 7) {
+            axiom += "abcd+-&"[pick];
+        }
+    }
+    axiom.append(depth, ']');
+    return axiom;
+}
+
+static void testRandomAxiomsMatchReference() {
+    uint32_t state = 17;
+    for (int i = 0; i < 50; ++i) {
+        checkMatchesReference(randomAxiom(state, 40), mixedRules(), kDefaultContextIgnore, 5);
+    }
+}
+
+// The same grammar spelled in the turtle alphabet, so the bracket index comes from the packed scan
+static std::string turtle(const std::string& text) {
+    std::string result = text;
+    for (char& c : result) {
+        auto at = std::string("abcd").find(c);
+        c = at == std::string::npos ? c : "FXL|"[at];
+    }
+    return result;
+}
+
+static void testTurtleGrammarMatchesReference() {
+    ProductionRules rules;
+    for (const auto& [symbol, productions] : mixedRules()) {
+        for (const Production& production : productions) {
+            rules[turtle(std::string(1, symbol))[0]].push_back(
+                {turtle(production.successor), production.weight, turtle(production.left), turtle(production.right)});
+        }
+    }
+    uint32_t state = 29;
+    for (int i = 0; i < 20; ++i) {
+        std::string axiom = turtle(randomAxiom(state, 80));
+        CHECK(RuleProgram(axiom, rules).turtleOnly());
+        checkMatchesReference(axiom, rules, "+-&", 5);
+    }
+}
+
+// With nothing ignored, turns separate modules like any other symbol
+static void testCustomIgnore() {
+    uint32_t state = 5;
+    for (int i = 0; i < 20; ++i) {
+        checkMatchesReference(randomAxiom(state, 40), mixedRules(), "", 5);
+        checkMatchesReference(randomAxiom(state, 40), mixedRules(), "+-&d", 5);
+    }
+
+    ProductionRules rules;
+    rules['a'] = {{"x", 1.0, "b", ""}};
+    std::string symbols;
+    PackedSymbols births;
+    RuleProgram(std::string("b+a"), rules).derive(1, 0, symbols, births);
+    CHECK(symbols == "b+x");
+    RuleProgram(std::string("b+a"), rules, "").derive(1, 0, symbols, births);
+    CHECK(symbols == "b+a");
+}
+
+int main() {
+    testAcropetalSignal();
+    testRandomAxiomsMatchReference();
+    testCustomIgnore();
+    testTurtleGrammarMatchesReference();
+    return checkResult();
+}
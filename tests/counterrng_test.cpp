@@ -0,0 +1,134 @@
+#include "check.h"
+#include "lsystem/counterrng.h"
+#include "lsystem/ruleprogram.h"
+#include <algorithm>
+#include <string>
+#include <vector>
+
+// The generator is a pure function of seed and counter
+static void testDeterministic() {
+    CounterRng a(7), b(7), c(8);
+    int differing = 0;
+    for (uint64_t counter = 0; counter < 1000; ++counter) {
+        CHECK(a.bits(counter) == b.bits(counter));
+        differing += a.bits(counter) != c.bits(counter) ? 1 : 0;
+    }
+    CHECK(differing > 990);
+}
+
+// uniform stays in [0, 1) and fills ten equal bins evenly, whatever the iteration
+static void testUniform() {
+    CounterRng rng(12345);
+    const int samples = 100000;
+    int bins[10] = {};
+    double sum = 0.0;
+    for (int iteration = 1; iteration <= 4; ++iteration) {
+        for (uint64_t position = 0; position < samples / 4; ++position) {
+            float u = rng.uniform(iteration, position);
+            CHECK(u >= 0.0f && u < 1.0f);
+            sum += u;
+            ++bins[std::min(static_cast<int>(u * 10.0f), 9)];
+        }
+    }
+    CHECK_NEAR(sum / samples, 0.5, 0.01);
+    for (int bin : bins) {
+        CHECK_NEAR(bin, samples / 10, samples / 100);
+    }
+}
+
+// The first tree of a forest keeps the forest's seed, the others get distinct ones
+static void testTreeSeeds() {
+    CHECK(CounterRng::treeSeed(42, 0) == 42);
+    std::vector<uint32_t> seeds;
+    for (uint32_t index = 0; index < 64; ++index) {
+        seeds.push_back(CounterRng::treeSeed(42, index));
+        CHECK(CounterRng::treeSeed(42, index) == seeds.back());
+    }
+    std::sort(seeds.begin(), seeds.end());
+    CHECK(std::unique(seeds.begin(), seeds.end()) == seeds.end());
+}
+
+static const ProductionRules kStochasticRules = {
+    {'F', {{"F[+F]F", 0.5}, {"F[-F]", 0.3}, {"FF", 0.2}}},
+};
+
+// Reference stochastic derivation on one thread: the symbol at position i of iteration k walks the
+// cumulative weights of its productions with CounterRng(seed).uniform(k, i)
+static std::string rewrite(const std::string& axiom, int iterations, uint32_t seed, std::vector<int>& births) {
+    CounterRng rng(seed);
+    std::string symbols = axiom;
+    births.assign(symbols.size(), 0);
+    for (int iteration = 1; iteration <= iterations; ++iteration) {
+        std::string next;
+        std::vector<int> nextBirths;
+        for (size_t i = 0; i < symbols.size(); ++i) {
+            auto rule = kStochasticRules.find(symbols[i]);
+            if (rule == kStochasticRules.end()) {
+                next += symbols[i];
+                nextBirths.push_back(births[i]);
+                continue;
+            }
+            const std::vector<Production>& productions = rule->second;
+            double total = 0.0;
+            for (const Production& production : productions) {
+                total += production.weight;
+            }
+            float u = rng.uniform(iteration, i);
+            size_t chosen = 0;
+            double cumulative = productions[0].weight / total;
+            while (chosen + 1 < productions.size() && u >= static_cast<float>(cumulative)) {
+                cumulative += productions[++chosen].weight / total;
+            }
+            next += productions[chosen].successor;
+            nextBirths.insert(nextBirths.end(), productions[chosen].successor.size(), std::min(iteration, 15));
+        }
+        symbols = std::move(next);
+        births = std::move(nextBirths);
+    }
+    return symbols;
+}
+
+// Stochastic derivations have to match the reference up to iterations of more than a thread's share of
+// symbols, so a derivation split across threads picks the same productions as one on a single thread
+static void testStochasticMatchesReference() {
+    RuleProgram program("F", kStochasticRules);
+    CHECK(program.stochastic());
+
+    size_t largest = 0;
+    for (int iterations = 0; largest < (size_t(1) << 17); ++iterations) {
+        std::vector<int> expectedBirths;
+        std::string expected = rewrite("F", iterations, 2024, expectedBirths);
+
+        std::string symbols;
+        PackedSymbols births;
+        program.derive(iterations, 2024, symbols, births);
+        CHECK(symbols == expected);
+        CHECK(births.size() == expected.size());
+        for (size_t i = 0; i < births.size(); ++i) {
+            CHECK(births.at(i) == expectedBirths[i]);
+        }
+        CHECK(program.derivedSize(iterations) >= symbols.size());
+        largest = symbols.size();
+    }
+}
+
+// Same seed, same tree; another seed, another tree
+static void testSeedsDiffer() {
+    RuleProgram program("F", kStochasticRules);
+    std::string first, again, other;
+    PackedSymbols births;
+    program.derive(6, 1, first, births);
+    program.derive(6, 1, again, births);
+    program.derive(6, 2, other, births);
+    CHECK(first == again);
+    CHECK(first != other);
+}
+
+int main() {
+    testDeterministic();
+    testUniform();
+    testTreeSeeds();
+    testStochasticMatchesReference();
+    testSeedsDiffer();
+    return checkResult();
+}
@@ -0,0 +1,59 @@
+#include "check.h"
+#include "lsystem/depthlod.h"
+#include <cmath>
+
+static constexpr float kNear = 10.0f;
+static constexpr int kLevels = 6;
+
+// Distance whose ideal depth is ideal
+static float distanceFor(float ideal) {
+    return kNear * std::exp2(kLevels - ideal);
+}
+
+// The full tree within the near distance, then one iteration fewer per doubling, never below one
+static void testDepthFromDistance() {
+    CHECK(treeDepthAt(0.0f, kNear, kLevels, 1) == kLevels);
+    CHECK(treeDepthAt(kNear, kNear, kLevels, 1) == kLevels);
+    CHECK(treeDepthAt(2.0f * kNear, kNear, kLevels, 1) == kLevels - 1);
+    CHECK(treeDepthAt(8.0f * kNear, kNear, kLevels, kLevels) == kLevels - 3);
+    CHECK(treeDepthAt(1e6f, kNear, kLevels, kLevels) == 1);
+    CHECK(treeDepthAt(distanceFor(3.0f), kNear, kLevels, kLevels) == 3);
+}
+
+// A depth changes only once the ideal depth is more than kDepthHysteresis past halfway to the next
+static void testHysteresis() {
+    float keep = 0.5f + kDepthHysteresis - 0.05f;
+    float change = 0.5f + kDepthHysteresis + 0.05f;
+    CHECK(treeDepthAt(distanceFor(4.0f + keep), kNear, kLevels, 4) == 4);
+    CHECK(treeDepthAt(distanceFor(4.0f + change), kNear, kLevels, 4) == 5);
+    CHECK(treeDepthAt(distanceFor(4.0f - keep), kNear, kLevels, 4) == 4);
+    CHECK(treeDepthAt(distanceFor(4.0f - change), kNear, kLevels, 4) == 3);
+}
+
+// A camera wobbling around a switching distance switches the tree once, not on every step
+static void testNoPopping() {
+    int depth = kLevels;
+    int switches = 0;
+    float switching = distanceFor(kLevels - 0.5f);
+    for (int step = 0; step < 100; ++step) {
+        float distance = switching * (step % 2 == 0 ? 1.1f : 0.9f) + step * 0.01f;
+        int next = treeDepthAt(distance, kNear, kLevels, depth);
+        switches += next != depth ? 1 : 0;
+        depth = next;
+    }
+    CHECK(switches <= 1);
+}
+
+// A degenerate near distance does not divide by zero
+static void testZeroNearDistance() {
+    int depth = treeDepthAt(5.0f, 0.0f, kLevels, kLevels);
+    CHECK(depth >= 1 && depth <= kLevels);
+}
+
+int main() {
+    testDepthFromDistance();
+    testHysteresis();
+    testNoPopping();
+    testZeroNearDistance();
+    return checkResult();
+}
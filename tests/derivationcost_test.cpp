@@ -0,0 +1,116 @@
+#include "check.h"
+#include "lsystem/derivationcost.h"
+#include "lsystem/lsystem.h"
+#include <algorithm>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+static double countOf(const std::string& string, char symbol) {
+    double count = 0.0;
+    for (char c : string) {
+        count += c == symbol ? 1.0 : 0.0;
+    }
+    return count;
+}
+
+// The predicted counts of a deterministic grammar are exactly those of the derived strings
+static void testEstimateMatchesDerivation() {
+    const std::unordered_map<char, std::string> rules = {{'F', "FF"}, {'X', "F[+X]F[-XL]+X"}};
+    LSystem lSystem("X", rules, 5);
+
+    DerivationCostModel model;
+    std::vector<DerivationCost> costs = model.estimate(lSystem, 0);
+    CHECK(costs.size() == 6);
+
+    for (int iterations = 0; iterations <= 5; ++iterations) {
+        lSystem.setIterations(iterations);
+        std::string derived = lSystem.generate();
+        const DerivationCost& cost = costs[iterations];
+        CHECK_NEAR(cost.symbols, derived.size(), 1e-9);
+        CHECK_NEAR(cost.segments, countOf(derived, 'F') + countOf(derived, 'X'), 1e-9);
+        CHECK_NEAR(cost.leaves, countOf(derived, 'L'), 1e-9);
+        if (iterations > 0) {
+            CHECK(cost.milliseconds > costs[iterations - 1].milliseconds);
+        }
+    }
+}
+
+// The triangle budget shrinks the tree, but never below the fewest slices a segment can have
+static void testTriangleBudget() {
+    LSystem lSystem("F", {{'F', "F[+F]F"}}, 4);
+    DerivationCostModel model;
+    std::vector<DerivationCost> unlimited = model.estimate(lSystem, 0);
+    std::vector<DerivationCost> budgeted = model.estimate(lSystem, 1000);
+    std::vector<DerivationCost> starved = model.estimate(lSystem, 1);
+
+    for (size_t i = 0; i < unlimited.size(); ++i) {
+        CHECK(budgeted[i].triangles <= unlimited[i].triangles);
+        CHECK(budgeted[i].triangles <= std::max(1000.0, starved[i].triangles));
+        CHECK(starved[i].triangles > 0.0);
+        CHECK(starved[i].triangles <= budgeted[i].triangles);
+    }
+    CHECK_NEAR(budgeted[0].triangles, unlimited[0].triangles, 1e-9);
+    CHECK(budgeted.back().triangles < unlimited.back().triangles);
+}
+
+static void testAffordableIterations() {
+    std::vector<DerivationCost> costs(5);
+    for (size_t i = 0; i < costs.size(); ++i) {
+        costs[i].milliseconds = static_cast<double>(1 << i);
+    }
+    CHECK(DerivationCostModel::affordableIterations(costs, 0.0) == 4);
+    CHECK(DerivationCostModel::affordableIterations(costs, 4.0) == 2);
+    CHECK(DerivationCostModel::affordableIterations(costs, 5.0) == 2);
+    CHECK(DerivationCostModel::affordableIterations(costs, 0.5) == 0);
+    CHECK(DerivationCostModel::affordableIterations(costs, 100.0) == 4);
+    CHECK(DerivationCostModel::affordableIterations({}, 10.0) == 0);
+}
+
+// Calibration moves the rates towards the measured ones, and ignores generations too small to time
+static void testCalibrate() {
+    LSystem lSystem("F", {{'F', "FF"}}, 12);
+    DerivationCostModel model;
+    DerivationCost predicted = model.estimate(lSystem, 0).back();
+    CHECK_NEAR(predicted.symbols, 4096.0, 1e-9);
+
+    DerivationCost tiny = model.estimate(lSystem, 0).front();
+    model.calibrate(tiny, 1000.0, 1000.0);
+    CHECK_NEAR(model.estimate(lSystem, 0).back().milliseconds, predicted.milliseconds, 1e-9);
+
+    // Ten times the predicted time, repeatedly, converges on it
+    for (int i = 0; i < 30; ++i) {
+        model.calibrate(predicted, 10.0 * predicted.symbols * 2e-5, 10.0 * predicted.segments * 4e-3);
+    }
+    CHECK_NEAR(model.estimate(lSystem, 0).back().milliseconds, 10.0 * predicted.milliseconds, 1e-6 * predicted.milliseconds);
+}
+
+// A stochastic grammar only has expected counts; the packed string has the ones it derived
+static void testCountedFromPackedString() {
+    ProductionRules rules;
+    rules['X'] = {{"F[+X]L", 1.0}, {"F[-X][+X]FX", 1.0}};
+    LSystem lSystem("X", rules, 6);
+    std::string derived = lSystem.generate();
+    CHECK(lSystem.packedString().size() == derived.size());
+
+    DerivationCost counted = DerivationCostModel::counted(lSystem.packedString());
+    CHECK_NEAR(counted.symbols, static_cast<double>(derived.size()), 1e-9);
+    CHECK_NEAR(counted.segments, countOf(derived, 'F') + countOf(derived, 'X'), 1e-9);
+    CHECK_NEAR(counted.leaves, countOf(derived, 'L'), 1e-9);
+
+    // Symbols outside the turtle alphabet leave nothing to count
+    ProductionRules named;
+    named['A'] = {{"F[+A]", 1.0}};
+    LSystem other("A", named, 3);
+    other.generate();
+    CHECK(other.packedString().empty());
+}
+
+int main() {
+    testEstimateMatchesDerivation();
+    testTriangleBudget();
+    testAffordableIterations();
+    testCalibrate();
+    testCountedFromPackedString();
+    return checkResult();
+}
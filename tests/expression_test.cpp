@@ -0,0 +1,104 @@
+#include "check.h"
+#include "lsystem/expression.h"
+#include <string>
+#include <vector>
+
+static const std::vector<std::string> kFormals = {"l", "w"};
+
+// Compile text over l and w and evaluate it with l = 2 and w = 0.5
+static float evaluate(const std::string& text) {
+    std::vector<Instruction> code;
+    std::string error;
+    bool compiled = compileExpression(text, kFormals, code, error);
+    CHECK(compiled);
+    CHECK(error.empty());
+    const float parameters[] = {2.0f, 0.5f};
+    return evaluateExpression(code.data(), code.data() + code.size(), parameters);
+}
+
+static bool rejects(const std::string& text) {
+    std::vector<Instruction> code;
+    std::string error;
+    bool compiled = compileExpression(text, kFormals, code, error);
+    return !compiled && !error.empty();
+}
+
+static void testArithmetic() {
+    CHECK_NEAR(evaluate("1 + 2 * 3"), 7.0, 1e-6);
+    CHECK_NEAR(evaluate("(1 + 2) * 3"), 9.0, 1e-6);
+    CHECK_NEAR(evaluate("10 - 4 - 3"), 3.0, 1e-6);
+    CHECK_NEAR(evaluate("12 / 3 / 2"), 2.0, 1e-6);
+    CHECK_NEAR(evaluate("l * 0.8"), 1.6, 1e-6);
+    CHECK_NEAR(evaluate("l / w + 1.5"), 5.5, 1e-6);
+    CHECK_NEAR(evaluate("-l"), -2.0, 1e-6);
+}
+
+// ^ is right associative and binds tighter than a leading minus
+static void testPower() {
+    CHECK_NEAR(evaluate("2 ^ 3 ^ 2"), 512.0, 1e-3);
+    CHECK_NEAR(evaluate("-2 ^ 2"), -4.0, 1e-6);
+    CHECK_NEAR(evaluate("l ^ 2 * 3"), 12.0, 1e-6);
+}
+
+// Comparisons and logic give 1 or 0
+static void testLogic() {
+    CHECK(evaluate("l > 1") == 1.0f);
+    CHECK(evaluate("l < 1") == 0.0f);
+    CHECK(evaluate("l >= 2 && w <= 0.5") == 1.0f);
+    CHECK(evaluate("l == 2") == 1.0f);
+    CHECK(evaluate("l != 2") == 0.0f);
+    CHECK(evaluate("l < 1 || w < 1") == 1.0f);
+    CHECK(evaluate("!(l > 1)") == 0.0f);
+    CHECK(evaluate("1 + 1 > 1 && 0 || 1") == 1.0f);
+}
+
+// Angles are in degrees
+static void testFunctions() {
+    CHECK_NEAR(evaluate("min(l, w)"), 0.5, 1e-6);
+    CHECK_NEAR(evaluate("max(l, w * 8)"), 4.0, 1e-6);
+    CHECK_NEAR(evaluate("sqrt(l * 8)"), 4.0, 1e-6);
+    CHECK_NEAR(evaluate("sin(30)"), 0.5, 1e-6);
+    CHECK_NEAR(evaluate("cos(60) * l"), 1.0, 1e-6);
+}
+
+// Several expressions compile into one program and each runs on its own range
+static void testAppendedCode() {
+    std::vector<Instruction> code;
+    std::string error;
+    CHECK(compileExpression("l + 1", kFormals, code, error));
+    size_t split = code.size();
+    CHECK(compileExpression("w * 4", kFormals, code, error));
+    const float parameters[] = {2.0f, 0.5f};
+    CHECK_NEAR(evaluateExpression(code.data(), code.data() + split, parameters), 3.0, 1e-6);
+    CHECK_NEAR(evaluateExpression(code.data() + split, code.data() + code.size(), parameters), 2.0, 1e-6);
+}
+
+static void testErrors() {
+    CHECK(rejects(""));
+    CHECK(rejects("x + 1"));
+    CHECK(rejects("(l + 1"));
+    CHECK(rejects("l + 1)"));
+    CHECK(rejects("l +"));
+    CHECK(rejects("1.2.3"));
+    CHECK(rejects("tan(l)"));
+    CHECK(rejects("min(l)"));
+    CHECK(rejects("sqrt(l, w)"));
+    CHECK(rejects("l $ w"));
+
+    // Nesting deeper than the evaluation stack holds is rejected rather than overflowing it
+    std::string deep = "l";
+    for (int i = 0; i < kMaxExpressionStack; ++i) {
+        deep = "1 + (" + deep + ")";
+    }
+    CHECK(rejects(deep));
+}
+
+int main() {
+    testArithmetic();
+    testPower();
+    testLogic();
+    testFunctions();
+    testAppendedCode();
+    testErrors();
+    return checkResult();
+}
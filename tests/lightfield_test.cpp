@@ -0,0 +1,109 @@
+#include "check.h"
+#include "lsystem/lightfield.h"
+#include <cmath>
+#include <glm/gtc/matrix_transform.hpp>
+#include <vector>
+
+// Light straight down from y = 20, so columns are vertical and depth grows downwards
+static const glm::mat4 kLightView = glm::lookAt(glm::vec3(0.0f, 20.0f, 0.0f), glm::vec3(0.0f), glm::vec3(0.0f, 0.0f, -1.0f));
+static constexpr float kExtent = 20.0f;
+static constexpr float kVoxelSize = 0.5f;
+static constexpr float kExtinction = 1.1f;
+
+static LightField makeField() {
+    return LightField(kLightView, kExtent, 1.0f, 50.0f, kVoxelSize, kExtinction);
+}
+
+// Branches scattered from a fixed seed
+static std::vector<TreeSegment> randomBranches(uint32_t& state, int count) {
+    auto next = [&state] {
+        state = state * 1664525u + 1013904223u;
+        return static_cast<float>(state >> 8) / 16777216.0f * 6.0f - 3.0f;
+    };
+    std::vector<TreeSegment> segments;
+    for (int i = 0; i < count; ++i) {
+        glm::vec3 start(next(), next() + 3.0f, next());
+        segments.push_back({SegmentKind::Branch, start, start + glm::vec3(0.3f, 0.2f, 0.0f), 0.05f, 1});
+    }
+    return segments;
+}
+
+// A leaf card inside one voxel shades everything below it in its column by its area, and nothing above it
+// or beside it
+static void testSingleLeaf() {
+    LightField field = makeField();
+    CHECK(field.exposure(glm::vec3(0.2f, 3.0f, 0.1f)) == 1.0f);
+
+    TreeSegment leaf = {SegmentKind::Leaf, glm::vec3(0.1f, 5.0f, 0.1f), glm::vec3(0.3f, 5.0f, 0.1f), 0.05f, 1};
+    field.update({{leaf}});
+    CHECK(field.updatedColumns() == 1);
+
+    float area = 0.2f * 0.2f;
+    CHECK_NEAR(field.exposure(glm::vec3(0.2f, 3.0f, 0.1f)), std::exp(-kExtinction * area / (kVoxelSize * kVoxelSize)), 1e-5);
+    CHECK(field.exposure(glm::vec3(0.2f, 7.0f, 0.1f)) == 1.0f);
+    CHECK(field.exposure(glm::vec3(2.2f, 3.0f, 0.1f)) == 1.0f);
+
+    // Outside the light's volume nothing is known, so everything is lit
+    CHECK(field.exposure(glm::vec3(30.0f, 3.0f, 0.0f)) == 1.0f);
+    CHECK(field.exposure(glm::vec3(0.2f, 25.0f, 0.1f)) == 1.0f);
+
+    // Removing the source brings the light back
+    field.update({{}});
+    CHECK_NEAR(field.exposure(glm::vec3(0.2f, 3.0f, 0.1f)), 1.0, 1e-6);
+}
+
+// Growing sources a step at a time and updating each step ends where building from scratch does
+static void testIncrementalMatchesFresh() {
+    uint32_t state = 3;
+    LightField incremental = makeField();
+    std::vector<std::vector<TreeSegment>> sources(10);
+    for (int step = 0; step < 6; ++step) {
+        for (std::vector<TreeSegment>& source : sources) {
+            std::vector<TreeSegment> grown = randomBranches(state, 50);
+            source.insert(source.end(), grown.begin(), grown.end());
+        }
+        incremental.update(sources);
+        CHECK(incremental.updatedColumns() > 0);
+    }
+
+    LightField fresh = makeField();
+    fresh.update(sources);
+
+    bool shaded = false;
+    for (float x = -3.0f; x <= 3.0f; x += 0.25f) {
+        for (float z = -3.0f; z <= 3.0f; z += 0.25f) {
+            for (float y = -1.0f; y <= 7.0f; y += 0.5f) {
+                glm::vec3 position(x, y, z);
+                CHECK_NEAR(incremental.exposure(position), fresh.exposure(position), 1e-4);
+                shaded = shaded || fresh.exposure(position) < 0.5f;
+            }
+        }
+    }
+    CHECK(shaded);
+}
+
+// Updating with the same sources changes no voxel, so no column is re-summed
+static void testUnchangedSourcesSkipped() {
+    uint32_t state = 9;
+    std::vector<std::vector<TreeSegment>> sources = {randomBranches(state, 100), randomBranches(state, 100)};
+    LightField field = makeField();
+    field.update(sources);
+    size_t columns = field.updatedColumns();
+    CHECK(columns > 0);
+
+    field.update(sources);
+    CHECK(field.updatedColumns() == 0);
+
+    // Replacing one source only touches the columns either version covers
+    sources[1] = randomBranches(state, 10);
+    field.update(sources);
+    CHECK(field.updatedColumns() > 0);
+    CHECK(field.updatedColumns() < columns);
+}
+
+int main() {
+    testSingleLeaf();
+    testIncrementalMatchesFresh();
+    testUnchangedSourcesSkipped();
+    return checkResult();
+}
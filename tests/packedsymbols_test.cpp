@@ -0,0 +1,142 @@
+#include "check.h"
+#include "lsystem/modulebuffer.h"
+#include "lsystem/packedsymbols.h"
+#include "lsystem/parametriclsystem.h"
+#include <algorithm>
+#include <array>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// ModuleBuffer keeps one birth per byte; packing them must keep every module's own birth
+static void testPackedModuleBirths() {
+    ParametricLSystem system;
+    std::string error;
+    CHECK(system.compile("A(1)", {{"A(x)", "", "F(x)[+A(x+1)]A(x+1)"}}, error));
+
+    ModuleBuffer modules;
+    system.derive(5, modules);
+    PackedSymbols births = PackedSymbols::fromUnpacked(modules.births.data(), modules.size());
+    CHECK(births.size() == modules.size());
+
+    bool distinctNeighbours = false;
+    for (size_t i = 0; i < modules.size(); ++i) {
+        CHECK(births.at(i) == modules.births[i]);
+        distinctNeighbours = distinctNeighbours || (i > 0 && modules.births[i] != modules.births[i - 1]);
+    }
+    CHECK(distinctNeighbours);
+}
+
+static void testFromUnpacked() {
+    const std::vector<uint8_t> values = {0, 1, 15, 7, 200, 3, 9};
+    PackedSymbols packed = PackedSymbols::fromUnpacked(values.data(), values.size());
+    CHECK(packed.size() == values.size());
+    CHECK(packed.bytes().size() == 4);
+    for (size_t i = 0; i < values.size(); ++i) {
+        CHECK(packed.at(i) == std::min<uint8_t>(values[i], 15));
+    }
+
+    // The unused high nibble of an odd-sized buffer stays zero
+    CHECK((packed.bytes().back() >> 4) == 0);
+    CHECK(PackedSymbols::fromUnpacked(nullptr, 0).empty());
+}
+
+// Long enough for the vector unpack, with an odd tail for the scalar one
+static void testUnpackRoundTrip() {
+    std::string text;
+    for (int i = 0; i < 1001; ++i) {
+        text.push_back(PackedSymbols::kAlphabet[(i * 7 + i / 13) % PackedSymbols::kAlphabetSize]);
+    }
+    CHECK(PackedSymbols::encodable(text));
+    PackedSymbols packed = PackedSymbols::encode(text);
+    CHECK(packed.size() == text.size());
+    CHECK(packed.unpack() == text);
+    for (size_t i = 0; i < text.size(); ++i) {
+        CHECK(packed.at(i) == PackedSymbols::code(text[i]));
+    }
+    CHECK(!PackedSymbols::encodable("FA"));
+}
+
+// Rewriting a byte at a time must agree with rewriting one symbol at a time
+static void testPackedRulesRewrite() {
+    std::unordered_map<char, std::string> rules = {{'F', "FF"}, {'X', "F[+X][-X]FX"}};
+    CHECK(PackedRules::encodable("X", rules));
+    PackedRules packedRules(rules);
+
+    std::string text = "X";
+    PackedSymbols symbols = PackedSymbols::encode(text);
+    PackedSymbols births = PackedSymbols::fromUnpacked(std::vector<uint8_t>(1, 0).data(), 1);
+    for (int iteration = 1; iteration <= 4; ++iteration) {
+        std::string next;
+        std::vector<uint8_t> nextBirths;
+        for (size_t i = 0; i < text.size(); ++i) {
+            auto rule = rules.find(text[i]);
+            std::string replacement = rule == rules.end() ? std::string(1, text[i]) : rule->second;
+            next += replacement;
+            nextBirths.insert(nextBirths.end(), replacement.size(),
+                              rule == rules.end() ? births.at(i) : static_cast<uint8_t>(iteration));
+        }
+
+        PackedSymbols output;
+        PackedSymbols outputBirths;
+        packedRules.rewrite(symbols, births, iteration, output, outputBirths);
+        CHECK(output.unpack() == next);
+        CHECK(outputBirths.size() == nextBirths.size());
+        for (size_t i = 0; i < nextBirths.size() && i < outputBirths.size(); ++i) {
+            CHECK(outputBirths.at(i) == nextBirths[i]);
+        }
+        text = next;
+        symbols = output;
+        births = outputBirths;
+    }
+}
+
+// Past one flush of the vector counters, with an odd tail
+static void testHistogram() {
+    std::string text;
+    for (int i = 0; i < 10001; ++i) {
+        text.push_back(PackedSymbols::kAlphabet[(i * 5 + i / 17) % PackedSymbols::kAlphabetSize]);
+    }
+    std::array<size_t, 16> counts = PackedSymbols::encode(text).histogram();
+    for (int c = 0; c < 16; ++c) {
+        size_t expected = c < PackedSymbols::kAlphabetSize ? std::count(text.begin(), text.end(), PackedSymbols::kAlphabet[c]) : 0;
+        CHECK(counts[c] == expected);
+    }
+    CHECK(PackedSymbols().histogram()[0] == 0);
+}
+
+// Random brackets, some of them unmatched, against a plain stack
+static void testMatchBrackets() {
+    uint32_t state = 3;
+    for (int round = 0; round < 20; ++round) {
+        std::string text;
+        for (int i = 0; i < 301; ++i) {
+            state = state * 1664525u + 1013904223u;
+            uint32_t pick = (state >> 16) % 8;
+            text.push_back(pick < 2 ? '[' : pick < 4 ? ']' : "FX+L"[pick - 4]);
+        }
+
+        std::vector<int32_t> expected(text.size(), -1);
+        std::vector<int32_t> open;
+        for (size_t i = 0; i < text.size(); ++i) {
+            if (text[i] == '[') {
+                open.push_back(static_cast<int32_t>(i));
+            } else if (text[i] == ']' && !open.empty()) {
+                expected[i] = open.back();
+                expected[open.back()] = static_cast<int32_t>(i);
+                open.pop_back();
+            }
+        }
+        CHECK(PackedSymbols::encode(text).matchBrackets() == expected);
+    }
+}
+
+int main() {
+    testPackedModuleBirths();
+    testFromUnpacked();
+    testUnpackRoundTrip();
+    testPackedRulesRewrite();
+    testHistogram();
+    testMatchBrackets();
+    return checkResult();
+}
@@ -0,0 +1,135 @@
+#include "check.h"
+#include "lsystem/parametriclsystem.h"
+#include <string>
+#include <vector>
+
+// Symbols and parameters of every module, written out like a successor, e.g. "F(2)[A(1,0.5)]"
+static std::string text(const ModuleBuffer& modules) {
+    std::string result;
+    for (size_t i = 0; i < modules.size(); ++i) {
+        result += modules.symbols[i];
+        for (int p = 0; p < modules.parameterCount(i); ++p) {
+            std::string value = std::to_string(modules.parametersOf(i)[p]);
+            value.erase(value.find_last_not_of('0') + 1);
+            if (value.back() == '.') {
+                value.pop_back();
+            }
+            result += (p == 0 ? "(" : ",") + value;
+        }
+        result += modules.parameterCount(i) > 0 ? ")" : "";
+    }
+    return result;
+}
+
+// A branch halving its length until it is short, then ending in a leaf
+static const std::vector<ParametricRule> kRules = {
+    {"A(l)", "l > 1", "F(l)[+(30)A(l/2)]A(l/2)"},
+    {"A(l)", "", "L"},
+};
+
+static void testDerivation() {
+    ParametricLSystem system;
+    std::string error;
+    CHECK(system.compile("A(4)", kRules, error));
+    CHECK(error.empty());
+    CHECK(text(system.axiom()) == "A(4)");
+
+    ModuleBuffer modules;
+    system.derive(0, modules);
+    CHECK(text(modules) == "A(4)");
+    system.derive(1, modules);
+    CHECK(text(modules) == "F(4)[+(30)A(2)]A(2)");
+    system.derive(2, modules);
+    CHECK(text(modules) == "F(4)[+(30)F(2)[+(30)A(1)]A(1)]F(2)[+(30)A(1)]A(1)");
+    system.derive(3, modules);
+    CHECK(text(modules) == "F(4)[+(30)F(2)[+(30)L]L]F(2)[+(30)L]L");
+
+    // Kept modules keep their births, rewritten ones get the iteration that wrote them
+    CHECK(modules.births[0] == 1);
+    CHECK(modules.births[3] == 2);
+    CHECK(modules.births[6] == 3);
+
+    // Nothing matches any more, so further iterations change nothing
+    ModuleBuffer later;
+    system.derive(5, later);
+    CHECK(later.symbols == modules.symbols);
+    CHECK(later.parameters == modules.parameters);
+}
+
+// The first rule in the order written whose parameter count and condition match wins
+static void testRuleOrder() {
+    ParametricLSystem system;
+    std::string error;
+    CHECK(system.compile("A(1)A(5)A(1,2)B", {
+                             {"A(x)", "x > 2", "P"},
+                             {"A(x)", "x > 0", "Q"},
+                             {"A(x,y)", "", "R(x+y)"},
+                             {"A(x)", "", "S"},
+                         },
+                         error));
+    ModuleBuffer modules;
+    system.derive(1, modules);
+    CHECK(text(modules) == "QPR(3)B");
+}
+
+// Deriving in one call, with its iterations split across threads, equals rewriting one iteration at a time
+// on a buffer large enough to be split
+static void testDeriveMatchesRewrite() {
+    ParametricLSystem system;
+    std::string error;
+    CHECK(system.compile("A(1,0)", {{"A(x,y)", "", "A(x*0.5,y+1)B(x)A(x+y,y*2)"}, {"B(x)", "x < 100", "B(x+1)"}},
+                         error));
+
+    ModuleBuffer derived;
+    system.derive(14, derived);
+    CHECK(derived.size() > (size_t(1) << 14));
+
+    ModuleBuffer rewritten = system.axiom();
+    for (int iteration = 1; iteration <= 14; ++iteration) {
+        system.rewrite(iteration, rewritten);
+    }
+    CHECK(derived.symbols == rewritten.symbols);
+    CHECK(derived.births == rewritten.births);
+    CHECK(derived.firstParameter == rewritten.firstParameter);
+    CHECK(derived.parameters == rewritten.parameters);
+}
+
+static void testSkeleton() {
+    ParametricLSystem system;
+    std::string error;
+    CHECK(system.compile("A(4)", kRules, error));
+    CHECK(system.skeletonAxiom() == "A");
+    CHECK(system.skeletonRules().at('A') == "F[+A]A");
+}
+
+// A malformed grammar is reported and leaves the system empty
+static void testErrors() {
+    ParametricLSystem system;
+    std::string error;
+    CHECK(!system.compile("A(l)", {}, error));
+    CHECK(!error.empty());
+    CHECK(system.axiom().empty());
+
+    const std::vector<std::vector<ParametricRule>> malformed = {
+        {{"A(l,l)", "", "A(l)"}},
+        {{"AB(l)", "", "A(l)"}},
+        {{"A(2)", "", "A"}},
+        {{"A(l)", "l >", "A(l)"}},
+        {{"A(l)", "", "A(l"}},
+        {{"A(l)", "", "A(w)"}},
+    };
+    for (const std::vector<ParametricRule>& rules : malformed) {
+        error.clear();
+        CHECK(!system.compile("A(1)", rules, error));
+        CHECK(!error.empty());
+    }
+}
+
+int main() {
+    testDerivation();
+    testRuleOrder();
+    testDeriveMatchesRewrite();
+    testSkeleton();
+    testErrors();
+    return checkResult();
+}
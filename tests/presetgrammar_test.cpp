@@ -0,0 +1,56 @@
+#include "check.h"
+#include "lsystem/lsystem.h"
+#include "lsystem/presetgrammar.h"
+#include <string>
+
+// A preset derived by the compiler has to equal what LSystem derives at run time from the same rules,
+// symbols and births alike
+template <const auto& Grammar>
+static void checkPresetMatchesRuntime(bool leaves) {
+    for (int iterations = 0; iterations <= kMaxPresetIterations; ++iterations) {
+        LSystem lSystem(std::string(Grammar.axiom), Grammar.runtimeRules(), iterations);
+        std::string derived = lSystem.generate();
+
+        PresetView preset = presetDerivation(leaves, iterations);
+        CHECK(!preset.empty());
+        CHECK(preset.symbols == derived);
+        CHECK(Grammar.derivedSize(iterations) == derived.size());
+
+        PackedSymbols births = PackedSymbols::fromBytes(preset.births, derived.size());
+        CHECK(births.unpack() == lSystem.birthIterations().unpack());
+    }
+}
+
+static void testPresetsMatchRuntime() {
+    checkPresetMatchesRuntime<kTreeGrammar>(false);
+    checkPresetMatchesRuntime<kLeafyTreeGrammar>(true);
+}
+
+static void testPastPrecomputedIterations() {
+    CHECK(presetDerivation(false, kMaxPresetIterations + 1).empty());
+    CHECK(presetDerivation(true, kMaxPresetIterations + 2).empty());
+}
+
+// The constexpr helpers on a grammar small enough to check by hand
+static void testConstexprDerivation() {
+    static constexpr PresetGrammar<2> grammar = {"A", {{{'A', "AB"}, {'B', "A"}}}};
+    static_assert(grammar.derivedSize(0) == 1);
+    static_assert(grammar.derivedSize(4) == 8);
+    static_assert(grammar.find('C') == nullptr);
+
+    constexpr auto derivation = grammar.derive<grammar.derivedSize(4)>(4);
+    CHECK(std::string(derivation.symbols.data(), derivation.symbols.size()) == "ABAABABA");
+
+    // Both symbols are rewritten every iteration, so every symbol was born by the last rewrite
+    PackedSymbols births = PackedSymbols::fromBytes(derivation.births.data(), derivation.symbols.size());
+    for (size_t i = 0; i < births.size(); ++i) {
+        CHECK(births.at(i) == 4);
+    }
+}
+
+int main() {
+    testPresetsMatchRuntime();
+    testPastPrecomputedIterations();
+    testConstexprDerivation();
+    return checkResult();
+}
@@ -0,0 +1,105 @@
+#include "check.h"
+#include "lsystem/lsystem.h"
+#include "lsystem/ruleprogram.h"
+#include <algorithm>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// A branching grammar mixing turtle symbols with ones the turtle ignores (B, L), so the expansion tables
+// cover symbols without rules and bodies of several lengths
+static const std::unordered_map<char, std::string> kRules = {
+    {'A', "[&+FLA]||[&-FLA][^<FLA]"}, {'F', "FB"}, {'B', "F"}};
+static const std::string kAxiom = "FA";
+
+// Reference derivation by plain string rewriting, one whole iteration at a time
+static std::string rewrite(const std::string& axiom, int iterations, std::vector<int>& births) {
+    std::string symbols = axiom;
+    births.assign(symbols.size(), 0);
+    for (int iteration = 1; iteration <= iterations; ++iteration) {
+        std::string next;
+        std::vector<int> nextBirths;
+        for (size_t i = 0; i < symbols.size(); ++i) {
+            auto rule = kRules.find(symbols[i]);
+            if (rule == kRules.end()) {
+                next += symbols[i];
+                nextBirths.push_back(births[i]);
+            } else {
+                next += rule->second;
+                nextBirths.insert(nextBirths.end(), rule->second.size(), std::min(iteration, 15));
+            }
+        }
+        symbols = std::move(next);
+        births = std::move(nextBirths);
+    }
+    return symbols;
+}
+
+// The depth-first expansion has to give the symbols and births of rewriting iteration by iteration
+static void testDepthFirstMatchesRewriting() {
+    RuleProgram program(kAxiom, deterministicRules(kRules));
+    CHECK(!program.stochastic());
+    CHECK(!program.contextSensitive());
+
+    for (int iterations = 0; iterations <= 7; ++iterations) {
+        std::vector<int> expectedBirths;
+        std::string expected = rewrite(kAxiom, iterations, expectedBirths);
+
+        std::string symbols;
+        PackedSymbols births;
+        program.derive(iterations, 0, symbols, births);
+        CHECK(symbols == expected);
+        CHECK(program.derivedSize(iterations) == expected.size());
+        CHECK(births.size() == expected.size());
+        for (size_t i = 0; i < births.size(); ++i) {
+            CHECK(births.at(i) == expectedBirths[i]);
+        }
+    }
+}
+
+// LSystem derives through the program, and changing its iterations has to derive again
+static void testLSystemMatchesRewriting() {
+    LSystem lSystem(kAxiom, kRules, 5);
+    std::vector<int> births;
+    CHECK(lSystem.generate() == rewrite(kAxiom, 5, births));
+
+    lSystem.setIterations(2);
+    CHECK(lSystem.generate() == rewrite(kAxiom, 2, births));
+}
+
+// Deterministic grammars ignore the seed
+static void testSeedIgnored() {
+    RuleProgram program(kAxiom, deterministicRules(kRules));
+    std::string first, second;
+    PackedSymbols firstBirths, secondBirths;
+    program.derive(4, 1, first, firstBirths);
+    program.derive(4, 99, second, secondBirths);
+    CHECK(first == second);
+    CHECK(firstBirths.unpack() == secondBirths.unpack());
+}
+
+// Past kMaxIterations births cannot tell iterations apart, so derivations stop there. A grammar that keeps
+// its length shows it without deriving a huge string
+static void testIterationsClamped() {
+    RuleProgram program("AB", deterministicRules({{'A', "B"}, {'B', "A"}}));
+    const int past = RuleProgram::kMaxIterations + 5;
+    CHECK(program.derivedSize(past) == program.derivedSize(RuleProgram::kMaxIterations));
+
+    std::string clamped, last;
+    PackedSymbols clampedBirths, lastBirths;
+    program.derive(past, 0, clamped, clampedBirths);
+    program.derive(RuleProgram::kMaxIterations, 0, last, lastBirths);
+    CHECK(clamped == last);
+    // 15 swaps of A and B end on the swapped axiom
+    CHECK(clamped == "BA");
+    CHECK(clampedBirths.at(0) == RuleProgram::kMaxIterations);
+    CHECK(clampedBirths.at(1) == RuleProgram::kMaxIterations);
+}
+
+int main() {
+    testDepthFirstMatchesRewriting();
+    testLSystemMatchesRewriting();
+    testSeedIgnored();
+    testIterationsClamped();
+    return checkResult();
+}
@@ -0,0 +1,123 @@
+#include "check.h"
+#include "lsystem/spacecolonization.h"
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+// A small crown, so the tests grow quickly
+static ColonizationParameters smallTree() {
+    ColonizationParameters parameters;
+    parameters.attractors = 3000;
+    parameters.leaves = true;
+    return parameters;
+}
+
+static bool same(const TreeSegment& a, const TreeSegment& b) {
+    return a.kind == b.kind && a.start == b.start && a.end == b.end && a.thickness == b.thickness && a.depth == b.depth &&
+           a.side == b.side && a.origin == b.origin && a.phase == b.phase && a.parentPhase == b.parentPhase &&
+           a.parentReach == b.parentReach && a.birth == b.birth && a.grown == b.grown;
+}
+
+// Attractors only depend on the seed, so growing twice gives the same tree and another seed another tree
+static void testDeterministic() {
+    ColonizationParameters parameters = smallTree();
+    SpaceColonization first(parameters), second(parameters);
+    std::vector<TreeSegment> a = first.grow();
+    std::vector<TreeSegment> b = second.grow();
+    CHECK(!a.empty());
+    CHECK(a.size() == b.size());
+    for (size_t i = 0; i < a.size() && i < b.size(); ++i) {
+        CHECK(same(a[i], b[i]));
+    }
+    CHECK(first.iterations() == second.iterations());
+
+    parameters.seed = 2;
+    std::vector<TreeSegment> other = SpaceColonization(parameters).grow();
+    bool differs = other.size() != a.size();
+    for (size_t i = 0; i < a.size() && !differs; ++i) {
+        differs = !same(a[i], other[i]);
+    }
+    CHECK(differs);
+}
+
+// Every branch segment is one step long and starts at the root or where an earlier one ends, and children
+// grow after their parent
+static void testConnected() {
+    ColonizationParameters parameters = smallTree();
+    SpaceColonization colonization(parameters);
+    std::vector<TreeSegment> segments = colonization.grow();
+    CHECK(colonization.iterations() > 0 && colonization.iterations() <= parameters.maxIterations);
+    CHECK(segments.front().start == parameters.root);
+    CHECK(segments.front().kind == SegmentKind::Trunk);
+
+    float highest = parameters.root.y;
+    for (size_t i = 0; i < segments.size(); ++i) {
+        const TreeSegment& segment = segments[i];
+        CHECK(segment.birth >= 0.0f && segment.birth < segment.grown && segment.grown <= 1.0f);
+        if (segment.kind == SegmentKind::Leaf) {
+            continue;
+        }
+        CHECK_NEAR(glm::distance(segment.start, segment.end), parameters.segmentLength, 1e-5);
+        highest = std::max(highest, segment.end.y);
+        if (segment.start == parameters.root) {
+            continue;
+        }
+        bool parentFound = false;
+        for (size_t j = 0; j < i && !parentFound; ++j) {
+            parentFound = segments[j].kind != SegmentKind::Leaf && segments[j].end == segment.start &&
+                          segments[j].grown <= segment.birth;
+        }
+        CHECK(parentFound);
+    }
+
+    // The trunk reached the crown and branched through it
+    CHECK(highest > parameters.crownCenter.y);
+}
+
+// Pipe model: a node's diameter^exponent is the sum over its children's, tips have the tip thickness and
+// every tip ends in a leaf
+static void testPipeModel() {
+    ColonizationParameters parameters = smallTree();
+    std::vector<TreeSegment> segments = SpaceColonization(parameters).grow();
+
+    size_t leaves = 0;
+    size_t tips = 0;
+    for (const TreeSegment& segment : segments) {
+        if (segment.kind == SegmentKind::Leaf) {
+            ++leaves;
+            continue;
+        }
+        double children = 0.0;
+        for (const TreeSegment& child : segments) {
+            if (child.kind != SegmentKind::Leaf && child.start == segment.end) {
+                children += std::pow(child.thickness, parameters.pipeExponent);
+            }
+        }
+        if (children == 0.0) {
+            ++tips;
+            CHECK_NEAR(segment.thickness, parameters.tipThickness, 1e-6);
+        } else {
+            double own = std::pow(segment.thickness, parameters.pipeExponent);
+            CHECK_NEAR(own / children, 1.0, 1e-3);
+        }
+    }
+    CHECK(tips > 1);
+    CHECK(leaves == tips);
+}
+
+// Without attractors nothing pulls, so nothing grows
+static void testNoAttractors() {
+    ColonizationParameters parameters = smallTree();
+    parameters.attractors = 0;
+    SpaceColonization colonization(parameters);
+    CHECK(colonization.grow().empty());
+    CHECK(colonization.iterations() == 0);
+}
+
+int main() {
+    testDeterministic();
+    testConnected();
+    testPipeModel();
+    testNoAttractors();
+    return checkResult();
+}
@@ -0,0 +1,165 @@
+#include "check.h"
+#include "lsystem/tubemesher.h"
+#include <cmath>
+#include <glm/glm.hpp>
+#include <vector>
+
+static TreeSegment trunk(const glm::vec3& start, const glm::vec3& end, float thickness, int heightSegments) {
+    TreeSegment segment{SegmentKind::Trunk, start, end, thickness, 0};
+    segment.heightSegments = heightSegments;
+    return segment;
+}
+
+// Segments continue a chain at their own depth when they start where it ends and are of the same kind;
+// a side branch opens its own chain, leaves never join one, and the parent's chain goes on after the branch
+static void testChains() {
+    std::vector<TreeSegment> segments = {
+        trunk(glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f), 0.4f, 1),
+        {SegmentKind::Branch, glm::vec3(0.0f, 1.0f, 0.0f), glm::vec3(1.0f, 2.0f, 0.0f), 0.1f, 1},
+        {SegmentKind::Leaf, glm::vec3(1.0f, 2.0f, 0.0f), glm::vec3(1.2f, 2.0f, 0.0f), 0.05f, 1},
+        trunk(glm::vec3(0.0f, 1.0f, 0.0f), glm::vec3(0.0f, 2.0f, 0.0f), 0.3f, 1),
+        {SegmentKind::Branch, glm::vec3(0.0f, 2.0f, 0.0f), glm::vec3(0.0f, 3.0f, 0.0f), 0.2f, 0},
+        trunk(glm::vec3(5.0f, 0.0f, 0.0f), glm::vec3(5.0f, 1.0f, 0.0f), 0.3f, 1),
+    };
+    TubeMesher mesher(segments);
+    const std::vector<std::vector<int>>& chains = mesher.chains();
+    CHECK(chains.size() == 4);
+    CHECK(chains[0] == std::vector<int>({0, 3}));
+    CHECK(chains[1] == std::vector<int>({1}));
+    CHECK(chains[2] == std::vector<int>({4}));
+    CHECK(chains[3] == std::vector<int>({5}));
+    CHECK(mesher.kind(0) == SegmentKind::Trunk);
+    CHECK(mesher.kind(1) == SegmentKind::Branch);
+}
+
+// mesh() emits triangleCount() triangles in the unit box, and modelMatrix puts every ring vertex at its radius
+// from the axis, so consecutive segments meet on one ring instead of overlapping
+static void testMeshOnTube() {
+    std::vector<TreeSegment> segments = {
+        trunk(glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f), 0.4f, 2),
+        trunk(glm::vec3(0.0f, 1.0f, 0.0f), glm::vec3(0.0f, 2.0f, 0.0f), 0.4f, 3),
+    };
+    segments[0].radialSegments = 6;
+    segments[1].radialSegments = 4;
+    TubeMesher mesher(segments);
+    CHECK(mesher.chains().size() == 1);
+
+    std::vector<float> vertices;
+    glm::mat4 modelMatrix;
+    mesher.mesh(0, vertices, modelMatrix);
+    CHECK(vertices.size() == static_cast<size_t>(mesher.triangleCount(0)) * 3 * 8);
+    // Welded rings take the finest slice count: five rings of bodies plus the tip fan
+    CHECK(mesher.triangleCount(0) == 2 * 5 * 6 + 6);
+
+    int onSurface = 0;
+    for (size_t v = 0; v < vertices.size(); v += 8) {
+        glm::vec3 local(vertices[v], vertices[v + 1], vertices[v + 2]);
+        CHECK(glm::all(glm::lessThanEqual(glm::abs(local), glm::vec3(0.5f + 1e-5f))));
+        glm::vec3 world = glm::vec3(modelMatrix * glm::vec4(local, 1.0f));
+        float fromAxis = glm::length(glm::vec2(world.x, world.z));
+        CHECK(world.y >= -1e-5f && world.y <= 2.0f + 1e-5f);
+        if (std::abs(fromAxis - 0.2f) < 1e-4f) {
+            ++onSurface;
+        } else {
+            // Only the tip fan's center lies inside the tube
+            CHECK(fromAxis < 1e-4f && std::abs(world.y - 2.0f) < 1e-4f);
+        }
+    }
+    CHECK(onSurface > 0);
+}
+
+// A bent chain gets one joint per segment start plus its tip, with the frames mesh() sweeps there
+static void testJointsOfBentChain() {
+    std::vector<TreeSegment> segments = {
+        trunk(glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f), 0.4f, 1),
+        trunk(glm::vec3(0.0f, 1.0f, 0.0f), glm::vec3(0.5f, 2.0f, 0.0f), 0.3f, 3),
+        trunk(glm::vec3(0.5f, 2.0f, 0.0f), glm::vec3(0.5f, 3.0f, 0.8f), 0.2f, 2),
+    };
+    TubeMesher mesher(segments);
+    CHECK(mesher.chains().size() == 1);
+
+    std::vector<TubeMesher::Joint> joints = mesher.joints(0);
+    CHECK(joints.size() == segments.size() + 1);
+    for (size_t s = 0; s < segments.size(); ++s) {
+        CHECK_NEAR(glm::distance(joints[s].center, segments[s].start), 0.0, 1e-6);
+        CHECK_NEAR(joints[s].radius, 0.5 * segments[s].thickness, 1e-6);
+    }
+    CHECK_NEAR(glm::distance(joints.back().center, segments.back().end), 0.0, 1e-6);
+    CHECK_NEAR(joints.back().radius, joints[segments.size() - 1].radius, 1e-6);
+
+    // Inner joints bisect the directions of both segments, the tip follows the last one
+    glm::vec3 first = glm::normalize(segments[0].end - segments[0].start);
+    glm::vec3 second = glm::normalize(segments[1].end - segments[1].start);
+    glm::vec3 last = glm::normalize(segments[2].end - segments[2].start);
+    CHECK_NEAR(glm::distance(joints[1].tangent, glm::normalize(first + second)), 0.0, 1e-5);
+    CHECK_NEAR(glm::distance(joints.back().tangent, last), 0.0, 1e-5);
+
+    // Frames stay orthonormal and the transported normal never flips around the tube
+    for (size_t j = 0; j < joints.size(); ++j) {
+        CHECK_NEAR(glm::length(joints[j].tangent), 1.0, 1e-5);
+        CHECK_NEAR(glm::length(joints[j].normal), 1.0, 1e-5);
+        CHECK_NEAR(glm::dot(joints[j].tangent, joints[j].normal), 0.0, 1e-5);
+        if (j > 0) {
+            CHECK(glm::dot(joints[j - 1].normal, joints[j].normal) > 0.5f);
+        }
+    }
+}
+
+// Along a straight chain transport is the identity, so every joint keeps the first normal
+static void testStraightChainDoesNotTwist() {
+    std::vector<TreeSegment> segments;
+    for (int s = 0; s < 6; ++s) {
+        segments.push_back(trunk(glm::vec3(0.0f, s, 0.0f), glm::vec3(0.0f, s + 1, 0.0f), 0.2f, 1 + s % 3));
+    }
+    TubeMesher mesher(segments);
+    CHECK(mesher.chains().size() == 1);
+
+    std::vector<TubeMesher::Joint> joints = mesher.joints(0);
+    CHECK(joints.size() == 7);
+    for (const TubeMesher::Joint& joint : joints) {
+        CHECK_NEAR(glm::distance(joint.normal, joints.front().normal), 0.0, 1e-5);
+        CHECK_NEAR(glm::distance(joint.tangent, glm::vec3(0.0f, 1.0f, 0.0f)), 0.0, 1e-5);
+    }
+}
+
+// Coarser levels drop slices and rings down to 3 and 1 per segment, and share the finest level's box
+static void testMeshLevels() {
+    std::vector<TreeSegment> segments = {
+        trunk(glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f), 0.4f, 4),
+        trunk(glm::vec3(0.0f, 1.0f, 0.0f), glm::vec3(0.5f, 2.0f, 0.0f), 0.3f, 2),
+    };
+    segments[0].radialSegments = 12;
+    segments[1].radialSegments = 8;
+    TubeMesher mesher(segments);
+
+    std::vector<float> finest;
+    glm::mat4 finestMatrix;
+    mesher.mesh(0, finest, finestMatrix);
+
+    std::vector<std::vector<float>> levels;
+    glm::mat4 modelMatrix;
+    mesher.meshLevels(0, {1.0f, 0.5f, 0.1f}, levels, modelMatrix);
+    CHECK(levels.size() == 3);
+    CHECK(levels[0] == finest);
+    CHECK(modelMatrix == finestMatrix);
+
+    // 12 slices and 6 rings, then 6 and 3, then the minimum 3 and 2
+    CHECK(levels[0].size() == static_cast<size_t>(2 * 6 * 12 + 12) * 3 * 8);
+    CHECK(levels[1].size() == static_cast<size_t>(2 * 3 * 6 + 6) * 3 * 8);
+    CHECK(levels[2].size() == static_cast<size_t>(2 * 2 * 3 + 3) * 3 * 8);
+    for (const std::vector<float>& level : levels) {
+        for (size_t v = 0; v < level.size(); v += 8) {
+            glm::vec3 local(level[v], level[v + 1], level[v + 2]);
+            CHECK(glm::all(glm::lessThanEqual(glm::abs(local), glm::vec3(0.5f + 1e-5f))));
+        }
+    }
+}
+
+int main() {
+    testChains();
+    testMeshOnTube();
+    testJointsOfBentChain();
+    testStraightChainDoesNotTwist();
+    testMeshLevels();
+    return checkResult();
+}